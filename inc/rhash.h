@@ -3,6 +3,9 @@
 #define RHASH_H
 
 #include <stdio.h>
+#ifndef _WIN32
+# include <sys/uio.h> /* struct iovec */
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -72,15 +75,33 @@ typedef struct rhash_context
 /** type of a pointer passed to all hashing functions */
 typedef struct rhash_context* rhash;
 
+/** a message fragment for rhash_updatev() */
+#ifdef _WIN32
+typedef struct rhash_iovec
+{
+	void* iov_base; /* start of the fragment */
+	size_t iov_len; /* the fragment length in bytes */
+} rhash_iovec;
+#else
+typedef struct iovec rhash_iovec;
+#endif
+
+/** the length argument for hashing a file till its end */
+#define RHASH_TILL_EOF ((unsigned long long)-1)
+
 /** type of a callback to be called periodically while hashing a file */
 typedef void (*rhash_callback_t)(void* data, unsigned long long offset);
 
-RHASH_API void rhash_library_init(void); /* initialize static data */
+RHASH_API void rhash_library_init(void); /* initialize static data, thread-safe */
 
 /* hi-level hashing functions */
 RHASH_API int rhash_msg(unsigned hash_id, const void* message, size_t length, unsigned char* result);
+RHASH_API int rhash_msg_batch(unsigned hash_id, const void* msgs[], const size_t lens[], size_t count, unsigned char* out);
+RHASH_API unsigned rhash_crc32_combine(unsigned crc_a, unsigned crc_b, unsigned long long len_b);
 RHASH_API int rhash_file(unsigned hash_id, const char* filepath, unsigned char* result);
 RHASH_API int rhash_file_update(rhash ctx, FILE* fd);
+RHASH_API int rhash_fd_update(rhash ctx, int fd, unsigned long long offset, unsigned long long length);
+RHASH_API int rhash_mmap_update(rhash ctx, int fd, unsigned long long offset, unsigned long long length);
 
 #ifdef _WIN32 /* windows only function */
 RHASH_API int rhash_wfile(unsigned hash_id, const wchar_t* filepath, unsigned char* result);
@@ -88,8 +109,11 @@ RHASH_API int rhash_wfile(unsigned hash_id, const wchar_t* filepath, unsigned ch
 
 /* lo-level interface */
 RHASH_API rhash rhash_init(unsigned hash_id);
+RHASH_API rhash rhash_init_in(void* buffer, size_t size, unsigned hash_id);
+RHASH_API size_t rhash_get_context_size(unsigned hash_id);
 /*RHASH_API rhash rhash_init_by_ids(unsigned hash_ids[], unsigned count);*/
 RHASH_API int  rhash_update(rhash ctx, const void* message, size_t length);
+RHASH_API int  rhash_updatev(rhash ctx, const rhash_iovec* iov, int iovcnt);
 RHASH_API int  rhash_final(rhash ctx, unsigned char* first_result);
 RHASH_API void rhash_reset(rhash ctx); /* reinitialize the context */
 RHASH_API void rhash_free(rhash ctx);
@@ -199,8 +223,15 @@ RHASH_API rhash_uptr_t rhash_transmit(
 #define RMSG_IS_CANCELED 3
 #define RMSG_GET_FINALIZED 4
 #define RMSG_SET_AUTOFINAL 5
+#define RMSG_SET_ASYNC_READ 6
+#define RMSG_SET_FILE_BLOCK_SIZE 7
+#define RMSG_SET_THREADS 8
 #define RMSG_SET_OPENSSL_MASK 10
 #define RMSG_GET_OPENSSL_MASK 11
+#define RMSG_GET_CPU_FEATURES 12
+#define RMSG_SET_CPU_FEATURES 13
+#define RMSG_GET_IMPLEMENTATION 14
+#define RMSG_SET_IMPLEMENTATION 15
 
 #define RMSG_BT_ADD_FILE 32
 #define RMSG_BT_SET_OPTIONS 33
@@ -232,10 +263,35 @@ RHASH_API rhash_uptr_t rhash_transmit(
  */
 #define rhash_set_autofinal(ctx, on) rhash_transmit(RMSG_SET_AUTOFINAL, ctx, on, 0)
 
+/**
+ * Turn on/off asynchronous reading of regular files by rhash_file_update().
+ * When it is on, a separate thread reads the file by big blocks,
+ * while the calling thread calculates hash sums of the previous block.
+ */
+#define rhash_set_async_read(ctx, on) rhash_transmit(RMSG_SET_ASYNC_READ, ctx, on, 0)
+
+/**
+ * Set the size of a block read by the asynchronous file reader.
+ * Zero means to choose it automatically: 1 MiB rounded up to
+ * a multiple of the file system block size.
+ */
+#define rhash_set_file_block_size(ctx, size) rhash_transmit(RMSG_SET_FILE_BLOCK_SIZE, ctx, size, 0)
+
+/**
+ * Set the number of threads, calculating hash sums of the given context.
+ * Every thread updates its own subset of the context hash sums by big
+ * messages. Also, a regular file hashed by rhash_fd_update() or
+ * rhash_file_update() is split into chunks for CRC32, TTH, ED2K, AICH and BTIH,
+ * which are hashed by different threads. Zero or one means to calculate
+ * all hash sums in the calling thread.
+ */
+#define rhash_set_threads(ctx, count) rhash_transmit(RMSG_SET_THREADS, ctx, count, 0)
+
 /**
  * Set the bit-mask of hash algorithms to be calculated by OpenSSL library.
  * The call rhash_set_openssl_mask(0) made before rhash_library_init(),
- * turns off loading of the OpenSSL dynamic library.
+ * turns off loading of the OpenSSL dynamic library. Otherwise the dynamic
+ * library is loaded, when a context first needs one of the algorithms.
  * This call works if the LibRHash was compiled with OpenSSL support.
  */
 #define rhash_set_openssl_mask(mask) rhash_transmit(RMSG_SET_OPENSSL_MASK, NULL, mask, 0);
@@ -246,6 +302,62 @@ RHASH_API rhash_uptr_t rhash_transmit(
  */
 #define rhash_get_openssl_mask() rhash_transmit(RMSG_GET_OPENSSL_MASK, NULL, 0, 0);
 
+/* CPU instruction sets, detected at run-time */
+#define RHASH_CPU_SSE2   0x01
+#define RHASH_CPU_SSSE3  0x02
+#define RHASH_CPU_SSE41  0x04
+#define RHASH_CPU_AVX    0x08
+#define RHASH_CPU_AVX2   0x10
+#define RHASH_CPU_AVX512 0x20
+#define RHASH_CPU_SHA    0x40
+#define RHASH_CPU_BMI2   0x80
+#define RHASH_CPU_PCLMUL 0x100
+#define RHASH_CPU_AVX512VBMI 0x200 /* AVX-512 BW and VBMI */
+#define RHASH_CPU_GFNI   0x400
+
+/**
+ * Return the bit-mask of RHASH_CPU_* instruction sets, supported by
+ * the CPU and the operating system, which the library is allowed to use.
+ */
+#define rhash_get_cpu_features() rhash_transmit(RMSG_GET_CPU_FEATURES, NULL, 0, 0)
+
+/**
+ * Restrict the instruction sets used by the library to the given bit-mask
+ * of RHASH_CPU_* flags, and reselect the fastest allowed implementation
+ * of every hash algorithm. Affects only contexts created after the call.
+ * Returns RHASH_ERROR if the implementations can't be reselected, see
+ * rhash_set_implementation().
+ */
+#define rhash_set_cpu_features(mask) rhash_transmit(RMSG_SET_CPU_FEATURES, NULL, mask, 0)
+
+/**
+ * Return the name of the implementation selected for the given hash
+ * algorithm, like "generic", "pclmul" or "openssl", or NULL for invalid hash_id.
+ */
+#define rhash_get_implementation(hash_id) ((const char*)RHASH_UPTR2PVOID( \
+	rhash_transmit(RMSG_GET_IMPLEMENTATION, NULL, hash_id, 0)))
+
+/**
+ * Return the name of the implementation, which the given context uses
+ * for a hash algorithm. A context keeps the implementations selected
+ * when it was created.
+ */
+#define rhash_get_context_implementation(ctx, hash_id) ((const char*)RHASH_UPTR2PVOID( \
+	rhash_transmit(RMSG_GET_IMPLEMENTATION, ctx, hash_id, 0)))
+
+/**
+ * Force the implementation of a hash algorithm by its name, or select
+ * the fastest one, if the name is NULL. Returns RHASH_ERROR if there is
+ * no such implementation, or it is not supported by the CPU.
+ * The name "openssl" selects the OpenSSL implementation, if it is loaded.
+ * Affects only contexts created after the call. Every call makes a new
+ * set of implementations, and the library keeps at most 8 sets; the old
+ * sets are reused, when their contexts are freed. While all of them are
+ * used by contexts, the call fails and returns RHASH_ERROR.
+ */
+#define rhash_set_implementation(hash_id, name) \
+	rhash_transmit(RMSG_SET_IMPLEMENTATION, NULL, hash_id, RHASH_STR2UPTR(name))
+
 /** The bit mask of hash algorithms implemented by OpenSSL */
 #ifdef USE_OPENSSL
 #define RHASH_OPENSSL_SUPPORTED_HASHES (RHASH_MD4 | RHASH_MD5 | \
@@ -0,0 +1,221 @@
+/** @file rhash.hpp C++17 interface with compile-time sets of hash algorithms
+ *
+ * The set of algorithms is a template parameter of librhash::hasher, so the
+ * contexts of the algorithms are kept in a std::tuple inside the object and
+ * every update is a direct call of the C kernel of each algorithm, which
+ * the compiler can inline. A hasher needs no heap memory, it can be placed
+ * on the stack, copied and moved.
+ *
+ *   librhash::hasher<librhash::sha256, librhash::crc32> h;
+ *   h.update(buffer, size);
+ *   auto [sha256, crc32] = h.final();
+ *
+ * The header uses the context structures and the kernels of librhash, so
+ * the librhash directory must be on the include path and the program must
+ * be linked with the static library, built with the same macros.
+ * The generic kernels are used. The run-time selected implementations
+ * (see rhash_set_implementation) and the algorithms allocating memory,
+ * BTIH and AICH, are available through the C interface of rhash.h.
+ * The namespace is librhash, since rhash is the context type of rhash.h.
+ */
+#ifndef RHASH_HPP
+#define RHASH_HPP
+
+#if !defined(__cplusplus) || (__cplusplus < 201703L && (!defined(_MSVC_LANG) || _MSVC_LANG < 201703L))
+# error "rhash.hpp requires C++17"
+#endif
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <tuple>
+
+#include "rhash.h"
+#include "algorithms.h"
+#include "byte_order.h"
+#include "crc32.h"
+#include "ed2k.h"
+#include "edonr.h"
+#include "gost.h"
+#include "has160.h"
+#include "md4.h"
+#include "md5.h"
+#include "ripemd-160.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "sha512.h"
+#include "snefru.h"
+#include "tiger.h"
+#include "tth.h"
+#include "whirlpool.h"
+
+namespace librhash {
+
+/* An algorithm of a hasher is a type with the members:
+ *   context_type - the trivially copyable context of the algorithm,
+ *   hash_id - the RHASH_* id of the algorithm,
+ *   digest_size - the size of the digest in bytes,
+ *   init(ctx), update(ctx, msg, size), final(ctx, result) - the methods. */
+#define RHASH_CXX_ALGORITHM(name, id, size, ctx_type, init_f, update_f, final_f) \
+	struct name \
+	{ \
+		typedef ctx_type context_type; \
+		static constexpr unsigned hash_id = id; \
+		static constexpr std::size_t digest_size = size; \
+		static void init(context_type& ctx) noexcept { init_f(&ctx); } \
+		static void update(context_type& ctx, const unsigned char* msg, std::size_t length) noexcept { \
+			update_f(&ctx, msg, length); \
+		} \
+		static void final(context_type& ctx, unsigned char* result) noexcept { final_f(&ctx, result); } \
+	};
+
+/** CRC32 checksum, the context is the current checksum value */
+struct crc32
+{
+	typedef unsigned context_type;
+	static constexpr unsigned hash_id = RHASH_CRC32;
+	static constexpr std::size_t digest_size = 4;
+	static void init(context_type& ctx) noexcept { ctx = 0; }
+	static void update(context_type& ctx, const unsigned char* msg, std::size_t length) noexcept {
+		ctx = rhash_get_crc32(ctx, msg, length);
+	}
+	static void final(context_type& ctx, unsigned char* result) noexcept {
+		result[0] = (unsigned char)(ctx >> 24), result[1] = (unsigned char)(ctx >> 16);
+		result[2] = (unsigned char)(ctx >> 8), result[3] = (unsigned char)ctx;
+	}
+};
+
+RHASH_CXX_ALGORITHM(md4, RHASH_MD4, 16, md4_ctx, rhash_md4_init, rhash_md4_update, rhash_md4_final)
+RHASH_CXX_ALGORITHM(md5, RHASH_MD5, 16, md5_ctx, rhash_md5_init, rhash_md5_update, rhash_md5_final)
+RHASH_CXX_ALGORITHM(sha1, RHASH_SHA1, 20, sha1_ctx, rhash_sha1_init, rhash_sha1_update, rhash_sha1_final)
+RHASH_CXX_ALGORITHM(tiger, RHASH_TIGER, 24, tiger_ctx, rhash_tiger_init, rhash_tiger_update, rhash_tiger_final)
+RHASH_CXX_ALGORITHM(tth, RHASH_TTH, 24, tth_ctx, rhash_tth_init, rhash_tth_update, rhash_tth_final)
+RHASH_CXX_ALGORITHM(ed2k, RHASH_ED2K, 16, ed2k_ctx, rhash_ed2k_init, rhash_ed2k_update, rhash_ed2k_final)
+RHASH_CXX_ALGORITHM(whirlpool, RHASH_WHIRLPOOL, 64, whirlpool_ctx, rhash_whirlpool_init, rhash_whirlpool_update, rhash_whirlpool_final)
+RHASH_CXX_ALGORITHM(ripemd160, RHASH_RIPEMD160, 20, ripemd160_ctx, rhash_ripemd160_init, rhash_ripemd160_update, rhash_ripemd160_final)
+RHASH_CXX_ALGORITHM(gost, RHASH_GOST, 32, gost_ctx, rhash_gost_init, rhash_gost_update, rhash_gost_final)
+RHASH_CXX_ALGORITHM(gost_cryptopro, RHASH_GOST_CRYPTOPRO, 32, gost_ctx, rhash_gost_cryptopro_init, rhash_gost_update, rhash_gost_final)
+RHASH_CXX_ALGORITHM(has160, RHASH_HAS160, 20, has160_ctx, rhash_has160_init, rhash_has160_update, rhash_has160_final)
+RHASH_CXX_ALGORITHM(snefru128, RHASH_SNEFRU128, 16, snefru_ctx, rhash_snefru128_init, rhash_snefru_update, rhash_snefru_final)
+RHASH_CXX_ALGORITHM(snefru256, RHASH_SNEFRU256, 32, snefru_ctx, rhash_snefru256_init, rhash_snefru_update, rhash_snefru_final)
+RHASH_CXX_ALGORITHM(sha224, RHASH_SHA224, 28, sha256_ctx, rhash_sha224_init, rhash_sha256_update, rhash_sha256_final)
+RHASH_CXX_ALGORITHM(sha256, RHASH_SHA256, 32, sha256_ctx, rhash_sha256_init, rhash_sha256_update, rhash_sha256_final)
+RHASH_CXX_ALGORITHM(sha384, RHASH_SHA384, 48, sha512_ctx, rhash_sha384_init, rhash_sha512_update, rhash_sha512_final)
+RHASH_CXX_ALGORITHM(sha512, RHASH_SHA512, 64, sha512_ctx, rhash_sha512_init, rhash_sha512_update, rhash_sha512_final)
+RHASH_CXX_ALGORITHM(edonr256, RHASH_EDONR256, 32, edonr_ctx, rhash_edonr256_init, rhash_edonr256_update, rhash_edonr256_final)
+RHASH_CXX_ALGORITHM(edonr512, RHASH_EDONR512, 64, edonr_ctx, rhash_edonr512_init, rhash_edonr512_update, rhash_edonr512_final)
+
+#undef RHASH_CXX_ALGORITHM
+
+/** the binary digest of an algorithm */
+template<class Algorithm>
+using digest = std::array<unsigned char, Algorithm::digest_size>;
+
+/**
+ * Calculates the digests of a fixed set of hash algorithms.
+ * After final() the hasher must be reset() to hash a new message.
+ */
+template<class... Algorithms>
+class hasher
+{
+	static_assert(sizeof...(Algorithms) > 0, "a hasher needs at least one algorithm");
+
+public:
+	/** the union of the ids of the algorithms */
+	static constexpr unsigned hash_ids = (Algorithms::hash_id | ...);
+	static_assert((Algorithms::hash_id + ...) == hash_ids, "duplicate algorithms in a hasher");
+
+	/** the digests, in the order of the algorithms */
+	typedef std::tuple<digest<Algorithms>...> result_type;
+
+	hasher() noexcept
+	{
+#if defined(GENERATE_CRC32_TABLE) || defined(GENERATE_GOST_LOOKUP_TABLE)
+		rhash_init_algorithms(hash_ids);
+#endif
+		reset();
+	}
+
+	/**
+	 * Start hashing a new message.
+	 */
+	void reset() noexcept
+	{
+		std::apply([](typename Algorithms::context_type&... ctx) { (Algorithms::init(ctx), ...); }, contexts);
+	}
+
+	/**
+	 * Hash the next chunk of the message by all algorithms.
+	 *
+	 * @param msg the message chunk
+	 * @param size the length of the message chunk
+	 * @return reference to this hasher
+	 */
+	hasher& update(const void* msg, std::size_t size) noexcept
+	{
+		const unsigned char* data = static_cast<const unsigned char*>(msg);
+		std::apply([data, size](typename Algorithms::context_type&... ctx) {
+			(Algorithms::update(ctx, data, size), ...);
+		}, contexts);
+		return *this;
+	}
+
+	/**
+	 * Hash the next chunk of the message by all algorithms.
+	 *
+	 * @param msg the message chunk
+	 * @return reference to this hasher
+	 */
+	hasher& update(std::string_view msg) noexcept
+	{
+		return update(msg.data(), msg.size());
+	}
+
+	/**
+	 * Finish hashing and return the digests of the message.
+	 *
+	 * @return the digests, in the order of the algorithms
+	 */
+	result_type final() noexcept
+	{
+		result_type result;
+		std::apply([&result](typename Algorithms::context_type&... ctx) {
+			std::apply([&ctx...](digest<Algorithms>&... out) {
+				(Algorithms::final(ctx, out.data()), ...);
+			}, result);
+		}, contexts);
+		return result;
+	}
+
+	/**
+	 * Calculate the digests of a message.
+	 *
+	 * @param msg the message to hash
+	 * @param size the length of the message
+	 * @return the digests, in the order of the algorithms
+	 */
+	static result_type hash(const void* msg, std::size_t size) noexcept
+	{
+		hasher h;
+		h.update(msg, size);
+		return h.final();
+	}
+
+	/**
+	 * Calculate the digests of a message.
+	 *
+	 * @param msg the message to hash
+	 * @return the digests, in the order of the algorithms
+	 */
+	static result_type hash(std::string_view msg) noexcept
+	{
+		return hash(msg.data(), msg.size());
+	}
+
+private:
+	std::tuple<typename Algorithms::context_type...> contexts;
+};
+
+} /* namespace librhash */
+
+#endif /* RHASH_HPP */
@@ -36,6 +36,9 @@ RHASH_API double rhash_timer_stop(timedelta_t* timer);
 RHASH_API void rhash_run_benchmark(unsigned hash_id, unsigned flags,
 				   FILE* output);
 
+/* select the fastest implementations of hash algorithms on this CPU */
+RHASH_API int rhash_autotune(unsigned hash_ids, const char* cache_path);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
@@ -32,12 +32,15 @@
 #include <assert.h>
 #include "byte_order.h"
 #include "algorithms.h"
+#include "batch.h"
 #include "aich.h"
 
 #define ED2K_CHUNK_SIZE  9728000
 #define FULL_BLOCK_SIZE  184320
 #define LAST_BLOCK_SIZE  143360
 #define BLOCKS_PER_CHUNK 53
+/* maximal number of blocks to hash at once by multi-buffer SHA1 */
+#define AICH_BATCH_BLOCKS 8
 
 /*
  * The Algorithm could be a little faster if it knows a
@@ -52,15 +55,10 @@
  * and its size is already known.
  */
 
-#ifdef USE_OPENSSL
+/* call the SHA1 methods, selected when the context was initialized */
 #define SHA1_INIT(ctx) ((pinit_t)ctx->sha_init)(&ctx->sha1_context)
 #define SHA1_UPDATE(ctx, msg, size) ((pupdate_t)ctx->sha_update)(&ctx->sha1_context, (msg), (size))
 #define SHA1_FINAL(ctx, result) ((pfinal_t)ctx->sha_final)(&ctx->sha1_context, (result))
-#else
-#define SHA1_INIT(ctx) rhash_sha1_init(&ctx->sha1_context)
-#define SHA1_UPDATE(ctx, msg, size) rhash_sha1_update(&ctx->sha1_context, (msg), (size))
-#define SHA1_FINAL(ctx, result) rhash_sha1_final(&ctx->sha1_context, (result))
-#endif
 
 /**
  * Initialize algorithm context before calculaing hash.
@@ -69,18 +67,17 @@
  */
 void rhash_aich_init(aich_ctx *ctx)
 {
+	/* get the methods of the SHA1 implementation used by new contexts */
+	const rhash_backend *backend = rhash_acquire_backend(0);
+	const rhash_hash_info *sha1_info = &backend->table[3];
 	memset(ctx, 0, sizeof(aich_ctx));
 
-#ifdef USE_OPENSSL
-	{
-		rhash_hash_info *sha1_info = &rhash_info_table[3];
-		assert(sha1_info->info->hash_id == RHASH_SHA1);
-		assert(sha1_info->context_size <= (sizeof(sha1_ctx) + sizeof(unsigned long)));
-		ctx->sha_init = sha1_info->init;
-		ctx->sha_update = sha1_info->update;
-		ctx->sha_final = sha1_info->final;
-	}
-#endif
+	assert(sha1_info->info->hash_id == RHASH_SHA1);
+	assert(sha1_info->context_size <= (sizeof(sha1_ctx) + sizeof(unsigned long)));
+	ctx->sha_init = (void*)sha1_info->init;
+	ctx->sha_update = (void*)sha1_info->update;
+	ctx->sha_final = (void*)sha1_info->final;
+	rhash_release_backend(backend);
 
 	SHA1_INIT(ctx);
 }
@@ -208,12 +205,12 @@ static void rhash_aich_hash_tree(aich_ctx *ctx, unsigned char* result, int type)
 		}
 
 		/* read a leaf hash */
-		leaf_hash = &(ctx->block_hashes[index][0]);
-
 		if(type == AICH_HASH_FULL_TREE) {
 			is_left_branch = (unsigned)path & 0x1;
 
 			leaf_hash = GET_HASH_PAIR(ctx, index)[is_left_branch];
+		} else {
+			leaf_hash = &(ctx->block_hashes[index][0]);
 		}
 		index++;
 
@@ -244,6 +241,24 @@ static void rhash_aich_hash_tree(aich_ctx *ctx, unsigned char* result, int type)
 #define AICH_PROCESS_FINAL_BLOCK 1
 #define AICH_PROCESS_FLUSH_BLOCK 2
 
+/**
+ * Ensure that the block_hashes array is allocated to save block hashes.
+ *
+ * @param ctx algorithm context
+ * @return non-zero on success, zero on memory allocation error
+ */
+static int rhash_aich_alloc_block_hashes(aich_ctx *ctx)
+{
+	if(ctx->block_hashes == NULL) {
+		ctx->block_hashes = (unsigned char (*)[sha1_hash_size])malloc(BLOCKS_PER_CHUNK * sha1_hash_size);
+		if(ctx->block_hashes == NULL) {
+			ctx->error = 1;
+			return 0;
+		}
+	}
+	return 1;
+}
+
 /**
  * Calculate and store a hash for a 180K/140K block.
  * Also, if it is the last block of a 9.2MiB ed2k chunk or of the hashed message,
@@ -251,24 +266,16 @@ static void rhash_aich_hash_tree(aich_ctx *ctx, unsigned char* result, int type)
  *
  * @param ctx algorithm context
  * @param type the actions to take, can be combination of bits AICH_PROCESS_FINAL_BLOCK
- *             and AICH_PROCESS_FLUSH_BLOCK
+ *             and AICH_PROCESS_FLUSH_BLOCK, 0 to only complete a fully hashed ed2k chunk
  */
 static void rhash_aich_process_block(aich_ctx *ctx, int type)
 {
-	assert(type != 0);
 	assert(ctx->index <= ED2K_CHUNK_SIZE);
 
 	/* if there is unprocessed data left in the current 180K block. */
 	if((type & AICH_PROCESS_FLUSH_BLOCK) != 0)
 	{
-		/* ensure that the block_hashes array is allocated to save the result */
-		if(ctx->block_hashes == NULL) {
-			ctx->block_hashes = (unsigned char (*)[sha1_hash_size])malloc(BLOCKS_PER_CHUNK * sha1_hash_size);
-			if(ctx->block_hashes == NULL) {
-				ctx->error = 1;
-				return;
-			}
-		}
+		if(!rhash_aich_alloc_block_hashes(ctx)) return;
 
 		/* store the 180-KiB block hash to the block_hashes array */
 		assert(((ctx->index - 1) / FULL_BLOCK_SIZE) < BLOCKS_PER_CHUNK);
@@ -307,6 +314,45 @@ static void rhash_aich_process_block(aich_ctx *ctx, int type)
 	}
 }
 
+/**
+ * Hash several whole blocks of the current ed2k chunk at once by the
+ * multi-buffer SHA1 kernels, if it is faster than hashing them one by one.
+ * The context must be at a block boundary.
+ *
+ * @param ctx algorithm context
+ * @param msg the message, starting with the next block
+ * @param size the message size
+ * @return the number of hashed bytes, 0 if no blocks were hashed
+ */
+static size_t rhash_aich_process_blocks(aich_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	const void* msgs[AICH_BATCH_BLOCKS];
+	size_t lens[AICH_BATCH_BLOCKS];
+	size_t min_count = rhash_batch_min_count(RHASH_SHA1);
+	unsigned first = ctx->index / FULL_BLOCK_SIZE;
+	size_t count, hashed = 0;
+
+	assert((ctx->index % FULL_BLOCK_SIZE) == 0);
+	if(min_count == 0) return 0;
+	for(count = 0; count < AICH_BATCH_BLOCKS && first + count < BLOCKS_PER_CHUNK; count++) {
+		size_t block_size = (first + count + 1 < BLOCKS_PER_CHUNK ? FULL_BLOCK_SIZE : LAST_BLOCK_SIZE);
+		if(size - hashed < block_size) break;
+		msgs[count] = msg + hashed;
+		lens[count] = block_size;
+		hashed += block_size;
+	}
+	if(count < min_count || !rhash_aich_alloc_block_hashes(ctx)) return 0;
+
+	rhash_msg_batch(RHASH_SHA1, msgs, lens, count, ctx->block_hashes[first]);
+	ctx->index += (unsigned)hashed;
+	if(ctx->index >= ED2K_CHUNK_SIZE) {
+		/* calculate the tree hash of the completed ed2k chunk */
+		rhash_aich_process_block(ctx, 0);
+		SHA1_INIT(ctx); /* the tree hashing has used the SHA1 context */
+	}
+	return hashed;
+}
+
 /**
  * Calculate message hash.
  * Can be called repeatedly with chunks of the message to be hashed.
@@ -320,8 +366,16 @@ void rhash_aich_update(aich_ctx *ctx, const unsigned char* msg, size_t size)
 	if(ctx->error) return;
 
 	while(size > 0) {
-		unsigned left_in_chunk = ED2K_CHUNK_SIZE - ctx->index;
-		unsigned block_left = (left_in_chunk <= LAST_BLOCK_SIZE ? left_in_chunk :
+		unsigned left_in_chunk, block_left;
+		if((ctx->index % FULL_BLOCK_SIZE) == 0 && size >= FULL_BLOCK_SIZE) {
+			size_t hashed = rhash_aich_process_blocks(ctx, msg, size);
+			if(ctx->error) return;
+			msg  += hashed;
+			size -= hashed;
+			if(hashed > 0) continue;
+		}
+		left_in_chunk = ED2K_CHUNK_SIZE - ctx->index;
+		block_left = (left_in_chunk <= LAST_BLOCK_SIZE ? left_in_chunk :
 			FULL_BLOCK_SIZE - ctx->index % FULL_BLOCK_SIZE);
 		assert(block_left > 0);
 
@@ -386,8 +440,8 @@ void rhash_aich_final(aich_ctx *ctx, unsigned char result[20])
 			/* process the last block of the message */
 			rhash_aich_process_block(ctx, AICH_PROCESS_FINAL_BLOCK);
 		}
+		/* block_hashes stay NULL if each chunk was added by rhash_aich_add_chunk() */
 		assert(ctx->chunks_number > 0);
-		assert(ctx->block_hashes != NULL);
 
 		rhash_aich_hash_tree(ctx, hash, AICH_HASH_FULL_TREE);
 	}
@@ -396,3 +450,84 @@ void rhash_aich_final(aich_ctx *ctx, unsigned char result[20])
 	ctx->sha1_context.length = total_size; /* store total message size  */
 	if(result) memcpy(result, hash, sha1_hash_size);
 }
+
+/**
+ * Return the size of a message chunk, which can be hashed independently
+ * by rhash_aich_hash_chunk(), if the context is at a chunk boundary.
+ *
+ * @param ctx the algorithm context
+ * @return the chunk size, or 0 if the context is not at a chunk boundary
+ */
+size_t rhash_aich_chunk_size(aich_ctx *ctx)
+{
+	return (ctx->index == 0 && !ctx->error ? ED2K_CHUNK_SIZE : 0);
+}
+
+/**
+ * Calculate the left and the right branch tree hashes of an ed2k chunk.
+ * The function doesn't modify the context, so it can be called
+ * by several threads at once.
+ *
+ * @param ctx the algorithm context
+ * @param msg the message chunk
+ * @param size the chunk size, as returned by rhash_aich_chunk_size()
+ * @param result the buffer to receive the pair of tree hashes
+ */
+void rhash_aich_hash_chunk(aich_ctx *ctx, const unsigned char* msg, size_t size, unsigned char result[40])
+{
+	aich_ctx chunk_ctx;
+	aich_ctx* const chunk = &chunk_ctx;
+	unsigned char block_hashes[BLOCKS_PER_CHUNK][sha1_hash_size];
+	unsigned i;
+	assert(size == ED2K_CHUNK_SIZE);
+	(void)size;
+
+	memset(chunk, 0, sizeof(aich_ctx));
+	chunk->sha_init = ctx->sha_init;
+	chunk->sha_update = ctx->sha_update;
+	chunk->sha_final = ctx->sha_final;
+
+	/* hash 180K blocks and the last 140K block */
+	if(rhash_batch_min_count(RHASH_SHA1) != 0) {
+		const void* msgs[BLOCKS_PER_CHUNK];
+		size_t lens[BLOCKS_PER_CHUNK];
+		for(i = 0; i < BLOCKS_PER_CHUNK; i++) {
+			msgs[i] = msg + (size_t)i * FULL_BLOCK_SIZE;
+			lens[i] = (i + 1 < BLOCKS_PER_CHUNK ? FULL_BLOCK_SIZE : LAST_BLOCK_SIZE);
+		}
+		rhash_msg_batch(RHASH_SHA1, msgs, lens, BLOCKS_PER_CHUNK, block_hashes[0]);
+	} else {
+		for(i = 0; i < BLOCKS_PER_CHUNK; i++) {
+			size_t block_size = (i + 1 < BLOCKS_PER_CHUNK ? FULL_BLOCK_SIZE : LAST_BLOCK_SIZE);
+			SHA1_INIT(chunk);
+			SHA1_UPDATE(chunk, msg, block_size);
+			SHA1_FINAL(chunk, block_hashes[i]);
+			msg += block_size;
+		}
+	}
+
+	chunk->block_hashes = block_hashes;
+	chunk->index = ED2K_CHUNK_SIZE;
+	rhash_aich_hash_tree(chunk, result + sha1_hash_size, AICH_HASH_LEFT_BRANCH);
+	rhash_aich_hash_tree(chunk, result, AICH_HASH_RIGHT_BRANCH);
+}
+
+/**
+ * Add the tree hashes of the next ed2k chunk.
+ *
+ * @param ctx the algorithm context
+ * @param result the pair of tree hashes, calculated by rhash_aich_hash_chunk()
+ */
+void rhash_aich_add_chunk(aich_ctx *ctx, const unsigned char result[40])
+{
+	if(ctx->error) return;
+	assert(ctx->index == 0);
+
+	/* ensure, that we have the space to store tree hashes */
+	if(CT_INDEX(ctx->chunks_number) == 0) {
+		rhash_aich_chunk_table_extend(ctx, ctx->chunks_number);
+		if(ctx->error) return;
+	}
+	memcpy(GET_HASH_PAIR(ctx, ctx->chunks_number), result, sizeof(hash_pair_t));
+	ctx->chunks_number++;
+}
@@ -13,9 +13,9 @@ typedef struct aich_ctx
 	sha1_ctx sha1_context; /* context used to hash tree leaves */
 #ifdef USE_OPENSSL
 	unsigned long reserved; /* need more space for openssl sha1 context */
-	void *sha_init, *sha_update, *sha_final;
 	unsigned long sha1_length;
 #endif
+	void *sha_init, *sha_update, *sha_final; /* SHA1 methods, selected on init */
 	unsigned index;        /* algorithm position in the current ed2k chunk */
 	unsigned char (*block_hashes)[sha1_hash_size];
 
@@ -31,6 +31,11 @@ void rhash_aich_init(aich_ctx *ctx);
 void rhash_aich_update(aich_ctx *ctx, const unsigned char* msg, size_t size);
 void rhash_aich_final(aich_ctx *ctx, unsigned char result[20]);
 
+/* hashing of ed2k chunks of a message by several threads */
+size_t rhash_aich_chunk_size(aich_ctx *ctx);
+void rhash_aich_hash_chunk(aich_ctx *ctx, const unsigned char* msg, size_t size, unsigned char result[40]);
+void rhash_aich_add_chunk(aich_ctx *ctx, const unsigned char result[40]);
+
 /* Clean up context by freeing allocated memory.
  * The function is called automatically by rhash_aich_final.
  * Shall be called when aborting hash calculations. */
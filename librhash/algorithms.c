@@ -14,12 +14,17 @@
  * or FITNESS FOR A PARTICULAR PURPOSE.  Use this program  at  your own risk!
  */
 
-#include <stdio.h>
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "byte_order.h"
 #include "rhash.h"
 #include "algorithms.h"
+#include "cpu_features.h"
+#include "rhash_thread.h"
+#include "util.h"
 
 /* header files of all supported hash sums */
 #include "aich.h"
@@ -30,44 +35,37 @@
 #include "has160.h"
 #include "md4.h"
 #include "md5.h"
+#include "openssl_asm.h"
+#include "plug_openssl.h"
 #include "ripemd-160.h"
 #include "snefru.h"
 #include "sha1.h"
 #include "sha256.h"
 #include "sha512.h"
+#include "stitch.h"
 #include "tiger.h"
 #include "torrent.h"
 #include "tth.h"
 #include "whirlpool.h"
 
-#ifdef USE_OPENSSL
-/* note: BTIH and AICH depends on the used SHA1 algorithm */
-# define NEED_OPENSSL_INIT (RHASH_MD4 | RHASH_MD5 | \
-	RHASH_SHA1 | RHASH_SHA224 | RHASH_SHA256 | RHASH_SHA384 | RHASH_SHA512 | \
-	RHASH_BTIH | RHASH_AICH | RHASH_RIPEMD160 | RHASH_WHIRLPOOL)
-#else
-# define NEED_OPENSSL_INIT 0
-#endif /* USE_OPENSSL */
-#ifdef GENERATE_GOST_LOOKUP_TABLE
-# define NEED_GOST_INIT (RHASH_GOST | RHASH_GOST_CRYPTOPRO)
-#else
-# define NEED_GOST_INIT 0
-#endif /* GENERATE_GOST_LOOKUP_TABLE */
+/* the once flags of the lookup tables, generated on the first use */
 #ifdef GENERATE_CRC32_TABLE
-# define NEED_CRC32_INIT RHASH_CRC32
-#else
-# define NEED_CRC32_INIT 0
-#endif /* GENERATE_CRC32_TABLE */
-
-#define RHASH_NEED_INIT_ALG (NEED_CRC32_INIT | NEED_GOST_INIT | NEED_OPENSSL_INIT)
-unsigned rhash_uninitialized_algorithms = RHASH_NEED_INIT_ALG;
+static rhash_atomic_t rhash_crc32_table_once;
+#endif
+#ifdef GENERATE_GOST_LOOKUP_TABLE
+static rhash_atomic_t rhash_gost_table_once;
+#endif
 
-rhash_hash_info* rhash_info_table = rhash_hash_info_default;
 int rhash_info_size = RHASH_HASH_COUNT;
 
 static void rhash_crc32_init(uint32_t* crc32);
 static void rhash_crc32_update(uint32_t* crc32, const unsigned char* msg, size_t size);
+#ifdef USE_CRC32_PCLMUL
+static void rhash_crc32_update_pclmul(uint32_t* crc32, const unsigned char* msg, size_t size);
+#endif
 static void rhash_crc32_final(uint32_t* crc32, unsigned char* result);
+static size_t rhash_crc32_chunk_size(uint32_t* crc32);
+static void rhash_crc32_add_chunk(uint32_t* crc32, const unsigned char* result);
 
 rhash_info info_crc32 = { RHASH_CRC32, F_BE32, 4, "CRC32", "crc32" };
 rhash_info info_md4 = { RHASH_MD4, F_LE32, 16, "MD4", "md4" };
@@ -103,7 +101,7 @@ rhash_info info_edr512 = { RHASH_EDONR512,  F_LE64, 64, "EDON-R512", "edon-r512"
 #define diuf(name) dgshft(name), ini(name), upd(name), fin(name)
 
 /* information about all hashes */
-rhash_hash_info rhash_hash_info_default[RHASH_HASH_COUNT] =
+const rhash_hash_info rhash_hash_info_default[RHASH_HASH_COUNT] =
 {
 	{ &info_crc32, sizeof(uint32_t), 0, iuf(rhash_crc32), 0 }, /* 32 bit */
 	{ &info_md4, sizeof(md4_ctx), dgshft(md4), iuf(rhash_md4), 0 }, /* 128 bit */
@@ -129,23 +127,487 @@ rhash_hash_info rhash_hash_info_default[RHASH_HASH_COUNT] =
 	{ &info_edr512, sizeof(edonr_ctx), dgshft2(edonr, u.data512.hash) + 64, iuf(rhash_edonr512), 0 },  /* 512 bit */
 };
 
+#define chunk(name) (pchunk_size_t)(name##_chunk_size), \
+	(phash_chunk_t)(name##_hash_chunk), (padd_chunk_t)(name##_add_chunk)
+
+/* algorithms, which hash independent message chunks */
+static const rhash_chunk_methods rhash_chunk_methods_table[] =
+{
+	/* a CRC32 chunk is hashed from zero by the update method of the context backend */
+	{ RHASH_CRC32, 4, (pchunk_size_t)rhash_crc32_chunk_size, 0, (padd_chunk_t)rhash_crc32_add_chunk },
+	{ RHASH_TTH,  24, chunk(rhash_tth) },
+	{ RHASH_BTIH, 20, chunk(bt) },
+	{ RHASH_ED2K, 16, chunk(rhash_ed2k) },
+	{ RHASH_AICH, 40, chunk(rhash_aich) },
+};
+
+#define impl(hash_id, name, features, update) { hash_id, name, features, 0, (pupdate_t)(update) }
+/* an implementation, which is faster than the one from OpenSSL */
+#define fast_impl(hash_id, name, features, update) { hash_id, name, features, 1, (pupdate_t)(update) }
+
+/* alternative implementations of hash algorithms, the fastest go first */
+static const rhash_hash_impl rhash_hash_impls[] =
+{
+#ifdef USE_CRC32_PCLMUL
+	impl(RHASH_CRC32, "pclmul", RHASH_CPU_PCLMUL, rhash_crc32_update_pclmul),
+#endif
+	impl(RHASH_CRC32, "generic", 0, rhash_crc32_update),
+#ifdef HAS_OPENSSL_ASM
+	impl(RHASH_MD5, "openssl-asm", 0, rhash_md5_update_asm),
+#endif
+	impl(RHASH_MD5, "generic", 0, rhash_md5_update),
+#ifdef USE_SHA1_SHANI
+	impl(RHASH_SHA1, "shani", RHASH_CPU_SHA | RHASH_CPU_SSE41, rhash_sha1_update_shani),
+#endif
+#ifdef HAS_OPENSSL_ASM
+	impl(RHASH_SHA1, "openssl-asm", 0, rhash_sha1_update_asm),
+#endif
+#ifdef USE_SHA1_AVX2
+	impl(RHASH_SHA1, "avx2", RHASH_CPU_AVX2, rhash_sha1_update_avx2),
+#endif
+#ifdef USE_SHA1_SSSE3
+	impl(RHASH_SHA1, "ssse3", RHASH_CPU_SSSE3, rhash_sha1_update_ssse3),
+#endif
+	impl(RHASH_SHA1, "generic", 0, rhash_sha1_update),
+#ifdef USE_SHA256_SHANI
+	impl(RHASH_SHA224, "shani", RHASH_CPU_SHA | RHASH_CPU_SSE41, rhash_sha256_update_shani),
+#endif
+#ifdef HAS_OPENSSL_ASM
+	impl(RHASH_SHA224, "openssl-asm", 0, rhash_sha256_update_asm),
+#endif
+#ifdef USE_SHA256_AVX2
+	impl(RHASH_SHA224, "avx2", RHASH_CPU_AVX2, rhash_sha256_update_avx2),
+#endif
+	impl(RHASH_SHA224, "generic", 0, rhash_sha256_update),
+#ifdef USE_SHA256_SHANI
+	impl(RHASH_SHA256, "shani", RHASH_CPU_SHA | RHASH_CPU_SSE41, rhash_sha256_update_shani),
+#endif
+#ifdef HAS_OPENSSL_ASM
+	impl(RHASH_SHA256, "openssl-asm", 0, rhash_sha256_update_asm),
+#endif
+#ifdef USE_SHA256_AVX2
+	impl(RHASH_SHA256, "avx2", RHASH_CPU_AVX2, rhash_sha256_update_avx2),
+#endif
+	impl(RHASH_SHA256, "generic", 0, rhash_sha256_update),
+#ifdef HAS_OPENSSL_ASM
+	impl(RHASH_SHA384, "openssl-asm", 0, rhash_sha512_update_asm),
+#endif
+#ifdef USE_SHA512_AVX2
+	impl(RHASH_SHA384, "avx2", RHASH_CPU_AVX2 | RHASH_CPU_BMI2, rhash_sha512_update_avx2),
+#endif
+	impl(RHASH_SHA384, "generic", 0, rhash_sha512_update),
+#ifdef HAS_OPENSSL_ASM
+	impl(RHASH_SHA512, "openssl-asm", 0, rhash_sha512_update_asm),
+#endif
+#ifdef USE_SHA512_AVX2
+	impl(RHASH_SHA512, "avx2", RHASH_CPU_AVX2 | RHASH_CPU_BMI2, rhash_sha512_update_avx2),
+#endif
+	impl(RHASH_SHA512, "generic", 0, rhash_sha512_update),
+#ifdef USE_GOST_X64
+	impl(RHASH_GOST, "x64", RHASH_CPU_SSE2, rhash_gost_update_x64),
+#endif
+	impl(RHASH_GOST, "generic", 0, rhash_gost_update),
+#ifdef USE_GOST_X64
+	impl(RHASH_GOST_CRYPTOPRO, "x64", RHASH_CPU_SSE2, rhash_gost_update_x64),
+#endif
+	impl(RHASH_GOST_CRYPTOPRO, "generic", 0, rhash_gost_update),
+#ifdef USE_WHIRLPOOL_AVX512
+	fast_impl(RHASH_WHIRLPOOL, "avx512", RHASH_CPU_AVX512 | RHASH_CPU_AVX512VBMI | RHASH_CPU_GFNI, rhash_whirlpool_update_avx512),
+#endif
+#if defined(HAS_OPENSSL_ASM) && defined(CPU_IA32)
+	impl(RHASH_WHIRLPOOL, "openssl-asm", RHASH_CPU_SSE2, rhash_whirlpool_update_asm),
+#endif
+	impl(RHASH_WHIRLPOOL, "generic", 0, rhash_whirlpool_update),
+#if defined(HAS_OPENSSL_ASM) && defined(CPU_X64)
+	/* slower than the generic code on x86-64, used only if forced */
+	impl(RHASH_WHIRLPOOL, "openssl-asm", 0, rhash_whirlpool_update_asm),
+#endif
+#ifdef HAS_OPENSSL_ASM_RIPEMD160
+	impl(RHASH_RIPEMD160, "openssl-asm", 0, rhash_ripemd160_update_asm),
+	impl(RHASH_RIPEMD160, "generic", 0, rhash_ripemd160_update),
+#endif
+};
+
+#define IMPLS_COUNT (sizeof(rhash_hash_impls) / sizeof(*rhash_hash_impls))
+
+/* The maximal number of backends. A replaced backend is reused, when the last
+ * context created with it is freed, so while all of them are used by contexts,
+ * selecting another implementation fails. */
+#define RHASH_MAX_BACKENDS 8
+
+/* a backend with the number of its users */
+typedef struct rhash_backend_slot
+{
+	rhash_backend backend;
+	rhash_atomic_t refs; /* the contexts and the threads reading the backend */
+} rhash_backend_slot;
+
+/* the storage of backends, the memory of a backend is never freed, so a thread
+ * can safely increment the reference count of a just replaced backend */
+static rhash_backend_slot rhash_backends[RHASH_MAX_BACKENDS];
+/* the backend used by new contexts, NULL until the first one is published */
+static rhash_atomic_ptr_t rhash_current_backend;
+/* non-zero while a thread replaces the backend */
+static rhash_atomic_t rhash_backend_lock;
+
+/**
+ * Reference the backend, used by new contexts.
+ * The library is initialized on the first call.
+ *
+ * @return the current backend
+ */
+static rhash_backend_slot* rhash_ref_current_backend(void)
+{
+	for(;;) {
+		rhash_backend_slot* slot = (rhash_backend_slot*)rhash_atomic_load_ptr(&rhash_current_backend);
+		unsigned refs;
+		if(!slot) {
+			rhash_library_init();
+			continue;
+		}
+		do {
+			refs = rhash_atomic_load(&slot->refs);
+		} while(!rhash_atomic_cas(&slot->refs, refs, refs + 1));
+		/* the backend can be reused only after it was replaced */
+		if(rhash_atomic_load_ptr(&rhash_current_backend) == (void*)slot) return slot;
+		rhash_release_backend(&slot->backend);
+	}
+}
+
+/**
+ * Reference the backend for new contexts, computing the given hash algorithms.
+ * The static data of the algorithms is initialized, and the OpenSSL library
+ * is loaded, when they are first needed. The backend must be released by
+ * rhash_release_backend().
+ *
+ * @param hash_ids the mask of the algorithms
+ * @return the current backend
+ */
+const rhash_backend* rhash_acquire_backend(unsigned hash_ids)
+{
+	rhash_backend_slot* slot = rhash_ref_current_backend();
+	rhash_init_algorithms(hash_ids);
+#ifdef USE_OPENSSL
+	/* BTIH and AICH depend on the SHA1 implementation */
+	if(hash_ids & (RHASH_BTIH | RHASH_AICH)) hash_ids |= RHASH_SHA1;
+	if(slot->backend.openssl_pending & hash_ids) {
+		rhash_release_backend(&slot->backend);
+		rhash_load_openssl();
+		slot = rhash_ref_current_backend();
+	}
+#endif
+	return &slot->backend;
+}
+
+/**
+ * Release a backend, returned by rhash_acquire_backend().
+ *
+ * @param backend the backend to release
+ */
+void rhash_release_backend(const rhash_backend* backend)
+{
+	rhash_backend_slot* slot = (rhash_backend_slot*)backend;
+	unsigned refs;
+	do {
+		refs = rhash_atomic_load(&slot->refs);
+		assert(refs > 0);
+	} while(!rhash_atomic_cas(&slot->refs, refs, refs - 1));
+}
+
 /**
- * Initialize requested algorithms.
+ * Start replacing the backend. Lock out other threads replacing it
+ * and return a copy of the current backend to modify, stored in
+ * a backend, which is not used by any context.
+ *
+ * @return the new backend, NULL if all backends are used by contexts
+ */
+static rhash_backend* rhash_begin_backend(void)
+{
+	const rhash_backend* current;
+	size_t i;
+
+	while(!rhash_atomic_cas(&rhash_backend_lock, 0, 1)) rhash_thread_yield();
+	current = (const rhash_backend*)rhash_atomic_load_ptr(&rhash_current_backend);
+	if(!current) return &rhash_backends[0].backend; /* zeroed, so every algorithm is generic */
+	for(i = 0; i < RHASH_MAX_BACKENDS; i++) {
+		rhash_backend_slot* slot = &rhash_backends[i];
+		if(&slot->backend == current || rhash_atomic_load(&slot->refs) != 0) continue;
+		memcpy(&slot->backend, current, sizeof(rhash_backend));
+		return &slot->backend;
+	}
+	rhash_atomic_store(&rhash_backend_lock, 0);
+	return NULL;
+}
+
+/**
+ * Fill the methods of the new backend from the selected implementations,
+ * then publish it for new contexts and unlock.
+ *
+ * @param backend the backend returned by rhash_begin_backend()
+ */
+static void rhash_publish_backend(rhash_backend* backend)
+{
+	unsigned i;
+	for(i = 0; i < RHASH_HASH_COUNT; i++) {
+		backend->table[i] = rhash_hash_info_default[i];
+		if(backend->impls[i]) backend->table[i].update = backend->impls[i]->update;
+	}
+#ifdef USE_OPENSSL
+	{
+		unsigned requested = backend->openssl_hashes | backend->openssl_pending;
+		backend->openssl_hashes = rhash_plug_openssl_methods(backend->table, requested);
+		/* the algorithms wait for the OpenSSL library till it is loaded */
+		backend->openssl_pending = (rhash_openssl_is_loaded() ? 0 : requested & ~backend->openssl_hashes);
+	}
+#else
+	backend->openssl_hashes = 0;
+	backend->openssl_pending = 0;
+#endif
+	rhash_atomic_store_ptr(&rhash_current_backend, backend);
+	rhash_atomic_store(&rhash_backend_lock, 0);
+}
+
+/**
+ * Find an implementation of a hash algorithm, supported by the CPU.
+ *
+ * @param hash_id id of the hash algorithm
+ * @param name the implementation name, NULL to find the fastest one
+ * @return the implementation found, NULL if there is no such implementation
  */
-void rhash_init_algorithms(unsigned mask)
+static const rhash_hash_impl* rhash_find_impl(unsigned hash_id, const char* name)
 {
-	(void)mask; /* unused now */
+	size_t i;
+	for(i = 0; i < IMPLS_COUNT; i++) {
+		const rhash_hash_impl* impl = &rhash_hash_impls[i];
+		if(impl->hash_id != hash_id || (name && strcmp(impl->name, name) != 0)) continue;
+		if(HAS_CPU_FEATURES(impl->cpu_features)) return impl;
+	}
+	return NULL;
+}
 
-	/* verify that RHASH_HASH_COUNT is the index of the major bit of RHASH_ALL_HASHES */
-	assert(1 == (RHASH_ALL_HASHES >> (RHASH_HASH_COUNT - 1)));
+/**
+ * Publish the copy of the current backend, to apply
+ * the methods of the just loaded OpenSSL library.
+ */
+void rhash_refresh_backend(void)
+{
+	rhash_backend* backend = rhash_begin_backend();
+	if(backend) rhash_publish_backend(backend);
+}
 
+/**
+ * Select the fastest implementation of every hash algorithm,
+ * using the instruction sets allowed by rhash_cpu_features().
+ *
+ * @return 0 on success, -1 if all backends are used by contexts
+ */
+int rhash_select_impls(void)
+{
+	rhash_backend* backend;
+	size_t i;
+#ifdef HAS_OPENSSL_ASM
+	rhash_openssl_asm_init();
+#endif
+	backend = rhash_begin_backend();
+	if(!backend) return -1; /* keep the current implementations */
+	for(i = 0; i < IMPLS_COUNT; i++) {
+		unsigned hash_id = rhash_hash_impls[i].hash_id;
+		/* process an algorithm only once, at its first implementation */
+		if(i > 0 && rhash_hash_impls[i - 1].hash_id == hash_id) continue;
+		backend->impls[rhash_ctz(hash_id)] = rhash_find_impl(hash_id, NULL);
+	}
+	rhash_publish_backend(backend);
+	return 0;
+}
+
+/**
+ * Force an implementation of a hash algorithm.
+ * The name "openssl" switches the algorithm to the OpenSSL library.
+ *
+ * @param hash_id id of the hash algorithm
+ * @param name the implementation name, NULL to select the fastest one
+ * @return 0 on success, -1 if the implementation is not found or not supported by the CPU
+ */
+int rhash_set_impl(unsigned hash_id, const char* name)
+{
+	const rhash_hash_impl* impl = NULL;
+	rhash_backend* backend;
+	int use_openssl = (name && strcmp(name, "openssl") == 0);
+	if(hash_id == 0 || (hash_id & (hash_id - 1)) != 0 || !(hash_id & RHASH_ALL_HASHES)) return -1;
+	if(use_openssl) {
+#ifdef USE_OPENSSL
+		rhash_load_openssl();
+		if(!(rhash_openssl_loaded_hashes() & hash_id)) return -1;
+#else
+		return -1;
+#endif
+	} else {
+		impl = rhash_find_impl(hash_id, name);
+		/* an algorithm without alternatives has the only "generic" implementation */
+		if(!impl && (rhash_find_impl(hash_id, NULL) || (name && strcmp(name, "generic") != 0))) return -1;
+	}
+
+	backend = rhash_begin_backend();
+	if(!backend) return -1;
+	if(use_openssl) backend->openssl_hashes |= hash_id;
+	else {
+		/* a forced internal implementation replaces the OpenSSL one */
+		if(name) {
+			backend->openssl_hashes &= ~hash_id;
+			backend->openssl_pending &= ~hash_id;
+		}
+		backend->impls[rhash_ctz(hash_id)] = impl;
+	}
+	rhash_publish_backend(backend);
+	return 0;
+}
+
+/**
+ * Select the hash algorithms to compute by OpenSSL. An algorithm is not
+ * switched to OpenSSL, if its selected implementation is faster.
+ * If the library is not loaded yet, the algorithms wait for it.
+ *
+ * @param hash_ids the bit mask of the algorithms
+ * @return 0 on success, -1 if all backends are used by contexts
+ */
+int rhash_set_openssl_hashes(unsigned hash_ids)
+{
+	rhash_backend* backend = rhash_begin_backend();
+	unsigned i;
+	if(!backend) return -1;
+	for(i = 0; i < RHASH_HASH_COUNT; i++) {
+		if(backend->impls[i] && backend->impls[i]->over_openssl) hash_ids &= ~(1u << i);
+	}
+	backend->openssl_hashes = 0;
+	backend->openssl_pending = hash_ids;
+	rhash_publish_backend(backend);
+	return 0;
+}
+
+/**
+ * List the implementations of a hash algorithm, supported by the CPU.
+ *
+ * @param hash_id id of the hash algorithm
+ * @param names the array to receive the implementation names, the fastest go first
+ * @param size the size of the array
+ * @return the number of implementations stored, 0 if the algorithm has only the generic one
+ */
+size_t rhash_list_impls(unsigned hash_id, const char** names, size_t size)
+{
+	size_t i, count = 0;
+	for(i = 0; i < IMPLS_COUNT && count < size; i++) {
+		const rhash_hash_impl* impl = &rhash_hash_impls[i];
+		if(impl->hash_id == hash_id && HAS_CPU_FEATURES(impl->cpu_features)) names[count++] = impl->name;
+	}
+	return count;
+}
+
+/**
+ * Return the name of the implementation of a hash algorithm in a backend.
+ *
+ * @param backend the backend
+ * @param hash_id id of the hash algorithm
+ * @return the implementation name, NULL if hash_id is invalid
+ */
+const char* rhash_backend_impl(const rhash_backend* backend, unsigned hash_id)
+{
+	const rhash_hash_impl* impl;
+	if(hash_id == 0 || (hash_id & (hash_id - 1)) != 0 || (hash_id & RHASH_ALL_HASHES) == 0) return NULL;
+	if(backend->openssl_hashes & hash_id) return "openssl";
+	impl = backend->impls[rhash_ctz(hash_id)];
+	return (impl ? impl->name : "generic");
+}
+
+/**
+ * Return the name of the implementation used by new contexts of a hash algorithm.
+ *
+ * @param hash_id id of the hash algorithm
+ * @return the implementation name, NULL if hash_id is invalid
+ */
+const char* rhash_get_impl(unsigned hash_id)
+{
+	const rhash_backend* backend = rhash_acquire_backend(hash_id & RHASH_ALL_HASHES);
+	const char* name = rhash_backend_impl(backend, hash_id);
+	rhash_release_backend(backend);
+	return name;
+}
+
+#define stitched(hash_ids, impl1, impl2, update) { hash_ids, impl1, impl2, (pstitched_update_t)(update) }
+
+/* kernels updating two hash algorithms at once, usable when both
+ * algorithms are computed by the given implementations. The kernels have
+ * their own MD5 rounds, which hide in the latency of the other algorithm,
+ * so they also replace the OpenSSL assembly MD5. The CRC32 kernel uses
+ * the slicing-by-8 tables and isn't faster than the separate MD5 and the
+ * PCLMUL CRC32, so it is used only when CRC32 is computed by the tables. */
+static const rhash_stitched_impl rhash_stitched_impls[] =
+{
+	stitched(RHASH_CRC32 | RHASH_MD5, "generic", "generic", rhash_crc32_md5_update),
+#ifdef HAS_OPENSSL_ASM
+	stitched(RHASH_CRC32 | RHASH_MD5, "generic", "openssl-asm", rhash_crc32_md5_update),
+#endif
+#ifdef USE_STITCH_SHANI
+	stitched(RHASH_MD5 | RHASH_SHA1, "generic", "shani", rhash_md5_sha1_update_shani),
+# ifdef HAS_OPENSSL_ASM
+	stitched(RHASH_MD5 | RHASH_SHA1, "openssl-asm", "shani", rhash_md5_sha1_update_shani),
+# endif
+	stitched(RHASH_SHA1 | RHASH_SHA224, "shani", "shani", rhash_sha1_sha256_update_shani),
+	stitched(RHASH_SHA1 | RHASH_SHA256, "shani", "shani", rhash_sha1_sha256_update_shani),
+#endif
+};
+
+/**
+ * Find a stitched kernel, updating both given hash algorithms at once.
+ * The kernel is found only if the algorithms are computed by the
+ * implementations, which the kernel interleaves.
+ *
+ * @param backend the backend of the context
+ * @param hash_ids the union of two hash ids
+ * @return the update function of the kernel, NULL if there is no such kernel
+ */
+pstitched_update_t rhash_find_stitched_update(const rhash_backend* backend, unsigned hash_ids)
+{
+	size_t i;
+	for(i = 0; i < sizeof(rhash_stitched_impls) / sizeof(*rhash_stitched_impls); i++) {
+		const rhash_stitched_impl* impl = &rhash_stitched_impls[i];
+		unsigned id1 = impl->hash_ids & (0 - impl->hash_ids); /* the lower hash id */
+		if(impl->hash_ids != hash_ids) continue;
+		if(strcmp(rhash_backend_impl(backend, id1), impl->impl1) == 0 &&
+			strcmp(rhash_backend_impl(backend, hash_ids ^ id1), impl->impl2) == 0) return impl->update;
+	}
+	return NULL;
+}
+
+/**
+ * Return the methods to hash independent message chunks by several threads.
+ *
+ * @param hash_id id of the hash algorithm
+ * @return the methods, or NULL if the algorithm can't hash chunks independently
+ */
+const rhash_chunk_methods* rhash_get_chunk_methods(unsigned hash_id)
+{
+	size_t i;
+	for(i = 0; i < sizeof(rhash_chunk_methods_table) / sizeof(*rhash_chunk_methods_table); i++) {
+		if(rhash_chunk_methods_table[i].hash_id == hash_id) return &rhash_chunk_methods_table[i];
+	}
+	return NULL;
+}
+
+/**
+ * Initialize static data of the given hash algorithms on their first use.
+ *
+ * @param hash_ids the mask of the algorithms to initialize
+ */
+void rhash_init_algorithms(unsigned hash_ids)
+{
 #ifdef GENERATE_CRC32_TABLE
-	rhash_crc32_init_table();
+	if(hash_ids & RHASH_CRC32) rhash_call_once(&rhash_crc32_table_once, rhash_crc32_init_table);
 #endif
 #ifdef GENERATE_GOST_LOOKUP_TABLE
-	rhash_gost_init_table();
+	if(hash_ids & (RHASH_GOST | RHASH_GOST_CRYPTOPRO))
+		rhash_call_once(&rhash_gost_table_once, rhash_gost_init_table);
 #endif
-	rhash_uninitialized_algorithms = 0;
+	(void)hash_ids;
 }
 
 /* CRC32 helper functions */
@@ -173,6 +635,20 @@ static void rhash_crc32_update(uint32_t* crc32, const unsigned char* msg, size_t
 	*crc32 = rhash_get_crc32(*crc32, msg, size);
 }
 
+#ifdef USE_CRC32_PCLMUL
+/**
+ * Calculate message CRC32 hash, using the PCLMULQDQ instruction.
+ *
+ * @param crc32 pointer to the hash
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+static void rhash_crc32_update_pclmul(uint32_t* crc32, const unsigned char* msg, size_t size)
+{
+	*crc32 = rhash_get_crc32_pclmul(*crc32, msg, size);
+}
+#endif
+
 /**
  * Store calculated hash into the given array.
  *
@@ -190,3 +666,31 @@ static void rhash_crc32_final(uint32_t* crc32, unsigned char* result)
 	result[2] = (unsigned char)(*crc32 >> 8), result[3] = (unsigned char)(*crc32);
 #endif
 }
+
+/* CRC32 of a message is combined from CRC32 sums of its 4 MiB chunks */
+#define CRC32_CHUNK_SIZE (4 * 1024 * 1024)
+
+/**
+ * Return the size of a message chunk, which can be hashed independently.
+ *
+ * @param crc32 pointer to the current hash value
+ * @return the chunk size
+ */
+static size_t rhash_crc32_chunk_size(uint32_t* crc32)
+{
+	(void)crc32;
+	return CRC32_CHUNK_SIZE;
+}
+
+/**
+ * Append the CRC32 of the next message chunk to the hash value.
+ *
+ * @param crc32 pointer to the current hash value
+ * @param result the chunk CRC32, calculated by the update method from zero
+ */
+static void rhash_crc32_add_chunk(uint32_t* crc32, const unsigned char* result)
+{
+	uint32_t crc;
+	memcpy(&crc, result, sizeof(crc));
+	*crc32 = rhash_crc32_combine(*crc32, crc, CRC32_CHUNK_SIZE);
+}
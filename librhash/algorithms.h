@@ -31,10 +31,60 @@ typedef struct rhash_hash_info
 	pcleanup_t cleanup;
 } rhash_hash_info;
 
-extern rhash_hash_info rhash_hash_info_default[RHASH_HASH_COUNT];
-extern rhash_hash_info* rhash_info_table;
+/* methods to hash independent chunks of a message by several threads */
+typedef size_t (*pchunk_size_t)(void* ctx);
+typedef void (*phash_chunk_t)(void* ctx, const unsigned char* msg, size_t size, unsigned char* result);
+typedef void (*padd_chunk_t)(void* ctx, const unsigned char* result);
+
+typedef struct rhash_chunk_methods
+{
+	unsigned hash_id;
+	size_t result_size;        /* size of the result of hashing one chunk */
+	pchunk_size_t chunk_size;  /* return the chunk size, 0 if chunks can't be hashed now */
+	phash_chunk_t hash_chunk;  /* hash a chunk, without modifying the context, NULL if the result is
+	                            * the state of result_size bytes, updated from zero by the chunk */
+	padd_chunk_t add_chunk;    /* add the result of the next chunk to the context */
+} rhash_chunk_methods;
+
+/* an implementation of a hash algorithm, optimized for some instruction sets */
+typedef struct rhash_hash_impl
+{
+	unsigned hash_id;
+	const char* name;
+	unsigned cpu_features; /* required RHASH_CPU_* instruction sets */
+	int over_openssl; /* non-zero if preferred to the OpenSSL implementation */
+	pupdate_t update;
+} rhash_hash_impl;
+
+/* a stitched kernel, updating the contexts of two hash algorithms at once,
+ * ctx1 belongs to the algorithm with the lower hash id */
+typedef void (*pstitched_update_t)(void* ctx1, void* ctx2, const void* msg, size_t size);
+
+typedef struct rhash_stitched_impl
+{
+	unsigned hash_ids; /* the union of two hash ids */
+	const char* impl1; /* required implementations of the algorithms */
+	const char* impl2;
+	pstitched_update_t update;
+} rhash_stitched_impl;
+
+/* the hash algorithms, which have stitched kernels */
+#define RHASH_STITCHED_HASHES (RHASH_CRC32 | RHASH_MD5 | RHASH_SHA1 | RHASH_SHA224 | RHASH_SHA256)
+
+/* The methods of all hash algorithms, used by new contexts. A backend is
+ * never modified while it is published or used by a context, so a context
+ * keeps using the methods it was created with, while other threads select
+ * other implementations. */
+typedef struct rhash_backend
+{
+	rhash_hash_info table[RHASH_HASH_COUNT];
+	const rhash_hash_impl* impls[RHASH_HASH_COUNT]; /* the selected implementations, NULL for generic */
+	unsigned openssl_hashes; /* the algorithms computed by OpenSSL */
+	unsigned openssl_pending; /* the algorithms to compute by OpenSSL, when it is loaded */
+} rhash_backend;
+
+extern const rhash_hash_info rhash_hash_info_default[RHASH_HASH_COUNT];
 extern int rhash_info_size;
-extern unsigned rhash_uninitialized_algorithms;
 
 extern rhash_info info_crc32;
 extern rhash_info info_md4;
@@ -77,7 +127,18 @@ extern rhash_info info_edr512;
 #define F_BE64 0
 #endif
 
-void rhash_init_algorithms(unsigned mask);
+void rhash_init_algorithms(unsigned hash_ids);
+const rhash_chunk_methods* rhash_get_chunk_methods(unsigned hash_id);
+const rhash_backend* rhash_acquire_backend(unsigned hash_ids);
+void rhash_release_backend(const rhash_backend* backend);
+void rhash_refresh_backend(void);
+int rhash_select_impls(void);
+int rhash_set_impl(unsigned hash_id, const char* name);
+int rhash_set_openssl_hashes(unsigned hash_ids);
+const char* rhash_get_impl(unsigned hash_id);
+const char* rhash_backend_impl(const rhash_backend* backend, unsigned hash_id);
+size_t rhash_list_impls(unsigned hash_id, const char** names, size_t size);
+pstitched_update_t rhash_find_stitched_update(const rhash_backend* backend, unsigned hash_ids);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -0,0 +1,368 @@
+/* batch.c - multi-buffer hashing of many short messages
+ *
+ * Copyright: 2013 Aleksey Kravchenko <rhash.admin@gmail.com>
+ *
+ * Permission is hereby granted,  free of charge,  to any person  obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction,  including without limitation
+ * the rights to  use, copy, modify,  merge, publish, distribute, sublicense,
+ * and/or sell copies  of  the Software,  and to permit  persons  to whom the
+ * Software is furnished to do so.
+ *
+ * This program  is  distributed  in  the  hope  that it will be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  Use this program  at  your own risk!
+ *
+ * MD5, SHA1, SHA-224 and SHA-256 are computed for 4 (SSE2) or 8 (AVX2)
+ * messages at once, one message per 32-bit vector lane. Other algorithms,
+ * and CPUs without the vector instructions, fall back to rhash_msg().
+ */
+#include <string.h>
+#include <errno.h>
+#include "byte_order.h"
+#include "rhash.h"
+#include "algorithms.h"
+#include "cpu_features.h"
+#include "batch.h"
+
+#if defined(CPU_X64) || defined(CPU_IA32)
+# if defined(__SSE2__) || defined(CPU_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define USE_BATCH_SSE2
+# endif
+# if defined(USE_BATCH_SSE2) && ((defined(_MSC_VER) && _MSC_VER >= 1700) || \
+	(defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))))
+#  define USE_BATCH_AVX2
+# endif
+#endif
+
+#if defined(USE_BATCH_AVX2)
+# include <immintrin.h>
+#elif defined(USE_BATCH_SSE2)
+# include <emmintrin.h>
+#endif
+
+#define BATCH_MAX_LANES 8
+#define BATCH_BLOCK_SIZE 64
+
+#ifdef USE_BATCH_SSE2
+static const unsigned rhash_batch_k256[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* SSE2 kernels, 4 lanes */
+#define LANES 4
+#define vec_t __m128i
+#define V_LOAD(p)     _mm_load_si128((const __m128i*)(p))
+#define V_STORE(p, v) _mm_store_si128((__m128i*)(p), v)
+#define V_SET1(x)     _mm_set1_epi32((int)(x))
+#define V_ADD(a, b)   _mm_add_epi32(a, b)
+#define V_XOR(a, b)   _mm_xor_si128(a, b)
+#define V_AND(a, b)   _mm_and_si128(a, b)
+#define V_OR(a, b)    _mm_or_si128(a, b)
+#define V_SHL(a, n)   _mm_slli_epi32(a, n)
+#define V_SHR(a, n)   _mm_srli_epi32(a, n)
+#define KERNEL(name)  rhash_batch_##name##_sse2
+#define KERNEL_ATTR
+#include "batch_simd.h"
+#undef LANES
+#undef vec_t
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_SHL
+#undef V_SHR
+#undef KERNEL
+#undef KERNEL_ATTR
+#endif /* USE_BATCH_SSE2 */
+
+#ifdef USE_BATCH_AVX2
+/* AVX2 kernels, 8 lanes */
+#define LANES 8
+#define vec_t __m256i
+#define V_LOAD(p)     _mm256_load_si256((const __m256i*)(p))
+#define V_STORE(p, v) _mm256_store_si256((__m256i*)(p), v)
+#define V_SET1(x)     _mm256_set1_epi32((int)(x))
+#define V_ADD(a, b)   _mm256_add_epi32(a, b)
+#define V_XOR(a, b)   _mm256_xor_si256(a, b)
+#define V_AND(a, b)   _mm256_and_si256(a, b)
+#define V_OR(a, b)    _mm256_or_si256(a, b)
+#define V_SHL(a, n)   _mm256_slli_epi32(a, n)
+#define V_SHR(a, n)   _mm256_srli_epi32(a, n)
+#define KERNEL(name)  rhash_batch_##name##_avx2
+#ifdef __GNUC__
+# define KERNEL_ATTR __attribute__((target("avx2")))
+#else
+# define KERNEL_ATTR
+#endif
+#include "batch_simd.h"
+#undef LANES
+#undef vec_t
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_SHL
+#undef V_SHR
+#undef KERNEL
+#undef KERNEL_ATTR
+#endif /* USE_BATCH_AVX2 */
+
+#ifdef USE_BATCH_SSE2
+/** compression function, processing one block in every lane */
+typedef void (*batch_kernel_t)(uint32_t* state, const uint32_t* w);
+
+/**
+ * Description of an algorithm, supported by the multi-buffer kernels.
+ */
+typedef struct batch_algorithm
+{
+	unsigned hash_id;
+	unsigned state_words;
+	unsigned digest_size;
+	int big_endian;
+	const unsigned* iv;
+	batch_kernel_t sse2;
+#ifdef USE_BATCH_AVX2
+	batch_kernel_t avx2;
+#endif
+} batch_algorithm;
+
+static const unsigned md5_iv[4] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476
+};
+static const unsigned sha1_iv[5] = {
+	0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+static const unsigned sha224_iv[8] = {
+	0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939,
+	0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4
+};
+static const unsigned sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#ifdef USE_BATCH_AVX2
+# define BATCH_KERNELS(name) rhash_batch_##name##_sse2, rhash_batch_##name##_avx2
+#else
+# define BATCH_KERNELS(name) rhash_batch_##name##_sse2
+#endif
+
+static const batch_algorithm batch_algorithms[] = {
+	{ RHASH_MD5,    4, 16, 0, md5_iv,    BATCH_KERNELS(md5) },
+	{ RHASH_SHA1,   5, 20, 1, sha1_iv,   BATCH_KERNELS(sha1) },
+	{ RHASH_SHA224, 8, 28, 1, sha224_iv, BATCH_KERNELS(sha256) },
+	{ RHASH_SHA256, 8, 32, 1, sha256_iv, BATCH_KERNELS(sha256) },
+};
+
+/**
+ * A message being hashed in a vector lane.
+ */
+typedef struct batch_lane
+{
+	const unsigned char* msg; /* the unprocessed full blocks of the message */
+	size_t blocks;     /* the number of full blocks left */
+	size_t tail_size;  /* the size of the padded tail, 64 or 128 bytes */
+	size_t index;      /* the message index, or (size_t)-1 for an idle lane */
+	unsigned char tail[BATCH_BLOCK_SIZE * 2]; /* the last bytes and padding */
+} batch_lane;
+
+/**
+ * Start hashing a message in the given lane.
+ *
+ * @param lane the lane to start
+ * @param msg the message
+ * @param length the message length
+ * @param big_endian non-zero to store the bit length in big-endian order
+ */
+static void batch_lane_start(batch_lane* lane, const void* msg, size_t length, int big_endian)
+{
+	uint64_t bits = (uint64_t)length << 3;
+	size_t rest = length % BATCH_BLOCK_SIZE;
+	int i;
+
+	lane->msg = (const unsigned char*)msg;
+	lane->blocks = length / BATCH_BLOCK_SIZE;
+	lane->tail_size = (rest < 56 ? BATCH_BLOCK_SIZE : 2 * BATCH_BLOCK_SIZE);
+	memset(lane->tail, 0, lane->tail_size);
+	if(rest) memcpy(lane->tail, lane->msg + lane->blocks * BATCH_BLOCK_SIZE, rest);
+	lane->tail[rest] = 0x80;
+	for(i = 0; i < 8; i++) {
+		lane->tail[lane->tail_size - 1 - (big_endian ? i : 7 - i)] = (unsigned char)(bits >> (i * 8));
+	}
+}
+
+/**
+ * Hash the messages with a multi-buffer kernel.
+ *
+ * @param algo the algorithm to use
+ * @param kernel the compression function
+ * @param lanes the number of vector lanes, processed by the kernel
+ * @param msgs the messages to hash
+ * @param lens the message lengths
+ * @param count the number of messages
+ * @param out the buffer to receive count message digests
+ */
+static void batch_hash(const batch_algorithm* algo, batch_kernel_t kernel, unsigned lanes,
+	const void* msgs[], const size_t lens[], size_t count, unsigned char* out)
+{
+	ALIGN_ATTR(32) uint32_t state[8 * BATCH_MAX_LANES];
+	ALIGN_ATTR(32) uint32_t w[16 * BATCH_MAX_LANES];
+	batch_lane lane[BATCH_MAX_LANES];
+	size_t next = 0, active = 0;
+	unsigned k, j;
+
+	for(k = 0; k < lanes; k++) {
+		lane[k].index = (size_t)-1;
+		memset(lane[k].tail, 0, BATCH_BLOCK_SIZE);
+	}
+
+	for(;;) {
+		/* feed idle lanes with new messages, and fill the message words */
+		for(k = 0; k < lanes; k++) {
+			const unsigned char* block;
+			uint32_t word;
+
+			if(lane[k].index == (size_t)-1 && next < count) {
+				batch_lane_start(&lane[k], msgs[next], lens[next], algo->big_endian);
+				lane[k].index = next++;
+				active++;
+				for(j = 0; j < algo->state_words; j++) {
+					state[j * lanes + k] = algo->iv[j];
+				}
+			}
+			/* note: an idle lane hashes its old tail, the result is dropped */
+			block = (lane[k].index != (size_t)-1 && lane[k].blocks > 0 ?
+				lane[k].msg : lane[k].tail);
+			for(j = 0; j < 16; j++) {
+				memcpy(&word, block + j * 4, 4);
+				w[j * lanes + k] = (algo->big_endian ? be2me_32(word) : le2me_32(word));
+			}
+		}
+		if(active == 0) break;
+
+		kernel(state, w);
+
+		/* advance the lanes and output the finished digests */
+		for(k = 0; k < lanes; k++) {
+			batch_lane* l = &lane[k];
+			if(l->index == (size_t)-1) continue;
+			if(l->blocks > 0) {
+				l->msg += BATCH_BLOCK_SIZE;
+				l->blocks--;
+				continue;
+			}
+			if(l->tail_size > BATCH_BLOCK_SIZE) {
+				/* the first of two tail blocks is done, move the last one */
+				memmove(l->tail, l->tail + BATCH_BLOCK_SIZE, BATCH_BLOCK_SIZE);
+				l->tail_size = BATCH_BLOCK_SIZE;
+				continue;
+			}
+			for(j = 0; j < algo->digest_size / 4; j++) {
+				uint32_t word = state[j * lanes + k];
+				word = (algo->big_endian ? be2me_32(word) : le2me_32(word));
+				memcpy(out + l->index * algo->digest_size + j * 4, &word, 4);
+			}
+			l->index = (size_t)-1;
+			active--;
+		}
+	}
+}
+#endif /* USE_BATCH_SSE2 */
+
+/**
+ * Return the minimal number of messages, which rhash_msg_batch() hashes
+ * faster than the implementation selected for the algorithm hashes them
+ * one by one. Used by the algorithms, hashing independent blocks of a
+ * message, like AICH and BTIH.
+ *
+ * @param hash_id id of the hash algorithm
+ * @return the minimal number of messages, 0 if hashing one by one is faster
+ */
+size_t rhash_batch_min_count(unsigned hash_id)
+{
+#ifdef USE_BATCH_SSE2
+	const char* impl;
+	size_t i;
+	if(!HAS_CPU_FEATURES(RHASH_CPU_SSE2)) return 0;
+	for(i = 0; i < sizeof(batch_algorithms) / sizeof(*batch_algorithms); i++) {
+		if(batch_algorithms[i].hash_id == hash_id) break;
+	}
+	if(i == sizeof(batch_algorithms) / sizeof(*batch_algorithms)) return 0;
+
+	/* the SHA extensions hash one message as fast as 8 AVX2 lanes */
+	impl = rhash_get_impl(hash_id);
+	if(strcmp(impl, "shani") == 0 || strcmp(impl, "openssl") == 0) return 0;
+	/* 3 messages in 4 SSE2 lanes outrun the fastest single-buffer code */
+	return 3;
+#else
+	(void)hash_id;
+	return 0;
+#endif
+}
+
+/**
+ * Compute a message digest of each of the given messages.
+ * MD5, SHA1, SHA-224 and SHA-256 are computed for several messages at once,
+ * using SIMD instructions, other algorithms are computed one by one.
+ * The results are identical to calling rhash_msg() for each message.
+ *
+ * @param hash_id id of the hash algorithm, only one algorithm can be specified
+ * @param msgs the array of messages to hash
+ * @param lens the array of message lengths
+ * @param count the number of messages
+ * @param out the buffer to receive count message digests, stored one after another
+ * @return 0 on success, -1 on error
+ */
+RHASH_API int rhash_msg_batch(unsigned hash_id, const void* msgs[], const size_t lens[], size_t count, unsigned char* out)
+{
+	int digest_size;
+	size_t i;
+
+	hash_id &= RHASH_ALL_HASHES;
+	if(hash_id == 0 || (hash_id & (hash_id - 1)) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+#ifdef USE_BATCH_SSE2
+	if(count > 1) {
+		for(i = 0; i < sizeof(batch_algorithms) / sizeof(*batch_algorithms); i++) {
+			const batch_algorithm* algo = &batch_algorithms[i];
+			if(algo->hash_id != hash_id) continue;
+# ifdef USE_BATCH_AVX2
+			if(count > 4 && HAS_CPU_FEATURES(RHASH_CPU_AVX2)) {
+				batch_hash(algo, algo->avx2, 8, msgs, lens, count, out);
+				return 0;
+			}
+# endif
+			batch_hash(algo, algo->sse2, 4, msgs, lens, count, out);
+			return 0;
+		}
+	}
+#endif
+
+	/* no multi-buffer kernel for the algorithm, hash messages one by one */
+	digest_size = rhash_get_digest_size(hash_id);
+	for(i = 0; i < count; i++) {
+		if(rhash_msg(hash_id, msgs[i], lens[i], out + i * digest_size) < 0) return -1;
+	}
+	return 0;
+}
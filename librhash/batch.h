@@ -0,0 +1,16 @@
+/* batch.h - multi-buffer hashing of many messages */
+#ifndef BATCH_H
+#define BATCH_H
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t rhash_batch_min_count(unsigned hash_id);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* BATCH_H */
@@ -0,0 +1,220 @@
+/* batch_simd.h - multi-buffer MD5, SHA1 and SHA-256 compression functions
+ *
+ * The file is a template, included by batch.c once for every vector
+ * instruction set. Before including it, the following macros must be set:
+ *   LANES - the number of 32-bit lanes in a vector
+ *   vec_t - the vector type
+ *   V_LOAD(p), V_SET1(x) - load an aligned vector, broadcast a 32-bit value
+ *   V_ADD(a, b), V_XOR(a, b), V_AND(a, b), V_OR(a, b) - lane-wise operations
+ *   V_SHL(a, n), V_SHR(a, n) - lane-wise logical shifts
+ *   V_STORE(p, v) - store a vector to an aligned address
+ *   KERNEL(name) - the name of a compression function for the instruction set
+ *   KERNEL_ATTR - function attributes, enabling the instruction set
+ *
+ * Every compression function processes one 64-byte block in each lane.
+ * The state and message words are interleaved by lanes: the j-th word
+ * of the k-th lane is stored at index j * LANES + k.
+ */
+
+#define V_ROL(x, n) V_OR(V_SHL(x, n), V_SHR(x, 32 - (n)))
+#define V_ROR(x, n) V_OR(V_SHR(x, n), V_SHL(x, 32 - (n)))
+#define V_NOT(x) V_XOR(x, V_SET1(0xFFFFFFFF))
+#define V_W(j) V_LOAD(w + (j) * LANES)
+
+/* MD5 */
+#define MB_MD5_F(x, y, z) V_XOR(V_AND(V_XOR(y, z), x), z)
+#define MB_MD5_G(x, y, z) V_XOR(V_AND(V_XOR(x, y), z), y)
+#define MB_MD5_H(x, y, z) V_XOR(V_XOR(x, y), z)
+#define MB_MD5_I(x, y, z) V_XOR(y, V_OR(x, V_NOT(z)))
+#define MB_MD5_STEP(f, a, b, c, d, j, s, ac) \
+	a = V_ADD(V_ROL(V_ADD(V_ADD(a, f(b, c, d)), V_ADD(V_W(j), V_SET1(ac))), s), b)
+
+/**
+ * Process one MD5 block in every lane.
+ *
+ * @param state the interleaved algorithm states
+ * @param w the interleaved message words
+ */
+static KERNEL_ATTR void KERNEL(md5)(uint32_t* state, const uint32_t* w)
+{
+	vec_t a = V_LOAD(state), b = V_LOAD(state + LANES);
+	vec_t c = V_LOAD(state + 2 * LANES), d = V_LOAD(state + 3 * LANES);
+
+	MB_MD5_STEP(MB_MD5_F, a, b, c, d,  0,  7, 0xd76aa478);
+	MB_MD5_STEP(MB_MD5_F, d, a, b, c,  1, 12, 0xe8c7b756);
+	MB_MD5_STEP(MB_MD5_F, c, d, a, b,  2, 17, 0x242070db);
+	MB_MD5_STEP(MB_MD5_F, b, c, d, a,  3, 22, 0xc1bdceee);
+	MB_MD5_STEP(MB_MD5_F, a, b, c, d,  4,  7, 0xf57c0faf);
+	MB_MD5_STEP(MB_MD5_F, d, a, b, c,  5, 12, 0x4787c62a);
+	MB_MD5_STEP(MB_MD5_F, c, d, a, b,  6, 17, 0xa8304613);
+	MB_MD5_STEP(MB_MD5_F, b, c, d, a,  7, 22, 0xfd469501);
+	MB_MD5_STEP(MB_MD5_F, a, b, c, d,  8,  7, 0x698098d8);
+	MB_MD5_STEP(MB_MD5_F, d, a, b, c,  9, 12, 0x8b44f7af);
+	MB_MD5_STEP(MB_MD5_F, c, d, a, b, 10, 17, 0xffff5bb1);
+	MB_MD5_STEP(MB_MD5_F, b, c, d, a, 11, 22, 0x895cd7be);
+	MB_MD5_STEP(MB_MD5_F, a, b, c, d, 12,  7, 0x6b901122);
+	MB_MD5_STEP(MB_MD5_F, d, a, b, c, 13, 12, 0xfd987193);
+	MB_MD5_STEP(MB_MD5_F, c, d, a, b, 14, 17, 0xa679438e);
+	MB_MD5_STEP(MB_MD5_F, b, c, d, a, 15, 22, 0x49b40821);
+
+	MB_MD5_STEP(MB_MD5_G, a, b, c, d,  1,  5, 0xf61e2562);
+	MB_MD5_STEP(MB_MD5_G, d, a, b, c,  6,  9, 0xc040b340);
+	MB_MD5_STEP(MB_MD5_G, c, d, a, b, 11, 14, 0x265e5a51);
+	MB_MD5_STEP(MB_MD5_G, b, c, d, a,  0, 20, 0xe9b6c7aa);
+	MB_MD5_STEP(MB_MD5_G, a, b, c, d,  5,  5, 0xd62f105d);
+	MB_MD5_STEP(MB_MD5_G, d, a, b, c, 10,  9, 0x02441453);
+	MB_MD5_STEP(MB_MD5_G, c, d, a, b, 15, 14, 0xd8a1e681);
+	MB_MD5_STEP(MB_MD5_G, b, c, d, a,  4, 20, 0xe7d3fbc8);
+	MB_MD5_STEP(MB_MD5_G, a, b, c, d,  9,  5, 0x21e1cde6);
+	MB_MD5_STEP(MB_MD5_G, d, a, b, c, 14,  9, 0xc33707d6);
+	MB_MD5_STEP(MB_MD5_G, c, d, a, b,  3, 14, 0xf4d50d87);
+	MB_MD5_STEP(MB_MD5_G, b, c, d, a,  8, 20, 0x455a14ed);
+	MB_MD5_STEP(MB_MD5_G, a, b, c, d, 13,  5, 0xa9e3e905);
+	MB_MD5_STEP(MB_MD5_G, d, a, b, c,  2,  9, 0xfcefa3f8);
+	MB_MD5_STEP(MB_MD5_G, c, d, a, b,  7, 14, 0x676f02d9);
+	MB_MD5_STEP(MB_MD5_G, b, c, d, a, 12, 20, 0x8d2a4c8a);
+
+	MB_MD5_STEP(MB_MD5_H, a, b, c, d,  5,  4, 0xfffa3942);
+	MB_MD5_STEP(MB_MD5_H, d, a, b, c,  8, 11, 0x8771f681);
+	MB_MD5_STEP(MB_MD5_H, c, d, a, b, 11, 16, 0x6d9d6122);
+	MB_MD5_STEP(MB_MD5_H, b, c, d, a, 14, 23, 0xfde5380c);
+	MB_MD5_STEP(MB_MD5_H, a, b, c, d,  1,  4, 0xa4beea44);
+	MB_MD5_STEP(MB_MD5_H, d, a, b, c,  4, 11, 0x4bdecfa9);
+	MB_MD5_STEP(MB_MD5_H, c, d, a, b,  7, 16, 0xf6bb4b60);
+	MB_MD5_STEP(MB_MD5_H, b, c, d, a, 10, 23, 0xbebfbc70);
+	MB_MD5_STEP(MB_MD5_H, a, b, c, d, 13,  4, 0x289b7ec6);
+	MB_MD5_STEP(MB_MD5_H, d, a, b, c,  0, 11, 0xeaa127fa);
+	MB_MD5_STEP(MB_MD5_H, c, d, a, b,  3, 16, 0xd4ef3085);
+	MB_MD5_STEP(MB_MD5_H, b, c, d, a,  6, 23, 0x04881d05);
+	MB_MD5_STEP(MB_MD5_H, a, b, c, d,  9,  4, 0xd9d4d039);
+	MB_MD5_STEP(MB_MD5_H, d, a, b, c, 12, 11, 0xe6db99e5);
+	MB_MD5_STEP(MB_MD5_H, c, d, a, b, 15, 16, 0x1fa27cf8);
+	MB_MD5_STEP(MB_MD5_H, b, c, d, a,  2, 23, 0xc4ac5665);
+
+	MB_MD5_STEP(MB_MD5_I, a, b, c, d,  0,  6, 0xf4292244);
+	MB_MD5_STEP(MB_MD5_I, d, a, b, c,  7, 10, 0x432aff97);
+	MB_MD5_STEP(MB_MD5_I, c, d, a, b, 14, 15, 0xab9423a7);
+	MB_MD5_STEP(MB_MD5_I, b, c, d, a,  5, 21, 0xfc93a039);
+	MB_MD5_STEP(MB_MD5_I, a, b, c, d, 12,  6, 0x655b59c3);
+	MB_MD5_STEP(MB_MD5_I, d, a, b, c,  3, 10, 0x8f0ccc92);
+	MB_MD5_STEP(MB_MD5_I, c, d, a, b, 10, 15, 0xffeff47d);
+	MB_MD5_STEP(MB_MD5_I, b, c, d, a,  1, 21, 0x85845dd1);
+	MB_MD5_STEP(MB_MD5_I, a, b, c, d,  8,  6, 0x6fa87e4f);
+	MB_MD5_STEP(MB_MD5_I, d, a, b, c, 15, 10, 0xfe2ce6e0);
+	MB_MD5_STEP(MB_MD5_I, c, d, a, b,  6, 15, 0xa3014314);
+	MB_MD5_STEP(MB_MD5_I, b, c, d, a, 13, 21, 0x4e0811a1);
+	MB_MD5_STEP(MB_MD5_I, a, b, c, d,  4,  6, 0xf7537e82);
+	MB_MD5_STEP(MB_MD5_I, d, a, b, c, 11, 10, 0xbd3af235);
+	MB_MD5_STEP(MB_MD5_I, c, d, a, b,  2, 15, 0x2ad7d2bb);
+	MB_MD5_STEP(MB_MD5_I, b, c, d, a,  9, 21, 0xeb86d391);
+
+	V_STORE(state, V_ADD(V_LOAD(state), a));
+	V_STORE(state + LANES, V_ADD(V_LOAD(state + LANES), b));
+	V_STORE(state + 2 * LANES, V_ADD(V_LOAD(state + 2 * LANES), c));
+	V_STORE(state + 3 * LANES, V_ADD(V_LOAD(state + 3 * LANES), d));
+}
+
+/**
+ * Process one SHA1 block in every lane.
+ *
+ * @param state the interleaved algorithm states
+ * @param w the interleaved message words
+ */
+static KERNEL_ATTR void KERNEL(sha1)(uint32_t* state, const uint32_t* w)
+{
+	vec_t W[16];
+	vec_t A = V_LOAD(state), B = V_LOAD(state + LANES), C = V_LOAD(state + 2 * LANES);
+	vec_t D = V_LOAD(state + 3 * LANES), E = V_LOAD(state + 4 * LANES);
+	vec_t temp, f, k;
+	int t;
+
+	for(t = 0; t < 80; t++) {
+		if(t < 16) {
+			W[t] = V_W(t);
+		} else {
+			W[t & 15] = V_ROL(V_XOR(V_XOR(W[(t - 3) & 15], W[(t - 8) & 15]),
+				V_XOR(W[(t - 14) & 15], W[t & 15])), 1);
+		}
+
+		if(t < 20) {
+			f = V_XOR(V_AND(V_XOR(C, D), B), D);
+			k = V_SET1(0x5A827999);
+		} else if(t < 40) {
+			f = V_XOR(V_XOR(B, C), D);
+			k = V_SET1(0x6ED9EBA1);
+		} else if(t < 60) {
+			f = V_OR(V_AND(B, C), V_AND(D, V_OR(B, C)));
+			k = V_SET1(0x8F1BBCDC);
+		} else {
+			f = V_XOR(V_XOR(B, C), D);
+			k = V_SET1(0xCA62C1D6);
+		}
+		temp = V_ADD(V_ADD(V_ROL(A, 5), f), V_ADD(V_ADD(E, W[t & 15]), k));
+		E = D;
+		D = C;
+		C = V_ROL(B, 30);
+		B = A;
+		A = temp;
+	}
+
+	V_STORE(state, V_ADD(V_LOAD(state), A));
+	V_STORE(state + LANES, V_ADD(V_LOAD(state + LANES), B));
+	V_STORE(state + 2 * LANES, V_ADD(V_LOAD(state + 2 * LANES), C));
+	V_STORE(state + 3 * LANES, V_ADD(V_LOAD(state + 3 * LANES), D));
+	V_STORE(state + 4 * LANES, V_ADD(V_LOAD(state + 4 * LANES), E));
+}
+
+/**
+ * Process one SHA-256 block in every lane.
+ *
+ * @param state the interleaved algorithm states
+ * @param w the interleaved message words
+ */
+static KERNEL_ATTR void KERNEL(sha256)(uint32_t* state, const uint32_t* w)
+{
+	vec_t W[16], S[8];
+	int t, i;
+
+	for(i = 0; i < 8; i++) S[i] = V_LOAD(state + i * LANES);
+
+	for(t = 0; t < 64; t++) {
+		vec_t T1, T2;
+		vec_t a = S[(64 - t) & 7], b = S[(65 - t) & 7], c = S[(66 - t) & 7];
+		vec_t e = S[(68 - t) & 7], f = S[(69 - t) & 7], g = S[(70 - t) & 7];
+
+		if(t < 16) {
+			W[t] = V_W(t);
+		} else {
+			vec_t w2 = W[(t - 2) & 15], w15 = W[(t - 15) & 15];
+			vec_t s0 = V_XOR(V_XOR(V_ROR(w15, 7), V_ROR(w15, 18)), V_SHR(w15, 3));
+			vec_t s1 = V_XOR(V_XOR(V_ROR(w2, 17), V_ROR(w2, 19)), V_SHR(w2, 10));
+			W[t & 15] = V_ADD(V_ADD(W[t & 15], s0), V_ADD(W[(t - 7) & 15], s1));
+		}
+
+		/* T1 = h + Sigma1(e) + Ch(e,f,g) + K[t] + W[t] */
+		T1 = V_ADD(S[(71 - t) & 7], V_XOR(V_XOR(V_ROR(e, 6), V_ROR(e, 11)), V_ROR(e, 25)));
+		T1 = V_ADD(T1, V_XOR(g, V_AND(e, V_XOR(f, g))));
+		T1 = V_ADD(T1, V_ADD(V_SET1(rhash_batch_k256[t]), W[t & 15]));
+		/* T2 = Sigma0(a) + Maj(a,b,c) */
+		T2 = V_XOR(V_XOR(V_ROR(a, 2), V_ROR(a, 13)), V_ROR(a, 22));
+		T2 = V_ADD(T2, V_XOR(V_AND(a, b), V_AND(c, V_XOR(a, b))));
+
+		/* rotate the state by renaming: d += T1, h = T1 + T2 */
+		S[(67 - t) & 7] = V_ADD(S[(67 - t) & 7], T1);
+		S[(71 - t) & 7] = V_ADD(T1, T2);
+	}
+
+	for(i = 0; i < 8; i++) {
+		V_STORE(state + i * LANES, V_ADD(V_LOAD(state + i * LANES), S[(i + 64) & 7]));
+	}
+}
+
+#undef V_ROL
+#undef V_ROR
+#undef V_NOT
+#undef V_W
+#undef MB_MD5_F
+#undef MB_MD5_G
+#undef MB_MD5_H
+#undef MB_MD5_I
+#undef MB_MD5_STEP
@@ -0,0 +1,163 @@
+/* cpu_features.c - runtime detection of CPU instruction sets
+ *
+ * Copyright: 2013 Aleksey Kravchenko <rhash.admin@gmail.com>
+ *
+ * Permission is hereby granted,  free of charge,  to any person  obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction,  including without limitation
+ * the rights to  use, copy, modify,  merge, publish, distribute, sublicense,
+ * and/or sell copies  of  the Software,  and to permit  persons  to whom the
+ * Software is furnished to do so.
+ *
+ * This program  is  distributed  in  the  hope  that it will be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  Use this program  at  your own risk!
+ */
+#include <string.h>
+#include "byte_order.h"
+#include "cpu_features.h"
+#include "util.h"
+
+#if defined(CPU_X64) || defined(CPU_IA32)
+# if defined(_MSC_VER)
+#  include <intrin.h> /* __cpuid(), __cpuidex() */
+#  define USE_CPUID
+# elif defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4))
+#  include <cpuid.h> /* __get_cpuid(), __cpuid_count() */
+#  define USE_CPUID
+# endif
+#endif
+
+/* the features detected on the first call, ~0 means not detected yet */
+static rhash_atomic_t cpu_features = ~0u;
+/* the features allowed to be used by the library */
+static rhash_atomic_t cpu_features_mask = ~0u;
+
+#ifdef USE_CPUID
+/**
+ * Execute the CPUID instruction.
+ *
+ * @param leaf the CPUID leaf
+ * @param subleaf the CPUID subleaf
+ * @param regs the array to receive the EAX, EBX, ECX and EDX registers
+ */
+static void rhash_cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/**
+ * Read the extended control register XCR0, describing
+ * the CPU registers saved by the operating system.
+ *
+ * @return the value of XCR0
+ */
+static unsigned rhash_xgetbv(void)
+{
+#ifdef _MSC_VER
+	return (unsigned)_xgetbv(0);
+#else
+	unsigned eax, edx;
+	__asm__ volatile(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0)); /* xgetbv */
+	return eax;
+#endif
+}
+
+/**
+ * Detect the instruction sets supported by the CPU and the operating system.
+ *
+ * @return bit mask of RHASH_CPU_* flags
+ */
+static unsigned rhash_detect_cpu_features(void)
+{
+	unsigned regs[4], max_leaf, xcr0 = 0;
+	unsigned features = 0;
+
+	rhash_cpuid(0, 0, regs);
+	max_leaf = regs[0];
+	if(max_leaf < 1) return 0;
+
+	rhash_cpuid(1, 0, regs);
+	if(regs[3] & (1u << 26)) features |= RHASH_CPU_SSE2;
+	if(regs[2] & (1u << 9))  features |= RHASH_CPU_SSSE3;
+	if(regs[2] & (1u << 19)) features |= RHASH_CPU_SSE41;
+	if(regs[2] & (1u << 1))  features |= RHASH_CPU_PCLMUL;
+	/* the OS must save the YMM registers to use AVX */
+	if(regs[2] & (1u << 27)) xcr0 = rhash_xgetbv();
+	if((regs[2] & (1u << 28)) && (xcr0 & 6) == 6) features |= RHASH_CPU_AVX;
+
+	if(max_leaf >= 7) {
+		rhash_cpuid(7, 0, regs);
+		if((features & RHASH_CPU_AVX) && (regs[1] & (1u << 5))) features |= RHASH_CPU_AVX2;
+		/* AVX-512 also requires saving of the opmask and ZMM registers */
+		if((features & RHASH_CPU_AVX) && (regs[1] & (1u << 16)) && (xcr0 & 0xE0) == 0xE0) {
+			features |= RHASH_CPU_AVX512;
+			if((regs[1] & (1u << 30)) && (regs[2] & (1u << 1))) features |= RHASH_CPU_AVX512VBMI;
+		}
+		if(regs[2] & (1u << 8))  features |= RHASH_CPU_GFNI;
+		if(regs[1] & (1u << 8))  features |= RHASH_CPU_BMI2;
+		if(regs[1] & (1u << 29)) features |= RHASH_CPU_SHA;
+	}
+	return features;
+}
+#else
+# define rhash_detect_cpu_features() 0
+#endif /* USE_CPUID */
+
+/**
+ * Return the CPU instruction sets, which can be used by the library.
+ * The CPU is examined on the first call.
+ *
+ * @return bit mask of RHASH_CPU_* flags
+ */
+unsigned rhash_cpu_features(void)
+{
+	/* note: concurrent detection is harmless, it gives the same result */
+	unsigned features = rhash_atomic_load(&cpu_features);
+	if(features == ~0u) {
+		features = rhash_detect_cpu_features();
+		rhash_atomic_store(&cpu_features, features);
+	}
+	return features & rhash_atomic_load(&cpu_features_mask);
+}
+
+/**
+ * Restrict the CPU instruction sets, used by the library.
+ *
+ * @param mask bit mask of RHASH_CPU_* flags allowed to use
+ */
+void rhash_set_cpu_features_mask(unsigned mask)
+{
+	rhash_atomic_store(&cpu_features_mask, mask);
+}
+
+/**
+ * Get the CPU model name, reported by the processor.
+ *
+ * @param model the buffer to receive the model name
+ * @param size the buffer size, 49 bytes are enough for any model name
+ */
+void rhash_get_cpu_model(char* model, size_t size)
+{
+	const char* name = "unknown";
+#ifdef USE_CPUID
+	unsigned regs[13];
+	rhash_cpuid(0x80000000, 0, regs);
+	if(regs[0] >= 0x80000004) {
+		rhash_cpuid(0x80000002, 0, regs);
+		rhash_cpuid(0x80000003, 0, regs + 4);
+		rhash_cpuid(0x80000004, 0, regs + 8);
+		regs[12] = 0;
+		/* the brand string can be padded by leading spaces */
+		for(name = (const char*)regs; *name == ' '; name++);
+		if(!*name) name = "unknown";
+	}
+#endif /* USE_CPUID */
+	if(size == 0) return;
+	strncpy(model, name, size - 1);
+	model[size - 1] = '\0';
+}
@@ -0,0 +1,23 @@
+/* cpu_features.h - runtime detection of CPU instruction sets */
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <stddef.h>
+#include "rhash.h" /* RHASH_CPU_* constants */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned rhash_cpu_features(void);
+void rhash_set_cpu_features_mask(unsigned mask);
+void rhash_get_cpu_model(char* model, size_t size);
+
+/* check if all given instruction sets can be used */
+#define HAS_CPU_FEATURES(features) ((rhash_cpu_features() & (features)) == (features))
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* CPU_FEATURES_H */
@@ -11,6 +11,19 @@ extern "C" {
 unsigned rhash_get_crc32(unsigned crcinit, const unsigned char* msg, size_t size);
 unsigned rhash_get_crc32_str(unsigned crcinit, const char* str);
 
+/* the slicing-by-8 tables */
+#ifdef GENERATE_CRC32_TABLE
+extern unsigned rhash_crc32_table[8][256];
+#else
+extern const unsigned rhash_crc32_table[8][256];
+#endif
+
+#if (defined(CPU_X64) || defined(CPU_IA32)) && ((defined(_MSC_VER) && _MSC_VER >= 1500) || \
+	(defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4))))
+# define USE_CRC32_PCLMUL
+unsigned rhash_get_crc32_pclmul(unsigned crcinit, const unsigned char* msg, size_t size);
+#endif
+
 #ifdef GENERATE_CRC32_TABLE
 void rhash_crc32_init_table(void); /* initialize algorithm static data */
 #endif
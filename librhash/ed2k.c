@@ -116,3 +116,46 @@ void rhash_ed2k_final(ed2k_ctx *ctx, unsigned char result[16])
 		if(result) rhash_md4_final(&ctx->md4_context_inner, result);
 	}
 }
+
+/**
+ * Return the size of a message chunk, which can be hashed independently
+ * by rhash_ed2k_hash_chunk(), if the context is at a chunk boundary.
+ *
+ * @param ctx the algorithm context
+ * @return the chunk size, or 0 if the context is not at a chunk boundary
+ */
+size_t rhash_ed2k_chunk_size(ed2k_ctx *ctx)
+{
+	/* note: eDonkey algorithm handles the last full chunk differently */
+	return (ctx->md4_context_inner.length == 0 && !ctx->not_emule ? ED2K_CHUNK_SIZE : 0);
+}
+
+/**
+ * Calculate the MD4 hash of a message chunk.
+ * The function doesn't modify the context, so it can be called
+ * by several threads at once.
+ *
+ * @param ctx the algorithm context
+ * @param msg the message chunk
+ * @param size the chunk size, as returned by rhash_ed2k_chunk_size()
+ * @param result the buffer to receive the chunk hash
+ */
+void rhash_ed2k_hash_chunk(ed2k_ctx *ctx, const unsigned char* msg, size_t size, unsigned char result[16])
+{
+	md4_ctx md4;
+	(void)ctx;
+	rhash_md4_init(&md4);
+	rhash_md4_update(&md4, msg, size);
+	rhash_md4_final(&md4, result);
+}
+
+/**
+ * Add the hash of the next message chunk.
+ *
+ * @param ctx the algorithm context
+ * @param result the chunk hash, calculated by rhash_ed2k_hash_chunk()
+ */
+void rhash_ed2k_add_chunk(ed2k_ctx *ctx, const unsigned char result[16])
+{
+	rhash_md4_update(&ctx->md4_context, result, 16);
+}
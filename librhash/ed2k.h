@@ -21,6 +21,11 @@ void rhash_ed2k_init(ed2k_ctx *ctx);
 void rhash_ed2k_update(ed2k_ctx *ctx, const unsigned char* msg, size_t size);
 void rhash_ed2k_final(ed2k_ctx *ctx, unsigned char result[16]);
 
+/* hashing of ed2k chunks of a message by several threads */
+size_t rhash_ed2k_chunk_size(ed2k_ctx *ctx);
+void rhash_ed2k_hash_chunk(ed2k_ctx *ctx, const unsigned char* msg, size_t size, unsigned char result[16]);
+void rhash_ed2k_add_chunk(ed2k_ctx *ctx, const unsigned char result[16]);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
@@ -20,8 +20,13 @@
 #include "byte_order.h"
 #include "gost.h"
 
+#ifdef GENERATE_GOST_LOOKUP_TABLE
 extern unsigned rhash_gost_sbox[4][256];
 extern unsigned rhash_gost_sbox_cryptpro[4][256];
+#else
+extern const unsigned rhash_gost_sbox[4][256];
+extern const unsigned rhash_gost_sbox_cryptpro[4][256];
+#endif
 
 /**
  * Initialize algorithm context before calculaing hash
@@ -51,6 +56,13 @@ void rhash_gost_cryptopro_init(gost_ctx *ctx)
 # define USE_GCC_ASM_X64
 #endif
 
+#ifdef USE_GOST_X64
+# include <emmintrin.h>
+#endif
+
+/* the compression function, processing a 256-bit block */
+typedef void (*gost_compress_t)(gost_ctx *ctx, const unsigned* block);
+
 /*
  *  A macro that performs a full encryption round of GOST 28147-89.
  *  Temporary variables tmp assumed and variables r and l for left and right
@@ -111,6 +123,77 @@ void rhash_gost_cryptopro_init(gost_ctx *ctx)
 	ENC_ASM(12, 11) ENC_ASM(10,  9) ENC_ASM( 8,  7) ENC_ASM( 6,  5)
 #endif /* USE_GCC_ASM_IA32 */
 
+/**
+ * The mixing step of the compression function:
+ * hash := psi^61(hash xor psi(block xor psi^12(S))).
+ *
+ * @param ctx algorithm context, containing the hash to update
+ * @param block the message block being processed
+ * @param s the hash encrypted by the four generated keys
+ */
+static void rhash_gost_mix(gost_ctx *ctx, const unsigned* block, const unsigned* s)
+{
+	unsigned u[8], v[8];
+
+
+	/* 12 rounds of the LFSR and xor in <message block> */
+	u[0] = block[0] ^ s[6];
+	u[1] = block[1] ^ s[7];
+	u[2] = block[2] ^ (s[0] << 16) ^ (s[0] >> 16) ^ (s[0] & 0xffff) ^ (s[1] & 0xffff) ^ (s[1] >> 16) ^ (s[2] << 16) ^ s[6] ^ (s[6] << 16) ^ (s[7] & 0xffff0000) ^ (s[7] >> 16);
+	u[3] = block[3] ^ (s[0] & 0xffff) ^ (s[0] << 16) ^ (s[1] & 0xffff) ^ (s[1] << 16) ^ (s[1] >> 16) ^
+		(s[2] << 16) ^ (s[2] >> 16) ^ (s[3] << 16) ^ s[6] ^ (s[6] << 16) ^ (s[6] >> 16) ^ (s[7] & 0xffff) ^ (s[7] << 16) ^ (s[7] >> 16);
+	u[4] = block[4] ^ (s[0] & 0xffff0000) ^ (s[0] << 16) ^ (s[0] >> 16) ^
+		(s[1] & 0xffff0000) ^ (s[1] >> 16) ^ (s[2] << 16) ^ (s[2] >> 16) ^ (s[3] << 16) ^ (s[3] >> 16) ^ (s[4] << 16) ^ (s[6] << 16) ^ (s[6] >> 16) ^ (s[7] & 0xffff) ^ (s[7] << 16) ^ (s[7] >> 16);
+	u[5] = block[5] ^ (s[0] << 16) ^ (s[0] >> 16) ^ (s[0] & 0xffff0000) ^
+		(s[1] & 0xffff) ^ s[2] ^ (s[2] >> 16) ^ (s[3] << 16) ^ (s[3] >> 16) ^ (s[4] << 16) ^ (s[4] >> 16) ^ (s[5] << 16) ^ (s[6] << 16) ^ (s[6] >> 16) ^ (s[7] & 0xffff0000) ^ (s[7] << 16) ^ (s[7] >> 16);
+	u[6] = block[6] ^ s[0] ^ (s[1] >> 16) ^ (s[2] << 16) ^ s[3] ^ (s[3] >> 16)
+		^ (s[4] << 16) ^ (s[4] >> 16) ^ (s[5] << 16) ^ (s[5] >> 16) ^ s[6] ^ (s[6] << 16) ^ (s[6] >> 16) ^ (s[7] << 16);
+	u[7] = block[7] ^ (s[0] & 0xffff0000) ^ (s[0] << 16) ^ (s[1] & 0xffff) ^
+		(s[1] << 16) ^ (s[2] >> 16) ^ (s[3] << 16) ^ s[4] ^ (s[4] >> 16) ^ (s[5] << 16) ^ (s[5] >> 16) ^ (s[6] >> 16) ^ (s[7] & 0xffff) ^ (s[7] << 16) ^ (s[7] >> 16);
+
+	/* 1 round of the LFSR (a mixing transformation) and xor with <hash> */
+	v[0] = ctx->hash[0] ^ (u[1] << 16) ^ (u[0] >> 16);
+	v[1] = ctx->hash[1] ^ (u[2] << 16) ^ (u[1] >> 16);
+	v[2] = ctx->hash[2] ^ (u[3] << 16) ^ (u[2] >> 16);
+	v[3] = ctx->hash[3] ^ (u[4] << 16) ^ (u[3] >> 16);
+	v[4] = ctx->hash[4] ^ (u[5] << 16) ^ (u[4] >> 16);
+	v[5] = ctx->hash[5] ^ (u[6] << 16) ^ (u[5] >> 16);
+	v[6] = ctx->hash[6] ^ (u[7] << 16) ^ (u[6] >> 16);
+	v[7] = ctx->hash[7] ^ (u[0] & 0xffff0000) ^ (u[0] << 16) ^ (u[1] & 0xffff0000) ^ (u[1] << 16) ^ (u[6] << 16) ^ (u[7] & 0xffff0000) ^ (u[7] >> 16);
+
+	/* 61 rounds of LFSR, mixing up hash */
+	ctx->hash[0] = (v[0] & 0xffff0000) ^ (v[0] << 16) ^ (v[0] >> 16) ^
+		(v[1] >> 16) ^ (v[1] & 0xffff0000) ^ (v[2] << 16) ^
+		(v[3] >> 16) ^ (v[4] << 16) ^ (v[5] >> 16) ^ v[5] ^
+		(v[6] >> 16) ^ (v[7] << 16) ^ (v[7] >> 16) ^ (v[7] & 0xffff);
+	ctx->hash[1] = (v[0] << 16) ^ (v[0] >> 16) ^ (v[0] & 0xffff0000) ^
+		(v[1] & 0xffff) ^ v[2] ^ (v[2] >> 16) ^ (v[3] << 16) ^
+		(v[4] >> 16) ^ (v[5] << 16) ^ (v[6] << 16) ^ v[6] ^
+		(v[7] & 0xffff0000) ^ (v[7] >> 16);
+	ctx->hash[2] = (v[0] & 0xffff) ^ (v[0] << 16) ^ (v[1] << 16) ^
+		(v[1] >> 16) ^ (v[1] & 0xffff0000) ^ (v[2] << 16) ^ (v[3] >> 16) ^
+		v[3] ^ (v[4] << 16) ^ (v[5] >> 16) ^ v[6] ^ (v[6] >> 16) ^
+		(v[7] & 0xffff) ^ (v[7] << 16) ^ (v[7] >> 16);
+	ctx->hash[3] = (v[0] << 16) ^ (v[0] >> 16) ^ (v[0] & 0xffff0000) ^
+		(v[1] & 0xffff0000) ^ (v[1] >> 16) ^ (v[2] << 16) ^
+		(v[2] >> 16) ^ v[2] ^ (v[3] << 16) ^ (v[4] >> 16) ^ v[4] ^
+		(v[5] << 16) ^ (v[6] << 16) ^ (v[7] & 0xffff) ^ (v[7] >> 16);
+	ctx->hash[4] = (v[0] >> 16) ^ (v[1] << 16) ^ v[1] ^ (v[2] >> 16) ^ v[2] ^
+		(v[3] << 16) ^ (v[3] >> 16) ^ v[3] ^ (v[4] << 16) ^
+		(v[5] >> 16) ^ v[5] ^ (v[6] << 16) ^ (v[6] >> 16) ^ (v[7] << 16);
+	ctx->hash[5] = (v[0] << 16) ^ (v[0] & 0xffff0000) ^ (v[1] << 16) ^
+		(v[1] >> 16) ^ (v[1] & 0xffff0000) ^ (v[2] << 16) ^ v[2] ^
+		(v[3] >> 16) ^ v[3] ^ (v[4] << 16) ^ (v[4] >> 16) ^ v[4] ^
+		(v[5] << 16) ^ (v[6] << 16) ^ (v[6] >> 16) ^ v[6] ^
+		(v[7] << 16) ^ (v[7] >> 16) ^ (v[7] & 0xffff0000);
+	ctx->hash[6] = v[0] ^ v[2] ^ (v[2] >> 16) ^ v[3] ^ (v[3] << 16) ^ v[4] ^
+		(v[4] >> 16) ^ (v[5] << 16) ^ (v[5] >> 16) ^ v[5] ^
+		(v[6] << 16) ^ (v[6] >> 16) ^ v[6] ^ (v[7] << 16) ^ v[7];
+	ctx->hash[7] = v[0] ^ (v[0] >> 16) ^ (v[1] << 16) ^ (v[1] >> 16) ^
+		(v[2] << 16) ^ (v[3] >> 16) ^ v[3] ^ (v[4] << 16) ^ v[4] ^
+		(v[5] >> 16) ^ v[5] ^ (v[6] << 16) ^ (v[6] >> 16) ^ (v[7] << 16) ^ v[7];
+}
+
 /**
  * The core transformation. Process a 512-bit block.
  *
@@ -121,7 +204,7 @@ static void rhash_gost_block_compress(gost_ctx *ctx, const unsigned* block)
 {
 	unsigned i;
 	unsigned key[8], u[8], v[8], w[8], s[8];
-	unsigned *sbox = (ctx->cryptpro ? (unsigned*)rhash_gost_sbox_cryptpro : (unsigned*)rhash_gost_sbox);
+	const unsigned *sbox = (ctx->cryptpro ? (const unsigned*)rhash_gost_sbox_cryptpro : (const unsigned*)rhash_gost_sbox);
 
 	/* u := hash, v := <256-bit message block> */
 	memcpy(u, ctx->hash, sizeof(u));
@@ -207,77 +290,133 @@ static void rhash_gost_block_compress(gost_ctx *ctx, const unsigned* block)
 		}
 	}
 
-	/* step hash function: x(block, hash) := psi^61(hash xor psi(block xor psi^12(S))) */
+	rhash_gost_mix(ctx, block, s);
+}
 
-	/* 12 rounds of the LFSR and xor in <message block> */
-	u[0] = block[0] ^ s[6];
-	u[1] = block[1] ^ s[7];
-	u[2] = block[2] ^ (s[0] << 16) ^ (s[0] >> 16) ^ (s[0] & 0xffff) ^ (s[1] & 0xffff) ^ (s[1] >> 16) ^ (s[2] << 16) ^ s[6] ^ (s[6] << 16) ^ (s[7] & 0xffff0000) ^ (s[7] >> 16);
-	u[3] = block[3] ^ (s[0] & 0xffff) ^ (s[0] << 16) ^ (s[1] & 0xffff) ^ (s[1] << 16) ^ (s[1] >> 16) ^
-		(s[2] << 16) ^ (s[2] >> 16) ^ (s[3] << 16) ^ s[6] ^ (s[6] << 16) ^ (s[6] >> 16) ^ (s[7] & 0xffff) ^ (s[7] << 16) ^ (s[7] >> 16);
-	u[4] = block[4] ^ (s[0] & 0xffff0000) ^ (s[0] << 16) ^ (s[0] >> 16) ^
-		(s[1] & 0xffff0000) ^ (s[1] >> 16) ^ (s[2] << 16) ^ (s[2] >> 16) ^ (s[3] << 16) ^ (s[3] >> 16) ^ (s[4] << 16) ^ (s[6] << 16) ^ (s[6] >> 16) ^ (s[7] & 0xffff) ^ (s[7] << 16) ^ (s[7] >> 16);
-	u[5] = block[5] ^ (s[0] << 16) ^ (s[0] >> 16) ^ (s[0] & 0xffff0000) ^
-		(s[1] & 0xffff) ^ s[2] ^ (s[2] >> 16) ^ (s[3] << 16) ^ (s[3] >> 16) ^ (s[4] << 16) ^ (s[4] >> 16) ^ (s[5] << 16) ^ (s[6] << 16) ^ (s[6] >> 16) ^ (s[7] & 0xffff0000) ^ (s[7] << 16) ^ (s[7] >> 16);
-	u[6] = block[6] ^ s[0] ^ (s[1] >> 16) ^ (s[2] << 16) ^ s[3] ^ (s[3] >> 16)
-		^ (s[4] << 16) ^ (s[4] >> 16) ^ (s[5] << 16) ^ (s[5] >> 16) ^ s[6] ^ (s[6] << 16) ^ (s[6] >> 16) ^ (s[7] << 16);
-	u[7] = block[7] ^ (s[0] & 0xffff0000) ^ (s[0] << 16) ^ (s[1] & 0xffff) ^
-		(s[1] << 16) ^ (s[2] >> 16) ^ (s[3] << 16) ^ s[4] ^ (s[4] >> 16) ^ (s[5] << 16) ^ (s[5] >> 16) ^ (s[6] >> 16) ^ (s[7] & 0xffff) ^ (s[7] << 16) ^ (s[7] >> 16);
+#ifdef USE_GOST_X64
+/* the lookup of the substitution table, joined with the 11-bit rotation */
+#define GOST_SUBST(sbox, x) ((sbox)[(x) & 0xff] ^ (sbox)[256 + (((x) >> 8) & 0xff)] ^ \
+	(sbox)[512 + (((x) >> 16) & 0xff)] ^ (sbox)[768 + ((x) >> 24)])
 
-	/* 1 round of the LFSR (a mixing transformation) and xor with <hash> */
-	v[0] = ctx->hash[0] ^ (u[1] << 16) ^ (u[0] >> 16);
-	v[1] = ctx->hash[1] ^ (u[2] << 16) ^ (u[1] >> 16);
-	v[2] = ctx->hash[2] ^ (u[3] << 16) ^ (u[2] >> 16);
-	v[3] = ctx->hash[3] ^ (u[4] << 16) ^ (u[3] >> 16);
-	v[4] = ctx->hash[4] ^ (u[5] << 16) ^ (u[4] >> 16);
-	v[5] = ctx->hash[5] ^ (u[6] << 16) ^ (u[5] >> 16);
-	v[6] = ctx->hash[6] ^ (u[7] << 16) ^ (u[6] >> 16);
-	v[7] = ctx->hash[7] ^ (u[0] & 0xffff0000) ^ (u[0] << 16) ^ (u[1] & 0xffff0000) ^ (u[1] << 16) ^ (u[6] << 16) ^ (u[7] & 0xffff0000) ^ (u[7] >> 16);
+/* a round of GOST 28147-89, applied to four independent blocks at once */
+#define GOST_ENCRYPT_ROUND4(k1, k2) \
+	tmp0 = key[0][k1] + r0, tmp1 = key[1][k1] + r1; \
+	tmp2 = key[2][k1] + r2, tmp3 = key[3][k1] + r3; \
+	l0 ^= GOST_SUBST(sbox, tmp0), l1 ^= GOST_SUBST(sbox, tmp1); \
+	l2 ^= GOST_SUBST(sbox, tmp2), l3 ^= GOST_SUBST(sbox, tmp3); \
+	tmp0 = key[0][k2] + l0, tmp1 = key[1][k2] + l1; \
+	tmp2 = key[2][k2] + l2, tmp3 = key[3][k2] + l3; \
+	r0 ^= GOST_SUBST(sbox, tmp0), r1 ^= GOST_SUBST(sbox, tmp1); \
+	r2 ^= GOST_SUBST(sbox, tmp2), r3 ^= GOST_SUBST(sbox, tmp3);
 
-	/* 61 rounds of LFSR, mixing up hash */
-	ctx->hash[0] = (v[0] & 0xffff0000) ^ (v[0] << 16) ^ (v[0] >> 16) ^
-		(v[1] >> 16) ^ (v[1] & 0xffff0000) ^ (v[2] << 16) ^
-		(v[3] >> 16) ^ (v[4] << 16) ^ (v[5] >> 16) ^ v[5] ^
-		(v[6] >> 16) ^ (v[7] << 16) ^ (v[7] >> 16) ^ (v[7] & 0xffff);
-	ctx->hash[1] = (v[0] << 16) ^ (v[0] >> 16) ^ (v[0] & 0xffff0000) ^
-		(v[1] & 0xffff) ^ v[2] ^ (v[2] >> 16) ^ (v[3] << 16) ^
-		(v[4] >> 16) ^ (v[5] << 16) ^ (v[6] << 16) ^ v[6] ^
-		(v[7] & 0xffff0000) ^ (v[7] >> 16);
-	ctx->hash[2] = (v[0] & 0xffff) ^ (v[0] << 16) ^ (v[1] << 16) ^
-		(v[1] >> 16) ^ (v[1] & 0xffff0000) ^ (v[2] << 16) ^ (v[3] >> 16) ^
-		v[3] ^ (v[4] << 16) ^ (v[5] >> 16) ^ v[6] ^ (v[6] >> 16) ^
-		(v[7] & 0xffff) ^ (v[7] << 16) ^ (v[7] >> 16);
-	ctx->hash[3] = (v[0] << 16) ^ (v[0] >> 16) ^ (v[0] & 0xffff0000) ^
-		(v[1] & 0xffff0000) ^ (v[1] >> 16) ^ (v[2] << 16) ^
-		(v[2] >> 16) ^ v[2] ^ (v[3] << 16) ^ (v[4] >> 16) ^ v[4] ^
-		(v[5] << 16) ^ (v[6] << 16) ^ (v[7] & 0xffff) ^ (v[7] >> 16);
-	ctx->hash[4] = (v[0] >> 16) ^ (v[1] << 16) ^ v[1] ^ (v[2] >> 16) ^ v[2] ^
-		(v[3] << 16) ^ (v[3] >> 16) ^ v[3] ^ (v[4] << 16) ^
-		(v[5] >> 16) ^ v[5] ^ (v[6] << 16) ^ (v[6] >> 16) ^ (v[7] << 16);
-	ctx->hash[5] = (v[0] << 16) ^ (v[0] & 0xffff0000) ^ (v[1] << 16) ^
-		(v[1] >> 16) ^ (v[1] & 0xffff0000) ^ (v[2] << 16) ^ v[2] ^
-		(v[3] >> 16) ^ v[3] ^ (v[4] << 16) ^ (v[4] >> 16) ^ v[4] ^
-		(v[5] << 16) ^ (v[6] << 16) ^ (v[6] >> 16) ^ v[6] ^
-		(v[7] << 16) ^ (v[7] >> 16) ^ (v[7] & 0xffff0000);
-	ctx->hash[6] = v[0] ^ v[2] ^ (v[2] >> 16) ^ v[3] ^ (v[3] << 16) ^ v[4] ^
-		(v[4] >> 16) ^ (v[5] << 16) ^ (v[5] >> 16) ^ v[5] ^
-		(v[6] << 16) ^ (v[6] >> 16) ^ v[6] ^ (v[7] << 16) ^ v[7];
-	ctx->hash[7] = v[0] ^ (v[0] >> 16) ^ (v[1] << 16) ^ (v[1] >> 16) ^
-		(v[2] << 16) ^ (v[3] >> 16) ^ v[3] ^ (v[4] << 16) ^ v[4] ^
-		(v[5] >> 16) ^ v[5] ^ (v[6] << 16) ^ (v[6] >> 16) ^ (v[7] << 16) ^ v[7];
+/**
+ * Key generation: key := P(w), the transposition of the bytes of w,
+ * calculated by SSE2 instructions.
+ *
+ * @param key the key to generate
+ * @param w 256-bit value to transform
+ */
+static void rhash_gost_p_transform(unsigned key[8], const uint64_t w[4])
+{
+	__m128i lo = _mm_loadu_si128((const __m128i*)w);
+	__m128i hi = _mm_loadu_si128((const __m128i*)(w + 2));
+
+	/* gather the even and the odd 32-bit words of w */
+	__m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+	__m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+
+	/* transpose them as 4x4 byte matrices */
+	even = _mm_unpacklo_epi8(even, _mm_srli_si128(even, 8));
+	even = _mm_unpacklo_epi8(even, _mm_srli_si128(even, 8));
+	odd = _mm_unpacklo_epi8(odd, _mm_srli_si128(odd, 8));
+	odd = _mm_unpacklo_epi8(odd, _mm_srli_si128(odd, 8));
+	_mm_storeu_si128((__m128i*)key, even);
+	_mm_storeu_si128((__m128i*)(key + 4), odd);
+}
+
+/**
+ * The core transformation for x86-64 CPUs. Unlike the generic version,
+ * it calculates all four keys at first, operating on 64-bit words, and
+ * then encrypts the four 64-bit parts of the hash simultaneously,
+ * so their table lookups don't wait for each other.
+ *
+ * @param ctx algorithm context
+ * @param block the message block to process
+ */
+static void rhash_gost_block_compress_x64(gost_ctx *ctx, const unsigned* block)
+{
+	unsigned i;
+	unsigned key[4][8], s[8];
+	uint64_t u[4], v[4], w[4], t0, t1;
+	const unsigned *sbox = (ctx->cryptpro ? (const unsigned*)rhash_gost_sbox_cryptpro : (const unsigned*)rhash_gost_sbox);
+
+	/* u := hash, v := <256-bit message block> */
+	memcpy(u, ctx->hash, sizeof(u));
+	memcpy(v, block, sizeof(v));
+
+	for(i = 0;; i++) {
+		/* key_i := P(u xor v) */
+		w[0] = u[0] ^ v[0], w[1] = u[1] ^ v[1];
+		w[2] = u[2] ^ v[2], w[3] = u[3] ^ v[3];
+		rhash_gost_p_transform(key[i], w);
+		if(i == 3) break;
+
+		/* u := A(u), where A(y4|y3|y2|y1) = (y1 xor y2)|y4|y3|y2 */
+		t0 = u[0] ^ u[1];
+		u[0] = u[1], u[1] = u[2], u[2] = u[3], u[3] = t0;
+		if(i == 1) {
+			/* C_3=0xff00ffff000000ffff0000ff00ffff0000ff00ff00ff00ffff00ff00ff00ff00 */
+			u[0] ^= I64(0xff00ff00ff00ff00);
+			u[1] ^= I64(0x00ff00ff00ff00ff);
+			u[2] ^= I64(0xff0000ff00ffff00);
+			u[3] ^= I64(0xff00ffff000000ff);
+		}
+
+		/* v := A^2(v) */
+		t0 = v[0] ^ v[1];
+		t1 = v[1] ^ v[2];
+		v[0] = v[2], v[1] = v[3], v[2] = t0, v[3] = t1;
+	}
+
+	/* encryption: s_i := E_{key_i} (h_i) */
+	{
+		unsigned r0 = ctx->hash[0], l0 = ctx->hash[1];
+		unsigned r1 = ctx->hash[2], l1 = ctx->hash[3];
+		unsigned r2 = ctx->hash[4], l2 = ctx->hash[5];
+		unsigned r3 = ctx->hash[6], l3 = ctx->hash[7];
+		unsigned tmp0, tmp1, tmp2, tmp3;
+		for(i = 0; i < 3; i++) {
+			GOST_ENCRYPT_ROUND4(0, 1)
+			GOST_ENCRYPT_ROUND4(2, 3)
+			GOST_ENCRYPT_ROUND4(4, 5)
+			GOST_ENCRYPT_ROUND4(6, 7)
+		}
+		GOST_ENCRYPT_ROUND4(7, 6)
+		GOST_ENCRYPT_ROUND4(5, 4)
+		GOST_ENCRYPT_ROUND4(3, 2)
+		GOST_ENCRYPT_ROUND4(1, 0)
+		s[0] = l0, s[1] = r0;
+		s[2] = l1, s[3] = r1;
+		s[4] = l2, s[5] = r2;
+		s[6] = l3, s[7] = r3;
+	}
+
+	rhash_gost_mix(ctx, block, s);
 }
+#endif /* USE_GOST_X64 */
 
 /**
  * This function calculates hash value by 256-bit blocks.
  * It updates 256-bit check sum as follows:
  *    *(uint256_t)(ctx->sum) += *(uint256_t*)block;
  * and then updates intermediate hash value ctx->hash
- * by calling rhash_gost_block_compress().
+ * by calling the given compression function.
  *
  * @param ctx algorithm context
  * @param block the 256-bit message block to process
+ * @param compress the compression function to use
  */
-static void rhash_gost_compute_sum_and_hash(gost_ctx * ctx, const unsigned* block)
+static void rhash_gost_compute_sum_and_hash(gost_ctx * ctx, const unsigned* block, gost_compress_t compress)
 {
 #ifdef CPU_BIG_ENDIAN
 	unsigned block_le[8]; /* tmp buffer for little endian number */
@@ -333,18 +472,18 @@ static void rhash_gost_compute_sum_and_hash(gost_ctx * ctx, const unsigned* bloc
 #endif /* USE_GCC_ASM_IA32 */
 
 	/* update message hash */
-	rhash_gost_block_compress(ctx, block_le);
+	compress(ctx, block_le);
 }
 
 /**
- * Calculate message hash.
- * Can be called repeatedly with chunks of the message to be hashed.
+ * Calculate message hash by the given compression function.
  *
  * @param ctx the algorithm context containing current hashing state
  * @param msg message chunk
  * @param size length of the message chunk
+ * @param compress the compression function to use
  */
-void rhash_gost_update(gost_ctx *ctx, const unsigned char* msg, size_t size)
+static void rhash_gost_update_by(gost_ctx *ctx, const unsigned char* msg, size_t size, gost_compress_t compress)
 {
 	unsigned index = (unsigned)ctx->length & 31;
 	ctx->length += size;
@@ -356,7 +495,7 @@ void rhash_gost_update(gost_ctx *ctx, const unsigned char* msg, size_t size)
 		if(size < left) return;
 
 		/* process partial block */
-		rhash_gost_compute_sum_and_hash(ctx, (unsigned*)ctx->message);
+		rhash_gost_compute_sum_and_hash(ctx, (unsigned*)ctx->message, compress);
 		msg += left;
 		size -= left;
 	}
@@ -375,7 +514,7 @@ void rhash_gost_update(gost_ctx *ctx, const unsigned char* msg, size_t size)
 			aligned_message_block = (unsigned*)ctx->message;
 		}
 
-		rhash_gost_compute_sum_and_hash(ctx, aligned_message_block);
+		rhash_gost_compute_sum_and_hash(ctx, aligned_message_block, compress);
 		msg += gost_block_size;
 		size -= gost_block_size;
 	}
@@ -385,6 +524,33 @@ void rhash_gost_update(gost_ctx *ctx, const unsigned char* msg, size_t size)
 	}
 }
 
+/**
+ * Calculate message hash.
+ * Can be called repeatedly with chunks of the message to be hashed.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_gost_update(gost_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	rhash_gost_update_by(ctx, msg, size, rhash_gost_block_compress);
+}
+
+#ifdef USE_GOST_X64
+/**
+ * Calculate message hash by the compression function optimized for x86-64.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_gost_update_x64(gost_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	rhash_gost_update_by(ctx, msg, size, rhash_gost_block_compress_x64);
+}
+#endif
+
 /**
  * Finish hashing and store message digest into given array.
  *
@@ -399,7 +565,7 @@ void rhash_gost_final(gost_ctx *ctx, unsigned char result[32])
 	/* pad the last block with zeroes and hash it */
 	if(index > 0) {
 		memset(ctx->message + index, 0, 32 - index);
-		rhash_gost_compute_sum_and_hash(ctx, msg32);
+		rhash_gost_compute_sum_and_hash(ctx, msg32, rhash_gost_block_compress);
 	}
 
 	/* hash the message length and the sum */
@@ -487,7 +653,7 @@ void rhash_gost_init_table(void)
 #else /* GENERATE_GOST_LOOKUP_TABLE */
 
 /* pre-initialized GOST lookup tables based on rotated S-Box */
-unsigned rhash_gost_sbox[4][256] = {
+const unsigned rhash_gost_sbox[4][256] = {
 	{
 		0x72000, 0x75000, 0x74800, 0x71000, 0x76800,
 		0x74000, 0x70000, 0x77000, 0x73000, 0x75800,
@@ -690,7 +856,7 @@ unsigned rhash_gost_sbox[4][256] = {
 };
 
 /* pre-initialized GOST lookup tables based on rotated S-Box */
-unsigned rhash_gost_sbox_cryptpro[4][256] = {
+const unsigned rhash_gost_sbox_cryptpro[4][256] = {
 	{
 		0x2d000, 0x2a000, 0x2a800, 0x2b000, 0x2c000,
 		0x28800, 0x29800, 0x2b800, 0x2e800, 0x2e000,
@@ -27,6 +27,12 @@ void rhash_gost_cryptopro_init(gost_ctx *ctx);
 void rhash_gost_update(gost_ctx *ctx, const unsigned char* msg, size_t size);
 void rhash_gost_final(gost_ctx *ctx, unsigned char result[32]);
 
+/* the implementation for x86-64 CPUs, selected at run-time */
+#if defined(CPU_X64) && (defined(_MSC_VER) || defined(__GNUC__))
+# define USE_GOST_X64
+void rhash_gost_update_x64(gost_ctx *ctx, const unsigned char* msg, size_t size);
+#endif
+
 #ifdef GENERATE_GOST_LOOKUP_TABLE
 void rhash_gost_init_table(void); /* initialize algorithm static data */
 #endif
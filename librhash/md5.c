@@ -16,6 +16,7 @@
 
 #include <string.h>
 #include "byte_order.h"
+#include "openssl_asm.h"
 #include "md5.h"
 
 /**
@@ -34,37 +35,6 @@ void rhash_md5_init(md5_ctx *ctx)
 	ctx->hash[3] = 0x10325476;
 }
 
-/* First, define four auxiliary functions that each take as input
- * three 32-bit words and returns a 32-bit word.*/
-
-/* F(x,y,z) = ((y XOR z) AND x) XOR z - is faster then original version */
-#define MD5_F(x, y, z) ((((y) ^ (z)) & (x)) ^ (z))
-#define MD5_G(x, y, z) (((x) & (z)) | ((y) & (~z)))
-#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
-#define MD5_I(x, y, z) ((y) ^ ((x) | (~z)))
-
-/* transformations for rounds 1, 2, 3, and 4. */
-#define MD5_ROUND1(a, b, c, d, x, s, ac) { \
-	(a) += MD5_F((b), (c), (d)) + (x) + (ac); \
-	(a) = ROTL32((a), (s)); \
-	(a) += (b); \
-}
-#define MD5_ROUND2(a, b, c, d, x, s, ac) { \
-	(a) += MD5_G((b), (c), (d)) + (x) + (ac); \
-	(a) = ROTL32((a), (s)); \
-	(a) += (b); \
-}
-#define MD5_ROUND3(a, b, c, d, x, s, ac) { \
-	(a) += MD5_H((b), (c), (d)) + (x) + (ac); \
-	(a) = ROTL32((a), (s)); \
-	(a) += (b); \
-}
-#define MD5_ROUND4(a, b, c, d, x, s, ac) { \
-	(a) += MD5_I((b), (c), (d)) + (x) + (ac); \
-	(a) = ROTL32((a), (s)); \
-	(a) += (b); \
-}
-
 /**
  * The core transformation. Process a 512-bit block.
  * The function has been taken from RFC 1321 with little changes.
@@ -199,6 +169,43 @@ void rhash_md5_update(md5_ctx *ctx, const unsigned char* msg, size_t size)
 	}
 }
 
+#ifdef HAS_OPENSSL_ASM
+/**
+ * Calculate message hash by the OpenSSL assembly kernel.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_md5_update_asm(md5_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	unsigned index = (unsigned)ctx->length & 63;
+	ctx->length += size;
+
+	/* fill partial block */
+	if(index) {
+		unsigned left = md5_block_size - index;
+		memcpy((char*)ctx->message + index, msg, (size < left ? size : left));
+		if(size < left) return;
+
+		/* process partial block */
+		rhash_openssl_md5_block_asm_data_order(ctx->hash, ctx->message, 1);
+		msg  += left;
+		size -= left;
+	}
+	if(size >= md5_block_size) {
+		/* the kernel reads unaligned little-endian blocks in place */
+		rhash_openssl_md5_block_asm_data_order(ctx->hash, msg, size / md5_block_size);
+		msg += size & ~(size_t)(md5_block_size - 1);
+		size &= md5_block_size - 1;
+	}
+	if(size) {
+		/* save leftovers */
+		memcpy(ctx->message, msg, size);
+	}
+}
+#endif
+
 /**
  * Store calculated hash into the given array.
  *
@@ -0,0 +1,50 @@
+/* openssl_asm.c - hash kernels assembled from the bundled OpenSSL source
+ *
+ * Copyright: 2013 Aleksey Kravchenko <rhash.admin@gmail.com>
+ *
+ * Permission is hereby granted,  free of charge,  to any person  obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction,  including without limitation
+ * the rights to  use, copy, modify,  merge, publish, distribute, sublicense,
+ * and/or sell copies  of  the Software,  and to permit  persons  to whom the
+ * Software is furnished to do so.
+ *
+ * This program  is  distributed  in  the  hope  that it will be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  Use this program  at  your own risk!
+ *
+ * The kernels are generated from the perlasm scripts of openssl-1.0.1e by
+ * openssl_asm.pl. This file provides the CPU capability vector, which the
+ * kernels read to choose their code path, instead of the one of libcrypto.
+ */
+#include "cpu_features.h"
+#include "openssl_asm.h"
+
+#ifdef HAS_OPENSSL_ASM
+
+/* the OPENSSL_ia32cap_P vector: CPUID(1).EDX and CPUID(1).ECX bits */
+unsigned rhash_openssl_ia32cap[2];
+
+/**
+ * Fill the CPU capability vector of the OpenSSL kernels
+ * from the instruction sets allowed by rhash_cpu_features().
+ */
+void rhash_openssl_asm_init(void)
+{
+	unsigned features = rhash_cpu_features();
+	unsigned edx = 0, ecx = 0;
+
+	/* MMX, FXSR, SSE and SSE2 */
+	if(features & RHASH_CPU_SSE2) edx |= (1u << 23) | (1u << 24) | (1u << 25) | (1u << 26);
+	if(features & RHASH_CPU_SSSE3) ecx |= 1u << 9;
+	if(features & RHASH_CPU_SSE41) ecx |= 1u << 19;
+	/* the kernels take the AVX path on Intel CPUs only, allow it everywhere */
+	if(features & RHASH_CPU_AVX) {
+		ecx |= 1u << 28;
+		edx |= 1u << 30;
+	}
+	/* bit 10 marks the vector as initialized */
+	rhash_openssl_ia32cap[0] = edx | (1u << 10);
+	rhash_openssl_ia32cap[1] = ecx;
+}
+#endif /* HAS_OPENSSL_ASM */
@@ -0,0 +1,38 @@
+/* openssl_asm.h - hash kernels assembled from the bundled OpenSSL source */
+#ifndef OPENSSL_ASM_H
+#define OPENSSL_ASM_H
+#include <stddef.h>
+#include "byte_order.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The kernels are generated by openssl_asm.pl and linked statically,
+ * so no libcrypto is needed to use them. */
+#if defined(USE_OPENSSL_ASM) && (defined(CPU_X64) || defined(CPU_IA32))
+# define HAS_OPENSSL_ASM
+
+/* each kernel processes the given number of 64-byte or 128-byte blocks,
+ * updating the hash state at the beginning of the context */
+void rhash_openssl_md5_block_asm_data_order(void* state, const void* msg, size_t blocks);
+void rhash_openssl_sha1_block_data_order(void* state, const void* msg, size_t blocks);
+void rhash_openssl_sha256_block_data_order(void* state, const void* msg, size_t blocks);
+void rhash_openssl_sha512_block_data_order(void* state, const void* msg, size_t blocks);
+# ifdef CPU_X64
+void rhash_openssl_whirlpool_block(void* state, const void* msg, size_t blocks);
+# else
+#  define HAS_OPENSSL_ASM_RIPEMD160
+void rhash_openssl_ripemd160_block_asm_data_order(void* state, const void* msg, size_t blocks);
+void rhash_openssl_whirlpool_block_mmx(void* state, const void* msg, size_t blocks);
+#  define rhash_openssl_whirlpool_block rhash_openssl_whirlpool_block_mmx
+# endif
+
+void rhash_openssl_asm_init(void);
+#endif /* USE_OPENSSL_ASM */
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* OPENSSL_ASM_H */
@@ -0,0 +1,79 @@
+#!/usr/bin/env perl
+# openssl_asm.pl - generate the OpenSSL assembly hash kernels for librhash
+#
+# Usage: perl openssl_asm.pl <flavour> <x86_64|x86> [<output directory>]
+#
+# Runs the perlasm scripts of the bundled OpenSSL source tree and writes
+# one assembly file per kernel. The flavour is passed to perlasm unchanged:
+# elf, macosx, mingw64, nasm or masm for x86_64; elf, coff, macosx, win32
+# (MASM) or win32n (NASM) for x86. The exported symbols are renamed to carry
+# the rhash_openssl_ prefix, so the kernels do not clash with a libcrypto
+# linked into the same program. Compile the files together with librhash,
+# built with the USE_OPENSSL_ASM macro defined. The MSVC project does this,
+# when built by msbuild /p:UseOpenSSLAsm=true.
+
+use strict;
+use File::Basename;
+use File::Spec;
+
+my ($flavour, $arch, $outdir) = @ARGV;
+die "Usage: perl $0 <flavour> <x86_64|x86> [<output directory>]\n"
+	unless defined($arch) && ($arch eq "x86_64" || $arch eq "x86");
+$outdir = "." unless defined($outdir);
+
+my $src = File::Spec->catdir(dirname(File::Spec->rel2abs($0)), "..", "openssl-1.0.1e", "crypto");
+my $ext = ($flavour =~ /^(nasm|masm|win32|win32n)$/ ? "asm" : "s");
+
+# the kernels: output file name => perlasm script
+my %kernels = ($arch eq "x86_64" ? (
+	"md5-x86_64"    => "md5/asm/md5-x86_64.pl",
+	"sha1-x86_64"   => "sha/asm/sha1-x86_64.pl",
+	"sha256-x86_64" => "sha/asm/sha512-x86_64.pl", # selected by the output name
+	"sha512-x86_64" => "sha/asm/sha512-x86_64.pl",
+	"wp-x86_64"     => "whrlpool/asm/wp-x86_64.pl",
+) : (
+	"md5-586"    => "md5/asm/md5-586.pl",
+	"sha1-586"   => "sha/asm/sha1-586.pl",
+	"sha256-586" => "sha/asm/sha256-586.pl",
+	"sha512-586" => "sha/asm/sha512-586.pl",
+	"rmd-586"    => "ripemd/asm/rmd-586.pl",
+	"wp-mmx"     => "whrlpool/asm/wp-mmx.pl",
+));
+
+# the symbols to rename
+my %symbols = (
+	"OPENSSL_ia32cap_P" => "rhash_openssl_ia32cap",
+	map { $_ => "rhash_openssl_$_" } qw(md5_block_asm_data_order
+		sha1_block_data_order sha256_block_data_order sha512_block_data_order
+		ripemd160_block_asm_data_order whirlpool_block whirlpool_block_mmx)
+);
+my $pattern = join("|", sort { length($b) <=> length($a) } keys %symbols);
+
+foreach my $name (sort keys %kernels) {
+	my $script = File::Spec->catfile($src, $kernels{$name});
+	my $output = File::Spec->catfile($outdir, "$name.$ext");
+	my @args = ($arch eq "x86_64" ? ($flavour, $output) :
+		($flavour, "-DOPENSSL_IA32_SSE2", ($flavour eq "elf" ? "-fPIC" : ())));
+
+	if($arch eq "x86_64") {
+		system($^X, $script, @args) == 0 or die "$script failed\n";
+	} else {
+		open(my $out, ">", $output) or die "$output: $!\n";
+		open(my $in, "-|", $^X, $script, @args) or die "$script: $!\n";
+		print $out $_ while(<$in>);
+		close($in) or die "$script failed\n";
+		close($out);
+	}
+
+	# rename the symbols, keeping the leading underscore of the x86 ABIs
+	open(my $in, "<", $output) or die "$output: $!\n";
+	my @lines = <$in>;
+	close($in);
+	s/(?<![A-Za-z0-9])(_?)($pattern)(?![A-Za-z0-9_])/$1$symbols{$2}/g foreach(@lines);
+	# the kernels do not need an executable stack
+	push(@lines, ".section .note.GNU-stack,\"\",%progbits\n") if($flavour eq "elf");
+	open(my $out, ">", $output) or die "$output: $!\n";
+	print $out @lines;
+	close($out);
+	print "$output\n";
+}
@@ -30,6 +30,7 @@
 
 #include "algorithms.h"
 #include "plug_openssl.h"
+#include "util.h"
 
 #if defined(OPENSSL_RUNTIME)
 # ifdef _WIN32
@@ -40,7 +41,11 @@
 #endif
 
 /* the mask of ids of hashing algorithms to use from the OpenSLL library */
-unsigned rhash_openssl_hash_mask = RHASH_OPENSSL_DEFAULT_HASHES;
+rhash_atomic_t rhash_openssl_hash_mask = RHASH_OPENSSL_DEFAULT_HASHES;
+/* the mask of the algorithms loaded from the OpenSSL library */
+#define OPENSSL_NOT_LOADED (~0u)
+static rhash_atomic_t rhash_openssl_loaded = OPENSSL_NOT_LOADED;
+static rhash_atomic_t rhash_openssl_once;
 
 #ifdef OPENSSL_RUNTIME
 typedef void (*os_fin_t)(void*, void*);
@@ -111,11 +116,6 @@ rhash_hash_info rhash_openssl_methods[] = {
 #endif
 };
 
-/* The rhash_openssl_hash_info static array initialized by rhash_plug_openssl() replaces
- * rhash internal algorithms table. It is kept in an unitialized-data segment
- * taking no space in the executable. */
-rhash_hash_info rhash_openssl_hash_info[RHASH_HASH_COUNT];
-
 #ifdef OPENSSL_RUNTIME
 #ifdef _WIN32
 #define LOAD_ADDR(n, name) \
@@ -164,40 +164,101 @@ static int load_openssl_runtime(void)
 }
 #endif
 
+#define OPENSSL_METHODS_COUNT (sizeof(rhash_openssl_methods) / sizeof(rhash_hash_info))
+
+/**
+ * Load the OpenSSL library, then apply its methods
+ * to the algorithms waiting for it.
+ */
+static void rhash_load_openssl_once(void)
+{
+	unsigned loaded = 0;
+	size_t i;
+
+#ifdef OPENSSL_RUNTIME
+	if(load_openssl_runtime())
+#endif
+	{
+		for(i = 0; i < OPENSSL_METHODS_COUNT; i++) {
+			if(rhash_openssl_methods[i].init) loaded |= rhash_openssl_methods[i].info->hash_id;
+		}
+	}
+	rhash_atomic_store(&rhash_openssl_loaded, loaded);
+	rhash_refresh_backend();
+}
+
+/**
+ * Load the OpenSSL library on the first call. Concurrent calls
+ * wait till the library is loaded.
+ */
+void rhash_load_openssl(void)
+{
+	rhash_call_once(&rhash_openssl_once, rhash_load_openssl_once);
+}
+
 /**
  * Replace several RHash internal algorithms with the OpenSSL ones.
- * It replaces MD4/MD5, SHA1/SHA2, RIPEMD, WHIRLPOOL.
+ * It replaces MD4/MD5, SHA1/SHA2, RIPEMD, WHIRLPOOL. A dynamically
+ * loaded library is loaded on the first use of these algorithms.
  *
- * @return 1 on success, 0 if OpenSSL library not found
+ * @return 1 on success, 0 on memory allocation failure
  */
 int rhash_plug_openssl(void)
 {
-	int i, bit_index;
-
-	assert(rhash_info_size <= RHASH_HASH_COUNT); /* buffer-overflow protection */
+	unsigned hash_mask = rhash_atomic_load(&rhash_openssl_hash_mask) & RHASH_OPENSSL_SUPPORTED_HASHES;
 
-	if( (rhash_openssl_hash_mask & RHASH_OPENSSL_SUPPORTED_HASHES) == 0) {
+	if(hash_mask == 0) {
 		return 1; /* do not load openssl */
 	}
-
-#ifdef OPENSSL_RUNTIME
-	if(!load_openssl_runtime()) return 0;
+#ifndef OPENSSL_RUNTIME
+	rhash_load_openssl(); /* the linked library costs nothing to load */
 #endif
+	return (rhash_set_openssl_hashes(hash_mask) == 0);
+}
 
-	memcpy(rhash_openssl_hash_info, rhash_info_table, sizeof(rhash_openssl_hash_info));
+/**
+ * Check if loading of the OpenSSL library has been tried.
+ *
+ * @return non-zero if the library is loaded or failed to load
+ */
+int rhash_openssl_is_loaded(void)
+{
+	return (rhash_atomic_load(&rhash_openssl_loaded) != OPENSSL_NOT_LOADED);
+}
 
-	/* replace internal rhash methods with the openssl ones */
-	for(i = 0; i < (int)(sizeof(rhash_openssl_methods) / sizeof(rhash_hash_info)); i++)
+/**
+ * Return the mask of the hash algorithms, loaded from the OpenSSL library.
+ *
+ * @return the mask of algorithm ids, 0 if the library is not loaded
+ */
+unsigned rhash_openssl_loaded_hashes(void)
+{
+	unsigned loaded = rhash_atomic_load(&rhash_openssl_loaded);
+	return (loaded == OPENSSL_NOT_LOADED ? 0 : loaded);
+}
+
+/**
+ * Put the OpenSSL methods of the given hash algorithms into a table.
+ *
+ * @param table the table of all hash algorithms to modify
+ * @param hash_ids the mask of the algorithms to compute by OpenSSL
+ * @return the mask of the algorithms, which methods were replaced
+ */
+unsigned rhash_plug_openssl_methods(rhash_hash_info* table, unsigned hash_ids)
+{
+	unsigned replaced = 0;
+	size_t i;
+
+	hash_ids &= rhash_openssl_loaded_hashes();
+	for(i = 0; i < OPENSSL_METHODS_COUNT; i++)
 	{
 		rhash_hash_info *method = &rhash_openssl_methods[i];
-		if((rhash_openssl_hash_mask & method->info->hash_id) == 0) continue;
-		if(!method->init) continue;
-		bit_index = rhash_ctz(method->info->hash_id);
-		assert(method->info->hash_id == rhash_openssl_hash_info[bit_index].info->hash_id);
-		memcpy(&rhash_openssl_hash_info[bit_index], method, sizeof(rhash_hash_info));
+		unsigned bit_index = rhash_ctz(method->info->hash_id);
+		if((hash_ids & method->info->hash_id) == 0) continue;
+		assert(method->info->hash_id == table[bit_index].info->hash_id);
+		memcpy(&table[bit_index], method, sizeof(rhash_hash_info));
+		replaced |= method->info->hash_id;
 	}
-
-	rhash_info_table = rhash_openssl_hash_info;
-	return 1;
+	return replaced;
 }
 #endif /* USE_OPENSSL */
@@ -2,18 +2,24 @@
 #ifndef RHASH_PLUG_OPENSSL_H
 #define RHASH_PLUG_OPENSSL_H
 #ifdef USE_OPENSSL
+#include "algorithms.h"
+#include "util.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int rhash_plug_openssl(void); /* load openssl algorithms */
+void rhash_load_openssl(void);
+int rhash_openssl_is_loaded(void);
+unsigned rhash_openssl_loaded_hashes(void);
+unsigned rhash_plug_openssl_methods(rhash_hash_info* table, unsigned hash_ids);
 
 #define RHASH_OPENSSL_DEFAULT_HASHES (RHASH_MD5 | RHASH_SHA1 | \
 	RHASH_SHA224 | RHASH_SHA256 | RHASH_SHA384 | RHASH_SHA512 | \
 	RHASH_WHIRLPOOL)
 
-extern unsigned rhash_openssl_hash_mask; /* mask of hash sums to use */
+extern rhash_atomic_t rhash_openssl_hash_mask; /* mask of hash sums to use */
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -19,6 +19,12 @@
 #include <stdio.h>
 #include <assert.h>
 #include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h> /* fstat() */
+#ifndef _WIN32
+# include <unistd.h> /* sysconf() */
+# include <sys/mman.h> /* mmap() */
+#endif
 
 /* modifier for Windows DLL */
 #if defined(_WIN32) && defined(RHASH_EXPORTS)
@@ -27,9 +33,11 @@
 
 #include "byte_order.h"
 #include "algorithms.h"
+#include "cpu_features.h"
 #include "torrent.h"
 #include "plug_openssl.h"
 #include "util.h"
+#include "rhash_thread.h"
 #include "hex.h"
 #include "rhash.h" /* RHash library interface */
 
@@ -39,20 +47,39 @@
 #define RCTX_AUTO_FINAL 0x1
 #define RCTX_FINALIZED  0x2
 #define RCTX_FINALIZED_MASK (RCTX_AUTO_FINAL | RCTX_FINALIZED)
+#define RCTX_ASYNC_READ 0x4
+#define RCTX_EXTERNAL_MEMORY 0x8
 #define RHPR_FORMAT (RHPR_RAW | RHPR_HEX | RHPR_BASE32 | RHPR_BASE64)
 #define RHPR_MODIFIER (RHPR_UPPERCASE | RHPR_REVERSE)
 
+static rhash_atomic_t rhash_library_once;
+
 /**
- * Initialize static data of rhash algorithms
+ * Select the implementations of hash algorithms for the CPU.
  */
-void rhash_library_init(void)
+static void rhash_library_init_once(void)
 {
-	rhash_init_algorithms(RHASH_ALL_HASHES);
+	/* verify that RHASH_HASH_COUNT is the index of the major bit of RHASH_ALL_HASHES */
+	assert(1 == (RHASH_ALL_HASHES >> (RHASH_HASH_COUNT - 1)));
+
+	rhash_select_impls();
 #ifdef USE_OPENSSL
 	rhash_plug_openssl();
 #endif
 }
 
+/**
+ * Initialize static data of rhash algorithms. Only the first call
+ * initializes the library, other calls wait until it is initialized.
+ * The function is also called on the first creation of a context.
+ * Lookup tables and the OpenSSL library are loaded later, when a context
+ * first needs them.
+ */
+void rhash_library_init(void)
+{
+	rhash_call_once(&rhash_library_once, rhash_library_init_once);
+}
+
 /**
  * Returns the number of supported hash algorithms.
  *
@@ -68,10 +95,14 @@ int RHASH_API rhash_count(void)
  */
 typedef struct rhash_vector_item
 {
-	struct rhash_hash_info* hash_info;
+	const struct rhash_hash_info* hash_info;
 	void *context;
 } rhash_vector_item;
 
+/* the maximal number of stitched kernels used by a context, every kernel
+ * updates two of the RHASH_STITCHED_HASHES algorithms */
+#define RHASH_MAX_STITCHED 2
+
 /**
  * The rhash context containing contexts for several hash functions
  */
@@ -80,39 +111,50 @@ typedef struct rhash_context_ext
 	struct rhash_context rc;
 	unsigned hash_vector_size; /* number of contained hash sums */
 	unsigned flags;
-	unsigned state;
+	rhash_atomic_t state;
+	const rhash_backend* backend; /* the methods of the hash algorithms */
 	void *callback, *callback_data;
 	void *bt_ctx;
+	size_t file_block_size; /* block size for asynchronous reading, 0 = auto */
+	struct update_pool* pool; /* worker threads for rhash_update(), can be NULL */
+	unsigned stitched_items; /* bit mask of the vector items, updated by stitched kernels */
+	unsigned stitched_count;
+	struct {
+		pstitched_update_t update;
+		unsigned item1, item2; /* indexes of the vector items to update */
+	} stitched[RHASH_MAX_STITCHED];
 	rhash_vector_item vector[1]; /* contexts of contained hash sums */
 } rhash_context_ext;
 
+/* Contexts of several hashes are aligned by the cache line size, so the hashes
+ * can be updated by different threads without false sharing of cache lines. */
+#define CONTEXT_ALIGNMENT_MASK(hash_id) \
+	((size_t)(((hash_id) & ((hash_id) - 1)) != 0 ? RHASH_CACHE_LINE_SIZE - 1 : 7))
+
+static void rhash_destroy_pool(struct update_pool* pool);
+
 /* Lo-level rhash library functions */
 
 /**
- * Allocate and initialize RHash context for calculating hash(es).
- * After initializing rhash_update()/rhash_final() functions should be used.
- * Then the context must be freed by calling rhash_free().
+ * Calculate the size of memory needed to store a rhash context
+ * for the given set of hash algorithms.
  *
- * @param hash_id union of bit flags, containing ids of hashes to calculate.
- * @return initialized rhash context, NULL on error and errno is set
+ * @param backend the methods of the hash algorithms
+ * @param hash_id union of bit flags, containing ids of hashes to calculate
+ * @param pnum pointer to receive the number of hashes to calculate
+ * @param phead_size pointer to receive the aligned size of the common part of the context
+ * @return the size of the rhash context
  */
-RHASH_API rhash rhash_init(unsigned hash_id)
+static size_t rhash_calc_context_size(const rhash_backend* backend,
+	unsigned hash_id, unsigned* pnum, size_t* phead_size)
 {
 	unsigned tail_bit_index; /* index of hash_id trailing bit */
 	unsigned num = 0;        /* number of hashes to compute */
-	rhash_context_ext *rctx = NULL; /* allocated rhash context */
 	size_t hash_size_sum = 0;   /* size of hash contexts to store in rctx */
-
-	unsigned i, bit_index, id;
-	struct rhash_hash_info* info;
+	unsigned bit_index, id;
+	const struct rhash_hash_info* info;
 	size_t aligned_size;
-	char* phash_ctx;
-
-	hash_id &= RHASH_ALL_HASHES;
-	if(hash_id == 0) {
-		errno = EINVAL;
-		return NULL;
-	}
+	size_t mask = CONTEXT_ALIGNMENT_MASK(hash_id);
 
 	tail_bit_index = rhash_ctz(hash_id); /* get trailing bit index */
 	assert(tail_bit_index < RHASH_HASH_COUNT);
@@ -122,17 +164,17 @@ RHASH_API rhash rhash_init(unsigned hash_id)
 	if(hash_id == id) {
 		/* handle the most common case of only one hash */
 		num = 1;
-		info = &rhash_info_table[tail_bit_index];
+		info = &backend->table[tail_bit_index];
 		hash_size_sum = info->context_size;
 	} else {
 		/* another case: hash_id contains several hashes */
 		for(bit_index = tail_bit_index; id <= hash_id; bit_index++, id = id << 1) {
 			assert(id != 0);
 			assert(bit_index < RHASH_HASH_COUNT);
-			info = &rhash_info_table[bit_index];
+			info = &backend->table[bit_index];
 			if(hash_id & id) {
-				/* align sizes by 8 bytes */
-				aligned_size = (info->context_size + 7) & ~7;
+				/* align sizes by 8 bytes or by the cache line size */
+				aligned_size = (info->context_size + mask) & ~mask;
 				hash_size_sum += aligned_size;
 				num++;
 			}
@@ -141,31 +183,83 @@ RHASH_API rhash rhash_init(unsigned hash_id)
 	}
 
 	/* align the size of the rhash context common part */
-	aligned_size = (offsetof(rhash_context_ext, vector[num]) + 7) & ~7;
+	aligned_size = (offsetof(rhash_context_ext, vector[num]) + mask) & ~mask;
 	assert(aligned_size >= sizeof(rhash_context_ext));
 
-	/* allocate rhash context with enough memory to store contexts of all used hashes */
-	rctx = (rhash_context_ext*)malloc(aligned_size + hash_size_sum);
-	if(rctx == NULL) return NULL;
+	*pnum = num;
+	*phead_size = aligned_size;
+	return aligned_size + hash_size_sum;
+}
+
+/**
+ * Find pairs of hash algorithms of the context, which can be updated at once
+ * by a stitched kernel, processing both algorithms in one loop.
+ *
+ * @param rctx the context with initialized vector of hash contexts
+ */
+static void rhash_init_stitched(rhash_context_ext *rctx)
+{
+	unsigned i, j;
+	unsigned stitched_hashes = rctx->rc.hash_id & RHASH_STITCHED_HASHES;
+	if((stitched_hashes & (stitched_hashes - 1)) == 0) return; /* less than two algorithms */
+
+	for(i = 0; i < rctx->hash_vector_size && rctx->stitched_count < RHASH_MAX_STITCHED; i++) {
+		unsigned id1 = rctx->vector[i].hash_info->info->hash_id;
+		if((id1 & RHASH_STITCHED_HASHES) == 0 || (rctx->stitched_items & (1u << i))) continue;
+		for(j = i + 1; j < rctx->hash_vector_size; j++) {
+			unsigned id2 = rctx->vector[j].hash_info->info->hash_id;
+			pstitched_update_t update;
+			if((id2 & RHASH_STITCHED_HASHES) == 0 || (rctx->stitched_items & (1u << j))) continue;
+			update = rhash_find_stitched_update(rctx->backend, id1 | id2);
+			if(update) {
+				rctx->stitched[rctx->stitched_count].update = update;
+				rctx->stitched[rctx->stitched_count].item1 = i;
+				rctx->stitched[rctx->stitched_count].item2 = j;
+				rctx->stitched_count++;
+				rctx->stitched_items |= (1u << i) | (1u << j);
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Initialize RHash context in the given memory block.
+ *
+ * @param rctx the memory block to store the context in
+ * @param backend the methods of the hash algorithms
+ * @param hash_id union of bit flags, containing ids of hashes to calculate
+ * @param num the number of hashes to calculate
+ * @param head_size the aligned size of the common part of the context
+ * @param flags initial context flags
+ * @return initialized rhash context
+ */
+static rhash rhash_init_context(rhash_context_ext *rctx, const rhash_backend* backend,
+	unsigned hash_id, unsigned num, size_t head_size, unsigned flags)
+{
+	unsigned i, bit_index, id;
+	const struct rhash_hash_info* info;
+	char* phash_ctx;
 
 	/* initialize common fields of the rhash context */
 	memset(rctx, 0, sizeof(rhash_context_ext));
 	rctx->rc.hash_id = hash_id;
-	rctx->flags = RCTX_AUTO_FINAL; /* turn on auto-final by default */
-	rctx->state = STATE_ACTIVE;
+	rctx->flags = flags;
+	rhash_atomic_store(&rctx->state, STATE_ACTIVE);
+	rctx->backend = backend;
 	rctx->hash_vector_size = num;
 
 	/* aligned hash contexts follows rctx->vector[num] in the same memory block */
-	phash_ctx = (char*)rctx + aligned_size;
+	phash_ctx = (char*)rctx + head_size;
 	assert(phash_ctx >= (char*)&rctx->vector[num]);
 
 	/* initialize context for every hash in a loop */
-	for(bit_index = tail_bit_index, id = 1 << tail_bit_index, i = 0;
-		id <= hash_id; bit_index++, id = id << 1)
+	bit_index = rhash_ctz(hash_id);
+	for(id = 1 << bit_index, i = 0; id <= hash_id; bit_index++, id = id << 1)
 	{
 		/* check if a hash function with given id shall be included into rctx */
 		if((hash_id & id) != 0) {
-			info = &rhash_info_table[bit_index];
+			info = &backend->table[bit_index];
 			assert(info->context_size > 0);
 			assert(((phash_ctx - (char*)0) & 7) == 0); /* hash context is aligned */
 			assert(info->init != NULL);
@@ -175,7 +269,7 @@ RHASH_API rhash rhash_init(unsigned hash_id)
 
 			/* BTIH initialization is complex, save pointer for later */
 			if((id & RHASH_BTIH) != 0) rctx->bt_ctx = phash_ctx;
-			phash_ctx += (info->context_size + 7) & ~7;
+			phash_ctx += (info->context_size + CONTEXT_ALIGNMENT_MASK(hash_id)) & ~CONTEXT_ALIGNMENT_MASK(hash_id);
 
 			/* initialize the i-th hash context */
 			info->init(rctx->vector[i].context);
@@ -183,7 +277,94 @@ RHASH_API rhash rhash_init(unsigned hash_id)
 		}
 	}
 
-	return &rctx->rc; /* return allocated and initialized rhash context */
+	if(num > 1) rhash_init_stitched(rctx);
+	return &rctx->rc;
+}
+
+/**
+ * Allocate and initialize RHash context for calculating hash(es).
+ * After initializing rhash_update()/rhash_final() functions should be used.
+ * Then the context must be freed by calling rhash_free().
+ *
+ * @param hash_id union of bit flags, containing ids of hashes to calculate.
+ * @return initialized rhash context, NULL on error and errno is set
+ */
+RHASH_API rhash rhash_init(unsigned hash_id)
+{
+	rhash_context_ext *rctx; /* allocated rhash context */
+	const rhash_backend* backend;
+	unsigned num;
+	size_t head_size, size;
+
+	hash_id &= RHASH_ALL_HASHES;
+	if(hash_id == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	backend = rhash_acquire_backend(hash_id);
+	size = rhash_calc_context_size(backend, hash_id, &num, &head_size);
+
+	/* allocate rhash context with enough memory to store contexts of all used hashes */
+	rctx = (rhash_context_ext*)rhash_aligned_alloc(RHASH_CACHE_LINE_SIZE, size);
+	if(rctx == NULL) {
+		rhash_release_backend(backend);
+		return NULL;
+	}
+
+	/* turn on auto-final by default */
+	return rhash_init_context(rctx, backend, hash_id, num, head_size, RCTX_AUTO_FINAL);
+}
+
+/**
+ * Initialize RHash context in a memory block supplied by the caller,
+ * e.g. in a stack buffer. The required size of the block is returned by
+ * the rhash_get_context_size() function. The context must be released
+ * by rhash_free(), which doesn't free the memory block itself.
+ *
+ * @param buffer the memory block, must be aligned by 8 bytes
+ * @param size the size of the memory block
+ * @param hash_id union of bit flags, containing ids of hashes to calculate
+ * @return initialized rhash context, NULL on error and errno is set
+ */
+RHASH_API rhash rhash_init_in(void* buffer, size_t size, unsigned hash_id)
+{
+	const rhash_backend* backend;
+	unsigned num;
+	size_t head_size;
+
+	hash_id &= RHASH_ALL_HASHES;
+	if(hash_id == 0 || buffer == NULL || !IS_ALIGNED_64(buffer)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	backend = rhash_acquire_backend(hash_id);
+	if(rhash_calc_context_size(backend, hash_id, &num, &head_size) > size) {
+		rhash_release_backend(backend);
+		errno = ERANGE;
+		return NULL;
+	}
+	return rhash_init_context((rhash_context_ext*)buffer, backend, hash_id, num,
+		head_size, RCTX_AUTO_FINAL | RCTX_EXTERNAL_MEMORY);
+}
+
+/**
+ * Return the size of a memory block needed to store
+ * a rhash context for the given hash algorithms.
+ *
+ * @param hash_id union of bit flags, containing ids of hashes to calculate
+ * @return the size of the context in bytes, 0 if hash_id is invalid
+ */
+RHASH_API size_t rhash_get_context_size(unsigned hash_id)
+{
+	const rhash_backend* backend;
+	unsigned num;
+	size_t head_size, size;
+	hash_id &= RHASH_ALL_HASHES;
+	if(hash_id == 0) return 0;
+	backend = rhash_acquire_backend(hash_id);
+	size = rhash_calc_context_size(backend, hash_id, &num, &head_size);
+	rhash_release_backend(backend);
+	return size;
 }
 
 /**
@@ -198,17 +379,21 @@ void rhash_free(rhash ctx)
 	
 	if(ctx == 0) return;
 	assert(ectx->hash_vector_size <= RHASH_HASH_COUNT);
-	ectx->state = STATE_DELETED; /* mark memory block as being removed */
+	rhash_atomic_store(&ectx->state, STATE_DELETED); /* mark memory block as being removed */
 
 	/* clean the hash functions, which require additional clean up */
 	for(i = 0; i < ectx->hash_vector_size; i++) {
-		struct rhash_hash_info* info = ectx->vector[i].hash_info;
+		const struct rhash_hash_info* info = ectx->vector[i].hash_info;
 		if(info->cleanup != 0) {
 			info->cleanup(ectx->vector[i].context);
 		}
 	}
 
-	free(ectx);
+	if(ectx->pool) rhash_destroy_pool(ectx->pool);
+	rhash_release_backend(ectx->backend);
+
+	/* the memory of a context created by rhash_init_in() belongs to the caller */
+	if((ectx->flags & RCTX_EXTERNAL_MEMORY) == 0) rhash_aligned_free(ectx);
 }
 
 /**
@@ -224,11 +409,11 @@ RHASH_API void rhash_reset(rhash ctx)
 
 	assert(ectx->hash_vector_size > 0);
 	assert(ectx->hash_vector_size <= RHASH_HASH_COUNT);
-	ectx->state = STATE_ACTIVE; /* re-activate the structure */
+	rhash_atomic_store(&ectx->state, STATE_ACTIVE); /* re-activate the structure */
 
 	/* re-initialize every hash in a loop */
 	for(i = 0; i < ectx->hash_vector_size; i++) {
-		struct rhash_hash_info* info = ectx->vector[i].hash_info;
+		const struct rhash_hash_info* info = ectx->vector[i].hash_info;
 		if(info->cleanup != 0) {
 			info->cleanup(ectx->vector[i].context);
 		}
@@ -239,6 +424,244 @@ RHASH_API void rhash_reset(rhash ctx)
 	ectx->flags &= ~RCTX_FINALIZED; /* clear finalized state */
 }
 
+/* the minimal message size to be hashed by several threads */
+#define RHASH_THREADED_MIN_SIZE 16384
+
+/** a job, executed by every thread of a pool */
+typedef void (*rhash_job_t)(void* arg);
+
+/**
+ * Worker threads of a rhash context. The threads wait for a job, posted
+ * by rhash_pool_run(), execute it together with the calling thread and
+ * wait for the next job.
+ */
+typedef struct update_pool
+{
+	rhash_mutex_t lock;
+	rhash_cond_t work_cond; /* signaled when a new job is posted */
+	rhash_cond_t done_cond; /* signaled when the job is released */
+	rhash_job_t job;
+	void* job_arg;
+	unsigned refcount;   /* the number of threads still running the job */
+	unsigned generation; /* incremented for every posted job */
+	int stop;
+	unsigned threads_count;
+	rhash_thread_t threads[1];
+} update_pool;
+
+/**
+ * The main function of a worker thread.
+ *
+ * @param arg the pool of the thread
+ */
+static void rhash_pool_thread(void* arg)
+{
+	update_pool* pool = (update_pool*)arg;
+	unsigned generation = 0;
+
+	rhash_mutex_lock(&pool->lock);
+	for(;;) {
+		while(!pool->stop && pool->generation == generation) {
+			rhash_cond_wait(&pool->work_cond, &pool->lock);
+		}
+		if(pool->stop) break;
+		generation = pool->generation;
+
+		rhash_mutex_unlock(&pool->lock);
+		pool->job(pool->job_arg);
+		rhash_mutex_lock(&pool->lock);
+		if(--pool->refcount == 0) rhash_cond_signal(&pool->done_cond);
+	}
+	rhash_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Start a pool of worker threads.
+ *
+ * @param count the number of threads to start
+ * @return the started threads, NULL on error and errno is set
+ */
+static update_pool* rhash_create_pool(unsigned count)
+{
+	update_pool* pool = (update_pool*)malloc(offsetof(update_pool, threads[count]));
+	if(!pool) return NULL;
+	memset(pool, 0, sizeof(update_pool));
+	rhash_mutex_init(&pool->lock);
+	rhash_cond_init(&pool->work_cond);
+	rhash_cond_init(&pool->done_cond);
+
+	for(; pool->threads_count < count; pool->threads_count++) {
+		if(rhash_thread_create(&pool->threads[pool->threads_count], rhash_pool_thread, pool) < 0) {
+			break;
+		}
+	}
+	if(pool->threads_count == 0) {
+		rhash_destroy_pool(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+/**
+ * Stop the worker threads and free the pool.
+ *
+ * @param pool the pool to destroy
+ */
+static void rhash_destroy_pool(update_pool* pool)
+{
+	unsigned i;
+	rhash_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	rhash_cond_broadcast(&pool->work_cond);
+	rhash_mutex_unlock(&pool->lock);
+	for(i = 0; i < pool->threads_count; i++) {
+		rhash_thread_join(&pool->threads[i]);
+	}
+	rhash_cond_destroy(&pool->work_cond);
+	rhash_cond_destroy(&pool->done_cond);
+	rhash_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+/**
+ * Execute a job by all threads of the pool and by the calling thread.
+ * The job argument is shared by the threads, and is released when
+ * the last thread finishes the job.
+ *
+ * @param pool the worker threads
+ * @param job the job to execute
+ * @param arg the job argument
+ */
+static void rhash_pool_run(update_pool* pool, rhash_job_t job, void* arg)
+{
+	rhash_mutex_lock(&pool->lock);
+	pool->job = job;
+	pool->job_arg = arg;
+	pool->refcount = pool->threads_count + 1;
+	pool->generation++;
+	rhash_cond_broadcast(&pool->work_cond);
+	rhash_mutex_unlock(&pool->lock);
+
+	job(arg);
+
+	rhash_mutex_lock(&pool->lock);
+	pool->refcount--;
+	while(pool->refcount > 0) {
+		rhash_cond_wait(&pool->done_cond, &pool->lock);
+	}
+	pool->job_arg = NULL;
+	rhash_mutex_unlock(&pool->lock);
+}
+
+/**
+ * A message, shared by the threads updating hashes of a context.
+ */
+typedef struct update_job
+{
+	rhash_context_ext* ectx;
+	const rhash_iovec* iov;
+	int iovcnt;
+	unsigned next_item; /* index of the next hash to update */
+} update_job;
+
+/**
+ * Take not yet updated hashes of the context one by one
+ * and update them by the message.
+ *
+ * @param arg the update_job
+ */
+static void rhash_update_job(void* arg)
+{
+	update_job* job = (update_job*)arg;
+	update_pool* pool = job->ectx->pool;
+
+	rhash_mutex_lock(&pool->lock);
+	while(job->next_item < job->ectx->hash_vector_size) {
+		rhash_vector_item* item = &job->ectx->vector[job->next_item++];
+		int j;
+		rhash_mutex_unlock(&pool->lock);
+		for(j = 0; j < job->iovcnt; j++) {
+			if(job->iov[j].iov_len == 0) continue;
+			item->hash_info->update(item->context, job->iov[j].iov_base, job->iov[j].iov_len);
+		}
+		rhash_mutex_lock(&pool->lock);
+	}
+	rhash_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Update all hashes of the context by the message, using worker threads.
+ *
+ * @param ectx the rhash context
+ * @param iov array of message fragments
+ * @param iovcnt the number of fragments
+ */
+static void rhash_pool_update(rhash_context_ext* ectx, const rhash_iovec* iov, int iovcnt)
+{
+	update_job job;
+	job.ectx = ectx;
+	job.iov = iov;
+	job.iovcnt = iovcnt;
+	job.next_item = 0;
+	rhash_pool_run(ectx->pool, rhash_update_job, &job);
+}
+
+/**
+ * Set the number of threads, updating the hashes of the context.
+ *
+ * @param ectx the rhash context
+ * @param count the number of threads, 0 or 1 to update hashes in the calling thread
+ * @return 0 on success, -1 on error and errno is set
+ */
+static int rhash_set_threads_count(rhash_context_ext* ectx, unsigned count)
+{
+	unsigned i;
+
+	/* there is no use in more threads, than hashes, unless a file can be split into chunks */
+	for(i = 0; i < ectx->hash_vector_size; i++) {
+		if(rhash_get_chunk_methods(ectx->vector[i].hash_info->info->hash_id)) break;
+	}
+	if(i == ectx->hash_vector_size && count > ectx->hash_vector_size) count = ectx->hash_vector_size;
+
+	if(ectx->pool) {
+		if(ectx->pool->threads_count + 1 == count) return 0;
+		rhash_destroy_pool(ectx->pool);
+		ectx->pool = NULL;
+	}
+	if(count > 1) {
+		ectx->pool = rhash_create_pool(count - 1);
+		if(!ectx->pool) return -1;
+	}
+	return 0;
+}
+
+/**
+ * Update the hash contexts by a message chunk, by one thread.
+ * Pairs of algorithms, having a stitched kernel, are updated at once.
+ *
+ * @param ectx the rhash context
+ * @param message message chunk
+ * @param length length of the message chunk
+ * @param skip_items bit mask of the vector items, which shall not be updated
+ */
+static void rhash_update_items(rhash_context_ext* ectx, const void* message, size_t length, unsigned skip_items)
+{
+	unsigned i;
+	for(i = 0; i < ectx->stitched_count; i++) {
+		unsigned item1 = ectx->stitched[i].item1, item2 = ectx->stitched[i].item2;
+		unsigned pair = (1u << item1) | (1u << item2);
+		if(skip_items & pair) continue;
+		ectx->stitched[i].update(ectx->vector[item1].context, ectx->vector[item2].context, message, length);
+		skip_items |= pair;
+	}
+	for(i = 0; i < ectx->hash_vector_size; i++) {
+		const struct rhash_hash_info* info = ectx->vector[i].hash_info;
+		if(skip_items & (1u << i)) continue;
+		assert(info->update != 0);
+		info->update(ectx->vector[i].context, message, length);
+	}
+}
+
 /**
  * Calculate hashes of message.
  * Can be called repeatedly with chunks of the message to be hashed.
@@ -251,22 +674,65 @@ RHASH_API void rhash_reset(rhash ctx)
 RHASH_API int rhash_update(rhash ctx, const void* message, size_t length)
 {
 	rhash_context_ext* const ectx = (rhash_context_ext*)ctx;
-	unsigned i;
 	
 	assert(ectx->hash_vector_size <= RHASH_HASH_COUNT);
-	if(ectx->state != STATE_ACTIVE) return 0; /* do nothing if canceled */
+	if(rhash_atomic_load(&ectx->state) != STATE_ACTIVE) return 0; /* do nothing if canceled */
 
 	ctx->msg_size += length;
 
-	/* call update method for every algorithm */
-	for(i = 0; i < ectx->hash_vector_size; i++) {
-		struct rhash_hash_info* info = ectx->vector[i].hash_info;
-		assert(info->update != 0);
-		info->update(ectx->vector[i].context, message, length);
+	if(ectx->pool && length >= RHASH_THREADED_MIN_SIZE) {
+		rhash_iovec iov;
+		iov.iov_base = (void*)message;
+		iov.iov_len = length;
+		rhash_pool_update(ectx, &iov, 1);
+		return 0;
 	}
+
+	/* call update method for every algorithm */
+	rhash_update_items(ectx, message, length, 0);
 	return 0; /* no error processing at the moment */
 }
 
+/**
+ * Calculate hashes of a message, consisting of several fragments.
+ * It is equivalent to calling rhash_update() for every fragment.
+ *
+ * @param ctx the rhash context
+ * @param iov array of message fragments
+ * @param iovcnt the number of fragments
+ * @return 0 on success; On fail return -1 and set errno
+ */
+RHASH_API int rhash_updatev(rhash ctx, const rhash_iovec* iov, int iovcnt)
+{
+	rhash_context_ext* const ectx = (rhash_context_ext*)ctx;
+	int j;
+	unsigned long long length = 0;
+
+	assert(ectx->hash_vector_size <= RHASH_HASH_COUNT);
+	if(iovcnt < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if(rhash_atomic_load(&ectx->state) != STATE_ACTIVE) return 0; /* do nothing if canceled */
+
+	for(j = 0; j < iovcnt; j++) {
+		length += iov[j].iov_len;
+	}
+	ctx->msg_size += length;
+
+	if(ectx->pool && length >= RHASH_THREADED_MIN_SIZE) {
+		rhash_pool_update(ectx, iov, iovcnt);
+		return 0;
+	}
+
+	/* call update method for every algorithm and message fragment */
+	for(j = 0; j < iovcnt; j++) {
+		if(iov[j].iov_len == 0) continue;
+		rhash_update_items(ectx, iov[j].iov_base, iov[j].iov_len, 0);
+	}
+	return 0;
+}
+
 /**
  * Finalize hash calculation and optionally store the first hash.
  *
@@ -288,7 +754,7 @@ RHASH_API int rhash_final(rhash ctx, unsigned char* first_result)
 
 	/* call final method for every algorithm */
 	for(i = 0; i < ectx->hash_vector_size; i++) {
-		struct rhash_hash_info* info = ectx->vector[i].hash_info;
+		const struct rhash_hash_info* info = ectx->vector[i].hash_info;
 		assert(info->final != 0);
 		assert(info->info->digest_size < sizeof(buffer));
 		info->final(ectx->vector[i].context, out);
@@ -312,7 +778,7 @@ static void rhash_put_digest(rhash ctx, unsigned hash_id, unsigned char* result)
 	rhash_context_ext* const ectx = (rhash_context_ext*)ctx;
 	unsigned i;
 	rhash_vector_item *item;
-	struct rhash_hash_info* info;
+	const struct rhash_hash_info* info;
 	unsigned char* digest;
 
 	assert(ectx);
@@ -350,7 +816,9 @@ static void rhash_put_digest(rhash ctx, unsigned hash_id, unsigned char* result)
  * Set the callback function to be called from the
  * rhash_file() and rhash_file_update() functions
  * on processing every file block. The file block
- * size is set internally by rhash and now is 8 KiB.
+ * size is set internally by rhash and now is 8 KiB,
+ * or the size set by rhash_set_file_block_size() for
+ * asynchronous reading.
  *
  * @param ctx rhash context
  * @param callback pointer to the callback function
@@ -365,8 +833,13 @@ RHASH_API void rhash_set_callback(rhash ctx, rhash_callback_t callback, void* ca
 
 /* hi-level message hashing interface */
 
+/* the size of a stack buffer used by rhash_msg() to store a rhash context */
+#define RHASH_MSG_CONTEXT_SIZE 1024
+
 /**
  * Compute a hash of the given message.
+ * For the most of hash combinations the function allocates no heap memory,
+ * storing the rhash context on the stack.
  *
  * @param hash_id id of hash sum to compute
  * @param message the message to process
@@ -376,9 +849,14 @@ RHASH_API void rhash_set_callback(rhash ctx, rhash_callback_t callback, void* ca
  */
 RHASH_API int rhash_msg(unsigned hash_id, const void* message, size_t length, unsigned char* result)
 {
+	union {
+		uint64_t align; /* align the buffer by 8 bytes */
+		unsigned char data[RHASH_MSG_CONTEXT_SIZE];
+	} buffer;
 	rhash ctx;
 	hash_id &= RHASH_ALL_HASHES;
-	ctx = rhash_init(hash_id);
+	ctx = (rhash_get_context_size(hash_id) <= sizeof(buffer) ?
+		rhash_init_in(&buffer, sizeof(buffer), hash_id) : rhash_init(hash_id));
 	if(ctx == NULL) return -1;
 	rhash_update(ctx, message, length);
 	rhash_final(ctx, result);
@@ -386,6 +864,683 @@ RHASH_API int rhash_msg(unsigned hash_id, const void* message, size_t length, un
 	return 0;
 }
 
+#ifdef _WIN32
+# define rhash_ftell64(fd) _ftelli64(fd)
+# define rhash_fseek64(fd, offset) _fseeki64(fd, offset, SEEK_SET)
+# define rhash_fstat64 _fstati64
+typedef struct _stati64 rhash_stat64_t;
+#else
+# define rhash_ftell64(fd) ftello(fd)
+# define rhash_fseek64(fd, offset) fseeko(fd, (off_t)(offset), SEEK_SET)
+# define rhash_fstat64 fstat
+typedef struct stat rhash_stat64_t;
+#endif
+
+/* default size of a block read by the asynchronous file reader */
+#define RHASH_ASYNC_BLOCK_SIZE (1024 * 1024)
+/* size of a file window mapped into memory by rhash_mmap_update() */
+#define RHASH_MMAP_WINDOW_SIZE (64 * 1024 * 1024)
+
+/**
+ * The state of an asynchronous file reader. The reader thread fills
+ * one buffer, while the calling thread hashes the other one.
+ */
+typedef struct file_reader
+{
+	int fd;                     /* descriptor of the file being read */
+	unsigned long long offset;  /* file offset of the next block to read */
+	unsigned long long end;     /* file offset to stop reading at */
+	size_t block_size;          /* size of each buffer */
+	unsigned char* buffers[2];  /* the double buffer */
+	size_t lengths[2];          /* number of bytes read into each buffer */
+	int filled[2];              /* non-zero if a buffer is ready for hashing */
+	int error;                  /* errno of a failed read, 0 on success */
+	int stop;                   /* non-zero if reading must be stopped */
+	rhash_mutex_t lock;
+	rhash_cond_t cond;
+} file_reader;
+
+/**
+ * Return the number of bytes to read into the next block.
+ *
+ * @param reader the file reader
+ * @return the size of the next block
+ */
+static size_t file_reader_next_size(file_reader* reader)
+{
+	unsigned long long left = (reader->end > reader->offset ? reader->end - reader->offset : 0);
+	return (left < reader->block_size ? (size_t)left : reader->block_size);
+}
+
+/**
+ * The reader thread: read file blocks into the buffers in turn,
+ * waiting for the hashing thread to release a buffer before reusing it.
+ *
+ * @param arg the file_reader structure
+ */
+static void file_reader_thread(void* arg)
+{
+	file_reader* const reader = (file_reader*)arg;
+	int i = 0;
+
+	for(;;) {
+		long long length;
+		int stop;
+
+		rhash_mutex_lock(&reader->lock);
+		while(reader->filled[i] && !reader->stop) {
+			rhash_cond_wait(&reader->cond, &reader->lock);
+		}
+		stop = reader->stop;
+		rhash_mutex_unlock(&reader->lock);
+		if(stop) break;
+
+		length = rhash_pread(reader->fd, reader->buffers[i],
+			file_reader_next_size(reader), reader->offset);
+
+		rhash_mutex_lock(&reader->lock);
+		if(length < 0) {
+			reader->error = (errno ? errno : EIO);
+			length = 0;
+		}
+		reader->lengths[i] = (size_t)length;
+		reader->filled[i] = 1;
+		rhash_cond_signal(&reader->cond);
+		rhash_mutex_unlock(&reader->lock);
+
+		/* a short block means the end of file or an error */
+		if((size_t)length < reader->block_size) break;
+		reader->offset += length;
+		i ^= 1;
+	}
+}
+
+/**
+ * Calculate the block size for reading of a file.
+ *
+ * @param ectx the rhash context
+ * @param st the file information
+ * @return the block size
+ */
+static size_t get_file_block_size(rhash_context_ext* ectx, rhash_stat64_t* st)
+{
+	size_t block_size = ectx->file_block_size;
+	if(block_size == 0) {
+		block_size = RHASH_ASYNC_BLOCK_SIZE;
+#ifndef _WIN32
+		/* use a multiple of the preferred I/O block size of the file system */
+		if(st->st_blksize > 0) {
+			size_t fs_block = (size_t)st->st_blksize;
+			block_size = (block_size + fs_block - 1) / fs_block * fs_block;
+		}
+#endif
+	}
+	return block_size;
+}
+
+/**
+ * A part of a file, hashed by a thread. It is either a range of chunks
+ * of one algorithm, or the whole file part for an algorithm, which
+ * can't hash chunks independently (or for a pair of such algorithms,
+ * updated by a stitched kernel).
+ */
+typedef struct chunk_task
+{
+	unsigned long long offset; /* the file offset of the first chunk */
+	size_t chunks;             /* the number of chunks, 0 for a sequential task */
+	size_t chunk_size;
+	const rhash_chunk_methods* methods;
+	void* context;             /* the algorithm context */
+	pupdate_t update;          /* the update method of the context backend */
+	unsigned char* results;    /* the buffer to receive results of the chunks */
+	unsigned skip_items;       /* bit mask of vector items not updated by a sequential task */
+} chunk_task;
+
+/**
+ * A file part, hashed by chunks by the threads of a pool.
+ */
+typedef struct chunked_job
+{
+	rhash_context_ext* ectx;
+	int fd;
+	unsigned long long offset; /* the file part to hash */
+	unsigned long long length;
+	unsigned split_items;      /* bit mask of vector items hashed by chunks */
+	chunk_task* tasks;
+	size_t tasks_count;
+	size_t next_task;          /* index of the next task to take */
+	int error;                 /* errno value of the first failed task */
+} chunked_job;
+
+/**
+ * Compare chunk tasks by the file offset.
+ */
+static int chunk_task_cmp(const void* a, const void* b)
+{
+	unsigned long long offset_a = ((const chunk_task*)a)->offset;
+	unsigned long long offset_b = ((const chunk_task*)b)->offset;
+	return (offset_a < offset_b ? -1 : offset_a > offset_b ? 1 : 0);
+}
+
+/**
+ * Execute a chunk task: read the chunks and store their results.
+ *
+ * @param job the chunked job
+ * @param task the task to execute
+ * @return 0 on success, -1 on error and errno is set
+ */
+static int rhash_run_chunk_task(chunked_job* job, chunk_task* task)
+{
+	unsigned char* buffer = (unsigned char*)rhash_aligned_alloc(RHASH_PAGE_ALIGNMENT, task->chunk_size);
+	size_t i;
+	if(!buffer) return -1;
+
+	for(i = 0; i < task->chunks && rhash_atomic_load(&job->ectx->state) == STATE_ACTIVE; i++) {
+		unsigned char* result = task->results + i * task->methods->result_size;
+		long long size = rhash_pread(job->fd, buffer, task->chunk_size,
+			task->offset + (unsigned long long)i * task->chunk_size);
+		if(size != (long long)task->chunk_size) {
+			if(size >= 0) errno = EIO; /* the file was truncated */
+			rhash_aligned_free(buffer);
+			return -1;
+		}
+		if(task->methods->hash_chunk) {
+			task->methods->hash_chunk(task->context, buffer, task->chunk_size, result);
+		} else {
+			/* use the implementation selected for the context */
+			memset(result, 0, task->methods->result_size);
+			task->update(result, buffer, task->chunk_size);
+		}
+	}
+	rhash_aligned_free(buffer);
+	return 0;
+}
+
+/**
+ * Execute a sequential task: hash the whole file part by the algorithms
+ * of the task, which are not hashed by chunks.
+ *
+ * @param job the chunked job
+ * @param task the task to execute
+ * @return 0 on success, -1 on error and errno is set
+ */
+static int rhash_run_sequential_task(chunked_job* job, chunk_task* task)
+{
+	rhash_context_ext* const ectx = job->ectx;
+	unsigned char* buffer = (unsigned char*)rhash_aligned_alloc(RHASH_PAGE_ALIGNMENT, RHASH_ASYNC_BLOCK_SIZE);
+	unsigned long long done;
+	if(!buffer) return -1;
+
+	for(done = 0; done < job->length && rhash_atomic_load(&ectx->state) == STATE_ACTIVE; ) {
+		size_t block_size = (job->length - done < RHASH_ASYNC_BLOCK_SIZE ?
+			(size_t)(job->length - done) : RHASH_ASYNC_BLOCK_SIZE);
+		long long size = rhash_pread(job->fd, buffer, block_size, job->offset + done);
+		if(size != (long long)block_size) {
+			if(size >= 0) errno = EIO; /* the file was truncated */
+			rhash_aligned_free(buffer);
+			return -1;
+		}
+		rhash_update_items(ectx, buffer, block_size, task->skip_items);
+		done += block_size;
+	}
+	rhash_aligned_free(buffer);
+	return 0;
+}
+
+/**
+ * Take tasks of the chunked job one by one and execute them.
+ *
+ * @param arg the chunked_job
+ */
+static void rhash_chunked_job(void* arg)
+{
+	chunked_job* job = (chunked_job*)arg;
+	update_pool* pool = job->ectx->pool;
+
+	for(;;) {
+		chunk_task* task;
+		int res;
+
+		rhash_mutex_lock(&pool->lock);
+		if(job->next_task >= job->tasks_count || job->error) {
+			rhash_mutex_unlock(&pool->lock);
+			break;
+		}
+		task = &job->tasks[job->next_task++];
+		rhash_mutex_unlock(&pool->lock);
+
+		res = (task->chunks > 0 ? rhash_run_chunk_task(job, task) : rhash_run_sequential_task(job, task));
+		if(res < 0) {
+			rhash_mutex_lock(&pool->lock);
+			if(!job->error) job->error = (errno ? errno : EIO);
+			rhash_mutex_unlock(&pool->lock);
+		}
+	}
+}
+
+/**
+ * Hash a part of a regular file by the worker threads of the context.
+ * The CRC32, TTH, ED2K, AICH and BTIH algorithms split the file part into chunks,
+ * which are hashed by different threads, and their results are merged
+ * in order. Every other algorithm hashes the whole part in its own thread,
+ * except for pairs updated by a stitched kernel, so the threads are never
+ * fewer, than the rhash_pool_update() would use.
+ *
+ * @param ectx the rhash context, having worker threads
+ * @param fd the descriptor of the file to hash
+ * @param offset the file offset to start hashing from
+ * @param length the number of bytes to hash, the file must contain them
+ * @return 1 if the file part was hashed, 0 if there are no algorithms to split
+ *         the file part into chunks, -1 on error and errno is set
+ */
+static int rhash_fd_chunked_update(rhash_context_ext* ectx, int fd,
+	unsigned long long offset, unsigned long long length)
+{
+	const unsigned threads = ectx->pool->threads_count + 1;
+	chunked_job job;
+	size_t chunks[RHASH_HASH_COUNT];
+	unsigned long long chunks_end[RHASH_HASH_COUNT]; /* the end of chunks of every algorithm */
+	unsigned char* results[RHASH_HASH_COUNT];
+	unsigned long long tail_start = length;
+	unsigned char* buffer;
+	unsigned sequential_items;
+	size_t sequential_count = 0;
+	unsigned i;
+	size_t k;
+	int res = 1;
+
+	memset(&job, 0, sizeof(job));
+	job.ectx = ectx;
+	job.fd = fd;
+	job.offset = offset;
+	job.length = length;
+
+	/* find the algorithms, which can hash at least two chunks */
+	for(i = 0; i < ectx->hash_vector_size; i++) {
+		const rhash_chunk_methods* methods = rhash_get_chunk_methods(ectx->vector[i].hash_info->info->hash_id);
+		size_t chunk_size = (methods ? methods->chunk_size(ectx->vector[i].context) : 0);
+		chunks[i] = (chunk_size > 0 ? (size_t)(length / chunk_size) : 0);
+		results[i] = NULL;
+		if(chunks[i] < 2) continue;
+		job.split_items |= 1u << i;
+		job.tasks_count += (chunks[i] < threads * 4 ? chunks[i] : threads * 4);
+	}
+	if(job.split_items == 0) return 0;
+
+	/* the algorithms, which are not split, get a sequential task each */
+	sequential_items = ~job.split_items & ((1u << ectx->hash_vector_size) - 1);
+	for(i = 0; i < ectx->hash_vector_size; i++) {
+		if(sequential_items & (1u << i)) sequential_count++;
+	}
+	for(i = 0; i < ectx->stitched_count; i++) {
+		unsigned pair = (1u << ectx->stitched[i].item1) | (1u << ectx->stitched[i].item2);
+		if((sequential_items & pair) == pair) sequential_count--; /* one task for both items */
+	}
+	job.tasks_count += sequential_count;
+
+	job.tasks = (chunk_task*)calloc(job.tasks_count, sizeof(chunk_task));
+	if(!job.tasks) return -1;
+
+	/* the sequential tasks are the longest ones, so they are taken first */
+	for(i = 0, k = 0; i < ectx->hash_vector_size; i++) {
+		unsigned items = 1u << i;
+		unsigned j;
+		if(!(sequential_items & items)) continue;
+		for(j = 0; j < ectx->stitched_count; j++) {
+			unsigned pair = (1u << ectx->stitched[j].item1) | (1u << ectx->stitched[j].item2);
+			if((pair & items) && (sequential_items & pair) == pair) items = pair;
+		}
+		sequential_items &= ~items;
+		job.tasks[k].offset = offset;
+		job.tasks[k].skip_items = ~items;
+		k++;
+	}
+	assert(k == sequential_count);
+
+	/* split chunks of every algorithm into tasks */
+	for(i = 0; i < ectx->hash_vector_size; i++) {
+		const rhash_chunk_methods* methods;
+		size_t chunk_size, parts, first, part;
+		if(!(job.split_items & (1u << i))) continue;
+		methods = rhash_get_chunk_methods(ectx->vector[i].hash_info->info->hash_id);
+		chunk_size = methods->chunk_size(ectx->vector[i].context);
+		chunks_end[i] = (unsigned long long)chunks[i] * chunk_size;
+		if(tail_start > chunks_end[i]) tail_start = chunks_end[i];
+		results[i] = (unsigned char*)malloc(chunks[i] * methods->result_size);
+		if(!results[i]) {
+			res = -1;
+			goto cleanup;
+		}
+		parts = (chunks[i] < threads * 4 ? chunks[i] : threads * 4);
+		for(part = 0, first = 0; part < parts; part++, k++) {
+			size_t next = chunks[i] * (part + 1) / parts;
+			job.tasks[k].offset = offset + (unsigned long long)first * chunk_size;
+			job.tasks[k].chunks = next - first;
+			job.tasks[k].chunk_size = chunk_size;
+			job.tasks[k].methods = methods;
+			job.tasks[k].context = ectx->vector[i].context;
+			job.tasks[k].update = ectx->vector[i].hash_info->update;
+			job.tasks[k].results = results[i] + first * methods->result_size;
+			first = next;
+		}
+	}
+	/* threads reading near file offsets share the page cache */
+	qsort(job.tasks + sequential_count, job.tasks_count - sequential_count, sizeof(chunk_task), chunk_task_cmp);
+	rhash_pool_run(ectx->pool, rhash_chunked_job, &job);
+	if(job.error) {
+		errno = job.error;
+		res = -1;
+		goto cleanup;
+	}
+	if(rhash_atomic_load(&ectx->state) != STATE_ACTIVE) goto cleanup;
+
+	/* merge results of the chunks in order */
+	for(i = 0; i < ectx->hash_vector_size; i++) {
+		const rhash_chunk_methods* methods;
+		if(!(job.split_items & (1u << i))) continue;
+		methods = rhash_get_chunk_methods(ectx->vector[i].hash_info->info->hash_id);
+		for(k = 0; k < chunks[i]; k++) {
+			methods->add_chunk(ectx->vector[i].context, results[i] + k * methods->result_size);
+		}
+	}
+
+	/* hash the rest of the file part, which doesn't fill a whole chunk */
+	buffer = (unsigned char*)rhash_aligned_alloc(RHASH_PAGE_ALIGNMENT, RHASH_ASYNC_BLOCK_SIZE);
+	if(!buffer) {
+		res = -1;
+		goto cleanup;
+	}
+	while(tail_start < length) {
+		size_t block_size = (length - tail_start < RHASH_ASYNC_BLOCK_SIZE ?
+			(size_t)(length - tail_start) : RHASH_ASYNC_BLOCK_SIZE);
+		long long size = rhash_pread(fd, buffer, block_size, offset + tail_start);
+		if(size != (long long)block_size) {
+			if(size >= 0) errno = EIO;
+			res = -1;
+			break;
+		}
+		for(i = 0; i < ectx->hash_vector_size; i++) {
+			size_t skip;
+			if(!(job.split_items & (1u << i)) || chunks_end[i] >= tail_start + block_size) continue;
+			skip = (chunks_end[i] > tail_start ? (size_t)(chunks_end[i] - tail_start) : 0);
+			ectx->vector[i].hash_info->update(ectx->vector[i].context, buffer + skip, block_size - skip);
+		}
+		tail_start += block_size;
+	}
+	rhash_aligned_free(buffer);
+	if(res < 0) goto cleanup;
+	ectx->rc.msg_size += length;
+	if(ectx->callback) {
+		((rhash_callback_t)ectx->callback)(ectx->callback_data, ectx->rc.msg_size);
+	}
+
+cleanup:
+	for(i = 0; i < ectx->hash_vector_size; i++) free(results[i]);
+	free(job.tasks);
+	return res;
+}
+
+/**
+ * Hash the given part of a file, reading it by pread() calls into an
+ * aligned buffer. If asynchronous reading is on and the data doesn't fit
+ * into one block, then a separate thread reads the file into a double
+ * buffer, while the calling thread calculates hashes. If the context has
+ * worker threads, then a regular file can be hashed by chunks in parallel.
+ *
+ * @param ectx the rhash context
+ * @param fd the descriptor of the file to hash
+ * @param offset the file offset to start hashing from
+ * @param length the number of bytes to hash, reading stops earlier at the end of file
+ * @param expected the expected number of bytes to hash
+ * @param st the file information
+ * @param pnext_offset receives the file offset, where hashing stopped
+ * @return 0 on success, -1 on error and errno is set
+ */
+static int rhash_fd_read_update(rhash_context_ext* ectx, int fd,
+	unsigned long long offset, unsigned long long length,
+	unsigned long long expected, rhash_stat64_t* st, unsigned long long* pnext_offset)
+{
+	file_reader reader;
+	rhash_thread_t thread;
+	size_t block_size = get_file_block_size(ectx, st);
+	int i = 0, res = 0;
+
+	*pnext_offset = offset;
+	if(ectx->pool && (st->st_mode & S_IFMT) == S_IFREG) {
+		/* split a big file into chunks, hashed by the worker threads */
+		int chunked = rhash_fd_chunked_update(ectx, fd, offset, expected);
+		if(chunked < 0) return -1;
+		if(chunked > 0) {
+			*pnext_offset = offset + expected;
+			return 0;
+		}
+	}
+
+	memset(&reader, 0, sizeof(reader));
+	reader.fd = fd;
+	reader.offset = offset;
+	reader.end = (length > ~offset ? ~0ULL : offset + length);
+
+	if(expected < block_size || (ectx->flags & RCTX_ASYNC_READ) == 0) {
+		/* read small files and use no thread in synchronous mode */
+		if(expected < block_size) {
+			block_size = (size_t)expected + 1; /* +1 byte to detect growing files */
+		}
+		reader.block_size = block_size;
+		reader.buffers[0] = (unsigned char*)rhash_aligned_alloc(RHASH_PAGE_ALIGNMENT, block_size);
+		if(!reader.buffers[0]) return -1;
+
+		while(rhash_atomic_load(&ectx->state) == STATE_ACTIVE) {
+			long long size = rhash_pread(fd, reader.buffers[0],
+				file_reader_next_size(&reader), reader.offset);
+			if(size < 0) {
+				res = -1;
+				break;
+			}
+			if(size > 0) {
+				rhash_update(&ectx->rc, reader.buffers[0], (size_t)size);
+				reader.offset += size;
+				if(ectx->callback) {
+					((rhash_callback_t)ectx->callback)(ectx->callback_data, ectx->rc.msg_size);
+				}
+			}
+			if((size_t)size < block_size) break; /* end of file */
+		}
+		*pnext_offset = reader.offset;
+		rhash_aligned_free(reader.buffers[0]);
+		return res;
+	}
+
+	reader.block_size = block_size;
+	reader.buffers[0] = (unsigned char*)rhash_aligned_alloc(RHASH_PAGE_ALIGNMENT, block_size);
+	reader.buffers[1] = (unsigned char*)rhash_aligned_alloc(RHASH_PAGE_ALIGNMENT, block_size);
+	if(!reader.buffers[0] || !reader.buffers[1]) {
+		rhash_aligned_free(reader.buffers[0]);
+		rhash_aligned_free(reader.buffers[1]);
+		return -1;
+	}
+	rhash_mutex_init(&reader.lock);
+	rhash_cond_init(&reader.cond);
+
+	if(rhash_thread_create(&thread, file_reader_thread, &reader) < 0) {
+		res = -1;
+	} else {
+		for(;;) {
+			size_t size;
+			int error;
+
+			/* wait for the reader thread to fill the buffer */
+			rhash_mutex_lock(&reader.lock);
+			while(!reader.filled[i]) {
+				rhash_cond_wait(&reader.cond, &reader.lock);
+			}
+			size = reader.lengths[i];
+			error = reader.error;
+			rhash_mutex_unlock(&reader.lock);
+
+			if(error) {
+				errno = error;
+				res = -1;
+				break;
+			}
+			if(size > 0) {
+				rhash_update(&ectx->rc, reader.buffers[i], size);
+				*pnext_offset += size;
+				if(ectx->callback) {
+					((rhash_callback_t)ectx->callback)(ectx->callback_data, ectx->rc.msg_size);
+				}
+			}
+			if(size < block_size) break; /* end of file */
+			if(rhash_atomic_load(&ectx->state) != STATE_ACTIVE) break; /* stop if canceled */
+
+			/* release the buffer for the reader thread */
+			rhash_mutex_lock(&reader.lock);
+			reader.filled[i] = 0;
+			rhash_cond_signal(&reader.cond);
+			rhash_mutex_unlock(&reader.lock);
+			i ^= 1;
+		}
+
+		/* stop the reader thread */
+		rhash_mutex_lock(&reader.lock);
+		reader.stop = 1;
+		rhash_cond_signal(&reader.cond);
+		rhash_mutex_unlock(&reader.lock);
+		rhash_thread_join(&thread);
+	}
+
+	rhash_cond_destroy(&reader.cond);
+	rhash_mutex_destroy(&reader.lock);
+	rhash_aligned_free(reader.buffers[0]);
+	rhash_aligned_free(reader.buffers[1]);
+	return res;
+}
+
+/**
+ * Hash a part of a file, given by its descriptor. The file is read by
+ * pread() calls, so the file position of the descriptor is not changed.
+ * If asynchronous reading is turned on by rhash_set_async_read(), then
+ * the file is read by a separate thread.
+ *
+ * @param ctx rhash context
+ * @param fd descriptor of the file to hash
+ * @param offset the file offset to start hashing from
+ * @param length the number of bytes to hash or RHASH_TILL_EOF
+ * @return 0 on success, -1 on error and errno is set
+ */
+RHASH_API int rhash_fd_update(rhash ctx, int fd, unsigned long long offset, unsigned long long length)
+{
+	rhash_context_ext* const ectx = (rhash_context_ext*)ctx;
+	rhash_stat64_t st;
+	unsigned long long expected, next_offset;
+
+	if(ctx == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if(rhash_atomic_load(&ectx->state) != STATE_ACTIVE) return 0; /* do nothing if canceled */
+	if(rhash_fstat64(fd, &st) < 0) return -1;
+
+	/* the size of a regular file is known in advance */
+	expected = length;
+	if((st.st_mode & S_IFMT) == S_IFREG) {
+		unsigned long long left = ((unsigned long long)st.st_size > offset ?
+			(unsigned long long)st.st_size - offset : 0);
+		if(left < expected) expected = left;
+	}
+	return rhash_fd_read_update(ectx, fd, offset, length, expected, &st, &next_offset);
+}
+
+/**
+ * Hash a part of a file, given by its descriptor, by mapping the file
+ * into memory. The file is mapped by windows of 64 MiB, which are passed
+ * to rhash_update() without copying.
+ *
+ * @param ctx rhash context
+ * @param fd descriptor of a regular file to hash
+ * @param offset the file offset to start hashing from
+ * @param length the number of bytes to hash or RHASH_TILL_EOF
+ * @return 0 on success, -1 on error and errno is set
+ */
+RHASH_API int rhash_mmap_update(rhash ctx, int fd, unsigned long long offset, unsigned long long length)
+{
+	rhash_context_ext* const ectx = (rhash_context_ext*)ctx;
+	rhash_stat64_t st;
+	unsigned long long end, granularity;
+#ifdef _WIN32
+	SYSTEM_INFO sys_info;
+	HANDLE mapping;
+#endif
+
+	if(ctx == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if(rhash_atomic_load(&ectx->state) != STATE_ACTIVE) return 0; /* do nothing if canceled */
+	if(rhash_fstat64(fd, &st) < 0) return -1;
+	if((st.st_mode & S_IFMT) != S_IFREG) {
+		errno = EINVAL; /* only regular files can be mapped */
+		return -1;
+	}
+
+	/* never map beyond the end of file */
+	end = (unsigned long long)st.st_size;
+	if(offset >= end) return 0;
+	if(length < end - offset) end = offset + length;
+
+#ifdef _WIN32
+	GetSystemInfo(&sys_info);
+	granularity = sys_info.dwAllocationGranularity;
+	mapping = CreateFileMapping((HANDLE)_get_osfhandle(fd), NULL, PAGE_READONLY, 0, 0, NULL);
+	if(mapping == NULL) {
+		errno = EACCES;
+		return -1;
+	}
+#else
+	granularity = (unsigned long long)sysconf(_SC_PAGESIZE);
+#endif
+
+	while(offset < end && rhash_atomic_load(&ectx->state) == STATE_ACTIVE) {
+		/* the mapping offset must be a multiple of the page size */
+		unsigned long long map_offset = offset - offset % granularity;
+		size_t shift = (size_t)(offset - map_offset);
+		size_t size = (end - offset > RHASH_MMAP_WINDOW_SIZE ? RHASH_MMAP_WINDOW_SIZE : (size_t)(end - offset));
+		unsigned char* map;
+
+#ifdef _WIN32
+		map = (unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ,
+			(DWORD)(map_offset >> 32), (DWORD)map_offset, shift + size);
+		if(map == NULL) {
+			CloseHandle(mapping);
+			errno = ENOMEM;
+			return -1;
+		}
+#else
+		map = (unsigned char*)mmap(NULL, shift + size, PROT_READ, MAP_SHARED, fd, (off_t)map_offset);
+		if(map == (unsigned char*)MAP_FAILED) return -1;
+# ifdef MADV_SEQUENTIAL
+		madvise(map, shift + size, MADV_SEQUENTIAL);
+# endif
+#endif
+
+		rhash_update(ctx, map + shift, size);
+		offset += size;
+
+#ifdef _WIN32
+		UnmapViewOfFile(map);
+#else
+		munmap(map, shift + size);
+#endif
+		if(ectx->callback) {
+			((rhash_callback_t)ectx->callback)(ectx->callback_data, ectx->rc.msg_size);
+		}
+	}
+#ifdef _WIN32
+	CloseHandle(mapping);
+#endif
+	return 0;
+}
+
 /**
  * Hash a file or stream. Multiple hashes can be computed.
  * First, inintialize ctx parameter with rhash_init() before calling
@@ -393,6 +1548,10 @@ RHASH_API int rhash_msg(unsigned hash_id, const void* message, size_t length, un
  * to retrive hash values. Finaly call rhash_free() on ctx
  * to free allocated memory or call rhash_reset() to reuse ctx.
  *
+ * If asynchronous reading is turned on by rhash_set_async_read() and
+ * the fd is a regular file, then the file is read by a separate thread,
+ * while the calling thread calculates hashes.
+ *
  * @param ctx rhash context
  * @param fd descriptor of the file to hash
  * @return 0 on success, -1 on error and errno is set
@@ -404,12 +1563,29 @@ RHASH_API int rhash_file_update(rhash ctx, FILE* fd)
 	unsigned char *buffer, *pmem;
 	size_t length = 0, align8;
 	int res = 0;
-	if(ectx->state != STATE_ACTIVE) return 0; /* do nothing if canceled */
 
 	if(ctx == NULL) {
 		errno = EINVAL;
 		return -1;
 	}
+	if(rhash_atomic_load(&ectx->state) != STATE_ACTIVE) return 0; /* do nothing if canceled */
+
+	if((ectx->flags & RCTX_ASYNC_READ) != 0 || ectx->pool) {
+		rhash_stat64_t st;
+		long long offset = rhash_ftell64(fd);
+
+		/* only regular files can be read by pread() */
+		if(offset >= 0 && rhash_fstat64(fileno(fd), &st) == 0 && (st.st_mode & S_IFMT) == S_IFREG) {
+			unsigned long long next_offset;
+			unsigned long long expected = ((unsigned long long)st.st_size > (unsigned long long)offset ?
+				(unsigned long long)st.st_size - offset : 0);
+			res = rhash_fd_read_update(ectx, fileno(fd), offset, RHASH_TILL_EOF, expected, &st, &next_offset);
+
+			/* move the stream position past the hashed data */
+			rhash_fseek64(fd, next_offset);
+			return res;
+		}
+	}
 
 	pmem = (unsigned char*)malloc(block_size + 8);
 	if(!pmem) return -1; /* errno is set to ENOMEM according to UNIX 98 */
@@ -418,7 +1594,7 @@ RHASH_API int rhash_file_update(rhash ctx, FILE* fd)
 	buffer = pmem + align8;
 
 	while(!feof(fd)) {
-		if(ectx->state != STATE_ACTIVE) break; /* stop if canceled */
+		if(rhash_atomic_load(&ectx->state) != STATE_ACTIVE) break; /* stop if canceled */
 
 		length = fread(buffer, 1, block_size, fd);
 		/* read can return -1 on error */
@@ -433,7 +1609,7 @@ RHASH_API int rhash_file_update(rhash ctx, FILE* fd)
 		}
 	}
 
-	free(buffer);
+	free(pmem);
 	return res;
 }
 
@@ -519,7 +1695,7 @@ const rhash_info* rhash_info_by_id(unsigned hash_id)
 	/* check that only one bit is set */
 	if(hash_id != (hash_id & -(int)hash_id)) return NULL;
 	/* note: alternative condition is (hash_id == 0 || (hash_id & (hash_id - 1)) != 0) */
-	return rhash_info_table[rhash_ctz(hash_id)].info;
+	return rhash_hash_info_default[rhash_ctz(hash_id)].info;
 }
 
 /**
@@ -544,7 +1720,7 @@ RHASH_API int rhash_get_digest_size(unsigned hash_id)
 {
 	hash_id &= RHASH_ALL_HASHES;
 	if(hash_id == 0 || (hash_id & (hash_id - 1)) != 0) return -1;
-	return (int)rhash_info_table[rhash_ctz(hash_id)].info->digest_size;
+	return (int)rhash_hash_info_default[rhash_ctz(hash_id)].info->digest_size;
 }
 
 /**
@@ -883,7 +2059,7 @@ RHASH_API rhash_uptr_t rhash_transmit(unsigned msg_id, void* dst, rhash_uptr_t l
 		{
 			unsigned i;
 			for(i = 0; i < ctx->hash_vector_size; i++) {
-				struct rhash_hash_info* info = ctx->vector[i].hash_info;
+				const struct rhash_hash_info* info = ctx->vector[i].hash_info;
 				if(info->info->hash_id == (unsigned)ldata)
 					return PVOID2UPTR(ctx->vector[i].context);
 			}
@@ -892,11 +2068,11 @@ RHASH_API rhash_uptr_t rhash_transmit(unsigned msg_id, void* dst, rhash_uptr_t l
 
 	case RMSG_CANCEL:
 		/* mark rhash context as canceled, in a multithreaded program */
-		atomic_compare_and_swap(&ctx->state, STATE_ACTIVE, STATE_STOPED);
+		rhash_atomic_cas(&ctx->state, STATE_ACTIVE, STATE_STOPED);
 		return 0;
 
 	case RMSG_IS_CANCELED:
-		return (ctx->state == STATE_STOPED);
+		return (rhash_atomic_load(&ctx->state) == STATE_STOPED);
 
 	case RMSG_GET_FINALIZED:
 		return ((ctx->flags & RCTX_FINALIZED) != 0);
@@ -904,14 +2080,39 @@ RHASH_API rhash_uptr_t rhash_transmit(unsigned msg_id, void* dst, rhash_uptr_t l
 		ctx->flags &= ~RCTX_AUTO_FINAL;
 		if(ldata) ctx->flags |= RCTX_AUTO_FINAL;
 		break;
+	case RMSG_SET_ASYNC_READ:
+		ctx->flags &= ~RCTX_ASYNC_READ;
+		if(ldata) ctx->flags |= RCTX_ASYNC_READ;
+		break;
+	case RMSG_SET_FILE_BLOCK_SIZE:
+		ctx->file_block_size = (size_t)ldata;
+		break;
+	case RMSG_SET_THREADS:
+		if(rhash_set_threads_count(ctx, (unsigned)ldata) < 0) return RHASH_ERROR;
+		break;
+
+	/* messages to select implementations of hash algorithms */
+	case RMSG_GET_CPU_FEATURES:
+		return rhash_cpu_features();
+	case RMSG_SET_CPU_FEATURES:
+		rhash_set_cpu_features_mask((unsigned)ldata);
+		if(rhash_select_impls() < 0) return RHASH_ERROR;
+		break;
+	case RMSG_GET_IMPLEMENTATION:
+		/* the implementation used by the given context or by new contexts */
+		if(ctx) return RHASH_STR2UPTR(rhash_backend_impl(ctx->backend, (unsigned)ldata));
+		return RHASH_STR2UPTR(rhash_get_impl((unsigned)ldata));
+	case RMSG_SET_IMPLEMENTATION:
+		if(rhash_set_impl((unsigned)ldata, (const char*)RHASH_UPTR2PVOID(rdata)) < 0) return RHASH_ERROR;
+		break;
 
 	/* OpenSSL related messages */
 #ifdef USE_OPENSSL
 	case RMSG_SET_OPENSSL_MASK:
-		rhash_openssl_hash_mask = (unsigned)ldata;
+		rhash_atomic_store(&rhash_openssl_hash_mask, (unsigned)ldata);
 		break;
 	case RMSG_GET_OPENSSL_MASK:
-		return rhash_openssl_hash_mask;
+		return rhash_atomic_load(&rhash_openssl_hash_mask);
 #endif
 
 	/* BitTorrent related messages */
@@ -0,0 +1,119 @@
+/* rhash_thread.c - portable threads and synchronization primitives
+ *
+ * Copyright: 2013 Aleksey Kravchenko <rhash.admin@gmail.com>
+ *
+ * Permission is hereby granted,  free of charge,  to any person  obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction,  including without limitation
+ * the rights to  use, copy, modify,  merge, publish, distribute, sublicense,
+ * and/or sell copies  of  the Software,  and to permit  persons  to whom the
+ * Software is furnished to do so.
+ *
+ * This program  is  distributed  in  the  hope  that it will be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  Use this program  at  your own risk!
+ */
+#include <stdlib.h>
+#include <errno.h>
+#include "rhash_thread.h"
+
+#ifdef _WIN32
+# include <process.h> /* _beginthreadex() */
+#else
+# include <unistd.h> /* sysconf() */
+#endif
+
+/**
+ * Thread start data, passed from rhash_thread_create() to the new thread.
+ */
+typedef struct thread_start_data
+{
+	rhash_thread_func_t func;
+	void* arg;
+} thread_start_data;
+
+/**
+ * The entry point of every thread created by rhash_thread_create().
+ * It unpacks and frees the start data, then calls the thread function.
+ *
+ * @param data pointer to the thread_start_data structure
+ */
+#ifdef _WIN32
+static unsigned __stdcall thread_start(void* data)
+#else
+static void* thread_start(void* data)
+#endif
+{
+	thread_start_data start = *(thread_start_data*)data;
+	free(data);
+	start.func(start.arg);
+	return 0;
+}
+
+/**
+ * Start a new thread executing given function.
+ *
+ * @param thread pointer to receive the thread handle
+ * @param func the function to execute
+ * @param arg the argument to pass to the function
+ * @return 0 on success, -1 on error and errno is set
+ */
+int rhash_thread_create(rhash_thread_t* thread, rhash_thread_func_t func, void* arg)
+{
+	thread_start_data* data = (thread_start_data*)malloc(sizeof(thread_start_data));
+	if(!data) return -1;
+	data->func = func;
+	data->arg = arg;
+
+#ifdef _WIN32
+	*thread = (HANDLE)_beginthreadex(NULL, 0, thread_start, data, 0, NULL);
+	if(*thread == 0) {
+		free(data);
+		return -1; /* note: _beginthreadex sets errno */
+	}
+#else
+	{
+		int res = pthread_create(thread, NULL, thread_start, data);
+		if(res != 0) {
+			free(data);
+			errno = res;
+			return -1;
+		}
+	}
+#endif
+	return 0;
+}
+
+/**
+ * Wait for a thread to finish and release its resources.
+ *
+ * @param thread the thread to join
+ */
+void rhash_thread_join(rhash_thread_t* thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(*thread, INFINITE);
+	CloseHandle(*thread);
+#else
+	pthread_join(*thread, NULL);
+#endif
+}
+
+/**
+ * Return the number of online processors.
+ *
+ * @return the number of processors, at least 1
+ */
+unsigned rhash_get_cpu_count(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (info.dwNumberOfProcessors > 0 ? (unsigned)info.dwNumberOfProcessors : 1);
+#elif defined(_SC_NPROCESSORS_ONLN)
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0 ? (unsigned)count : 1);
+#else
+	return 1;
+#endif
+}
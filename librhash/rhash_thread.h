@@ -0,0 +1,59 @@
+/* rhash_thread.h - portable threads and synchronization primitives */
+#ifndef RHASH_THREAD_H
+#define RHASH_THREAD_H
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <pthread.h>
+# include <sched.h> /* sched_yield() */
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+typedef HANDLE rhash_thread_t;
+typedef CRITICAL_SECTION rhash_mutex_t;
+typedef CONDITION_VARIABLE rhash_cond_t;
+
+# define rhash_mutex_init(m)    InitializeCriticalSection(m)
+# define rhash_mutex_destroy(m) DeleteCriticalSection(m)
+# define rhash_mutex_lock(m)    EnterCriticalSection(m)
+# define rhash_mutex_unlock(m)  LeaveCriticalSection(m)
+# define rhash_cond_init(c)      InitializeConditionVariable(c)
+# define rhash_cond_destroy(c)   /* nothing to free */
+# define rhash_cond_wait(c, m)   SleepConditionVariableCS(c, m, INFINITE)
+# define rhash_cond_signal(c)    WakeConditionVariable(c)
+# define rhash_cond_broadcast(c) WakeAllConditionVariable(c)
+# define rhash_thread_yield()    SwitchToThread()
+#else
+typedef pthread_t rhash_thread_t;
+typedef pthread_mutex_t rhash_mutex_t;
+typedef pthread_cond_t rhash_cond_t;
+
+# define rhash_mutex_init(m)    pthread_mutex_init(m, NULL)
+# define rhash_mutex_destroy(m) pthread_mutex_destroy(m)
+# define rhash_mutex_lock(m)    pthread_mutex_lock(m)
+# define rhash_mutex_unlock(m)  pthread_mutex_unlock(m)
+# define rhash_cond_init(c)      pthread_cond_init(c, NULL)
+# define rhash_cond_destroy(c)   pthread_cond_destroy(c)
+# define rhash_cond_wait(c, m)   pthread_cond_wait(c, m)
+# define rhash_cond_signal(c)    pthread_cond_signal(c)
+# define rhash_cond_broadcast(c) pthread_cond_broadcast(c)
+# define rhash_thread_yield()    sched_yield()
+#endif
+
+/** type of a function executed by a thread */
+typedef void (*rhash_thread_func_t)(void* arg);
+
+int  rhash_thread_create(rhash_thread_t* thread, rhash_thread_func_t func, void* arg);
+void rhash_thread_join(rhash_thread_t* thread);
+unsigned rhash_get_cpu_count(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* RHASH_THREAD_H */
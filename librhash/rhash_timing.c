@@ -19,8 +19,14 @@
 # define RHASH_API __declspec(dllexport)
 #endif
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "byte_order.h"
 #include "rhash.h"
+#include "algorithms.h"
+#include "cpu_features.h"
+#include "version.h"
 #include "rhash_timing.h"
 
 /* DEFINE read_tsc() if possible */
@@ -248,3 +254,219 @@ void rhash_run_benchmark(unsigned hash_id, unsigned flags, FILE* output)
 		fprintf(output, "\n");
 	}
 }
+
+/* AUTO-TUNING OF IMPLEMENTATIONS */
+
+/* the maximal number of implementations of a hash algorithm to compare */
+#define AUTOTUNE_MAX_IMPLS 8
+/* the number of times to measure an implementation, the best time is taken */
+#define AUTOTUNE_ROUNDS 5
+/* the number of message chunks to hash per measurement */
+#define AUTOTUNE_CHUNKS 32
+/* an implementation must be that much faster to replace the default one */
+#define AUTOTUNE_MARGIN 0.98
+
+/**
+ * Build the key of an auto-tuning cache file, identifying the library
+ * version, the CPU model and the instruction sets allowed to use.
+ *
+ * @param key the buffer to receive the key
+ * @param size the buffer size
+ */
+static void autotune_cache_key(char* key, size_t size)
+{
+	char model[49];
+	rhash_get_cpu_model(model, sizeof(model));
+	snprintf(key, size, "RHash %s autotune, cpu features 0x%x, %s", VERSION, rhash_cpu_features(), model);
+}
+
+/**
+ * Load the implementations, selected by a previous auto-tuning,
+ * from a cache file. The file is ignored if its key doesn't match
+ * or if any of its lines is malformed.
+ *
+ * @param path the path of the cache file
+ * @param choices the array to receive the implementation names by hash algorithm bit index
+ * @return the bit-mask of hash algorithms loaded
+ */
+static unsigned autotune_load(const char* path, char choices[][32])
+{
+	char key[160], line[160], hash_name[32], impl_name[32];
+	unsigned loaded = 0;
+	FILE* fd = fopen(path, "r");
+	if(!fd) return 0;
+
+	autotune_cache_key(key, sizeof(key));
+	if(!fgets(line, sizeof(line), fd) || strncmp(line, key, strlen(key)) != 0 ||
+		(line[strlen(key)] != '\n' && line[strlen(key)] != '\0')) {
+		fclose(fd);
+		return 0;
+	}
+	while(fgets(line, sizeof(line), fd)) {
+		unsigned hash_id;
+		int end = 0;
+		/* a truncated or a too long line, unknown algorithm or extra words */
+		if(!strchr(line, '\n') || sscanf(line, "%31s %31s %n", hash_name, impl_name, &end) != 2 ||
+				line[end] != '\0') {
+			loaded = 0;
+			break;
+		}
+		for(hash_id = 1; hash_id & RHASH_ALL_HASHES; hash_id <<= 1) {
+			if(strcmp(rhash_get_name(hash_id), hash_name) == 0) break;
+		}
+		if(!(hash_id & RHASH_ALL_HASHES)) {
+			loaded = 0;
+			break;
+		}
+		strcpy(choices[rhash_ctz(hash_id)], impl_name);
+		loaded |= hash_id;
+	}
+	if(ferror(fd)) loaded = 0;
+	fclose(fd);
+	return loaded;
+}
+
+/**
+ * Save the selected implementations to a cache file.
+ * The file is written under a temporary name in the same directory
+ * and then renamed, so a concurrent reader never sees a partial file.
+ *
+ * @param path the path of the cache file
+ * @param choices the implementation names by hash algorithm bit index
+ * @param hash_ids the bit-mask of hash algorithms to save
+ * @return 0 on success, -1 on error
+ */
+static int autotune_save(const char* path, char choices[][32], unsigned hash_ids)
+{
+	char key[160];
+	unsigned hash_id;
+	int res;
+	size_t len = strlen(path);
+	char* tmp_path = (char*)malloc(len + 5);
+	FILE* fd;
+	if(!tmp_path) return -1;
+	memcpy(tmp_path, path, len);
+	strcpy(tmp_path + len, ".new");
+
+	fd = fopen(tmp_path, "w");
+	if(!fd) {
+		free(tmp_path);
+		return -1;
+	}
+	autotune_cache_key(key, sizeof(key));
+	fprintf(fd, "%s\n", key);
+	for(hash_id = 1; hash_id & RHASH_ALL_HASHES; hash_id <<= 1) {
+		if(hash_ids & hash_id) fprintf(fd, "%s %s\n", rhash_get_name(hash_id), choices[rhash_ctz(hash_id)]);
+	}
+	res = (ferror(fd) ? -1 : 0);
+	if(fclose(fd) != 0) res = -1;
+
+	if(res == 0) {
+#ifdef _WIN32
+		/* under win32 the cache file must be removed before overwriting it */
+		remove(path);
+#endif
+		if(rename(tmp_path, path) < 0) res = -1;
+	}
+	if(res < 0) remove(tmp_path);
+	free(tmp_path);
+	return res;
+}
+
+/**
+ * Measure the time of hashing a message by the selected implementation.
+ *
+ * @param hash_id hash algorithm identifier
+ * @param message a message chunk to hash repeatedly
+ * @param msg_size message chunk size
+ * @return the best time in seconds
+ */
+static double autotune_measure(unsigned hash_id, const unsigned char* message, size_t msg_size)
+{
+	unsigned char out[130];
+	double time, best = 0;
+	timedelta_t timer;
+	int i;
+
+	for(i = 0; i < AUTOTUNE_ROUNDS; i++) {
+		rhash_timer_start(&timer);
+		hash_in_loop(hash_id, message, msg_size, AUTOTUNE_CHUNKS, out);
+		time = rhash_timer_stop(&timer);
+		if(i == 0 || time < best) best = time;
+	}
+	return best;
+}
+
+/**
+ * Select the fastest implementation of a hash algorithm by
+ * benchmarking all implementations available on the current CPU.
+ *
+ * @param hash_id hash algorithm identifier
+ * @param message a message chunk to hash repeatedly
+ * @param msg_size message chunk size
+ * @param choice the buffer to receive the name of the selected implementation
+ * @return 1 if the algorithm has several implementations, 0 otherwise
+ */
+static int autotune_algorithm(unsigned hash_id, const unsigned char* message, size_t msg_size, char* choice)
+{
+	const char* names[AUTOTUNE_MAX_IMPLS + 2];
+	const char* best_name = NULL;
+	double time, best_time = 0;
+	size_t count, i;
+
+	count = rhash_list_impls(hash_id, names, AUTOTUNE_MAX_IMPLS);
+	if(count == 0) names[count++] = "generic";
+	if(hash_id & RHASH_OPENSSL_SUPPORTED_HASHES) names[count++] = "openssl";
+	if(count < 2) return 0;
+
+	/* the implementations are listed by the expected speed, so the first one
+	 * is kept, unless another one is noticeably faster */
+	for(i = 0; i < count; i++) {
+		if(rhash_set_impl(hash_id, names[i]) < 0) continue;
+		time = autotune_measure(hash_id, message, msg_size);
+		if(!best_name || time < best_time * AUTOTUNE_MARGIN) {
+			best_name = names[i];
+			best_time = time;
+		}
+	}
+	if(!best_name) return 0;
+	rhash_set_impl(hash_id, best_name);
+	strcpy(choice, best_name);
+	return 1;
+}
+
+/**
+ * Select the fastest implementation of the given hash algorithms, by
+ * benchmarking all the implementations, available on the current CPU,
+ * including the OpenSSL ones. The choice can be cached in a file, keyed
+ * by the library version and the CPU model, so the following calls on
+ * the same host only load it. Should be called after rhash_library_init()
+ * and before creating contexts.
+ *
+ * @param hash_ids bit-mask of hash algorithms to tune
+ * @param cache_path the path of the cache file, NULL to always benchmark
+ * @return 0 on success, -1 if the cache file can't be written
+ */
+int rhash_autotune(unsigned hash_ids, const char* cache_path)
+{
+	unsigned char ALIGN_ATTR(16) message[8192]; /* 8 KiB */
+	char choices[RHASH_HASH_COUNT][32];
+	unsigned hash_id, loaded = 0, tuned = 0;
+	size_t i;
+
+	if(cache_path) loaded = autotune_load(cache_path, choices);
+
+	for(i = 0; i < sizeof(message); i++) message[i] = (unsigned char)(i & 0xff);
+	for(hash_id = 1; hash_id & RHASH_ALL_HASHES; hash_id <<= 1) {
+		char* choice = choices[rhash_ctz(hash_id)];
+		if((hash_ids & hash_id) == 0) continue;
+		/* use the cached choice, unless the implementation is unavailable */
+		if((loaded & hash_id) && rhash_set_impl(hash_id, choice) == 0) continue;
+		loaded &= ~hash_id;
+		if(autotune_algorithm(hash_id, message, sizeof(message), choice)) tuned |= hash_id;
+	}
+
+	/* rewrite the cache file, keeping the choices loaded for other algorithms */
+	if(cache_path && tuned) return autotune_save(cache_path, choices, loaded | tuned);
+	return 0;
+}
@@ -19,6 +19,7 @@
 
 #include <string.h>
 #include "byte_order.h"
+#include "openssl_asm.h"
 #include "ripemd-160.h"
 
 /**
@@ -304,6 +305,43 @@ void rhash_ripemd160_update(ripemd160_ctx *ctx, const unsigned char* msg, size_t
 	}
 }
 
+#ifdef HAS_OPENSSL_ASM_RIPEMD160
+/**
+ * Calculate message hash by the OpenSSL assembly kernel.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_ripemd160_update_asm(ripemd160_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	unsigned index = (unsigned)ctx->length & 63;
+	ctx->length += size;
+
+	/* fill partial block */
+	if(index) {
+		unsigned left = ripemd160_block_size - index;
+		memcpy((char*)ctx->message + index, msg, (size < left ? size : left));
+		if(size < left) return;
+
+		/* process partial block */
+		rhash_openssl_ripemd160_block_asm_data_order(ctx->hash, ctx->message, 1);
+		msg  += left;
+		size -= left;
+	}
+	if(size >= ripemd160_block_size) {
+		/* the kernel reads unaligned little-endian blocks in place */
+		rhash_openssl_ripemd160_block_asm_data_order(ctx->hash, msg, size / ripemd160_block_size);
+		msg += size & ~(size_t)(ripemd160_block_size - 1);
+		size &= ripemd160_block_size - 1;
+	}
+	if(size) {
+		/* save leftovers */
+		memcpy(ctx->message, msg, size);
+	}
+}
+#endif
+
 /**
  * Store calculated hash into the given array.
  *
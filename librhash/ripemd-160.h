@@ -24,6 +24,11 @@ void rhash_ripemd160_init(ripemd160_ctx *ctx);
 void rhash_ripemd160_update(ripemd160_ctx *ctx, const unsigned char* msg, size_t size);
 void rhash_ripemd160_final(ripemd160_ctx *ctx, unsigned char result[20]);
 
+/* the kernel assembled from the OpenSSL source, see openssl_asm.h */
+#ifdef USE_OPENSSL_ASM
+void rhash_ripemd160_update_asm(ripemd160_ctx *ctx, const unsigned char* msg, size_t size);
+#endif
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
@@ -17,8 +17,29 @@
 
 #include <string.h>
 #include "byte_order.h"
+#include "openssl_asm.h"
 #include "sha1.h"
 
+#if defined(USE_SHA1_SSSE3) || defined(USE_SHA1_SHANI)
+# if defined(USE_SHA1_AVX2) || defined(USE_SHA1_SHANI)
+#  include <immintrin.h>
+# else
+#  include <tmmintrin.h> /* _mm_shuffle_epi8(), _mm_alignr_epi8() */
+# endif
+# ifdef __GNUC__
+#  define SSSE3_ATTR __attribute__((target("ssse3")))
+#  define AVX2_ATTR  __attribute__((target("avx2")))
+#  define SHANI_ATTR __attribute__((target("sse4.1,sha")))
+# else
+#  define SSSE3_ATTR
+#  define AVX2_ATTR
+#  define SHANI_ATTR
+# endif
+#endif
+
+/* processes the given number of 64-byte blocks, possibly not aligned */
+typedef void (*sha1_process_t)(unsigned* hash, const unsigned char* msg, size_t blocks);
+
 /**
  * Initialize context before calculaing hash.
  *
@@ -114,14 +135,322 @@ static void rhash_sha1_process_block(unsigned* hash, const unsigned* block)
 }
 
 /**
- * Calculate message hash.
- * Can be called repeatedly with chunks of the message to be hashed.
+ * Process several 512-bit blocks by the portable round function.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks to process
+ * @param blocks the number of blocks
+ */
+static void rhash_sha1_process_blocks(unsigned* hash, const unsigned char* msg, size_t blocks)
+{
+	unsigned buffer[16];
+	for(; blocks > 0; blocks--, msg += sha1_block_size) {
+		if(IS_ALIGNED_32(msg)) {
+			/* the most common case is processing of an already aligned message
+			without copying it */
+			rhash_sha1_process_block(hash, (const unsigned*)msg);
+		} else {
+			memcpy(buffer, msg, sha1_block_size);
+			rhash_sha1_process_block(hash, buffer);
+		}
+	}
+}
+
+#ifdef USE_SHA1_SSSE3
+static const uint32_t rhash_sha1_k[4] = { 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+
+/**
+ * The 80 rounds of SHA1, reading the message words with added round
+ * constants from the array, prepared by a vectorised message schedule.
+ *
+ * @param hash algorithm state
+ * @param wk the message schedule words plus round constants
+ */
+static void rhash_sha1_rounds(unsigned* hash, const uint32_t* wk)
+{
+	uint32_t A = hash[0], B = hash[1], C = hash[2], D = hash[3], E = hash[4];
+	int t;
+
+#define SHA1_F1(b, c, d) (((c ^ d) & b) ^ d)
+#define SHA1_F2(b, c, d) (b ^ c ^ d)
+#define SHA1_F3(b, c, d) ((b & c) | (d & (b | c)))
+	/* a round, renaming the variables instead of moving them */
+#define SHA1_ROUND(a, b, c, d, e, f, t) \
+	e += ROTL32(a, 5) + f(b, c, d) + wk[t]; \
+	b = ROTL32(b, 30);
+#define SHA1_ROUNDS5(f) \
+	SHA1_ROUND(A, B, C, D, E, f, t); \
+	SHA1_ROUND(E, A, B, C, D, f, t + 1); \
+	SHA1_ROUND(D, E, A, B, C, f, t + 2); \
+	SHA1_ROUND(C, D, E, A, B, f, t + 3); \
+	SHA1_ROUND(B, C, D, E, A, f, t + 4);
+
+	for(t = 0; t < 20; t += 5) { SHA1_ROUNDS5(SHA1_F1) }
+	for(; t < 40; t += 5) { SHA1_ROUNDS5(SHA1_F2) }
+	for(; t < 60; t += 5) { SHA1_ROUNDS5(SHA1_F3) }
+	for(; t < 80; t += 5) { SHA1_ROUNDS5(SHA1_F2) }
+#undef SHA1_ROUNDS5
+#undef SHA1_ROUND
+#undef SHA1_F3
+#undef SHA1_F2
+#undef SHA1_F1
+
+	hash[0] += A;
+	hash[1] += B;
+	hash[2] += C;
+	hash[3] += D;
+	hash[4] += E;
+}
+
+/*
+ * The message schedule is computed four words at once. For words 16..31
+ * W[t] = ROTL(W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16], 1), where the lane of
+ * W[t+3] depends on W[t] from the same vector and is fixed up separately.
+ * For words 32..79 the equivalent W[t] = ROTL(W[t-6] ^ W[t-16] ^ W[t-28] ^ W[t-32], 2)
+ * has no dependencies inside a vector.
+ */
+#define SHA1_SCHEDULE(vec_t, w, i, V_XOR, V_ROL, V_ALIGNR8, V_SRL4, V_SLL12) \
+	if(i < 8) { \
+		vec_t x = V_XOR(V_XOR(w[i - 4], V_ALIGNR8(w[i - 3], w[i - 4])), \
+			V_XOR(w[i - 2], V_SRL4(w[i - 1]))); \
+		w[i] = V_XOR(V_ROL(x, 1), V_ROL(V_SLL12(x), 2)); \
+	} else { \
+		w[i] = V_ROL(V_XOR(V_XOR(V_ALIGNR8(w[i - 1], w[i - 2]), w[i - 4]), \
+			V_XOR(w[i - 7], w[i - 8])), 2); \
+	}
+
+#define SSE_ROL(x, n) _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n))
+#define SSE_ALIGNR8(a, b) _mm_alignr_epi8(a, b, 8)
+#define SSE_SRL4(x) _mm_srli_si128(x, 4)
+#define SSE_SLL12(x) _mm_slli_si128(x, 12)
+
+/**
+ * Process 512-bit blocks, computing the message schedule by SSSE3 instructions.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks to process
+ * @param blocks the number of blocks
+ */
+static SSSE3_ATTR void rhash_sha1_process_ssse3(unsigned* hash, const unsigned char* msg, size_t blocks)
+{
+	const __m128i bswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	uint32_t wk[80];
+	__m128i w[20];
+	int i;
+
+	for(; blocks > 0; blocks--, msg += sha1_block_size) {
+		for(i = 0; i < 20; i++) {
+			if(i < 4) {
+				w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + i * 16)), bswap);
+			} else {
+				SHA1_SCHEDULE(__m128i, w, i, _mm_xor_si128, SSE_ROL, SSE_ALIGNR8, SSE_SRL4, SSE_SLL12)
+			}
+			_mm_storeu_si128((__m128i*)(wk + i * 4),
+				_mm_add_epi32(w[i], _mm_set1_epi32((int)rhash_sha1_k[i / 5])));
+		}
+		rhash_sha1_rounds(hash, wk);
+	}
+}
+#endif /* USE_SHA1_SSSE3 */
+
+#ifdef USE_SHA1_AVX2
+#define AVX2_ROL(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n))
+#define AVX2_ALIGNR8(a, b) _mm256_alignr_epi8(a, b, 8)
+#define AVX2_SRL4(x) _mm256_srli_si256(x, 4)
+#define AVX2_SLL12(x) _mm256_slli_si256(x, 12)
+
+/**
+ * Process 512-bit blocks, computing the message schedule of two blocks
+ * at once by AVX2 instructions, one block per 128-bit lane.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks to process
+ * @param blocks the number of blocks
+ */
+static AVX2_ATTR void rhash_sha1_process_avx2(unsigned* hash, const unsigned char* msg, size_t blocks)
+{
+	const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	uint32_t wk[2][80];
+	__m256i w[20];
+	int i;
+
+	for(; blocks >= 2; blocks -= 2, msg += 2 * sha1_block_size) {
+		for(i = 0; i < 20; i++) {
+			__m256i x;
+			if(i < 4) {
+				x = _mm256_inserti128_si256(_mm256_castsi128_si256(
+					_mm_loadu_si128((const __m128i*)(msg + i * 16))),
+					_mm_loadu_si128((const __m128i*)(msg + sha1_block_size + i * 16)), 1);
+				w[i] = _mm256_shuffle_epi8(x, bswap);
+			} else {
+				SHA1_SCHEDULE(__m256i, w, i, _mm256_xor_si256, AVX2_ROL, AVX2_ALIGNR8, AVX2_SRL4, AVX2_SLL12)
+			}
+			x = _mm256_add_epi32(w[i], _mm256_set1_epi32((int)rhash_sha1_k[i / 5]));
+			_mm_storeu_si128((__m128i*)(wk[0] + i * 4), _mm256_castsi256_si128(x));
+			_mm_storeu_si128((__m128i*)(wk[1] + i * 4), _mm256_extracti128_si256(x, 1));
+		}
+		_mm256_zeroupper(); /* avoid penalties of mixing AVX and SSE code */
+		rhash_sha1_rounds(hash, wk[0]);
+		rhash_sha1_rounds(hash, wk[1]);
+	}
+	if(blocks) rhash_sha1_process_ssse3(hash, msg, blocks);
+}
+#endif /* USE_SHA1_AVX2 */
+
+#ifdef USE_SHA1_SHANI
+/**
+ * Process 512-bit blocks by the Intel SHA extensions.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks to process
+ * @param blocks the number of blocks
+ */
+static SHANI_ATTR void rhash_sha1_process_shani(unsigned* hash, const unsigned char* msg, size_t blocks)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i abcd, abcd_save, e0, e0_save, e1, msg0, msg1, msg2, msg3;
+
+	/* load the state in the order expected by the instructions */
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)hash), 0x1B);
+	e0 = _mm_set_epi32((int)hash[4], 0, 0, 0);
+
+	for(; blocks > 0; blocks--, msg += sha1_block_size) {
+		abcd_save = abcd;
+		e0_save = e0;
+
+		/* rounds 0-3 */
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 0)), bswap);
+		e0 = _mm_add_epi32(e0, msg0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		/* rounds 4-7 */
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 16)), bswap);
+		SHA1NI_ROUNDS4(e1, e0, msg1, 0);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+		/* rounds 8-11 */
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 32)), bswap);
+		SHA1NI_ROUNDS4(e0, e1, msg2, 0);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* rounds 12-15 */
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 48)), bswap);
+		SHA1NI_ROUNDS4(e1, e0, msg3, 0);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* rounds 16-19 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 0);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* rounds 20-23 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 1);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* rounds 24-27 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 1);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* rounds 28-31 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 1);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* rounds 32-35 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 1);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* rounds 36-39 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 1);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* rounds 40-43 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 2);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* rounds 44-47 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 2);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* rounds 48-51 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 2);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* rounds 52-55 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 2);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* rounds 56-59 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 2);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* rounds 60-63 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 3);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* rounds 64-67 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 3);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* rounds 68-71 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 3);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* rounds 72-75 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 3);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+
+		/* rounds 76-79 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	_mm_storeu_si128((__m128i*)hash, _mm_shuffle_epi32(abcd, 0x1B));
+	hash[4] = (unsigned)_mm_extract_epi32(e0, 3);
+}
+#endif /* USE_SHA1_SHANI */
+
+/**
+ * Calculate message hash by the given block processing function.
  *
  * @param ctx the algorithm context containing current hashing state
  * @param msg message chunk
  * @param size length of the message chunk
+ * @param process the function to process message blocks
  */
-void rhash_sha1_update(sha1_ctx *ctx, const unsigned char* msg, size_t size)
+static void rhash_sha1_update_by(sha1_ctx *ctx, const unsigned char* msg, size_t size, sha1_process_t process)
 {
 	unsigned index = (unsigned)ctx->length & 63;
 	ctx->length += size;
@@ -133,24 +462,14 @@ void rhash_sha1_update(sha1_ctx *ctx, const unsigned char* msg, size_t size)
 		if(size < left) return;
 
 		/* process partial block */
-		rhash_sha1_process_block(ctx->hash, (unsigned*)ctx->message);
+		process(ctx->hash, ctx->message, 1);
 		msg  += left;
 		size -= left;
 	}
-	while(size >= sha1_block_size) {
-		unsigned* aligned_message_block;
-		if(IS_ALIGNED_32(msg)) {
-			/* the most common case is processing of an already aligned message
-			without copying it */
-			aligned_message_block = (unsigned*)msg;
-		} else {
-			memcpy(ctx->message, msg, sha1_block_size);
-			aligned_message_block = (unsigned*)ctx->message;
-		}
-
-		rhash_sha1_process_block(ctx->hash, aligned_message_block);
-		msg  += sha1_block_size;
-		size -= sha1_block_size;
+	if(size >= sha1_block_size) {
+		process(ctx->hash, msg, size / sha1_block_size);
+		msg += size & ~(size_t)(sha1_block_size - 1);
+		size &= sha1_block_size - 1;
 	}
 	if(size) {
 		/* save leftovers */
@@ -158,6 +477,75 @@ void rhash_sha1_update(sha1_ctx *ctx, const unsigned char* msg, size_t size)
 	}
 }
 
+/**
+ * Calculate message hash.
+ * Can be called repeatedly with chunks of the message to be hashed.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha1_update(sha1_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	rhash_sha1_update_by(ctx, msg, size, rhash_sha1_process_blocks);
+}
+
+#ifdef USE_SHA1_SSSE3
+/**
+ * Calculate message hash, computing the message schedule by SSSE3 instructions.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha1_update_ssse3(sha1_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	rhash_sha1_update_by(ctx, msg, size, rhash_sha1_process_ssse3);
+}
+#endif
+
+#ifdef USE_SHA1_AVX2
+/**
+ * Calculate message hash, computing the message schedule by AVX2 instructions.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha1_update_avx2(sha1_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	rhash_sha1_update_by(ctx, msg, size, rhash_sha1_process_avx2);
+}
+#endif
+
+#ifdef USE_SHA1_SHANI
+/**
+ * Calculate message hash by the Intel SHA extensions.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha1_update_shani(sha1_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	rhash_sha1_update_by(ctx, msg, size, rhash_sha1_process_shani);
+}
+#endif
+
+#ifdef HAS_OPENSSL_ASM
+/**
+ * Calculate message hash by the OpenSSL assembly kernel.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha1_update_asm(sha1_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	rhash_sha1_update_by(ctx, msg, size, (sha1_process_t)rhash_openssl_sha1_block_data_order);
+}
+#endif
+
 /**
  * Store calculated hash into the given array.
  *
@@ -24,6 +24,36 @@ void rhash_sha1_init(sha1_ctx *ctx);
 void rhash_sha1_update(sha1_ctx *ctx, const unsigned char* msg, size_t size);
 void rhash_sha1_final(sha1_ctx *ctx, unsigned char* result);
 
+/* implementations for x86 instruction sets, selected at run-time */
+#if defined(CPU_X64) || defined(CPU_IA32)
+# if (defined(_MSC_VER) && _MSC_VER >= 1500) || \
+	(defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4)))
+#  define USE_SHA1_SSSE3
+void rhash_sha1_update_ssse3(sha1_ctx *ctx, const unsigned char* msg, size_t size);
+# endif
+# if (defined(_MSC_VER) && _MSC_VER >= 1700) || \
+	(defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#  define USE_SHA1_AVX2
+void rhash_sha1_update_avx2(sha1_ctx *ctx, const unsigned char* msg, size_t size);
+# endif
+# if (defined(_MSC_VER) && _MSC_VER >= 1900) || \
+	(defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#  define USE_SHA1_SHANI
+void rhash_sha1_update_shani(sha1_ctx *ctx, const unsigned char* msg, size_t size);
+
+/* four rounds by SHA extensions: update e by the message, save abcd into e_next */
+#  define SHA1NI_ROUNDS4(e, e_next, m, f) \
+	e = _mm_sha1nexte_epu32(e, m); \
+	e_next = abcd; \
+	abcd = _mm_sha1rnds4_epu32(abcd, e, f);
+# endif
+#endif
+
+/* the kernel assembled from the OpenSSL source, see openssl_asm.h */
+#ifdef USE_OPENSSL_ASM
+void rhash_sha1_update_asm(sha1_ctx *ctx, const unsigned char* msg, size_t size);
+#endif
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
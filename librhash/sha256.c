@@ -17,12 +17,27 @@
 
 #include <string.h>
 #include "byte_order.h"
+#include "openssl_asm.h"
 #include "sha256.h"
 
+#if defined(USE_SHA256_AVX2) || defined(USE_SHA256_SHANI)
+# include <immintrin.h>
+# ifdef __GNUC__
+#  define AVX2_ATTR  __attribute__((target("avx2")))
+#  define SHANI_ATTR __attribute__((target("sse4.1,sha")))
+# else
+#  define AVX2_ATTR
+#  define SHANI_ATTR
+# endif
+#endif
+
+/* processes the given number of 64-byte blocks, possibly not aligned */
+typedef void (*sha256_process_t)(unsigned* hash, const unsigned char* msg, size_t blocks);
+
 /* SHA-224 and SHA-256 constants for 64 rounds. These words represent
  * the first 32 bits of the fractional parts of the cube
  * roots of the first 64 prime numbers. */
-static const unsigned rhash_k256[64] = {
+const unsigned rhash_k256[64] = {
 	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
 	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
 	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
@@ -161,14 +176,263 @@ static void rhash_sha256_process_block(unsigned hash[8], unsigned block[16])
 }
 
 /**
- * Calculate message hash.
- * Can be called repeatedly with chunks of the message to be hashed.
+ * Process several 512-bit blocks by the portable round function.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks to process
+ * @param blocks the number of blocks
+ */
+static void rhash_sha256_process_blocks(unsigned* hash, const unsigned char* msg, size_t blocks)
+{
+	unsigned buffer[16];
+	for(; blocks > 0; blocks--, msg += sha256_block_size) {
+		if(IS_ALIGNED_32(msg)) {
+			/* the most common case is processing of an already aligned message
+			without copying it */
+			rhash_sha256_process_block(hash, (unsigned*)msg);
+		} else {
+			memcpy(buffer, msg, sha256_block_size);
+			rhash_sha256_process_block(hash, buffer);
+		}
+	}
+}
+
+#ifdef USE_SHA256_AVX2
+#define ROUND_WK(a,b,c,d,e,f,g,h,n) ROUND(a,b,c,d,e,f,g,h, 0, wk[n])
+
+/**
+ * The 64 rounds of SHA-256, reading the message words with added round
+ * constants from the array, prepared by a vectorised message schedule.
+ *
+ * @param hash algorithm state
+ * @param wk the message schedule words plus round constants
+ */
+static void rhash_sha256_rounds(unsigned hash[8], const unsigned* wk)
+{
+	unsigned A, B, C, D, E, F, G, H;
+	int i;
+
+	A = hash[0], B = hash[1], C = hash[2], D = hash[3];
+	E = hash[4], F = hash[5], G = hash[6], H = hash[7];
+
+	for(i = 0; i < 64; i += 8, wk += 8) {
+		ROUND_WK(A, B, C, D, E, F, G, H, 0);
+		ROUND_WK(H, A, B, C, D, E, F, G, 1);
+		ROUND_WK(G, H, A, B, C, D, E, F, 2);
+		ROUND_WK(F, G, H, A, B, C, D, E, 3);
+		ROUND_WK(E, F, G, H, A, B, C, D, 4);
+		ROUND_WK(D, E, F, G, H, A, B, C, 5);
+		ROUND_WK(C, D, E, F, G, H, A, B, 6);
+		ROUND_WK(B, C, D, E, F, G, H, A, 7);
+	}
+
+	hash[0] += A, hash[1] += B, hash[2] += C, hash[3] += D;
+	hash[4] += E, hash[5] += F, hash[6] += G, hash[7] += H;
+}
+
+#define V_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n))
+#define V_SIGMA0(x) _mm256_xor_si256(_mm256_xor_si256(V_ROTR(x, 7), V_ROTR(x, 18)), _mm256_srli_epi32(x, 3))
+#define V_SIGMA1(x) _mm256_xor_si256(_mm256_xor_si256(V_ROTR(x, 17), V_ROTR(x, 19)), _mm256_srli_epi32(x, 10))
+
+/**
+ * Process 512-bit blocks, computing the message schedule of two blocks
+ * at once by AVX2 instructions, one block per 128-bit lane.
+ * Four schedule words W[t..t+3] are computed by a vector, and the sigma1
+ * terms of W[t+2] and W[t+3] are added after W[t] and W[t+1] are known.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks to process
+ * @param blocks the number of blocks
+ */
+static AVX2_ATTR void rhash_sha256_process_avx2(unsigned* hash, const unsigned char* msg, size_t blocks)
+{
+	const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	unsigned wk[2][64];
+	__m256i w[16];
+	int i;
+
+	for(; blocks >= 2; blocks -= 2, msg += 2 * sha256_block_size) {
+		for(i = 0; i < 16; i++) {
+			__m256i x;
+			if(i < 4) {
+				x = _mm256_inserti128_si256(_mm256_castsi128_si256(
+					_mm_loadu_si128((const __m128i*)(msg + i * 16))),
+					_mm_loadu_si128((const __m128i*)(msg + sha256_block_size + i * 16)), 1);
+				w[i] = _mm256_shuffle_epi8(x, bswap);
+			} else {
+				x = _mm256_add_epi32(_mm256_add_epi32(w[i - 4],
+					V_SIGMA0(_mm256_alignr_epi8(w[i - 3], w[i - 4], 4))),
+					_mm256_alignr_epi8(w[i - 1], w[i - 2], 4));
+				x = _mm256_add_epi32(x, V_SIGMA1(_mm256_srli_si256(w[i - 1], 8)));
+				w[i] = _mm256_add_epi32(x, V_SIGMA1(_mm256_slli_si256(x, 8)));
+			}
+			x = _mm256_add_epi32(w[i], _mm256_broadcastsi128_si256(
+				_mm_loadu_si128((const __m128i*)(rhash_k256 + i * 4))));
+			_mm_storeu_si128((__m128i*)(wk[0] + i * 4), _mm256_castsi256_si128(x));
+			_mm_storeu_si128((__m128i*)(wk[1] + i * 4), _mm256_extracti128_si256(x, 1));
+		}
+		_mm256_zeroupper(); /* avoid penalties of mixing AVX and SSE code */
+		rhash_sha256_rounds(hash, wk[0]);
+		rhash_sha256_rounds(hash, wk[1]);
+	}
+	if(blocks) rhash_sha256_process_blocks(hash, msg, blocks);
+}
+#endif /* USE_SHA256_AVX2 */
+
+#ifdef USE_SHA256_SHANI
+/**
+ * Process 512-bit blocks by the Intel SHA extensions.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks to process
+ * @param blocks the number of blocks
+ */
+static SHANI_ATTR void rhash_sha256_process_shani(unsigned* hash, const unsigned char* msg, size_t blocks)
+{
+	const __m128i bswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	__m128i state0, state1, abef_save, cdgh_save, tmp, msg0, msg1, msg2, msg3;
+
+	/* load the state as ABEF and CDGH, the order expected by the instructions */
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)hash), 0xB1);          /* CDAB */
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(hash + 4)), 0x1B); /* EFGH */
+	state0 = _mm_alignr_epi8(tmp, state1, 8);    /* ABEF */
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0); /* CDGH */
+
+	for(; blocks > 0; blocks--, msg += sha256_block_size) {
+		abef_save = state0;
+		cdgh_save = state1;
+
+		/* rounds 0-3 */
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 0)), bswap);
+		tmp = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)(rhash_k256 + 0)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+		/* rounds 4-7 */
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 16)), bswap);
+		tmp = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)(rhash_k256 + 4)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+		/* rounds 8-11 */
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 32)), bswap);
+		tmp = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)(rhash_k256 + 8)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+		/* rounds 12-15 */
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 48)), bswap);
+		tmp = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)(rhash_k256 + 12)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(msg0, _mm_alignr_epi8(msg3, msg2, 4)), msg3);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+
+		/* rounds 16-19 */
+		tmp = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)(rhash_k256 + 16)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(msg1, _mm_alignr_epi8(msg0, msg3, 4)), msg0);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+
+		/* rounds 20-23 */
+		tmp = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)(rhash_k256 + 20)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(msg2, _mm_alignr_epi8(msg1, msg0, 4)), msg1);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+		/* rounds 24-27 */
+		tmp = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)(rhash_k256 + 24)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(msg3, _mm_alignr_epi8(msg2, msg1, 4)), msg2);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+		/* rounds 28-31 */
+		tmp = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)(rhash_k256 + 28)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(msg0, _mm_alignr_epi8(msg3, msg2, 4)), msg3);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+
+		/* rounds 32-35 */
+		tmp = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)(rhash_k256 + 32)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(msg1, _mm_alignr_epi8(msg0, msg3, 4)), msg0);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+
+		/* rounds 36-39 */
+		tmp = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)(rhash_k256 + 36)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(msg2, _mm_alignr_epi8(msg1, msg0, 4)), msg1);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+		/* rounds 40-43 */
+		tmp = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)(rhash_k256 + 40)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(msg3, _mm_alignr_epi8(msg2, msg1, 4)), msg2);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+		/* rounds 44-47 */
+		tmp = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)(rhash_k256 + 44)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(msg0, _mm_alignr_epi8(msg3, msg2, 4)), msg3);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+
+		/* rounds 48-51 */
+		tmp = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)(rhash_k256 + 48)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(msg1, _mm_alignr_epi8(msg0, msg3, 4)), msg0);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+		msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+
+		/* rounds 52-55 */
+		tmp = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)(rhash_k256 + 52)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(msg2, _mm_alignr_epi8(msg1, msg0, 4)), msg1);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+		/* rounds 56-59 */
+		tmp = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)(rhash_k256 + 56)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(msg3, _mm_alignr_epi8(msg2, msg1, 4)), msg2);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+		/* rounds 60-63 */
+		tmp = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)(rhash_k256 + 60)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+		state0 = _mm_add_epi32(state0, abef_save);
+		state1 = _mm_add_epi32(state1, cdgh_save);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1B);       /* FEBA */
+	state1 = _mm_shuffle_epi32(state1, 0xB1);    /* DCHG */
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0); /* DCBA */
+	state1 = _mm_alignr_epi8(state1, tmp, 8);    /* HGFE */
+	_mm_storeu_si128((__m128i*)hash, state0);
+	_mm_storeu_si128((__m128i*)(hash + 4), state1);
+}
+#endif /* USE_SHA256_SHANI */
+
+/**
+ * Calculate message hash by the given block processing function.
  *
  * @param ctx the algorithm context containing current hashing state
  * @param msg message chunk
  * @param size length of the message chunk
+ * @param process the function to process message blocks
  */
-void rhash_sha256_update(sha256_ctx *ctx, const unsigned char *msg, size_t size)
+static void rhash_sha256_update_by(sha256_ctx *ctx, const unsigned char *msg, size_t size, sha256_process_t process)
 {
 	size_t index = (size_t)ctx->length & 63;
 	ctx->length += size;
@@ -180,30 +444,76 @@ void rhash_sha256_update(sha256_ctx *ctx, const unsigned char *msg, size_t size)
 		if(size < left) return;
 
 		/* process partial block */
-		rhash_sha256_process_block(ctx->hash, (unsigned*)ctx->message);
+		process(ctx->hash, (unsigned char*)ctx->message, 1);
 		msg  += left;
 		size -= left;
 	}
-	while(size >= sha256_block_size) {
-		unsigned* aligned_message_block;
-		if(IS_ALIGNED_32(msg)) {
-			/* the most common case is processing of an already aligned message
-			without copying it */
-			aligned_message_block = (unsigned*)msg;
-		} else {
-			memcpy(ctx->message, msg, sha256_block_size);
-			aligned_message_block = (unsigned*)ctx->message;
-		}
-
-		rhash_sha256_process_block(ctx->hash, aligned_message_block);
-		msg  += sha256_block_size;
-		size -= sha256_block_size;
+	if(size >= sha256_block_size) {
+		/* process the blocks in place, without copying them */
+		process(ctx->hash, msg, size / sha256_block_size);
+		msg += size & ~(size_t)(sha256_block_size - 1);
+		size &= sha256_block_size - 1;
 	}
 	if(size) {
 		memcpy(ctx->message, msg, size); /* save leftovers */
 	}
 }
 
+/**
+ * Calculate message hash.
+ * Can be called repeatedly with chunks of the message to be hashed.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha256_update(sha256_ctx *ctx, const unsigned char *msg, size_t size)
+{
+	rhash_sha256_update_by(ctx, msg, size, rhash_sha256_process_blocks);
+}
+
+#ifdef USE_SHA256_AVX2
+/**
+ * Calculate message hash, computing the message schedule by AVX2 instructions.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha256_update_avx2(sha256_ctx *ctx, const unsigned char *msg, size_t size)
+{
+	rhash_sha256_update_by(ctx, msg, size, rhash_sha256_process_avx2);
+}
+#endif
+
+#ifdef USE_SHA256_SHANI
+/**
+ * Calculate message hash by the Intel SHA extensions.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha256_update_shani(sha256_ctx *ctx, const unsigned char *msg, size_t size)
+{
+	rhash_sha256_update_by(ctx, msg, size, rhash_sha256_process_shani);
+}
+#endif
+
+#ifdef HAS_OPENSSL_ASM
+/**
+ * Calculate message hash by the OpenSSL assembly kernel.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha256_update_asm(sha256_ctx *ctx, const unsigned char *msg, size_t size)
+{
+	rhash_sha256_update_by(ctx, msg, size, (sha256_process_t)rhash_openssl_sha256_block_data_order);
+}
+#endif
+
 /**
  * Store calculated hash into the given array.
  *
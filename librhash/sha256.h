@@ -25,6 +25,27 @@ void rhash_sha256_init(sha256_ctx *ctx);
 void rhash_sha256_update(sha256_ctx *ctx, const unsigned char* data, size_t length);
 void rhash_sha256_final(sha256_ctx *ctx, unsigned char result[32]);
 
+extern const unsigned rhash_k256[64]; /* the SHA-256 round constants */
+
+/* implementations for x86 instruction sets, selected at run-time */
+#if defined(CPU_X64) || defined(CPU_IA32)
+# if (defined(_MSC_VER) && _MSC_VER >= 1700) || \
+	(defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#  define USE_SHA256_AVX2
+void rhash_sha256_update_avx2(sha256_ctx *ctx, const unsigned char* data, size_t length);
+# endif
+# if (defined(_MSC_VER) && _MSC_VER >= 1900) || \
+	(defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#  define USE_SHA256_SHANI
+void rhash_sha256_update_shani(sha256_ctx *ctx, const unsigned char* data, size_t length);
+# endif
+#endif
+
+/* the kernel assembled from the OpenSSL source, see openssl_asm.h */
+#ifdef USE_OPENSSL_ASM
+void rhash_sha256_update_asm(sha256_ctx *ctx, const unsigned char* data, size_t length);
+#endif
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
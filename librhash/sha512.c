@@ -17,8 +17,21 @@
 
 #include <string.h>
 #include "byte_order.h"
+#include "openssl_asm.h"
 #include "sha512.h"
 
+#ifdef USE_SHA512_AVX2
+# include <immintrin.h>
+# ifdef __GNUC__
+#  define AVX2_ATTR __attribute__((target("avx2,bmi2")))
+# else
+#  define AVX2_ATTR
+# endif
+#endif
+
+/* processes the given number of 128-byte blocks, possibly not aligned */
+typedef void (*sha512_process_t)(uint64_t* hash, const unsigned char* msg, size_t blocks);
+
 /* SHA-384 and SHA-512 constants for 80 rounds. These qwords represent
  * the first 64 bits of the fractional parts of the cube
  * roots of the first 80 prime numbers. */
@@ -179,14 +192,104 @@ static void rhash_sha512_process_block(uint64_t hash[8], uint64_t block[16])
 }
 
 /**
- * Calculate message hash.
- * Can be called repeatedly with chunks of the message to be hashed.
+ * Process several 1024-bit blocks by the portable round function.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks to process
+ * @param blocks the number of blocks
+ */
+static void rhash_sha512_process_blocks(uint64_t* hash, const unsigned char* msg, size_t blocks)
+{
+	uint64_t buffer[16];
+	for(; blocks > 0; blocks--, msg += sha512_block_size) {
+		if(IS_ALIGNED_64(msg)) {
+			/* the most common case is processing of an already aligned message
+			without copying it */
+			rhash_sha512_process_block(hash, (uint64_t*)msg);
+		} else {
+			memcpy(buffer, msg, sha512_block_size);
+			rhash_sha512_process_block(hash, buffer);
+		}
+	}
+}
+
+#ifdef USE_SHA512_AVX2
+/* W[t+1..t+4], taken from two adjacent vectors lo = W[t..t+3] and hi = W[t+4..t+7] */
+#define V_NEXT1(hi, lo) _mm256_alignr_epi8(_mm256_permute2x128_si256(lo, hi, 0x21), lo, 8)
+#define V_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - n))
+#define V_SIGMA0(x) _mm256_xor_si256(_mm256_xor_si256(V_ROTR(x, 1), V_ROTR(x, 8)), _mm256_srli_epi64(x, 7))
+#define V_SIGMA1(x) _mm256_xor_si256(_mm256_xor_si256(V_ROTR(x, 19), V_ROTR(x, 61)), _mm256_srli_epi64(x, 6))
+
+#define ROUND_WK(a,b,c,d,e,f,g,h,n) ROUND(a,b,c,d,e,f,g,h, 0, wk[n])
+
+/* store the words W[4i..4i+3] plus round constants */
+#define SHA512_STORE_WK(i) _mm256_storeu_si256((__m256i*)(wk + (i) * 4), \
+	_mm256_add_epi64(w[i], _mm256_loadu_si256((const __m256i*)(rhash_k512 + (i) * 4))))
+
+/* calculate W[4i..4i+3], where sigma1 terms of W[4i+2] and W[4i+3] depend on W[4i] and W[4i+1] */
+#define SHA512_SCHEDULE(i) { \
+	__m256i x = _mm256_add_epi64(_mm256_add_epi64(w[i - 4], \
+		V_SIGMA0(V_NEXT1(w[i - 3], w[i - 4]))), V_NEXT1(w[i - 1], w[i - 2])); \
+	x = _mm256_add_epi64(x, V_SIGMA1(_mm256_permute2x128_si256(w[i - 1], w[i - 1], 0x81))); \
+	w[i] = _mm256_add_epi64(x, V_SIGMA1(_mm256_permute2x128_si256(x, x, 0x08))); \
+	SHA512_STORE_WK(i); \
+}
+
+/**
+ * Process 1024-bit blocks, computing the message schedule by AVX2
+ * instructions, four 64-bit words at once, while the scalar rounds are
+ * running. The rounds are compiled with BMI2 enabled, so the rotations
+ * use the rorx instruction.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks to process
+ * @param blocks the number of blocks
+ */
+static AVX2_ATTR void rhash_sha512_process_avx2(uint64_t* hash, const unsigned char* msg, size_t blocks)
+{
+	const __m256i bswap = _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+		8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+	uint64_t A, B, C, D, E, F, G, H;
+	uint64_t wk[80];
+	__m256i w[20];
+	int i;
+
+	for(; blocks > 0; blocks--, msg += sha512_block_size) {
+		for(i = 0; i < 4; i++) {
+			w[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(msg + i * 32)), bswap);
+			SHA512_STORE_WK(i);
+		}
+
+		A = hash[0], B = hash[1], C = hash[2], D = hash[3];
+		E = hash[4], F = hash[5], G = hash[6], H = hash[7];
+		/* interleave the rounds with the schedule of the words for the next rounds */
+		for(i = 0; i < 20; i += 2) {
+			if(i < 16) SHA512_SCHEDULE(i + 4);
+			ROUND_WK(A, B, C, D, E, F, G, H, i * 4 + 0);
+			ROUND_WK(H, A, B, C, D, E, F, G, i * 4 + 1);
+			ROUND_WK(G, H, A, B, C, D, E, F, i * 4 + 2);
+			ROUND_WK(F, G, H, A, B, C, D, E, i * 4 + 3);
+			if(i < 16) SHA512_SCHEDULE(i + 5);
+			ROUND_WK(E, F, G, H, A, B, C, D, i * 4 + 4);
+			ROUND_WK(D, E, F, G, H, A, B, C, i * 4 + 5);
+			ROUND_WK(C, D, E, F, G, H, A, B, i * 4 + 6);
+			ROUND_WK(B, C, D, E, F, G, H, A, i * 4 + 7);
+		}
+		hash[0] += A, hash[1] += B, hash[2] += C, hash[3] += D;
+		hash[4] += E, hash[5] += F, hash[6] += G, hash[7] += H;
+	}
+}
+#endif /* USE_SHA512_AVX2 */
+
+/**
+ * Calculate message hash by the given block processing function.
  *
  * @param ctx the algorithm context containing current hashing state
  * @param msg message chunk
  * @param size length of the message chunk
+ * @param process the function to process message blocks
  */
-void rhash_sha512_update(sha512_ctx *ctx, const unsigned char *msg, size_t size)
+static void rhash_sha512_update_by(sha512_ctx *ctx, const unsigned char *msg, size_t size, sha512_process_t process)
 {
 	size_t index = (size_t)ctx->length & 127;
 	ctx->length += size;
@@ -198,30 +301,62 @@ void rhash_sha512_update(sha512_ctx *ctx, const unsigned char *msg, size_t size)
 		if(size < left) return;
 
 		/* process partial block */
-		rhash_sha512_process_block(ctx->hash, ctx->message);
+		process(ctx->hash, (unsigned char*)ctx->message, 1);
 		msg  += left;
 		size -= left;
 	}
-	while(size >= sha512_block_size) {
-		uint64_t* aligned_message_block;
-		if(IS_ALIGNED_64(msg)) {
-			/* the most common case is processing of an already aligned message
-			without copying it */
-			aligned_message_block = (uint64_t*)msg;
-		} else {
-			memcpy(ctx->message, msg, sha512_block_size);
-			aligned_message_block = ctx->message;
-		}
-
-		rhash_sha512_process_block(ctx->hash, aligned_message_block);
-		msg  += sha512_block_size;
-		size -= sha512_block_size;
+	if(size >= sha512_block_size) {
+		/* process the blocks in place, without copying them */
+		process(ctx->hash, msg, size / sha512_block_size);
+		msg += size & ~(size_t)(sha512_block_size - 1);
+		size &= sha512_block_size - 1;
 	}
 	if(size) {
 		memcpy(ctx->message, msg, size); /* save leftovers */
 	}
 }
 
+/**
+ * Calculate message hash.
+ * Can be called repeatedly with chunks of the message to be hashed.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha512_update(sha512_ctx *ctx, const unsigned char *msg, size_t size)
+{
+	rhash_sha512_update_by(ctx, msg, size, rhash_sha512_process_blocks);
+}
+
+#ifdef USE_SHA512_AVX2
+/**
+ * Calculate message hash by AVX2 and BMI2 instructions.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha512_update_avx2(sha512_ctx *ctx, const unsigned char *msg, size_t size)
+{
+	rhash_sha512_update_by(ctx, msg, size, rhash_sha512_process_avx2);
+}
+#endif
+
+#ifdef HAS_OPENSSL_ASM
+/**
+ * Calculate message hash by the OpenSSL assembly kernel.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha512_update_asm(sha512_ctx *ctx, const unsigned char *msg, size_t size)
+{
+	rhash_sha512_update_by(ctx, msg, size, (sha512_process_t)rhash_openssl_sha512_block_data_order);
+}
+#endif
+
 /**
  * Store calculated hash into the given array.
  *
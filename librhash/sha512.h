@@ -25,6 +25,18 @@ void rhash_sha512_init(sha512_ctx *ctx);
 void rhash_sha512_update(sha512_ctx *ctx, const unsigned char* data, size_t length);
 void rhash_sha512_final(sha512_ctx *ctx, unsigned char* result);
 
+/* implementation for 64-bit x86 processors, selected at run-time */
+#if defined(CPU_X64) && ((defined(_MSC_VER) && _MSC_VER >= 1700) || \
+	(defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))))
+# define USE_SHA512_AVX2
+void rhash_sha512_update_avx2(sha512_ctx *ctx, const unsigned char* data, size_t length);
+#endif
+
+/* the kernel assembled from the OpenSSL source, see openssl_asm.h */
+#ifdef USE_OPENSSL_ASM
+void rhash_sha512_update_asm(sha512_ctx *ctx, const unsigned char* data, size_t length);
+#endif
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
@@ -0,0 +1,734 @@
+/* stitch.c - stitched kernels, computing two hash functions at once
+ *
+ * Copyright: 2013 Aleksey Kravchenko <rhash.admin@gmail.com>
+ *
+ * Permission is hereby granted,  free of charge,  to any person  obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction,  including without limitation
+ * the rights to  use, copy, modify,  merge, publish, distribute, sublicense,
+ * and/or sell copies  of  the Software,  and to permit  persons  to whom the
+ * Software is furnished to do so.
+ *
+ * This program  is  distributed  in  the  hope  that it will be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  Use this program  at  your own risk!
+ *
+ * A stitched kernel processes a message block by two algorithms in one loop,
+ * interleaving their rounds. The rounds of each algorithm form a long chain
+ * of dependent instructions, so the CPU can execute the instructions of one
+ * algorithm while the other one waits for its results.
+ */
+
+#include <string.h>
+#include "byte_order.h"
+#include "crc32.h"
+#include "stitch.h"
+
+#ifdef USE_STITCH_SHANI
+# include <immintrin.h>
+# ifdef __GNUC__
+#  define SHANI_ATTR __attribute__((target("sse4.1,sha")))
+# else
+#  define SHANI_ATTR
+# endif
+#endif
+
+/**
+ * Return the length of the message head, which completes the partial
+ * block of a context, so the rest of the message starts at a block boundary.
+ *
+ * @param length the number of bytes processed by the context
+ * @param size the message size
+ * @return the head length
+ */
+static size_t rhash_stitch_head(uint64_t length, size_t size)
+{
+	size_t head = (size_t)(0 - (unsigned)length) & 63;
+	return (head < size ? head : size);
+}
+
+/* process 8 message bytes by the CRC32 slicing-by-8 algorithm */
+#define CRC32_STEP8(crc, lo, hi) { \
+	unsigned l = (crc) ^ (lo), h = (hi); \
+	(crc) = rhash_crc32_table[7][l & 0xFF] ^ rhash_crc32_table[6][(l >> 8) & 0xFF] ^ \
+		rhash_crc32_table[5][(l >> 16) & 0xFF] ^ rhash_crc32_table[4][l >> 24] ^ \
+		rhash_crc32_table[3][h & 0xFF] ^ rhash_crc32_table[2][(h >> 8) & 0xFF] ^ \
+		rhash_crc32_table[1][(h >> 16) & 0xFF] ^ rhash_crc32_table[0][h >> 24]; \
+}
+
+/**
+ * Process message blocks by CRC32 and MD5, doing a CRC32 step
+ * of 8 bytes after every 8 MD5 steps.
+ *
+ * @param crc32 pointer to the CRC32 hash
+ * @param md5 the MD5 context, its message buffer is used for copying
+ * @param msg the message blocks
+ * @param blocks the number of 64-byte blocks
+ */
+static void rhash_crc32_md5_process(uint32_t* crc32, md5_ctx *md5, const unsigned char* msg, size_t blocks)
+{
+	unsigned crc = *crc32 ^ 0xFFFFFFFF;
+	for(; blocks > 0; blocks--, msg += md5_block_size) {
+		register unsigned a = md5->hash[0], b = md5->hash[1], c = md5->hash[2], d = md5->hash[3];
+		const unsigned* x;
+		if(IS_LITTLE_ENDIAN && IS_ALIGNED_32(msg)) {
+			x = (const unsigned*)msg;
+		} else {
+			/* little-endian words are needed by both MD5 and CRC32 */
+			le32_copy(md5->message, 0, msg, md5_block_size);
+			x = md5->message;
+		}
+
+		MD5_ROUND1(a, b, c, d, x[ 0],  7, 0xd76aa478);
+		MD5_ROUND1(d, a, b, c, x[ 1], 12, 0xe8c7b756);
+		MD5_ROUND1(c, d, a, b, x[ 2], 17, 0x242070db);
+		MD5_ROUND1(b, c, d, a, x[ 3], 22, 0xc1bdceee);
+		MD5_ROUND1(a, b, c, d, x[ 4],  7, 0xf57c0faf);
+		MD5_ROUND1(d, a, b, c, x[ 5], 12, 0x4787c62a);
+		MD5_ROUND1(c, d, a, b, x[ 6], 17, 0xa8304613);
+		MD5_ROUND1(b, c, d, a, x[ 7], 22, 0xfd469501);
+		CRC32_STEP8(crc, x[0], x[1]);
+		MD5_ROUND1(a, b, c, d, x[ 8],  7, 0x698098d8);
+		MD5_ROUND1(d, a, b, c, x[ 9], 12, 0x8b44f7af);
+		MD5_ROUND1(c, d, a, b, x[10], 17, 0xffff5bb1);
+		MD5_ROUND1(b, c, d, a, x[11], 22, 0x895cd7be);
+		MD5_ROUND1(a, b, c, d, x[12],  7, 0x6b901122);
+		MD5_ROUND1(d, a, b, c, x[13], 12, 0xfd987193);
+		MD5_ROUND1(c, d, a, b, x[14], 17, 0xa679438e);
+		MD5_ROUND1(b, c, d, a, x[15], 22, 0x49b40821);
+		CRC32_STEP8(crc, x[2], x[3]);
+		MD5_ROUND2(a, b, c, d, x[ 1],  5, 0xf61e2562);
+		MD5_ROUND2(d, a, b, c, x[ 6],  9, 0xc040b340);
+		MD5_ROUND2(c, d, a, b, x[11], 14, 0x265e5a51);
+		MD5_ROUND2(b, c, d, a, x[ 0], 20, 0xe9b6c7aa);
+		MD5_ROUND2(a, b, c, d, x[ 5],  5, 0xd62f105d);
+		MD5_ROUND2(d, a, b, c, x[10],  9,  0x2441453);
+		MD5_ROUND2(c, d, a, b, x[15], 14, 0xd8a1e681);
+		MD5_ROUND2(b, c, d, a, x[ 4], 20, 0xe7d3fbc8);
+		CRC32_STEP8(crc, x[4], x[5]);
+		MD5_ROUND2(a, b, c, d, x[ 9],  5, 0x21e1cde6);
+		MD5_ROUND2(d, a, b, c, x[14],  9, 0xc33707d6);
+		MD5_ROUND2(c, d, a, b, x[ 3], 14, 0xf4d50d87);
+		MD5_ROUND2(b, c, d, a, x[ 8], 20, 0x455a14ed);
+		MD5_ROUND2(a, b, c, d, x[13],  5, 0xa9e3e905);
+		MD5_ROUND2(d, a, b, c, x[ 2],  9, 0xfcefa3f8);
+		MD5_ROUND2(c, d, a, b, x[ 7], 14, 0x676f02d9);
+		MD5_ROUND2(b, c, d, a, x[12], 20, 0x8d2a4c8a);
+		CRC32_STEP8(crc, x[6], x[7]);
+		MD5_ROUND3(a, b, c, d, x[ 5],  4, 0xfffa3942);
+		MD5_ROUND3(d, a, b, c, x[ 8], 11, 0x8771f681);
+		MD5_ROUND3(c, d, a, b, x[11], 16, 0x6d9d6122);
+		MD5_ROUND3(b, c, d, a, x[14], 23, 0xfde5380c);
+		MD5_ROUND3(a, b, c, d, x[ 1],  4, 0xa4beea44);
+		MD5_ROUND3(d, a, b, c, x[ 4], 11, 0x4bdecfa9);
+		MD5_ROUND3(c, d, a, b, x[ 7], 16, 0xf6bb4b60);
+		MD5_ROUND3(b, c, d, a, x[10], 23, 0xbebfbc70);
+		CRC32_STEP8(crc, x[8], x[9]);
+		MD5_ROUND3(a, b, c, d, x[13],  4, 0x289b7ec6);
+		MD5_ROUND3(d, a, b, c, x[ 0], 11, 0xeaa127fa);
+		MD5_ROUND3(c, d, a, b, x[ 3], 16, 0xd4ef3085);
+		MD5_ROUND3(b, c, d, a, x[ 6], 23,  0x4881d05);
+		MD5_ROUND3(a, b, c, d, x[ 9],  4, 0xd9d4d039);
+		MD5_ROUND3(d, a, b, c, x[12], 11, 0xe6db99e5);
+		MD5_ROUND3(c, d, a, b, x[15], 16, 0x1fa27cf8);
+		MD5_ROUND3(b, c, d, a, x[ 2], 23, 0xc4ac5665);
+		CRC32_STEP8(crc, x[10], x[11]);
+		MD5_ROUND4(a, b, c, d, x[ 0],  6, 0xf4292244);
+		MD5_ROUND4(d, a, b, c, x[ 7], 10, 0x432aff97);
+		MD5_ROUND4(c, d, a, b, x[14], 15, 0xab9423a7);
+		MD5_ROUND4(b, c, d, a, x[ 5], 21, 0xfc93a039);
+		MD5_ROUND4(a, b, c, d, x[12],  6, 0x655b59c3);
+		MD5_ROUND4(d, a, b, c, x[ 3], 10, 0x8f0ccc92);
+		MD5_ROUND4(c, d, a, b, x[10], 15, 0xffeff47d);
+		MD5_ROUND4(b, c, d, a, x[ 1], 21, 0x85845dd1);
+		CRC32_STEP8(crc, x[12], x[13]);
+		MD5_ROUND4(a, b, c, d, x[ 8],  6, 0x6fa87e4f);
+		MD5_ROUND4(d, a, b, c, x[15], 10, 0xfe2ce6e0);
+		MD5_ROUND4(c, d, a, b, x[ 6], 15, 0xa3014314);
+		MD5_ROUND4(b, c, d, a, x[13], 21, 0x4e0811a1);
+		MD5_ROUND4(a, b, c, d, x[ 4],  6, 0xf7537e82);
+		MD5_ROUND4(d, a, b, c, x[11], 10, 0xbd3af235);
+		MD5_ROUND4(c, d, a, b, x[ 2], 15, 0x2ad7d2bb);
+		MD5_ROUND4(b, c, d, a, x[ 9], 21, 0xeb86d391);
+		CRC32_STEP8(crc, x[14], x[15]);
+
+		md5->hash[0] += a;
+		md5->hash[1] += b;
+		md5->hash[2] += c;
+		md5->hash[3] += d;
+	}
+	*crc32 = crc ^ 0xFFFFFFFF;
+}
+
+/**
+ * Calculate CRC32 and MD5 hashes of a message.
+ * Can be called repeatedly with chunks of the message to be hashed.
+ *
+ * @param crc32 pointer to the CRC32 hash
+ * @param md5 the MD5 context, which has processed the same data as CRC32
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_crc32_md5_update(uint32_t* crc32, md5_ctx *md5, const unsigned char* msg, size_t size)
+{
+	size_t head = rhash_stitch_head(md5->length, size);
+	if(head) {
+		*crc32 = rhash_get_crc32(*crc32, msg, head);
+		rhash_md5_update(md5, msg, head);
+		msg  += head;
+		size -= head;
+	}
+	if(size >= md5_block_size) {
+		size_t blocks = size / md5_block_size;
+		rhash_crc32_md5_process(crc32, md5, msg, blocks);
+		md5->length += (uint64_t)blocks * md5_block_size;
+		msg  += blocks * md5_block_size;
+		size &= md5_block_size - 1;
+	}
+	if(size) {
+		*crc32 = rhash_get_crc32(*crc32, msg, size);
+		rhash_md5_update(md5, msg, size);
+	}
+}
+
+#ifdef USE_STITCH_SHANI
+/**
+ * Process message blocks by MD5 and by SHA1, using the SHA extensions.
+ * Four SHA1 rounds are interleaved with every three MD5 steps.
+ *
+ * @param md5 the MD5 context, its message buffer is used for copying
+ * @param hash the SHA1 hash state
+ * @param msg the message blocks
+ * @param blocks the number of 64-byte blocks
+ */
+
+static SHANI_ATTR void rhash_md5_sha1_process_shani(md5_ctx *md5, unsigned* hash, const unsigned char* msg, size_t blocks)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i abcd, abcd_save, e0, e0_save, e1, msg0, msg1, msg2, msg3;
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)hash), 0x1B);
+	e0 = _mm_set_epi32((int)hash[4], 0, 0, 0);
+	for(; blocks > 0; blocks--, msg += 64) {
+		const unsigned* x = (const unsigned*)msg;
+		unsigned a = md5->hash[0], b = md5->hash[1], c = md5->hash[2], d = md5->hash[3];
+		if(!IS_ALIGNED_32(msg)) {
+			memcpy(md5->message, msg, md5_block_size);
+			x = md5->message;
+		}
+		abcd_save = abcd;
+		e0_save = e0;
+		MD5_ROUND1(a, b, c, d, x[ 0],  7, 0xd76aa478);
+		MD5_ROUND1(d, a, b, c, x[ 1], 12, 0xe8c7b756);
+		MD5_ROUND1(c, d, a, b, x[ 2], 17, 0x242070db);
+		/* SHA1 rounds 0-3 */
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 0)), bswap);
+		e0 = _mm_add_epi32(e0, msg0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		MD5_ROUND1(b, c, d, a, x[ 3], 22, 0xc1bdceee);
+		MD5_ROUND1(a, b, c, d, x[ 4],  7, 0xf57c0faf);
+		MD5_ROUND1(d, a, b, c, x[ 5], 12, 0x4787c62a);
+		/* SHA1 rounds 4-7 */
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 16)), bswap);
+		SHA1NI_ROUNDS4(e1, e0, msg1, 0);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+		MD5_ROUND1(c, d, a, b, x[ 6], 17, 0xa8304613);
+		MD5_ROUND1(b, c, d, a, x[ 7], 22, 0xfd469501);
+		MD5_ROUND1(a, b, c, d, x[ 8],  7, 0x698098d8);
+		/* SHA1 rounds 8-11 */
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 32)), bswap);
+		SHA1NI_ROUNDS4(e0, e1, msg2, 0);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		MD5_ROUND1(d, a, b, c, x[ 9], 12, 0x8b44f7af);
+		MD5_ROUND1(c, d, a, b, x[10], 17, 0xffff5bb1);
+		MD5_ROUND1(b, c, d, a, x[11], 22, 0x895cd7be);
+		/* SHA1 rounds 12-15 */
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 48)), bswap);
+		SHA1NI_ROUNDS4(e1, e0, msg3, 0);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		MD5_ROUND1(a, b, c, d, x[12],  7, 0x6b901122);
+		MD5_ROUND1(d, a, b, c, x[13], 12, 0xfd987193);
+		MD5_ROUND1(c, d, a, b, x[14], 17, 0xa679438e);
+		/* SHA1 rounds 16-19 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 0);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		MD5_ROUND1(b, c, d, a, x[15], 22, 0x49b40821);
+		MD5_ROUND2(a, b, c, d, x[ 1],  5, 0xf61e2562);
+		MD5_ROUND2(d, a, b, c, x[ 6],  9, 0xc040b340);
+		/* SHA1 rounds 20-23 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 1);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		MD5_ROUND2(c, d, a, b, x[11], 14, 0x265e5a51);
+		MD5_ROUND2(b, c, d, a, x[ 0], 20, 0xe9b6c7aa);
+		MD5_ROUND2(a, b, c, d, x[ 5],  5, 0xd62f105d);
+		/* SHA1 rounds 24-27 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 1);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		MD5_ROUND2(d, a, b, c, x[10],  9,  0x2441453);
+		MD5_ROUND2(c, d, a, b, x[15], 14, 0xd8a1e681);
+		MD5_ROUND2(b, c, d, a, x[ 4], 20, 0xe7d3fbc8);
+		/* SHA1 rounds 28-31 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 1);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		MD5_ROUND2(a, b, c, d, x[ 9],  5, 0x21e1cde6);
+		MD5_ROUND2(d, a, b, c, x[14],  9, 0xc33707d6);
+		MD5_ROUND2(c, d, a, b, x[ 3], 14, 0xf4d50d87);
+		/* SHA1 rounds 32-35 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 1);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		MD5_ROUND2(b, c, d, a, x[ 8], 20, 0x455a14ed);
+		MD5_ROUND2(a, b, c, d, x[13],  5, 0xa9e3e905);
+		MD5_ROUND2(d, a, b, c, x[ 2],  9, 0xfcefa3f8);
+		/* SHA1 rounds 36-39 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 1);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		MD5_ROUND2(c, d, a, b, x[ 7], 14, 0x676f02d9);
+		MD5_ROUND2(b, c, d, a, x[12], 20, 0x8d2a4c8a);
+		MD5_ROUND3(a, b, c, d, x[ 5],  4, 0xfffa3942);
+		/* SHA1 rounds 40-43 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 2);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		MD5_ROUND3(d, a, b, c, x[ 8], 11, 0x8771f681);
+		MD5_ROUND3(c, d, a, b, x[11], 16, 0x6d9d6122);
+		MD5_ROUND3(b, c, d, a, x[14], 23, 0xfde5380c);
+		/* SHA1 rounds 44-47 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 2);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		MD5_ROUND3(a, b, c, d, x[ 1],  4, 0xa4beea44);
+		MD5_ROUND3(d, a, b, c, x[ 4], 11, 0x4bdecfa9);
+		MD5_ROUND3(c, d, a, b, x[ 7], 16, 0xf6bb4b60);
+		/* SHA1 rounds 48-51 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 2);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		MD5_ROUND3(b, c, d, a, x[10], 23, 0xbebfbc70);
+		MD5_ROUND3(a, b, c, d, x[13],  4, 0x289b7ec6);
+		MD5_ROUND3(d, a, b, c, x[ 0], 11, 0xeaa127fa);
+		/* SHA1 rounds 52-55 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 2);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		MD5_ROUND3(c, d, a, b, x[ 3], 16, 0xd4ef3085);
+		MD5_ROUND3(b, c, d, a, x[ 6], 23,  0x4881d05);
+		MD5_ROUND3(a, b, c, d, x[ 9],  4, 0xd9d4d039);
+		/* SHA1 rounds 56-59 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 2);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		MD5_ROUND3(d, a, b, c, x[12], 11, 0xe6db99e5);
+		MD5_ROUND3(c, d, a, b, x[15], 16, 0x1fa27cf8);
+		MD5_ROUND3(b, c, d, a, x[ 2], 23, 0xc4ac5665);
+		/* SHA1 rounds 60-63 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 3);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		MD5_ROUND4(a, b, c, d, x[ 0],  6, 0xf4292244);
+		MD5_ROUND4(d, a, b, c, x[ 7], 10, 0x432aff97);
+		MD5_ROUND4(c, d, a, b, x[14], 15, 0xab9423a7);
+		/* SHA1 rounds 64-67 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 3);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		MD5_ROUND4(b, c, d, a, x[ 5], 21, 0xfc93a039);
+		MD5_ROUND4(a, b, c, d, x[12],  6, 0x655b59c3);
+		MD5_ROUND4(d, a, b, c, x[ 3], 10, 0x8f0ccc92);
+		/* SHA1 rounds 68-71 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 3);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		MD5_ROUND4(c, d, a, b, x[10], 15, 0xffeff47d);
+		MD5_ROUND4(b, c, d, a, x[ 1], 21, 0x85845dd1);
+		MD5_ROUND4(a, b, c, d, x[ 8],  6, 0x6fa87e4f);
+		/* SHA1 rounds 72-75 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 3);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+
+		MD5_ROUND4(d, a, b, c, x[15], 10, 0xfe2ce6e0);
+		MD5_ROUND4(c, d, a, b, x[ 6], 15, 0xa3014314);
+		MD5_ROUND4(b, c, d, a, x[13], 21, 0x4e0811a1);
+		/* SHA1 rounds 76-79 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 3);
+		MD5_ROUND4(a, b, c, d, x[ 4],  6, 0xf7537e82);
+		MD5_ROUND4(d, a, b, c, x[11], 10, 0xbd3af235);
+		MD5_ROUND4(c, d, a, b, x[ 2], 15, 0x2ad7d2bb);
+		MD5_ROUND4(b, c, d, a, x[ 9], 21, 0xeb86d391);
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+		md5->hash[0] += a;
+		md5->hash[1] += b;
+		md5->hash[2] += c;
+		md5->hash[3] += d;
+	}
+	_mm_storeu_si128((__m128i*)hash, _mm_shuffle_epi32(abcd, 0x1B));
+	hash[4] = (unsigned)_mm_extract_epi32(e0, 3);
+}
+
+/**
+ * Calculate MD5 and SHA1 hashes of a message, using the SHA extensions.
+ * The caller must check that the CPU supports them.
+ *
+ * @param md5 the MD5 context
+ * @param sha1 the SHA1 context, which has processed the same data as MD5
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_md5_sha1_update_shani(md5_ctx *md5, sha1_ctx *sha1, const unsigned char* msg, size_t size)
+{
+	size_t head = rhash_stitch_head(md5->length, size);
+	if(head) {
+		rhash_md5_update(md5, msg, head);
+		rhash_sha1_update_shani(sha1, msg, head);
+		msg  += head;
+		size -= head;
+	}
+	if(size >= md5_block_size) {
+		size_t blocks = size / md5_block_size;
+		rhash_md5_sha1_process_shani(md5, sha1->hash, msg, blocks);
+		md5->length += (uint64_t)blocks * md5_block_size;
+		sha1->length += (uint64_t)blocks * md5_block_size;
+		msg  += blocks * md5_block_size;
+		size &= md5_block_size - 1;
+	}
+	if(size) {
+		rhash_md5_update(md5, msg, size);
+		rhash_sha1_update_shani(sha1, msg, size);
+	}
+}
+
+/**
+ * Process message blocks by SHA1 and by SHA-256, using the SHA extensions.
+ * SHA1 takes 80 rounds and SHA-256 takes 64 rounds per block, so SHA1 rounds
+ * are interleaved with SHA-256 rounds in the 5:4 proportion.
+ *
+ * @param hash the SHA1 hash state
+ * @param h256 the SHA-256 hash state
+ * @param msg the message blocks
+ * @param blocks the number of 64-byte blocks
+ */
+
+static SHANI_ATTR void rhash_sha1_sha256_process_shani(unsigned* hash, unsigned* h256, const unsigned char* msg, size_t blocks)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i bswap32 = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	__m128i abcd, abcd_save, e0, e0_save, e1, msg0, msg1, msg2, msg3;
+	__m128i state0, state1, abef_save, cdgh_save, t, w0, w1, w2, w3;
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)hash), 0x1B);
+	e0 = _mm_set_epi32((int)hash[4], 0, 0, 0);
+	t = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)h256), 0xB1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(h256 + 4)), 0x1B);
+	state0 = _mm_alignr_epi8(t, state1, 8);
+	state1 = _mm_blend_epi16(state1, t, 0xF0);
+	for(; blocks > 0; blocks--, msg += 64) {
+		abcd_save = abcd;
+		e0_save = e0;
+		abef_save = state0;
+		cdgh_save = state1;
+		/* SHA1 rounds 0-3 */
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 0)), bswap);
+		e0 = _mm_add_epi32(e0, msg0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		/* SHA256 rounds 0-3 */
+		w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 0)), bswap32);
+		t = _mm_add_epi32(w0, _mm_loadu_si128((const __m128i*)(rhash_k256 + 0)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+
+		/* SHA1 rounds 4-7 */
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 16)), bswap);
+		SHA1NI_ROUNDS4(e1, e0, msg1, 0);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+		/* SHA256 rounds 4-7 */
+		w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 16)), bswap32);
+		t = _mm_add_epi32(w1, _mm_loadu_si128((const __m128i*)(rhash_k256 + 4)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w0 = _mm_sha256msg1_epu32(w0, w1);
+
+		/* SHA1 rounds 8-11 */
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 32)), bswap);
+		SHA1NI_ROUNDS4(e0, e1, msg2, 0);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* SHA256 rounds 8-11 */
+		w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 32)), bswap32);
+		t = _mm_add_epi32(w2, _mm_loadu_si128((const __m128i*)(rhash_k256 + 8)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w1 = _mm_sha256msg1_epu32(w1, w2);
+
+		/* SHA1 rounds 12-15 */
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 48)), bswap);
+		SHA1NI_ROUNDS4(e1, e0, msg3, 0);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* SHA1 rounds 16-19 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 0);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* SHA256 rounds 12-15 */
+		w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 48)), bswap32);
+		t = _mm_add_epi32(w3, _mm_loadu_si128((const __m128i*)(rhash_k256 + 12)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w0 = _mm_sha256msg2_epu32(_mm_add_epi32(w0, _mm_alignr_epi8(w3, w2, 4)), w3);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w2 = _mm_sha256msg1_epu32(w2, w3);
+
+		/* SHA1 rounds 20-23 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 1);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* SHA256 rounds 16-19 */
+		t = _mm_add_epi32(w0, _mm_loadu_si128((const __m128i*)(rhash_k256 + 16)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w1 = _mm_sha256msg2_epu32(_mm_add_epi32(w1, _mm_alignr_epi8(w0, w3, 4)), w0);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w3 = _mm_sha256msg1_epu32(w3, w0);
+
+		/* SHA1 rounds 24-27 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 1);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* SHA256 rounds 20-23 */
+		t = _mm_add_epi32(w1, _mm_loadu_si128((const __m128i*)(rhash_k256 + 20)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w2 = _mm_sha256msg2_epu32(_mm_add_epi32(w2, _mm_alignr_epi8(w1, w0, 4)), w1);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w0 = _mm_sha256msg1_epu32(w0, w1);
+
+		/* SHA1 rounds 28-31 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 1);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* SHA256 rounds 24-27 */
+		t = _mm_add_epi32(w2, _mm_loadu_si128((const __m128i*)(rhash_k256 + 24)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w3 = _mm_sha256msg2_epu32(_mm_add_epi32(w3, _mm_alignr_epi8(w2, w1, 4)), w2);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w1 = _mm_sha256msg1_epu32(w1, w2);
+
+		/* SHA1 rounds 32-35 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 1);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* SHA1 rounds 36-39 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 1);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* SHA256 rounds 28-31 */
+		t = _mm_add_epi32(w3, _mm_loadu_si128((const __m128i*)(rhash_k256 + 28)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w0 = _mm_sha256msg2_epu32(_mm_add_epi32(w0, _mm_alignr_epi8(w3, w2, 4)), w3);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w2 = _mm_sha256msg1_epu32(w2, w3);
+
+		/* SHA1 rounds 40-43 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 2);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* SHA256 rounds 32-35 */
+		t = _mm_add_epi32(w0, _mm_loadu_si128((const __m128i*)(rhash_k256 + 32)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w1 = _mm_sha256msg2_epu32(_mm_add_epi32(w1, _mm_alignr_epi8(w0, w3, 4)), w0);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w3 = _mm_sha256msg1_epu32(w3, w0);
+
+		/* SHA1 rounds 44-47 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 2);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* SHA256 rounds 36-39 */
+		t = _mm_add_epi32(w1, _mm_loadu_si128((const __m128i*)(rhash_k256 + 36)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w2 = _mm_sha256msg2_epu32(_mm_add_epi32(w2, _mm_alignr_epi8(w1, w0, 4)), w1);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w0 = _mm_sha256msg1_epu32(w0, w1);
+
+		/* SHA1 rounds 48-51 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 2);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* SHA256 rounds 40-43 */
+		t = _mm_add_epi32(w2, _mm_loadu_si128((const __m128i*)(rhash_k256 + 40)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w3 = _mm_sha256msg2_epu32(_mm_add_epi32(w3, _mm_alignr_epi8(w2, w1, 4)), w2);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w1 = _mm_sha256msg1_epu32(w1, w2);
+
+		/* SHA1 rounds 52-55 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 2);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* SHA1 rounds 56-59 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 2);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* SHA256 rounds 44-47 */
+		t = _mm_add_epi32(w3, _mm_loadu_si128((const __m128i*)(rhash_k256 + 44)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w0 = _mm_sha256msg2_epu32(_mm_add_epi32(w0, _mm_alignr_epi8(w3, w2, 4)), w3);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w2 = _mm_sha256msg1_epu32(w2, w3);
+
+		/* SHA1 rounds 60-63 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 3);
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* SHA256 rounds 48-51 */
+		t = _mm_add_epi32(w0, _mm_loadu_si128((const __m128i*)(rhash_k256 + 48)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w1 = _mm_sha256msg2_epu32(_mm_add_epi32(w1, _mm_alignr_epi8(w0, w3, 4)), w0);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		w3 = _mm_sha256msg1_epu32(w3, w0);
+
+		/* SHA1 rounds 64-67 */
+		SHA1NI_ROUNDS4(e0, e1, msg0, 3);
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* SHA256 rounds 52-55 */
+		t = _mm_add_epi32(w1, _mm_loadu_si128((const __m128i*)(rhash_k256 + 52)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w2 = _mm_sha256msg2_epu32(_mm_add_epi32(w2, _mm_alignr_epi8(w1, w0, 4)), w1);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+
+		/* SHA1 rounds 68-71 */
+		SHA1NI_ROUNDS4(e1, e0, msg1, 3);
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* SHA256 rounds 56-59 */
+		t = _mm_add_epi32(w2, _mm_loadu_si128((const __m128i*)(rhash_k256 + 56)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		w3 = _mm_sha256msg2_epu32(_mm_add_epi32(w3, _mm_alignr_epi8(w2, w1, 4)), w2);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+
+		/* SHA1 rounds 72-75 */
+		SHA1NI_ROUNDS4(e0, e1, msg2, 3);
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+
+		/* SHA1 rounds 76-79 */
+		SHA1NI_ROUNDS4(e1, e0, msg3, 3);
+		/* SHA256 rounds 60-63 */
+		t = _mm_add_epi32(w3, _mm_loadu_si128((const __m128i*)(rhash_k256 + 60)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, t);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(t, 0x0E));
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+		state0 = _mm_add_epi32(state0, abef_save);
+		state1 = _mm_add_epi32(state1, cdgh_save);
+	}
+	_mm_storeu_si128((__m128i*)hash, _mm_shuffle_epi32(abcd, 0x1B));
+	hash[4] = (unsigned)_mm_extract_epi32(e0, 3);
+	t = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	state0 = _mm_blend_epi16(t, state1, 0xF0);
+	state1 = _mm_alignr_epi8(state1, t, 8);
+	_mm_storeu_si128((__m128i*)h256, state0);
+	_mm_storeu_si128((__m128i*)(h256 + 4), state1);
+}
+
+/**
+ * Calculate SHA1 and SHA-256 (or SHA-224) hashes of a message,
+ * using the SHA extensions. The caller must check that the CPU supports them.
+ *
+ * @param sha1 the SHA1 context
+ * @param sha256 the SHA-256 context, which has processed the same data as SHA1
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_sha1_sha256_update_shani(sha1_ctx *sha1, sha256_ctx *sha256, const unsigned char* msg, size_t size)
+{
+	size_t head = rhash_stitch_head(sha1->length, size);
+	if(head) {
+		rhash_sha1_update_shani(sha1, msg, head);
+		rhash_sha256_update_shani(sha256, msg, head);
+		msg  += head;
+		size -= head;
+	}
+	if(size >= sha1_block_size) {
+		size_t blocks = size / sha1_block_size;
+		rhash_sha1_sha256_process_shani(sha1->hash, sha256->hash, msg, blocks);
+		sha1->length += (uint64_t)blocks * sha1_block_size;
+		sha256->length += (uint64_t)blocks * sha1_block_size;
+		msg  += blocks * sha1_block_size;
+		size &= sha1_block_size - 1;
+	}
+	if(size) {
+		rhash_sha1_update_shani(sha1, msg, size);
+		rhash_sha256_update_shani(sha256, msg, size);
+	}
+}
+#endif /* USE_STITCH_SHANI */
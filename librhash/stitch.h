@@ -0,0 +1,26 @@
+/* stitch.h - stitched kernels, computing two hash functions at once */
+#ifndef STITCH_H
+#define STITCH_H
+#include <stdint.h>
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void rhash_crc32_md5_update(uint32_t* crc32, md5_ctx *ctx, const unsigned char* msg, size_t size);
+
+/* the kernels, interleaving an algorithm with the SHA extensions */
+#if defined(USE_SHA1_SHANI) && defined(USE_SHA256_SHANI)
+# define USE_STITCH_SHANI
+void rhash_md5_sha1_update_shani(md5_ctx *md5, sha1_ctx *sha1, const unsigned char* msg, size_t size);
+void rhash_sha1_sha256_update_shani(sha1_ctx *sha1, sha256_ctx *sha256, const unsigned char* msg, size_t size);
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* STITCH_H */
@@ -0,0 +1,100 @@
+/* test_hasher.cpp - test the C++17 interface of rhash.hpp
+ *
+ * Copyright: 2013 Aleksey Kravchenko <rhash.admin@gmail.com>
+ *
+ * Permission is hereby granted,  free of charge,  to any person  obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction,  including without limitation
+ * the rights to  use, copy, modify,  merge, publish, distribute, sublicense,
+ * and/or sell copies  of  the Software,  and to permit  persons  to whom the
+ * Software is furnished to do so.
+ *
+ * This program  is  distributed  in  the  hope  that it will be useful,  but
+ * WITHOUT ANY WARRANTY;  without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  Use this program  at  your own risk!
+ */
+#include <cstdio>
+#include <cstring>
+#include "rhash.hpp"
+
+namespace {
+
+unsigned char message[1000];
+
+/**
+ * Compare the digest of a hasher of one algorithm with the digest
+ * calculated by rhash_msg().
+ *
+ * @return the number of errors
+ */
+template<class Algorithm>
+int test_algorithm()
+{
+	unsigned char expected[130];
+	int errors = 0;
+	const std::size_t lengths[] = { 0, 3, 64, 255, sizeof(message) };
+
+	for(std::size_t length : lengths) {
+		auto [result] = librhash::hasher<Algorithm>::hash(message, length);
+		rhash_msg(Algorithm::hash_id, message, length, expected);
+		if(std::memcmp(result.data(), expected, Algorithm::digest_size) != 0) {
+			std::printf("failed: librhash::hasher<%s>::hash() of %u bytes differs from rhash_msg()\n",
+				rhash_get_name(Algorithm::hash_id), (unsigned)length);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+/**
+ * Verify that a hasher of several algorithms returns the digests
+ * in the order of the algorithms, independently of the update sizes.
+ *
+ * @return the number of errors
+ */
+int test_algorithm_set()
+{
+	typedef librhash::hasher<librhash::sha256, librhash::crc32, librhash::md5> hasher_t;
+	unsigned char sha256[32], crc32[4], md5[16];
+	hasher_t h;
+	std::size_t i;
+
+	for(i = 0; i < sizeof(message); i += 7) {
+		h.update(message + i, (i + 7 < sizeof(message) ? 7 : sizeof(message) - i));
+	}
+	auto [d_sha256, d_crc32, d_md5] = h.final();
+	rhash_msg(RHASH_SHA256, message, sizeof(message), sha256);
+	rhash_msg(RHASH_CRC32, message, sizeof(message), crc32);
+	rhash_msg(RHASH_MD5, message, sizeof(message), md5);
+
+	h.reset();
+	h.update(message, sizeof(message));
+	if(std::memcmp(d_sha256.data(), sha256, 32) != 0 || std::memcmp(d_crc32.data(), crc32, 4) != 0 ||
+			std::memcmp(d_md5.data(), md5, 16) != 0 || h.final() != hasher_t::hash(message, sizeof(message))) {
+		std::printf("failed: librhash::hasher of SHA256, CRC32 and MD5\n");
+		return 1;
+	}
+	return 0;
+}
+
+} /* namespace */
+
+/**
+ * Verify the C++17 interface against the C interface of the library.
+ *
+ * @return the number of errors
+ */
+extern "C" int test_cpp_hasher(void)
+{
+	using namespace librhash;
+	std::size_t i;
+	for(i = 0; i < sizeof(message); i++) message[i] = (unsigned char)(i * 31 + (i >> 7));
+
+	return test_algorithm<crc32>() + test_algorithm<md4>() + test_algorithm<md5>() +
+		test_algorithm<sha1>() + test_algorithm<tiger>() + test_algorithm<tth>() +
+		test_algorithm<ed2k>() + test_algorithm<whirlpool>() + test_algorithm<ripemd160>() +
+		test_algorithm<gost>() + test_algorithm<gost_cryptopro>() + test_algorithm<has160>() +
+		test_algorithm<snefru128>() + test_algorithm<snefru256>() + test_algorithm<sha224>() +
+		test_algorithm<sha256>() + test_algorithm<sha384>() + test_algorithm<sha512>() +
+		test_algorithm<edonr256>() + test_algorithm<edonr512>() + test_algorithm_set();
+}
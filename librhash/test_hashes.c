@@ -14,6 +14,7 @@
  * or FITNESS FOR A PARTICULAR PURPOSE.  Use this program  at  your own risk!
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <assert.h>
@@ -384,6 +385,9 @@ known_strings_t known_strings[] = {
 
 static int g_errors = 0;  /* total number of errors occured */
 
+/* the test of the C++17 interface, see test_hasher.cpp */
+int test_cpp_hasher(void);
+
 #ifdef UNDER_CE /* if Windows CE */
 static char *g_msg = NULL; /* string buffer to store errors */
 #endif
@@ -655,6 +659,45 @@ static void test_alignment(void)
 	}
 }
 
+/**
+ * Verify that calculated hash doesn't depend on how a message
+ * of several blocks is split between the update calls.
+ */
+static void test_update_sizes(void)
+{
+	/* EDON-R512 of the bytes 0..255, hashed by one update. The EDON-R512 block loop
+	 * used to advance by an EDON-R256 block, giving 5BA23C8E7A9F425D...19D1BC0BB79B8FF9 */
+	static const char* edonr512_256 = "12E6B34E01FB2029F49DF91694F2FAE0C5B9FEDDD1B4EA64C2C834634ACB21FA"
+		"D7232DF0C273BF3FA4B3CDBD84E04057FA752F386B7CC900FF5343CA9C9F7074";
+	int i, hash_id;
+	unsigned char message[1000], digest[64];
+	char hex[130];
+
+	for(i = 0; i < 256; i++) message[i] = (unsigned char)i;
+	rhash_msg(RHASH_EDONR512, message, 256, digest);
+	rhash_print_bytes(hex, digest, 64, RHPR_HEX | RHPR_UPPERCASE);
+	if(strcmp(hex, edonr512_256) != 0) {
+		log_message("failed: EDON-R512 of 256 bytes = %s, expected %s\n", hex, edonr512_256);
+		g_errors++;
+	}
+
+	for(i = 0; i < (int)sizeof(message); i++) message[i] = (unsigned char)(i * 31 + (i >> 7));
+	for(hash_id = 1; (hash_id & RHASH_ALL_HASHES); hash_id <<= 1) {
+		unsigned char expected[130], result[130];
+		int size = rhash_get_digest_size(hash_id);
+		rhash ctx = rhash_init(hash_id);
+		for(i = 0; i < (int)sizeof(message); i++) rhash_update(ctx, message + i, 1);
+		rhash_final(ctx, expected);
+		rhash_free(ctx);
+
+		rhash_msg(hash_id, message, sizeof(message), result);
+		if(memcmp(expected, result, size) != 0) {
+			log_message("failed: %s of 1000 bytes differs when hashed at once\n", rhash_get_name(hash_id));
+			g_errors++;
+		}
+	}
+}
+
 /**
  * Verify processor endianness detected at compile-time against
  * with the actual CPU endianness in runtime.
@@ -721,6 +764,665 @@ static void test_magnet(void)
 	rhash_free(ctx);
 }
 
+/**
+ * Verify hashing with a rhash context stored in a caller-supplied buffer.
+ */
+static void test_init_in(void)
+{
+	union {
+		unsigned long long align;
+		char data[8192];
+	} buffer;
+	const char* msg = "message digest";
+	unsigned hash_id;
+
+	for(hash_id = 1; (hash_id & RHASH_ALL_HASHES); hash_id <<= 1) {
+		char expected[130], result[130];
+		size_t size = rhash_get_context_size(hash_id | RHASH_CRC32);
+		rhash ctx;
+		assert(size <= sizeof(buffer));
+		if(hash_id == RHASH_BTIH) continue; /* the test hash value depends on a file name */
+		strcpy(expected, hash_message(hash_id, msg));
+
+		if(rhash_init_in(&buffer, size - 1, hash_id | RHASH_CRC32) != NULL) {
+			log_message("failed: rhash_init_in() accepted a small buffer for %s\n", rhash_get_name(hash_id));
+			g_errors++;
+		}
+		ctx = rhash_init_in(&buffer, size, hash_id | RHASH_CRC32);
+		if(ctx == NULL) {
+			log_message("failed: rhash_init_in() for %s\n", rhash_get_name(hash_id));
+			g_errors++;
+			continue;
+		}
+		rhash_update(ctx, msg, strlen(msg));
+		rhash_final(ctx, 0);
+		rhash_print(result, ctx, hash_id, RHPR_UPPERCASE);
+		rhash_free(ctx);
+		if(strcmp(result, expected) != 0) {
+			log_message("failed: %s(\"%s\") = %s in a stack context, expected %s\n", rhash_get_name(hash_id), msg, result, expected);
+			g_errors++;
+		}
+	}
+}
+
+/**
+ * Verify that hashing by several threads gives the same results,
+ * as hashing in the calling thread.
+ */
+static void test_threads(void)
+{
+	size_t size = 300000, i;
+	unsigned char* data = (unsigned char*)malloc(size);
+	unsigned hash_id;
+	rhash ctx, ctx_mt;
+
+	for(i = 0; i < size; i++) data[i] = (unsigned char)(i * 13 + (i >> 11));
+	ctx = rhash_init(RHASH_ALL_HASHES);
+	ctx_mt = rhash_init(RHASH_ALL_HASHES);
+	if(rhash_set_threads(ctx_mt, 4) == RHASH_ERROR) {
+		log_message("failed: rhash_set_threads()\n");
+		g_errors++;
+	}
+	/* the small message is hashed in the calling thread */
+	rhash_update(ctx, data, 100);
+	rhash_update(ctx_mt, data, 100);
+	rhash_update(ctx, data + 100, size - 100);
+	rhash_update(ctx_mt, data + 100, size - 100);
+	rhash_final(ctx, 0);
+	rhash_final(ctx_mt, 0);
+
+	for(hash_id = 1; (hash_id & RHASH_ALL_HASHES); hash_id <<= 1) {
+		char expected[130], result[130];
+		rhash_print(expected, ctx, hash_id, RHPR_UPPERCASE);
+		rhash_print(result, ctx_mt, hash_id, RHPR_UPPERCASE);
+		if(strcmp(result, expected) != 0) {
+			log_message("failed: %s calculated by threads = %s, expected %s\n", rhash_get_name(hash_id), result, expected);
+			g_errors++;
+		}
+	}
+	rhash_free(ctx);
+	rhash_free(ctx_mt);
+	free(data);
+}
+
+/**
+ * Verify hashing of a file, split into chunks, which are hashed by several threads.
+ */
+static void test_threaded_file(void)
+{
+	static const unsigned hash_masks[] = {
+		RHASH_TTH | RHASH_ED2K | RHASH_AICH | RHASH_BTIH,
+		RHASH_TTH | RHASH_ED2K | RHASH_AICH | RHASH_BTIH | RHASH_SHA1 | RHASH_CRC32,
+		RHASH_TTH | RHASH_CRC32 | RHASH_MD5 | RHASH_SHA1 | RHASH_SHA256 | RHASH_SHA512
+	};
+	/* exact multiples of the ED2K/AICH, TTH and BTIH chunk sizes, a single chunk and a tail */
+	static const size_t sizes[] = {
+		2 * 9728000 + 1234567, 2 * 9728000, 9728000, 20 * 1048576, 3 * 65536
+	};
+	size_t max_size = 20 * 1048576, i, n;
+	unsigned char* data = (unsigned char*)malloc(max_size);
+	unsigned hash_id, k;
+
+	if(!data) {
+		log_message("failed: can't allocate memory\n");
+		g_errors++;
+		return;
+	}
+	for(i = 0; i < max_size; i++) data[i] = (unsigned char)(i * 7 + (i >> 13));
+
+	for(n = 0; n < sizeof(sizes) / sizeof(*sizes); n++) {
+		size_t size = sizes[n];
+		FILE* fd = tmpfile();
+		if(!fd || fwrite(data, 1, size, fd) != size || fflush(fd) != 0) {
+			log_message("failed: can't write a temporary file\n");
+			g_errors++;
+			if(fd) fclose(fd);
+			break;
+		}
+
+		for(k = 0; k < sizeof(hash_masks) / sizeof(*hash_masks); k++) {
+			rhash ctx = rhash_init(hash_masks[k]);
+			rhash ctx_mt = rhash_init(hash_masks[k]);
+			rhash_set_threads(ctx_mt, 3);
+			rhash_update(ctx, data, size);
+			rhash_fd_update(ctx_mt, fileno(fd), 0, RHASH_TILL_EOF);
+			rhash_final(ctx, 0);
+			rhash_final(ctx_mt, 0);
+
+			for(hash_id = 1; (hash_id & RHASH_ALL_HASHES); hash_id <<= 1) {
+				char expected[130], result[130];
+				if(!(hash_id & hash_masks[k])) continue;
+				rhash_print(expected, ctx, hash_id, RHPR_UPPERCASE);
+				rhash_print(result, ctx_mt, hash_id, RHPR_UPPERCASE);
+				if(strcmp(result, expected) != 0) {
+					log_message("failed: %s of a %u-byte file hashed by chunks = %s, expected %s\n",
+						rhash_get_name(hash_id), (unsigned)size, result, expected);
+					g_errors++;
+				}
+			}
+			rhash_free(ctx);
+			rhash_free(ctx_mt);
+		}
+		fclose(fd);
+	}
+	free(data);
+}
+
+/**
+ * Verify CRC32 of a file hashed by chunks in several threads,
+ * using every CRC32 implementation supported by the CPU.
+ */
+static void test_threaded_crc32(void)
+{
+	static const char* names[] = { "generic", "pclmul" };
+	size_t size = 3 * 4 * 1024 * 1024 + 12345, i;
+	unsigned char* data = (unsigned char*)malloc(size);
+	unsigned char expected[4];
+	FILE* fd = tmpfile();
+	unsigned k;
+
+	if(!data || !fd) {
+		log_message("failed: can't allocate memory\n");
+		g_errors++;
+		if(fd) fclose(fd);
+		free(data);
+		return;
+	}
+	for(i = 0; i < size; i++) data[i] = (unsigned char)(i * 13 + (i >> 11));
+	if(fwrite(data, 1, size, fd) != size || fflush(fd) != 0) {
+		log_message("failed: can't write a temporary file\n");
+		g_errors++;
+		fclose(fd);
+		free(data);
+		return;
+	}
+	rhash_msg(RHASH_CRC32, data, size, expected);
+
+	for(k = 0; k < sizeof(names) / sizeof(*names); k++) {
+		unsigned char result[4];
+		rhash ctx;
+		if(rhash_set_implementation(RHASH_CRC32, names[k]) == RHASH_ERROR) continue; /* unsupported by the CPU */
+		ctx = rhash_init(RHASH_CRC32);
+		rhash_set_threads(ctx, 3);
+		rhash_fd_update(ctx, fileno(fd), 0, RHASH_TILL_EOF);
+		rhash_final(ctx, result);
+		if(memcmp(result, expected, sizeof(result)) != 0 ||
+				strcmp(rhash_get_context_implementation(ctx, RHASH_CRC32), names[k]) != 0) {
+			log_message("failed: CRC32 of a file hashed by chunks (%s implementation)\n", names[k]);
+			g_errors++;
+		}
+		rhash_free(ctx);
+	}
+	rhash_set_implementation(RHASH_CRC32, NULL);
+	fclose(fd);
+	free(data);
+}
+
+/**
+ * Verify CRC32 of messages of different lengths and alignment,
+ * and combining of CRC32 sums of message parts.
+ */
+static void test_crc32(void)
+{
+	unsigned char data[1100];
+	size_t i, start, len;
+
+	for(i = 0; i < sizeof(data); i++) data[i] = (unsigned char)(i * 31 + (i >> 5));
+	for(start = 0; start < 8; start++) {
+		for(len = 0; len + start <= sizeof(data); len += (len < 130 ? 1 : 97)) {
+			unsigned crc = 0xFFFFFFFF, expected, result, crc_a, crc_b;
+			unsigned char digest[4];
+			int j;
+			/* calculate CRC32 bit by bit */
+			for(i = 0; i < len; i++) {
+				crc ^= data[start + i];
+				for(j = 0; j < 8; j++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+			}
+			expected = crc ^ 0xFFFFFFFF;
+			rhash_msg(RHASH_CRC32, data + start, len, digest);
+			result = ((unsigned)digest[0] << 24) | (digest[1] << 16) | (digest[2] << 8) | digest[3];
+			if(result != expected) {
+				log_message("failed: CRC32 of %u bytes at offset %u = %08X, expected %08X\n",
+					(unsigned)len, (unsigned)start, result, expected);
+				g_errors++;
+				return;
+			}
+
+			/* combine CRC32 of two parts of the message */
+			rhash_msg(RHASH_CRC32, data + start, len / 3, digest);
+			crc_a = ((unsigned)digest[0] << 24) | (digest[1] << 16) | (digest[2] << 8) | digest[3];
+			rhash_msg(RHASH_CRC32, data + start + len / 3, len - len / 3, digest);
+			crc_b = ((unsigned)digest[0] << 24) | (digest[1] << 16) | (digest[2] << 8) | digest[3];
+			result = rhash_crc32_combine(crc_a, crc_b, len - len / 3);
+			if(result != expected) {
+				log_message("failed: rhash_crc32_combine() for %u bytes = %08X, expected %08X\n",
+					(unsigned)len, result, expected);
+				g_errors++;
+				return;
+			}
+		}
+	}
+}
+
+/**
+ * Verify that a context, which updates pairs of algorithms by stitched
+ * kernels, gives the same results as hashing by every algorithm alone.
+ */
+static void test_stitched(void)
+{
+	static const unsigned hash_ids[] = {
+		RHASH_CRC32 | RHASH_MD5, RHASH_MD5 | RHASH_SHA1, RHASH_SHA1 | RHASH_SHA224,
+		RHASH_SHA1 | RHASH_SHA256, RHASH_CRC32 | RHASH_MD5 | RHASH_SHA1 | RHASH_SHA256
+	};
+	/* sizes of the message parts to update a context by, their sum is 1457 */
+	static const size_t parts[] = { 3, 64, 200, 61, 1000, 128, 1 };
+	unsigned char data[1458], result[64], expected[64];
+	size_t i, k;
+
+	for(i = 0; i < sizeof(data); i++) data[i] = (unsigned char)(i * 13 + 5);
+	for(k = 0; k < sizeof(hash_ids) / sizeof(*hash_ids); k++) {
+		const unsigned char* msg = data + 1; /* an unaligned message */
+		rhash ctx = rhash_init(hash_ids[k]);
+		unsigned hash_id;
+		if(!ctx) {
+			log_message("error: failed to create a context\n");
+			g_errors++;
+			return;
+		}
+		for(i = 0; i < sizeof(parts) / sizeof(*parts); i++) {
+			rhash_update(ctx, msg, parts[i]);
+			msg += parts[i];
+		}
+		rhash_final(ctx, 0);
+
+		for(hash_id = 1; hash_id & RHASH_ALL_HASHES; hash_id <<= 1) {
+			if((hash_ids[k] & hash_id) == 0) continue;
+			rhash_print((char*)result, ctx, hash_id, RHPR_RAW);
+			rhash_msg(hash_id, data + 1, (size_t)(msg - data - 1), expected);
+			if(memcmp(result, expected, rhash_get_digest_size(hash_id)) != 0) {
+				log_message("failed: stitched %s (%s implementation)\n",
+					rhash_get_name(hash_id), rhash_get_implementation(hash_id));
+				g_errors++;
+			}
+		}
+		rhash_free(ctx);
+	}
+}
+
+/**
+ * Verify that TTH, AICH and BTIH give the same results, when a long message
+ * is hashed at once, so leaves and blocks are hashed several at a time,
+ * and when the message is hashed by small parts.
+ */
+static void test_tree_hashes(void)
+{
+	const unsigned hash_ids = RHASH_TTH | RHASH_AICH | RHASH_BTIH;
+	const size_t size = 9728000 + 184320 * 4 + 1000, part_size = 1000;
+	char expected[130], result[130];
+	unsigned char* data = (unsigned char*)malloc(size);
+	rhash ctx, ctx_parts;
+	unsigned hash_id;
+	size_t i;
+
+	ctx = rhash_init(hash_ids);
+	ctx_parts = rhash_init(hash_ids);
+	if(!data || !ctx || !ctx_parts) {
+		log_message("error: failed to allocate memory\n");
+		g_errors++;
+		free(data);
+		if(ctx) rhash_free(ctx);
+		if(ctx_parts) rhash_free(ctx_parts);
+		return;
+	}
+	for(i = 0; i < size; i++) data[i] = (unsigned char)(i * 7 + (i >> 11));
+
+	rhash_update(ctx, data, size);
+	for(i = 0; i < size; i += part_size) {
+		rhash_update(ctx_parts, data + i, (size - i < part_size ? size - i : part_size));
+	}
+	rhash_final(ctx, 0);
+	rhash_final(ctx_parts, 0);
+
+	for(hash_id = 1; hash_id & RHASH_ALL_HASHES; hash_id <<= 1) {
+		if((hash_ids & hash_id) == 0) continue;
+		rhash_print(result, ctx, hash_id, RHPR_UPPERCASE);
+		rhash_print(expected, ctx_parts, hash_id, RHPR_UPPERCASE);
+		if(strcmp(result, expected) != 0) {
+			log_message("failed: %s of a long message hashed at once: %s, expected %s\n",
+				rhash_get_name(hash_id), result, expected);
+			g_errors++;
+		}
+	}
+	rhash_free(ctx);
+	rhash_free(ctx_parts);
+	free(data);
+}
+
+/**
+ * Verify all implementations of hash algorithms, by restricting
+ * the CPU instruction sets and by forcing implementations.
+ */
+static void test_implementations(void)
+{
+	/* subsets of instruction sets to test by increasing order */
+	static const unsigned features_subsets[] = {
+		0, RHASH_CPU_SSE2 | RHASH_CPU_SSSE3 | RHASH_CPU_SSE41 | RHASH_CPU_PCLMUL,
+		RHASH_CPU_SSE2 | RHASH_CPU_SSSE3 | RHASH_CPU_SSE41 | RHASH_CPU_AVX | RHASH_CPU_AVX2 | RHASH_CPU_BMI2
+	};
+	unsigned features = (unsigned)rhash_get_cpu_features();
+	unsigned hash_id, i;
+	const char* name;
+
+	/* without extra instruction sets only the generic code is used */
+	rhash_set_cpu_features(0);
+	for(hash_id = 1; hash_id & RHASH_ALL_HASHES; hash_id <<= 1) {
+		name = rhash_get_implementation(hash_id);
+		if(!name || (strcmp(name, "generic") != 0 && strncmp(name, "openssl", 7) != 0)) {
+			log_message("failed: %s implementation is %s without CPU features\n", rhash_get_name(hash_id), name);
+			g_errors++;
+		}
+	}
+	for(i = 0; i < sizeof(features_subsets) / sizeof(*features_subsets); i++) {
+		rhash_set_cpu_features(features & features_subsets[i]);
+		test_all_known_strings();
+		test_long_strings();
+		test_crc32();
+		test_stitched();
+		test_tree_hashes();
+	}
+	rhash_set_cpu_features(features);
+	test_stitched();
+	test_tree_hashes();
+
+	if(rhash_set_implementation(RHASH_CRC32, "generic") == RHASH_ERROR ||
+		strcmp(rhash_get_implementation(RHASH_CRC32), "generic") != 0 ||
+		rhash_set_implementation(RHASH_CRC32, "no-such-implementation") != RHASH_ERROR ||
+		rhash_set_implementation(RHASH_CRC32 | RHASH_MD5, NULL) != RHASH_ERROR ||
+		rhash_set_implementation(RHASH_CRC32, NULL) == RHASH_ERROR) {
+		log_message("failed: rhash_set_implementation()\n");
+		g_errors++;
+	}
+}
+
+/**
+ * Verify that a context keeps its implementations, while other
+ * implementations are selected for new contexts.
+ */
+static void test_context_backend(void)
+{
+	static const unsigned hash_ids[] = { RHASH_CRC32, RHASH_MD5, RHASH_SHA1, RHASH_AICH, RHASH_BTIH, RHASH_SHA256 };
+	enum { COUNT = sizeof(hash_ids) / sizeof(*hash_ids) };
+	unsigned features = (unsigned)rhash_get_cpu_features();
+	size_t size = 1000000, i;
+	unsigned char* data = (unsigned char*)malloc(size);
+	const char* used[COUNT];
+	unsigned mask = 0;
+	rhash ctx;
+
+	for(i = 0; i < size; i++) data[i] = (unsigned char)(i * 11 + (i >> 9));
+	for(i = 0; i < COUNT; i++) mask |= hash_ids[i];
+	ctx = rhash_init(mask);
+	for(i = 0; i < COUNT; i++) used[i] = rhash_get_context_implementation(ctx, hash_ids[i]);
+	rhash_update(ctx, data, size / 2);
+
+	/* switch the implementations in the middle of hashing */
+	rhash_set_cpu_features(0);
+	rhash_set_implementation(RHASH_SHA1, "generic");
+	rhash_library_init(); /* must not reselect the implementations */
+	if(strcmp(rhash_get_implementation(RHASH_SHA1), "generic") != 0) {
+		log_message("failed: rhash_library_init() has reselected implementations\n");
+		g_errors++;
+	}
+	rhash_update(ctx, data + size / 2, size - size / 2);
+	rhash_final(ctx, 0);
+
+	for(i = 0; i < COUNT; i++) {
+		char expected[130], result[130];
+		unsigned char digest[64];
+		const char* name = rhash_get_context_implementation(ctx, hash_ids[i]);
+		if(strcmp(name, used[i]) != 0) {
+			log_message("failed: %s context implementation changed from %s to %s\n",
+				rhash_get_name(hash_ids[i]), used[i], name);
+			g_errors++;
+		}
+		rhash_msg(hash_ids[i], data, size, digest);
+		rhash_print_bytes(expected, digest, rhash_get_digest_size(hash_ids[i]),
+			(rhash_is_base32(hash_ids[i]) ? RHPR_BASE32 : RHPR_HEX) | RHPR_UPPERCASE);
+		rhash_print(result, ctx, hash_ids[i], RHPR_UPPERCASE);
+		if(strcmp(result, expected) != 0) {
+			log_message("failed: %s = %s after switching implementations, expected %s\n",
+				rhash_get_name(hash_ids[i]), result, expected);
+			g_errors++;
+		}
+	}
+	rhash_free(ctx);
+	rhash_set_cpu_features(features);
+	free(data);
+}
+
+/**
+ * Verify that the sets of implementations, replaced while contexts
+ * were using them, are reused when the contexts are freed.
+ */
+static void test_backend_reuse(void)
+{
+	rhash contexts[64];
+	size_t count, i;
+
+	/* without live contexts, implementations can be switched any number of times */
+	for(i = 0; i < 100; i++) {
+		if(rhash_set_implementation(RHASH_CRC32, (i & 1 ? "generic" : NULL)) == RHASH_ERROR) {
+			log_message("failed: rhash_set_implementation() call %u without contexts\n", (unsigned)i);
+			g_errors++;
+			break;
+		}
+	}
+
+	/* every context keeps its set of implementations, so the number of sets is bounded */
+	for(count = 0; count < sizeof(contexts) / sizeof(*contexts); count++) {
+		contexts[count] = rhash_init(RHASH_CRC32 | RHASH_SHA1);
+		if(rhash_set_implementation(RHASH_CRC32, (count & 1 ? "generic" : NULL)) == RHASH_ERROR) {
+			count++;
+			break;
+		}
+	}
+	if(count == sizeof(contexts) / sizeof(*contexts)) {
+		log_message("failed: %u sets of implementations are kept for contexts\n", (unsigned)count);
+		g_errors++;
+	}
+	rhash_free(contexts[0]);
+	if(rhash_set_implementation(RHASH_CRC32, NULL) == RHASH_ERROR) {
+		log_message("failed: rhash_set_implementation() after freeing a context\n");
+		g_errors++;
+	}
+	for(i = 1; i < count; i++) {
+		char result[130];
+		rhash_update(contexts[i], "abc", 3);
+		rhash_final(contexts[i], 0);
+		rhash_print(result, contexts[i], RHASH_CRC32, RHPR_UPPERCASE);
+		if(strcmp(result, "352441C2") != 0) {
+			log_message("failed: CRC32 of a context created before switching = %s\n", result);
+			g_errors++;
+		}
+		rhash_free(contexts[i]);
+	}
+}
+
+/**
+ * Verify that auto-tuning selects working implementations,
+ * and that the choice is restored from the cache file.
+ */
+static void test_autotune(void)
+{
+	static const unsigned hash_ids[] = { RHASH_MD5, RHASH_SHA1, RHASH_SHA256, RHASH_SHA512, RHASH_WHIRLPOOL };
+	enum { COUNT = sizeof(hash_ids) / sizeof(*hash_ids) };
+	const char* cache_path = "test_autotune.tmp";
+	unsigned features = (unsigned)rhash_get_cpu_features();
+	unsigned mask = 0;
+	const char* tuned[COUNT];
+	char buffer[1024];
+	FILE* fd;
+	size_t i, size;
+
+	for(i = 0; i < COUNT; i++) mask |= hash_ids[i];
+	remove(cache_path);
+	if(rhash_autotune(mask, cache_path) != 0) {
+		log_message("failed: rhash_autotune() can't write %s\n", cache_path);
+		g_errors++;
+	}
+	for(i = 0; i < COUNT; i++) tuned[i] = rhash_get_implementation(hash_ids[i]);
+	test_all_known_strings();
+
+	/* reselect the default implementations, then load the tuned ones from the cache */
+	rhash_set_cpu_features(features);
+	rhash_autotune(mask, cache_path);
+	for(i = 0; i < COUNT; i++) {
+		const char* name = rhash_get_implementation(hash_ids[i]);
+		if(strcmp(name, tuned[i]) != 0) {
+			log_message("failed: rhash_autotune() cached %s implementation %s, loaded %s\n",
+				rhash_get_name(hash_ids[i]), tuned[i], name);
+			g_errors++;
+		}
+	}
+
+	/* a cache file with a truncated line is ignored and rewritten */
+	fd = fopen(cache_path, "a");
+	if(fd) {
+		fputs("sha1 trunc", fd);
+		fclose(fd);
+	}
+	rhash_set_cpu_features(features);
+	rhash_autotune(mask, cache_path);
+	fd = fopen(cache_path, "r");
+	size = (fd ? fread(buffer, 1, sizeof(buffer) - 1, fd) : 0);
+	buffer[size] = '\0';
+	if(fd) fclose(fd);
+	if(size == 0 || buffer[size - 1] != '\n' || strstr(buffer, "trunc")) {
+		log_message("failed: rhash_autotune() kept a malformed cache file\n");
+		g_errors++;
+	}
+	remove(cache_path);
+	rhash_set_cpu_features(features);
+}
+
+/**
+ * Verify that rhash_msg_batch() gives the same results as rhash_msg().
+ */
+static void test_msg_batch(void)
+{
+	static const unsigned hash_ids[] = {
+		RHASH_MD5, RHASH_SHA1, RHASH_SHA224, RHASH_SHA256, RHASH_CRC32, RHASH_TIGER
+	};
+	static const size_t sizes[] = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 1000 };
+	enum { COUNT = 37 };
+	const void* msgs[COUNT];
+	size_t lens[COUNT];
+	unsigned char data[1000 + COUNT];
+	unsigned char out[COUNT * 64], expected[64];
+	size_t i, k;
+
+	for(i = 0; i < sizeof(data); i++) data[i] = (unsigned char)(i * 7 + 3);
+	for(i = 0; i < COUNT; i++) {
+		msgs[i] = data + i;
+		lens[i] = sizes[(i * 5) % (sizeof(sizes) / sizeof(*sizes))];
+	}
+
+	for(k = 0; k < sizeof(hash_ids) / sizeof(*hash_ids); k++) {
+		unsigned hash_id = hash_ids[k];
+		size_t digest_size = rhash_get_digest_size(hash_id);
+		size_t count;
+		/* check a single message, less messages than lanes and a full batch */
+		for(count = 1; count <= COUNT; count += 4) {
+			rhash_msg_batch(hash_id, msgs, lens, count, out);
+			for(i = 0; i < count; i++) {
+				rhash_msg(hash_id, msgs[i], lens[i], expected);
+				if(memcmp(out + i * digest_size, expected, digest_size) != 0) {
+					log_message("failed: rhash_msg_batch(%s) for message %u of %u, length %u\n",
+						rhash_get_name(hash_id), (unsigned)i, (unsigned)count, (unsigned)lens[i]);
+					g_errors++;
+					break;
+				}
+			}
+		}
+	}
+	if(rhash_msg_batch(RHASH_MD5 | RHASH_SHA1, msgs, lens, 1, out) == 0) {
+		log_message("failed: rhash_msg_batch() accepted several hash ids\n");
+		g_errors++;
+	}
+}
+
+/**
+ * Verify that hashing a file by rhash_file_update(), rhash_fd_update() and
+ * rhash_mmap_update() gives the same result as hashing its content in memory.
+ */
+static void test_file_update(void)
+{
+	static const size_t block_sizes[] = { 0, 4096, 65536, 1000 };
+	const unsigned hash_id = RHASH_CRC32 | RHASH_SHA1;
+	const size_t file_size = 300000, start = 5;
+	unsigned char expected[20], result[20];
+	char* data;
+	FILE* fd;
+	size_t i;
+
+	data = (char*)malloc(file_size);
+	fd = tmpfile();
+	if(!data || !fd) {
+		log_message("error: can't create a temporary file\n");
+		g_errors++;
+		free(data);
+		return;
+	}
+	for(i = 0; i < file_size; i++) data[i] = (char)(i * 7 + (i >> 8));
+	fwrite(data, 1, file_size, fd);
+	rhash_msg(RHASH_SHA1, data + start, file_size - start, expected);
+
+	for(i = 0; i <= sizeof(block_sizes) / sizeof(*block_sizes); i++) {
+		rhash ctx = rhash_init(hash_id);
+		if(i < sizeof(block_sizes) / sizeof(*block_sizes)) {
+			rhash_set_async_read(ctx, 1);
+			rhash_set_file_block_size(ctx, block_sizes[i]);
+		}
+		fseek(fd, (long)start, SEEK_SET);
+		rhash_file_update(ctx, fd);
+		rhash_final(ctx, 0);
+		rhash_print((char*)result, ctx, RHASH_SHA1, RHPR_RAW);
+		if(memcmp(result, expected, 20) != 0 || ctx->msg_size != file_size - start) {
+			log_message("failed: rhash_file_update() with block size %d\n", (i < sizeof(block_sizes) / sizeof(*block_sizes) ? (int)block_sizes[i] : -1));
+			g_errors++;
+		}
+		rhash_free(ctx);
+	}
+
+	/* hash a part of the file by its descriptor */
+	for(i = 0; i < 3; i++) {
+		const size_t part_size = 100000;
+		rhash ctx = rhash_init(hash_id);
+		rhash_msg(RHASH_SHA1, data + start, part_size, expected);
+		if(i == 0) rhash_fd_update(ctx, fileno(fd), start, part_size);
+		else if(i == 1) rhash_mmap_update(ctx, fileno(fd), start, part_size);
+		else {
+			rhash_iovec iov[3];
+			iov[0].iov_base = data + start;
+			iov[0].iov_len = 10;
+			iov[1].iov_base = data + start + 10;
+			iov[1].iov_len = 0;
+			iov[2].iov_base = data + start + 10;
+			iov[2].iov_len = part_size - 10;
+			rhash_updatev(ctx, iov, 3);
+		}
+		rhash_final(ctx, 0);
+		rhash_print((char*)result, ctx, RHASH_SHA1, RHPR_RAW);
+		if(memcmp(result, expected, 20) != 0 || ctx->msg_size != part_size) {
+			log_message("failed: %s()\n", (i == 0 ? "rhash_fd_update" : i == 1 ? "rhash_mmap_update" : "rhash_updatev"));
+			g_errors++;
+		}
+		rhash_free(ctx);
+	}
+	fclose(fd);
+	free(data);
+}
+
 /**
  * Find hash id by its name.
  *
@@ -778,7 +1480,20 @@ int main(int argc, char *argv[])
 		test_all_known_strings();
 		test_long_strings();
 		test_alignment();
+		test_update_sizes();
+		g_errors += test_cpp_hasher();
 		test_magnet();
+		test_init_in();
+		test_crc32();
+		test_implementations();
+		test_context_backend();
+		test_backend_reuse();
+		test_autotune();
+		test_msg_batch();
+		test_threads();
+		test_threaded_file();
+		test_threaded_crc32();
+		test_file_update();
 		if(g_errors == 0) printf("All sums are working properly!\n");
 		fflush(stdout);
 	}
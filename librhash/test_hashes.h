@@ -254,6 +254,9 @@ char* compiler_flags = "Compile-time flags:"
 #ifdef USE_OPENSSL
 	" USE_OPENSSL"
 #endif
+#ifdef USE_OPENSSL_ASM
+	" USE_OPENSSL_ASM"
+#endif
 
 /* detect endianness */
 #ifdef CPU_LITTLE_ENDIAN
@@ -37,7 +37,7 @@ void rhash_tiger_init(tiger_ctx *ctx)
 }
 
 /* lookup tables */
-extern uint64_t rhash_tiger_sboxes[4][256];
+extern const uint64_t rhash_tiger_sboxes[4][256];
 #define t1 rhash_tiger_sboxes[0]
 #define t2 rhash_tiger_sboxes[1]
 #define t3 rhash_tiger_sboxes[2]
@@ -150,6 +150,96 @@ static void rhash_tiger_process_block(uint64_t state[3], uint64_t* block)
 	state[2] = c + state[2];
 }
 
+/* the rounds and the key schedule for TIGER_LANES independent blocks, the
+ * variables of the lane l are named by the suffix _l, like a_0 and x0_0 */
+#define round_lanes(a,b,c,x,mul) \
+	round(a##_0, b##_0, c##_0, x##_0, mul) \
+	round(a##_1, b##_1, c##_1, x##_1, mul) \
+	round(a##_2, b##_2, c##_2, x##_2, mul) \
+	round(a##_3, b##_3, c##_3, x##_3, mul)
+
+#define pass_lanes(a,b,c,mul) \
+	round_lanes(a,b,c,x0,mul) \
+	round_lanes(b,c,a,x1,mul) \
+	round_lanes(c,a,b,x2,mul) \
+	round_lanes(a,b,c,x3,mul) \
+	round_lanes(b,c,a,x4,mul) \
+	round_lanes(c,a,b,x5,mul) \
+	round_lanes(a,b,c,x6,mul) \
+	round_lanes(b,c,a,x7,mul)
+
+#define key_schedule_lane(l) { \
+	x0##l -= x7##l ^ I64(0xA5A5A5A5A5A5A5A5); \
+	x1##l ^= x0##l; \
+	x2##l += x1##l; \
+	x3##l -= x2##l ^ ((~x1##l)<<19); \
+	x4##l ^= x3##l; \
+	x5##l += x4##l; \
+	x6##l -= x5##l ^ ((~x4##l)>>23); \
+	x7##l ^= x6##l; \
+	x0##l += x7##l; \
+	x1##l -= x0##l ^ ((~x7##l)<<19); \
+	x2##l ^= x1##l; \
+	x3##l += x2##l; \
+	x4##l -= x3##l ^ ((~x2##l)>>23); \
+	x5##l ^= x4##l; \
+	x6##l += x5##l; \
+	x7##l -= x6##l ^ I64(0x0123456789ABCDEF); \
+}
+
+#define key_schedule_lanes \
+	key_schedule_lane(_0) \
+	key_schedule_lane(_1) \
+	key_schedule_lane(_2) \
+	key_schedule_lane(_3)
+
+#define load_lane(l, n) \
+	x0##l = le2me_64(blocks[n][0]); x1##l = le2me_64(blocks[n][1]); \
+	x2##l = le2me_64(blocks[n][2]); x3##l = le2me_64(blocks[n][3]); \
+	x4##l = le2me_64(blocks[n][4]); x5##l = le2me_64(blocks[n][5]); \
+	x6##l = le2me_64(blocks[n][6]); x7##l = le2me_64(blocks[n][7]); \
+	a##l = state[n][0]; \
+	b##l = state[n][1]; \
+	c##l = state[n][2];
+
+#define feedforward_lane(l, n) \
+	state[n][0] = a##l ^ state[n][0]; \
+	state[n][1] = b##l - state[n][1]; \
+	state[n][2] = c##l + state[n][2];
+
+/**
+ * Process TIGER_LANES independent blocks with their own states at once.
+ * A round of one block depends on the result of its previous round,
+ * so interleaving the rounds of several blocks keeps the CPU busy,
+ * while the table lookups of a block are in progress.
+ *
+ * @param state the algorithm states, one per block
+ * @param blocks the message blocks to process
+ */
+void rhash_tiger_process_lanes(uint64_t state[TIGER_LANES][3], const uint64_t blocks[TIGER_LANES][8])
+{
+	uint64_t a_0, b_0, c_0, x0_0, x1_0, x2_0, x3_0, x4_0, x5_0, x6_0, x7_0;
+	uint64_t a_1, b_1, c_1, x0_1, x1_1, x2_1, x3_1, x4_1, x5_1, x6_1, x7_1;
+	uint64_t a_2, b_2, c_2, x0_2, x1_2, x2_2, x3_2, x4_2, x5_2, x6_2, x7_2;
+	uint64_t a_3, b_3, c_3, x0_3, x1_3, x2_3, x3_3, x4_3, x5_3, x6_3, x7_3;
+
+	load_lane(_0, 0)
+	load_lane(_1, 1)
+	load_lane(_2, 2)
+	load_lane(_3, 3)
+
+	pass_lanes(a, b, c, 5);
+	key_schedule_lanes;
+	pass_lanes(c, a, b, 7);
+	key_schedule_lanes;
+	pass_lanes(b, c, a, 9);
+
+	feedforward_lane(_0, 0)
+	feedforward_lane(_1, 1)
+	feedforward_lane(_2, 2)
+	feedforward_lane(_3, 3)
+}
+
 /**
  * Calculate message hash.
  * Can be called repeatedly with chunks of the message to be hashed.
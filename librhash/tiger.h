@@ -26,6 +26,10 @@ void rhash_tiger_init(tiger_ctx *ctx);
 void rhash_tiger_update(tiger_ctx *ctx, const unsigned char* msg, size_t size);
 void rhash_tiger_final(tiger_ctx *ctx, unsigned char result[24]);
 
+/* the number of blocks processed at once by rhash_tiger_process_lanes() */
+#define TIGER_LANES 4
+void rhash_tiger_process_lanes(uint64_t state[TIGER_LANES][3], const uint64_t blocks[TIGER_LANES][8]);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
@@ -16,7 +16,7 @@
 #include "byte_order.h"
 
 /* Four S-boxes used for table lookups by Tiger hash function. 8Kb in total. */
-uint64_t rhash_tiger_sboxes[4][256] = {
+const uint64_t rhash_tiger_sboxes[4][256] = {
 	{
 		I64(0x02AAB17CF7E90C5E),  I64(0xAC424B03E243A8EC),
 		I64(0x72CD5BE30DD5FCD3),  I64(0x6D019B93F6F97F3A),
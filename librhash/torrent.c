@@ -22,23 +22,21 @@
 
 #include "byte_order.h"
 #include "algorithms.h"
+#include "batch.h"
 #include "hex.h"
 #include "torrent.h"
 
-#ifdef USE_OPENSSL
+/* call the SHA1 methods, selected when the context was initialized */
 #define SHA1_INIT(ctx) ((pinit_t)ctx->sha_init)(&ctx->sha1_context)
 #define SHA1_UPDATE(ctx, msg, size) ((pupdate_t)ctx->sha_update)(&ctx->sha1_context, (msg), (size))
 #define SHA1_FINAL(ctx, result) ((pfinal_t)ctx->sha_final)(&ctx->sha1_context, (result))
-#else
-#define SHA1_INIT(ctx) rhash_sha1_init(&ctx->sha1_context)
-#define SHA1_UPDATE(ctx, msg, size) rhash_sha1_update(&ctx->sha1_context, (msg), (size))
-#define SHA1_FINAL(ctx, result) rhash_sha1_final(&ctx->sha1_context, (result))
-#endif
 
 /** size of a SHA1 hash in bytes */
 #define BT_HASH_SIZE 20
 /** number of SHA1 hashes to store together in one block */
 #define BT_BLOCK_SIZE 256
+/** maximal number of file pieces to hash at once by multi-buffer SHA1 */
+#define BT_BATCH_PIECES 8
 
 /**
  * Initialize torrent context before calculating hash.
@@ -47,20 +45,18 @@
  */
 void bt_init(torrent_ctx* ctx)
 {
+	/* get the methods of the SHA1 implementation used by new contexts */
+	const rhash_backend *backend = rhash_acquire_backend(0);
+	const rhash_hash_info *sha1_info = &backend->table[3];
 	memset(ctx, 0, sizeof(torrent_ctx));
 	ctx->piece_length = 65536;
 
-#ifdef USE_OPENSSL
-	{
-		/* get the methods of the selected SHA1 algorithm */
-		rhash_hash_info *sha1_info = &rhash_info_table[3];
-		assert(sha1_info->info->hash_id == RHASH_SHA1);
-		assert(sha1_info->context_size <= (sizeof(sha1_ctx) + sizeof(unsigned long)));
-		ctx->sha_init = sha1_info->init;
-		ctx->sha_update = sha1_info->update;
-		ctx->sha_final = sha1_info->final;
-	}
-#endif
+	assert(sha1_info->info->hash_id == RHASH_SHA1);
+	assert(sha1_info->context_size <= (sizeof(sha1_ctx) + sizeof(unsigned long)));
+	ctx->sha_init = (void*)sha1_info->init;
+	ctx->sha_update = (void*)sha1_info->update;
+	ctx->sha_final = (void*)sha1_info->final;
+	rhash_release_backend(backend);
 
 	SHA1_INIT(ctx);
 }
@@ -125,27 +121,38 @@ static int bt_vector_add_ptr(torrent_vect* vect, void* item)
 }
 
 /**
- * Store a SHA1 hash of a processed file piece.
+ * Return the place to store a SHA1 hash of the next file piece.
  *
  * @param ctx torrent algorithm context
- * @return non-zero on success, zero on fail
+ * @return pointer to the hash, NULL on fail
  */
-static int bt_store_piece_sha1(torrent_ctx *ctx)
+static unsigned char* bt_next_piece_hash(torrent_ctx *ctx)
 {
 	unsigned char* block;
-	unsigned char* hash;
 
 	if((ctx->piece_count % BT_BLOCK_SIZE) == 0) {
 		block = (unsigned char*)malloc(BT_HASH_SIZE * BT_BLOCK_SIZE);
 		if(block == NULL || !bt_vector_add_ptr(&ctx->hash_blocks, block)) {
 			if(block) free(block);
-			return 0;
+			return NULL;
 		}
 	} else {
 		block = (unsigned char*)(ctx->hash_blocks.array[ctx->piece_count / BT_BLOCK_SIZE]);
 	}
+	return &block[BT_HASH_SIZE * (ctx->piece_count % BT_BLOCK_SIZE)];
+}
+
+/**
+ * Store a SHA1 hash of a processed file piece.
+ *
+ * @param ctx torrent algorithm context
+ * @return non-zero on success, zero on fail
+ */
+static int bt_store_piece_sha1(torrent_ctx *ctx)
+{
+	unsigned char* hash = bt_next_piece_hash(ctx);
+	if(hash == NULL) return 0;
 
-	hash = &block[BT_HASH_SIZE * (ctx->piece_count % BT_BLOCK_SIZE)];
 	SHA1_FINAL(ctx, hash); /* write the hash */
 	ctx->piece_count++;
 	return 1;
@@ -189,6 +196,47 @@ int bt_add_file(torrent_ctx *ctx, const char* path, uint64_t filesize)
 	return 1;
 }
 
+/**
+ * Hash several whole file pieces at once by the multi-buffer SHA1 kernels,
+ * if it is faster than hashing them one by one.
+ * The context must be at a piece boundary.
+ *
+ * @param ctx the algorithm context
+ * @param msg the message, starting with the next file piece
+ * @param size the message size
+ * @return the number of hashed bytes, 0 if no pieces were hashed
+ */
+static size_t bt_hash_pieces(torrent_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	const void* msgs[BT_BATCH_PIECES];
+	size_t lens[BT_BATCH_PIECES];
+	unsigned char hashes[BT_BATCH_PIECES * BT_HASH_SIZE];
+	size_t min_count = rhash_batch_min_count(RHASH_SHA1);
+	size_t count = size / ctx->piece_length;
+	size_t i;
+
+	assert(ctx->index == 0);
+	if(min_count == 0 || count < min_count) return 0;
+	if(count > BT_BATCH_PIECES) count = BT_BATCH_PIECES;
+
+	for(i = 0; i < count; i++) {
+		msgs[i] = msg + i * ctx->piece_length;
+		lens[i] = ctx->piece_length;
+	}
+	rhash_msg_batch(RHASH_SHA1, msgs, lens, count, hashes);
+
+	for(i = 0; i < count; i++) {
+		unsigned char* hash = bt_next_piece_hash(ctx);
+		if(hash == NULL) {
+			ctx->error = 1;
+			break;
+		}
+		memcpy(hash, hashes + i * BT_HASH_SIZE, BT_HASH_SIZE);
+		ctx->piece_count++;
+	}
+	return count * ctx->piece_length;
+}
+
 /**
  * Calculate message hash.
  * Can be called repeatedly with chunks of the message to be hashed.
@@ -204,7 +252,14 @@ void bt_update(torrent_ctx *ctx, const void* msg, size_t size)
 	assert(ctx->index < ctx->piece_length);
 
 	while(size > 0) {
-		size_t left = (size < rest ? size : rest);
+		size_t left;
+		if(ctx->index == 0 && size >= ctx->piece_length) {
+			size_t hashed = bt_hash_pieces(ctx, pmsg, size);
+			pmsg += hashed;
+			size -= hashed;
+			if(hashed > 0) continue;
+		}
+		left = (size < rest ? size : rest);
 		SHA1_UPDATE(ctx, pmsg, left);
 		if(size < rest) {
 			ctx->index += left;
@@ -220,6 +275,57 @@ void bt_update(torrent_ctx *ctx, const void* msg, size_t size)
 	}
 }
 
+/**
+ * Return the size of a file piece, which can be hashed independently
+ * by bt_hash_chunk(), if the context is at a piece boundary.
+ *
+ * @param ctx the algorithm context
+ * @return the piece length, or 0 if the context is not at a piece boundary
+ */
+size_t bt_chunk_size(torrent_ctx *ctx)
+{
+	return (ctx->index == 0 && !ctx->error ? ctx->piece_length : 0);
+}
+
+/**
+ * Calculate the SHA1 hash of a file piece.
+ * The function doesn't modify the context, so it can be called
+ * by several threads at once.
+ *
+ * @param ctx the algorithm context
+ * @param msg the file piece
+ * @param size the piece length, as returned by bt_chunk_size()
+ * @param result the buffer to receive the piece hash
+ */
+void bt_hash_chunk(torrent_ctx *ctx, const unsigned char* msg, size_t size, unsigned char result[20])
+{
+	torrent_ctx piece_ctx;
+	torrent_ctx* const piece = &piece_ctx;
+	piece->sha_init = ctx->sha_init;
+	piece->sha_update = ctx->sha_update;
+	piece->sha_final = ctx->sha_final;
+	SHA1_INIT(piece);
+	SHA1_UPDATE(piece, msg, size);
+	SHA1_FINAL(piece, result);
+}
+
+/**
+ * Add the hash of the next file piece.
+ *
+ * @param ctx the algorithm context
+ * @param result the piece hash, calculated by bt_hash_chunk()
+ */
+void bt_add_chunk(torrent_ctx *ctx, const unsigned char result[20])
+{
+	unsigned char* hash = bt_next_piece_hash(ctx);
+	if(hash == NULL) {
+		ctx->error = 1;
+		return;
+	}
+	memcpy(hash, result, BT_HASH_SIZE);
+	ctx->piece_count++;
+}
+
 /**
  * Finalize hashing and optionally store calculated hash into the given array.
  * If the result parameter is NULL, the hash is not stored, but it is
@@ -25,8 +25,8 @@ typedef struct torrent_ctx
 	sha1_ctx sha1_context;  /* context for hashing current file piece */
 #ifdef USE_OPENSSL
 	unsigned long reserved; /* need more space for OpenSSL SHA1 context */
-	void *sha_init, *sha_update, *sha_final;
 #endif
+	void *sha_init, *sha_update, *sha_final; /* SHA1 methods, selected on init */
 	size_t index;             /* byte index in the current piece */
 	size_t piece_length;      /* length of a torrent file piece */
 	size_t piece_count;       /* the number of pieces processed */
@@ -46,6 +46,11 @@ void bt_update(torrent_ctx *ctx, const void* msg, size_t size);
 void bt_final(torrent_ctx *ctx, unsigned char result[20]);
 void bt_cleanup(torrent_ctx *ctx);
 
+/* hashing of file pieces by several threads */
+size_t bt_chunk_size(torrent_ctx *ctx);
+void bt_hash_chunk(torrent_ctx *ctx, const unsigned char* msg, size_t size, unsigned char result[20]);
+void bt_add_chunk(torrent_ctx *ctx, const unsigned char result[20]);
+
 size_t bt_get_text(torrent_ctx *ctx, char** pstr);
 unsigned char* bt_get_btih(torrent_ctx *ctx);
 
@@ -15,9 +15,15 @@
  */
 
 #include <string.h>
+#include <assert.h>
 #include "byte_order.h"
 #include "tth.h"
 
+/* a chunk is a subtree of 2^10 leaves, i.e. 1 MiB of a message */
+#define TTH_CHUNK_LEVEL  10
+#define TTH_CHUNK_LEAVES ((uint64_t)1 << TTH_CHUNK_LEVEL)
+#define TTH_CHUNK_SIZE   ((size_t)TTH_CHUNK_LEAVES * 1024)
+
 /**
  * Initialize context before calculaing hash.
  *
@@ -31,27 +37,88 @@ void rhash_tth_init(tth_ctx *ctx)
 }
 
 /**
- * The core transformation.
+ * Add the hash of a subtree of 2^level leaves into the tree, by merging it
+ * with the stored subtrees of the same height.
  *
  * @param ctx algorithm state
+ * @param hash the subtree hash, it is overwritten by the function
+ * @param level the subtree height
  */
-static void rhash_tth_process_block(tth_ctx *ctx)
+static void rhash_tth_add_subtree(tth_ctx *ctx, unsigned char hash[24], unsigned level)
 {
 	uint64_t it;
-	unsigned pos = 0;
-	unsigned char msg[24];
+	unsigned pos = 3 * level;
+	tiger_ctx tiger;
 
-	for(it = 1; it & ctx->block_count; it <<= 1) {
-		rhash_tiger_final(&ctx->tiger, msg);
-		rhash_tiger_init(&ctx->tiger);
-		ctx->tiger.message[ctx->tiger.length++] = 0x01;
-		rhash_tiger_update(&ctx->tiger, (unsigned char*)(ctx->stack + pos), 24);
-		/* note: we can cut this step, if the previous rhash_tiger_final saves directly to ctx->tiger.message+25; */
-		rhash_tiger_update(&ctx->tiger, msg, 24);
+	for(it = (uint64_t)1 << level; it & ctx->block_count; it <<= 1) {
+		rhash_tiger_init(&tiger);
+		tiger.message[tiger.length++] = 0x01;
+		rhash_tiger_update(&tiger, (unsigned char*)(ctx->stack + pos), 24);
+		rhash_tiger_update(&tiger, hash, 24);
+		rhash_tiger_final(&tiger, hash);
 		pos += 3;
 	}
-	rhash_tiger_final(&ctx->tiger, (unsigned char*)(ctx->stack + pos));
-	ctx->block_count++;
+	memcpy(ctx->stack + pos, hash, tiger_hash_length);
+	ctx->block_count += (uint64_t)1 << level;
+}
+
+/**
+ * The core transformation.
+ *
+ * @param ctx algorithm state
+ */
+static void rhash_tth_process_block(tth_ctx *ctx)
+{
+	unsigned char hash[24];
+	rhash_tiger_final(&ctx->tiger, hash);
+	rhash_tth_add_subtree(ctx, hash, 0);
+}
+
+/**
+ * Hash TIGER_LANES whole leaves at once and add them into the tree.
+ * A leaf is the 0x00 byte followed by 1024 message bytes, so the leaf
+ * data is split into 16 full Tiger blocks and a padded last block.
+ *
+ * @param ctx algorithm state, which must be at a leaf boundary
+ * @param msg the message, containing TIGER_LANES * 1024 bytes
+ */
+static void rhash_tth_process_leaves(tth_ctx *ctx, const unsigned char* msg)
+{
+	uint64_t state[TIGER_LANES][3];
+	uint64_t blocks[TIGER_LANES][8];
+	unsigned char hash[24];
+	unsigned i, k;
+
+	for(k = 0; k < TIGER_LANES; k++) {
+		state[k][0] = I64(0x0123456789ABCDEF);
+		state[k][1] = I64(0xFEDCBA9876543210);
+		state[k][2] = I64(0xF096A5B4C3B2E187);
+	}
+	for(i = 0; i < 16; i++) {
+		for(k = 0; k < TIGER_LANES; k++) {
+			const unsigned char* leaf = msg + k * 1024;
+			if(i == 0) {
+				((unsigned char*)blocks[k])[0] = 0x00;
+				memcpy((unsigned char*)blocks[k] + 1, leaf, 63);
+			} else {
+				memcpy(blocks[k], leaf + i * 64 - 1, 64);
+			}
+		}
+		rhash_tiger_process_lanes(state, (const uint64_t (*)[8])blocks);
+	}
+	/* the last block: the last message byte, padding and the leaf bit length */
+	for(k = 0; k < TIGER_LANES; k++) {
+		memset(blocks[k], 0, 64);
+		((unsigned char*)blocks[k])[0] = msg[k * 1024 + 1023];
+		((unsigned char*)blocks[k])[1] = 0x01;
+		blocks[k][7] = le2me_64(1025 * 8);
+	}
+	rhash_tiger_process_lanes(state, (const uint64_t (*)[8])blocks);
+
+	for(k = 0; k < TIGER_LANES; k++) {
+		le64_copy(hash, 0, state[k], 24);
+		rhash_tth_add_subtree(ctx, hash, 0);
+	}
 }
 
 /**
@@ -66,6 +133,11 @@ void rhash_tth_update(tth_ctx *ctx, const unsigned char* msg, size_t size)
 {
 	size_t rest = 1025 - (size_t)ctx->tiger.length;
 	for(;;) {
+		/* hash the whole leaves of the message several at once */
+		for(; rest == 1024 && size >= TIGER_LANES * 1024; size -= TIGER_LANES * 1024) {
+			rhash_tth_process_leaves(ctx, msg);
+			msg += TIGER_LANES * 1024;
+		}
 		if(size < rest) rest = size;
 		rhash_tiger_update(&ctx->tiger, msg, rest);
 		msg += rest;
@@ -123,3 +195,55 @@ void rhash_tth_final(tth_ctx *ctx, unsigned char result[24])
 	memcpy(ctx->tiger.hash, last_message, tiger_hash_length);
 	if(result) memcpy(result, last_message, tiger_hash_length);
 }
+
+/**
+ * Return the size of a message chunk, which can be hashed independently
+ * by rhash_tth_hash_chunk(), if the context is at a chunk boundary.
+ *
+ * @param ctx the algorithm context
+ * @return the chunk size, or 0 if the context is not at a chunk boundary
+ */
+size_t rhash_tth_chunk_size(tth_ctx *ctx)
+{
+	return (ctx->tiger.length == 1 && (ctx->block_count & (TTH_CHUNK_LEAVES - 1)) == 0 ?
+		TTH_CHUNK_SIZE : 0);
+}
+
+/**
+ * Calculate the root hash of the subtree for a message chunk.
+ * The function doesn't modify the context, so it can be called
+ * by several threads at once.
+ *
+ * @param ctx the algorithm context
+ * @param msg the message chunk
+ * @param size the chunk size, as returned by rhash_tth_chunk_size()
+ * @param result the buffer to receive the subtree hash
+ */
+void rhash_tth_hash_chunk(tth_ctx *ctx, const unsigned char* msg, size_t size, unsigned char result[24])
+{
+	tth_ctx chunk;
+	(void)ctx;
+	assert(size == TTH_CHUNK_SIZE);
+
+	rhash_tth_init(&chunk);
+	rhash_tth_update(&chunk, msg, size);
+	/* the subtree root is the only hash stored at the chunk level */
+	assert(chunk.block_count == TTH_CHUNK_LEAVES);
+	memcpy(result, chunk.stack + 3 * TTH_CHUNK_LEVEL, tiger_hash_length);
+}
+
+/**
+ * Add the subtree hash of the next message chunk into the tree.
+ *
+ * @param ctx the algorithm context
+ * @param result the subtree hash, calculated by rhash_tth_hash_chunk()
+ */
+void rhash_tth_add_chunk(tth_ctx *ctx, const unsigned char result[24])
+{
+	unsigned char hash[24];
+	assert(rhash_tth_chunk_size(ctx) != 0);
+
+	/* merge the subtree with the stored subtrees of the same height */
+	memcpy(hash, result, tiger_hash_length);
+	rhash_tth_add_subtree(ctx, hash, TTH_CHUNK_LEVEL);
+}
@@ -22,6 +22,11 @@ void rhash_tth_init(tth_ctx *ctx);
 void rhash_tth_update(tth_ctx *ctx, const unsigned char* msg, size_t size);
 void rhash_tth_final(tth_ctx *ctx, unsigned char result[64]);
 
+/* hashing of 1 MiB chunks of a message by several threads */
+size_t rhash_tth_chunk_size(tth_ctx *ctx);
+void rhash_tth_hash_chunk(tth_ctx *ctx, const unsigned char* msg, size_t size, unsigned char result[24]);
+void rhash_tth_add_chunk(tth_ctx *ctx, const unsigned char result[24]);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
@@ -20,5 +20,111 @@
 #include <stdio.h>
 #include <string.h>
 #include <wchar.h>
+#include <errno.h>
+#ifdef _WIN32
+# include <windows.h> /* ReadFile() */
+#else
+# include <unistd.h> /* pread() */
+#endif
+#include "rhash_thread.h"
 #include "util.h"
 
+/* the states of a once flag */
+#define ONCE_RUNNING 1
+#define ONCE_DONE 2
+
+/**
+ * Call a function only once, even if several threads get here at once.
+ * A thread, losing the race, waits till the function returns.
+ *
+ * @param once the once flag, must be zero-initialized
+ * @param func the function to call
+ */
+void rhash_call_once(rhash_atomic_t* once, void (*func)(void))
+{
+	if(rhash_atomic_load(once) == ONCE_DONE) return;
+	if(rhash_atomic_cas(once, 0, ONCE_RUNNING)) {
+		func();
+		rhash_atomic_store(once, ONCE_DONE);
+		return;
+	}
+	while(rhash_atomic_load(once) != ONCE_DONE) rhash_thread_yield();
+}
+
+/**
+ * Allocate a memory block with the given alignment.
+ * The block must be freed by rhash_aligned_free().
+ *
+ * @param alignment the alignment, must be a power of 2 and a multiple of sizeof(void*)
+ * @param size the size of the block to allocate
+ * @return pointer to the allocated block, NULL on error and errno is set
+ */
+void* rhash_aligned_alloc(size_t alignment, size_t size)
+{
+#ifdef _WIN32
+	return _aligned_malloc(size, alignment);
+#else
+	void* ptr;
+	int res = posix_memalign(&ptr, alignment, size);
+	if(res != 0) {
+		errno = res;
+		return NULL;
+	}
+	return ptr;
+#endif
+}
+
+/**
+ * Free a memory block allocated by rhash_aligned_alloc().
+ *
+ * @param ptr pointer to the memory block
+ */
+void rhash_aligned_free(void* ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+/**
+ * Read data from the given file offset without changing the file position.
+ * Unlike the POSIX pread(), the function retries short reads, so
+ * a result less than the requested size means the end of file.
+ *
+ * @param fd file descriptor
+ * @param buffer the buffer to read into
+ * @param size the number of bytes to read
+ * @param offset the file offset to read from
+ * @return the number of bytes read, -1 on error and errno is set
+ */
+long long rhash_pread(int fd, void* buffer, size_t size, unsigned long long offset)
+{
+	size_t done = 0;
+	while(done < size) {
+#ifdef _WIN32
+		HANDLE handle = (HANDLE)_get_osfhandle(fd);
+		OVERLAPPED overlapped;
+		DWORD chunk = (DWORD)(size - done > 0x40000000 ? 0x40000000 : size - done);
+		DWORD length;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = (DWORD)(offset + done);
+		overlapped.OffsetHigh = (DWORD)((offset + done) >> 32);
+		if(!ReadFile(handle, (char*)buffer + done, chunk, &length, &overlapped)) {
+			if(GetLastError() == ERROR_HANDLE_EOF) break;
+			errno = EIO;
+			return -1;
+		}
+#else
+		ssize_t length = pread(fd, (char*)buffer + done, size - done, (off_t)(offset + done));
+		if(length < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+#endif
+		if(length == 0) break; /* end of file */
+		done += length;
+	}
+	return (long long)done;
+}
@@ -2,28 +2,80 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stddef.h> /* size_t */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#if (defined(__GNUC__) && __GNUC__ >= 4 && (__GNUC__ > 4 || __GNUC_MINOR__ >= 1) \
-	&& defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4)) \
+/* Atomic operations on an unsigned integer and on a pointer. A load has
+ * the acquire semantics, a store has the release semantics, a compare-and-swap
+ * is a full barrier and returns non-zero if the value has been replaced. */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+# include <stdatomic.h>
+typedef atomic_uint rhash_atomic_t;
+typedef _Atomic(void*) rhash_atomic_ptr_t;
+# define rhash_atomic_load(ptr) atomic_load_explicit((ptr), memory_order_acquire)
+# define rhash_atomic_store(ptr, value) atomic_store_explicit((ptr), (value), memory_order_release)
+# define rhash_atomic_cas(ptr, oldval, newval) rhash_atomic_cas_c11((ptr), (oldval), (newval))
+# define rhash_atomic_load_ptr(ptr) atomic_load_explicit((ptr), memory_order_acquire)
+# define rhash_atomic_store_ptr(ptr, value) atomic_store_explicit((ptr), (void*)(value), memory_order_release)
+static inline int rhash_atomic_cas_c11(rhash_atomic_t* ptr, unsigned oldval, unsigned newval)
+{
+	return atomic_compare_exchange_strong(ptr, &oldval, newval);
+}
+#elif defined(__GNUC__) && defined(__ATOMIC_ACQUIRE)
+/* the __atomic builtins of GCC >= 4.7 and Clang */
+typedef unsigned rhash_atomic_t;
+typedef void* rhash_atomic_ptr_t;
+# define rhash_atomic_load(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+# define rhash_atomic_store(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+# define rhash_atomic_cas(ptr, oldval, newval) __sync_bool_compare_and_swap((ptr), (oldval), (newval))
+# define rhash_atomic_load_ptr(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+# define rhash_atomic_store_ptr(ptr, value) __atomic_store_n((ptr), (void*)(value), __ATOMIC_RELEASE)
+#elif (defined(__GNUC__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4)) \
 	|| (defined(__INTEL_COMPILER) && !defined(_WIN32))
-/* atomic operations are defined by ICC and GCC >= 4.1, but by the later one supposedly not for ARM */
-/* note: ICC on ia64 platform possibly require ia64intrin.h, need testing */
-# define atomic_compare_and_swap(ptr, oldval, newval) __sync_val_compare_and_swap(ptr, oldval, newval)
+/* the __sync builtins of ICC and GCC >= 4.1, the loads are done by full barriers */
+typedef volatile unsigned rhash_atomic_t;
+typedef void* volatile rhash_atomic_ptr_t;
+# define rhash_atomic_load(ptr) __sync_val_compare_and_swap((ptr), 0, 0)
+# define rhash_atomic_store(ptr, value) (__sync_synchronize(), *(ptr) = (value))
+# define rhash_atomic_cas(ptr, oldval, newval) __sync_bool_compare_and_swap((ptr), (oldval), (newval))
+# define rhash_atomic_load_ptr(ptr) __sync_val_compare_and_swap((ptr), (void*)0, (void*)0)
+# define rhash_atomic_store_ptr(ptr, value) (__sync_synchronize(), *(ptr) = (void*)(value))
 #elif defined(_MSC_VER)
 # include <windows.h>
-# define atomic_compare_and_swap(ptr, oldval, newval) InterlockedCompareExchange(ptr, newval, oldval)
+typedef volatile LONG rhash_atomic_t;
+typedef void* volatile rhash_atomic_ptr_t;
+# define rhash_atomic_load(ptr) ((unsigned)InterlockedCompareExchange((ptr), 0, 0))
+# define rhash_atomic_store(ptr, value) InterlockedExchange((ptr), (LONG)(value))
+# define rhash_atomic_cas(ptr, oldval, newval) \
+	(InterlockedCompareExchange((ptr), (LONG)(newval), (LONG)(oldval)) == (LONG)(oldval))
+# define rhash_atomic_load_ptr(ptr) InterlockedCompareExchangePointer((ptr), NULL, NULL)
+# define rhash_atomic_store_ptr(ptr, value) InterlockedExchangePointer((ptr), (void*)(value))
 #elif defined(__sun)
 # include <atomic.h>
-# define atomic_compare_and_swap(ptr, oldval, newval) atomic_cas_32(ptr, oldval, newval);
+typedef volatile uint32_t rhash_atomic_t;
+typedef void* volatile rhash_atomic_ptr_t;
+# define rhash_atomic_load(ptr) atomic_or_32_nv((ptr), 0)
+# define rhash_atomic_store(ptr, value) atomic_swap_32((ptr), (value))
+# define rhash_atomic_cas(ptr, oldval, newval) (atomic_cas_32((ptr), (oldval), (newval)) == (oldval))
+# define rhash_atomic_load_ptr(ptr) atomic_cas_ptr((ptr), NULL, NULL)
+# define rhash_atomic_store_ptr(ptr, value) atomic_swap_ptr((ptr), (void*)(value))
 #else
-/* pray that it will work */
-# define atomic_compare_and_swap(ptr, oldval, newval) { if(*(ptr) == (oldval)) *(ptr) = (newval); }
-# define NO_ATOMIC_BUILTINS
+# error "atomic operations are not supported by the compiler"
 #endif
 
+/* alignment of memory blocks allocated for file reading */
+#define RHASH_PAGE_ALIGNMENT 4096
+/* the assumed size of a CPU cache line */
+#define RHASH_CACHE_LINE_SIZE 64
+
+void rhash_call_once(rhash_atomic_t* once, void (*func)(void));
+void* rhash_aligned_alloc(size_t alignment, size_t size);
+void rhash_aligned_free(void* ptr);
+long long rhash_pread(int fd, void* buffer, size_t size, unsigned long long offset);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
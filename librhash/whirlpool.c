@@ -23,8 +23,21 @@
 #include <assert.h>
 #include <string.h>
 #include "byte_order.h"
+#include "openssl_asm.h"
 #include "whirlpool.h"
 
+#ifdef USE_WHIRLPOOL_AVX512
+# include <immintrin.h>
+# ifdef __GNUC__
+#  define AVX512_ATTR __attribute__((target("avx512f,avx512bw,avx512vbmi,gfni")))
+# else
+#  define AVX512_ATTR
+# endif
+#endif
+
+/* processes the given number of 64-byte blocks, possibly not aligned */
+typedef void (*whirlpool_process_t)(uint64_t* hash, const unsigned char* msg, size_t blocks);
+
 /**
  * Initialize context before calculaing hash.
  *
@@ -37,7 +50,7 @@ void rhash_whirlpool_init(struct whirlpool_ctx* ctx)
 }
 
 /* Algorithm S-Box */
-extern uint64_t rhash_whirlpool_sbox[8][256];
+extern const uint64_t rhash_whirlpool_sbox[8][256];
 
 #define WHIRLPOOL_OP(src, shift) ( \
 	rhash_whirlpool_sbox[0][(int)(src[ shift      & 7] >> 56)       ] ^ \
@@ -49,13 +62,27 @@ extern uint64_t rhash_whirlpool_sbox[8][256];
 	rhash_whirlpool_sbox[6][(int)(src[(shift + 2) & 7] >>  8) & 0xff] ^ \
 	rhash_whirlpool_sbox[7][(int)(src[(shift + 1) & 7]      ) & 0xff])
 
+/* the round constants */
+static const uint64_t rc[10] = {
+	I64(0x1823c6e887b8014f),
+	I64(0x36a6d2f5796f9152),
+	I64(0x60bc9b8ea30c7b35),
+	I64(0x1de0d7c22e4bfe57),
+	I64(0x157737e59ff04ada),
+	I64(0x58c9290ab1a06b85),
+	I64(0xbd5d10f4cb3e0567),
+	I64(0xe427418ba77d95d8),
+	I64(0xfbee7c66dd17479e),
+	I64(0xca2dbf07ad5a8333)
+};
+
 /**
  * The core transformation. Process a 512-bit block.
  *
  * @param hash algorithm state
  * @param block the message block to process
  */
-static void rhash_whirlpool_process_block(uint64_t *hash, uint64_t* p_block)
+static void rhash_whirlpool_process_block(uint64_t *hash, const uint64_t* p_block)
 {
 	int i;                /* loop counter */
 	uint64_t K1[8];       /* key used in even rounds */
@@ -66,19 +93,6 @@ static void rhash_whirlpool_process_block(uint64_t *hash, uint64_t* p_block)
 	/* the number of rounds of the internal dedicated block cipher */
 	const int number_of_rounds = 10;
 
-	/* array used in the rounds */
-	static const uint64_t rc[10] = {
-		I64(0x1823c6e887b8014f),
-		I64(0x36a6d2f5796f9152),
-		I64(0x60bc9b8ea30c7b35),
-		I64(0x1de0d7c22e4bfe57),
-		I64(0x157737e59ff04ada),
-		I64(0x58c9290ab1a06b85),
-		I64(0xbd5d10f4cb3e0567),
-		I64(0xe427418ba77d95d8),
-		I64(0xfbee7c66dd17479e),
-		I64(0xca2dbf07ad5a8333)
-	};
 
 	/* map the message buffer to a block */
 	for(i = 0; i < 8; i++) {
@@ -143,14 +157,140 @@ static void rhash_whirlpool_process_block(uint64_t *hash, uint64_t* p_block)
 }
 
 /**
- * Calculate message hash.
- * Can be called repeatedly with chunks of the message to be hashed.
+ * Process several 512-bit blocks by the portable round function.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks to process
+ * @param blocks the number of blocks
+ */
+static void rhash_whirlpool_process_blocks(uint64_t* hash, const unsigned char* msg, size_t blocks)
+{
+	uint64_t buffer[8];
+	for(; blocks > 0; blocks--, msg += whirlpool_block_size) {
+		if(IS_ALIGNED_64(msg)) {
+			/* the most common case is processing of an already aligned message
+			without copying it */
+			rhash_whirlpool_process_block(hash, (const uint64_t*)msg);
+		} else {
+			memcpy(buffer, msg, whirlpool_block_size);
+			rhash_whirlpool_process_block(hash, buffer);
+		}
+	}
+}
+
+#ifdef USE_WHIRLPOOL_AVX512
+/* the Whirlpool S-box */
+static ALIGN_ATTR(64) const unsigned char rhash_whirlpool_sbox8[256] = {
+	0x18, 0x23, 0xc6, 0xe8, 0x87, 0xb8, 0x01, 0x4f, 0x36, 0xa6, 0xd2, 0xf5, 0x79, 0x6f, 0x91, 0x52,
+	0x60, 0xbc, 0x9b, 0x8e, 0xa3, 0x0c, 0x7b, 0x35, 0x1d, 0xe0, 0xd7, 0xc2, 0x2e, 0x4b, 0xfe, 0x57,
+	0x15, 0x77, 0x37, 0xe5, 0x9f, 0xf0, 0x4a, 0xda, 0x58, 0xc9, 0x29, 0x0a, 0xb1, 0xa0, 0x6b, 0x85,
+	0xbd, 0x5d, 0x10, 0xf4, 0xcb, 0x3e, 0x05, 0x67, 0xe4, 0x27, 0x41, 0x8b, 0xa7, 0x7d, 0x95, 0xd8,
+	0xfb, 0xee, 0x7c, 0x66, 0xdd, 0x17, 0x47, 0x9e, 0xca, 0x2d, 0xbf, 0x07, 0xad, 0x5a, 0x83, 0x33,
+	0x63, 0x02, 0xaa, 0x71, 0xc8, 0x19, 0x49, 0xd9, 0xf2, 0xe3, 0x5b, 0x88, 0x9a, 0x26, 0x32, 0xb0,
+	0xe9, 0x0f, 0xd5, 0x80, 0xbe, 0xcd, 0x34, 0x48, 0xff, 0x7a, 0x90, 0x5f, 0x20, 0x68, 0x1a, 0xae,
+	0xb4, 0x54, 0x93, 0x22, 0x64, 0xf1, 0x73, 0x12, 0x40, 0x08, 0xc3, 0xec, 0xdb, 0xa1, 0x8d, 0x3d,
+	0x97, 0x00, 0xcf, 0x2b, 0x76, 0x82, 0xd6, 0x1b, 0xb5, 0xaf, 0x6a, 0x50, 0x45, 0xf3, 0x30, 0xef,
+	0x3f, 0x55, 0xa2, 0xea, 0x65, 0xba, 0x2f, 0xc0, 0xde, 0x1c, 0xfd, 0x4d, 0x92, 0x75, 0x06, 0x8a,
+	0xb2, 0xe6, 0x0e, 0x1f, 0x62, 0xd4, 0xa8, 0x96, 0xf9, 0xc5, 0x25, 0x59, 0x84, 0x72, 0x39, 0x4c,
+	0x5e, 0x78, 0x38, 0x8c, 0xd1, 0xa5, 0xe2, 0x61, 0xb3, 0x21, 0x9c, 0x1e, 0x43, 0xc7, 0xfc, 0x04,
+	0x51, 0x99, 0x6d, 0x0d, 0xfa, 0xdf, 0x7e, 0x24, 0x3b, 0xab, 0xce, 0x11, 0x8f, 0x4e, 0xb7, 0xeb,
+	0x3c, 0x81, 0x94, 0xf7, 0xb9, 0x13, 0x2c, 0xd3, 0xe7, 0x6e, 0xc4, 0x03, 0x56, 0x44, 0x7f, 0xa9,
+	0x2a, 0xbb, 0xc1, 0x53, 0xdc, 0x0b, 0x9d, 0x6c, 0x31, 0x74, 0xf6, 0x46, 0xac, 0x89, 0x14, 0xe1,
+	0x16, 0x3a, 0x69, 0x09, 0x70, 0xb6, 0xd0, 0xed, 0xcc, 0x42, 0x98, 0xa4, 0x28, 0x5c, 0xf8, 0x86,
+};
+
+/* byte indexes of the ShiftColumns permutation, moving column j down by j rows */
+static ALIGN_ATTR(64) const unsigned char rhash_whirlpool_shift_columns[64] = {
+	8, 17, 26, 35, 44, 53, 62, 7, 16, 25, 34, 43, 52, 61, 6, 15,
+	24, 33, 42, 51, 60, 5, 14, 23, 32, 41, 50, 59, 4, 13, 22, 31,
+	40, 49, 58, 3, 12, 21, 30, 39, 48, 57, 2, 11, 20, 29, 38, 47,
+	56, 1, 10, 19, 28, 37, 46, 55, 0, 9, 18, 27, 36, 45, 54, 63,
+};
+
+/* the bit matrices for GF2P8AFFINEQB, multiplying bytes by 2, 4 and 8 modulo x^8+x^4+x^3+x^2+1 */
+#define GF_MUL2 I64(0x8001828488102040)
+#define GF_MUL4 I64(0x408041c2c4881020)
+#define GF_MUL8 I64(0x2040a061e2c48810)
+
+#define XOR3(a, b, c) _mm512_ternarylogic_epi64(a, b, c, 0x96)
+
+/**
+ * The round function of the Whirlpool block cipher without the key addition.
+ * The 8x8 byte matrix is kept in one 512-bit register, a row per 64-bit lane.
+ *
+ * @param x the cipher state
+ * @param sbox the S-box, as four 64-byte registers
+ * @param shift_columns the ShiftColumns permutation indexes
+ * @return the transformed state
+ */
+static AVX512_ATTR __m512i rhash_whirlpool_round_avx512(__m512i x, const __m512i* sbox, __m512i shift_columns)
+{
+	__m512i lo, hi, x2, x4, x8;
+
+	/* SubBytes: two 128-byte table lookups, selected by the high bit */
+	lo = _mm512_permutex2var_epi8(sbox[0], x, sbox[1]);
+	hi = _mm512_permutex2var_epi8(sbox[2], x, sbox[3]);
+	x = _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), lo, hi);
+
+	/* ShiftColumns */
+	x = _mm512_permutexvar_epi8(shift_columns, x);
+
+	/* MixRows: multiply each row by the circulant matrix (1, 1, 4, 1, 8, 5, 2, 9) */
+	x2 = _mm512_gf2p8affine_epi64_epi8(x, _mm512_set1_epi64(GF_MUL2), 0);
+	x4 = _mm512_gf2p8affine_epi64_epi8(x, _mm512_set1_epi64(GF_MUL4), 0);
+	x8 = _mm512_gf2p8affine_epi64_epi8(x, _mm512_set1_epi64(GF_MUL8), 0);
+	return XOR3(
+		XOR3(x, _mm512_ror_epi64(x, 8), _mm512_ror_epi64(x4, 16)),
+		XOR3(_mm512_ror_epi64(x, 24), _mm512_ror_epi64(x8, 32), _mm512_ror_epi64(_mm512_xor_si512(x4, x), 40)),
+		_mm512_xor_si512(_mm512_ror_epi64(x2, 48), _mm512_ror_epi64(_mm512_xor_si512(x8, x), 56)));
+}
+
+/**
+ * Process 512-bit blocks by AVX-512 VBMI and GFNI instructions,
+ * calculating the S-box by byte permutations instead of table lookups.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks to process
+ * @param blocks the number of blocks
+ */
+static AVX512_ATTR void rhash_whirlpool_process_avx512(uint64_t* hash, const unsigned char* msg, size_t blocks)
+{
+	const __m512i bswap = _mm512_set4_epi64(I64(0x08090a0b0c0d0e0f), I64(0x0001020304050607),
+		I64(0x08090a0b0c0d0e0f), I64(0x0001020304050607));
+	const __m512i shift_columns = _mm512_loadu_si512(rhash_whirlpool_shift_columns);
+	__m512i sbox[4], h, m, k, state;
+	int i;
+	sbox[0] = _mm512_loadu_si512(rhash_whirlpool_sbox8);
+	sbox[1] = _mm512_loadu_si512(rhash_whirlpool_sbox8 + 64);
+	sbox[2] = _mm512_loadu_si512(rhash_whirlpool_sbox8 + 128);
+	sbox[3] = _mm512_loadu_si512(rhash_whirlpool_sbox8 + 192);
+
+	h = _mm512_loadu_si512(hash);
+	for(; blocks > 0; blocks--, msg += whirlpool_block_size) {
+		m = _mm512_shuffle_epi8(_mm512_loadu_si512(msg), bswap);
+		k = h;
+		state = _mm512_xor_si512(h, m);
+		for(i = 0; i < 10; i++) {
+			/* compute K^i from K^{i-1} and apply the i-th round transformation */
+			k = _mm512_xor_si512(rhash_whirlpool_round_avx512(k, sbox, shift_columns), _mm512_maskz_set1_epi64(1, rc[i]));
+			state = _mm512_xor_si512(rhash_whirlpool_round_avx512(state, sbox, shift_columns), k);
+		}
+		/* apply the Miyaguchi-Preneel compression function */
+		h = XOR3(h, m, state);
+	}
+	_mm512_storeu_si512(hash, h);
+}
+#endif /* USE_WHIRLPOOL_AVX512 */
+
+/**
+ * Calculate message hash by the given block processing function.
  *
  * @param ctx the algorithm context containing current hashing state
  * @param msg message chunk
  * @param size length of the message chunk
+ * @param process the function to process message blocks
  */
-void rhash_whirlpool_update(whirlpool_ctx *ctx, const unsigned char* msg, size_t size)
+static void rhash_whirlpool_update_by(whirlpool_ctx *ctx, const unsigned char* msg, size_t size, whirlpool_process_t process)
 {
 	unsigned index = (unsigned)ctx->length & 63;
 	unsigned left;
@@ -163,24 +303,15 @@ void rhash_whirlpool_update(whirlpool_ctx *ctx, const unsigned char* msg, size_t
 		if(size < left) return;
 
 		/* process partial block */
-		rhash_whirlpool_process_block(ctx->hash, (uint64_t*)ctx->message);
+		process(ctx->hash, ctx->message, 1);
 		msg  += left;
 		size -= left;
 	}
-	while(size >= whirlpool_block_size) {
-		uint64_t* aligned_message_block;
-		if(IS_ALIGNED_64(msg)) {
-			/* the most common case is processing of an already aligned message
-			without copying it */
-			aligned_message_block = (uint64_t*)msg;
-		} else {
-			memcpy(ctx->message, msg, whirlpool_block_size);
-			aligned_message_block = (uint64_t*)ctx->message;
-		}
-
-		rhash_whirlpool_process_block(ctx->hash, aligned_message_block);
-		msg += whirlpool_block_size;
-		size -= whirlpool_block_size;
+	if(size >= whirlpool_block_size) {
+		/* process the blocks in place, without copying them */
+		process(ctx->hash, msg, size / whirlpool_block_size);
+		msg += size & ~(size_t)(whirlpool_block_size - 1);
+		size &= whirlpool_block_size - 1;
 	}
 	if(size) {
 		/* save leftovers */
@@ -188,6 +319,63 @@ void rhash_whirlpool_update(whirlpool_ctx *ctx, const unsigned char* msg, size_t
 	}
 }
 
+/**
+ * Calculate message hash.
+ * Can be called repeatedly with chunks of the message to be hashed.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_whirlpool_update(whirlpool_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	rhash_whirlpool_update_by(ctx, msg, size, rhash_whirlpool_process_blocks);
+}
+
+#ifdef USE_WHIRLPOOL_AVX512
+/**
+ * Calculate message hash by AVX-512 VBMI and GFNI instructions.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_whirlpool_update_avx512(whirlpool_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	rhash_whirlpool_update_by(ctx, msg, size, rhash_whirlpool_process_avx512);
+}
+#endif
+
+#ifdef HAS_OPENSSL_ASM
+/**
+ * Process message blocks by the OpenSSL assembly kernel.
+ *
+ * @param hash algorithm state
+ * @param msg the message blocks
+ * @param blocks the number of blocks to process
+ */
+static void rhash_whirlpool_process_asm(uint64_t* hash, const unsigned char* msg, size_t blocks)
+{
+	/* the kernel keeps the state as bytes in the digest order */
+	uint64_t state[8];
+	be64_copy(state, 0, hash, 64);
+	rhash_openssl_whirlpool_block(state, msg, blocks);
+	be64_copy(hash, 0, state, 64);
+}
+
+/**
+ * Calculate message hash by the OpenSSL assembly kernel.
+ *
+ * @param ctx the algorithm context containing current hashing state
+ * @param msg message chunk
+ * @param size length of the message chunk
+ */
+void rhash_whirlpool_update_asm(whirlpool_ctx *ctx, const unsigned char* msg, size_t size)
+{
+	rhash_whirlpool_update_by(ctx, msg, size, rhash_whirlpool_process_asm);
+}
+#endif
+
 /**
  * Store calculated hash into the given array.
  *
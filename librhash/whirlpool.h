@@ -27,6 +27,17 @@ void rhash_whirlpool_init(whirlpool_ctx* ctx);
 void rhash_whirlpool_update(whirlpool_ctx* ctx, const unsigned char* msg, size_t size);
 void rhash_whirlpool_final(whirlpool_ctx* ctx, unsigned char* result);
 
+/* the implementation for x86-64 CPUs with AVX-512 VBMI and GFNI, selected at run-time */
+#if defined(CPU_X64) && ((defined(_MSC_VER) && _MSC_VER >= 1920) || (defined(__GNUC__) && __GNUC__ >= 8))
+# define USE_WHIRLPOOL_AVX512
+void rhash_whirlpool_update_avx512(whirlpool_ctx* ctx, const unsigned char* msg, size_t size);
+#endif
+
+/* the kernel assembled from the OpenSSL source, see openssl_asm.h */
+#ifdef USE_OPENSSL_ASM
+void rhash_whirlpool_update_asm(whirlpool_ctx* ctx, const unsigned char* msg, size_t size);
+#endif
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
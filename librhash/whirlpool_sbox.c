@@ -16,7 +16,7 @@
 
 #include "byte_order.h"
 
-uint64_t rhash_whirlpool_sbox[8][256] = {
+const uint64_t rhash_whirlpool_sbox[8][256] = {
 	{
 		/* C0 vectors */
 		I64(0x18186018c07830d8), I64(0x23238c2305af4626), I64(0xc6c63fc67ef991b8), I64(0xe8e887e8136fcdfb),
@@ -1,5 +1,6 @@
 /* calc_sums.c - crc calculating and printing functions */
 
+#define _GNU_SOURCE /* for O_NOATIME */
 #include "common_func.h" /* should be included before the C library files */
 #include <stdio.h>
 #include <string.h>
@@ -9,6 +10,9 @@
 #include <sys/stat.h> /* stat() */
 #include <errno.h>
 #include <assert.h>
+#ifndef _WIN32
+# include <unistd.h> /* close() */
+#endif
 
 #include "rhash.h"
 #include "rhash_timing.h"
@@ -54,26 +58,33 @@ static void init_btih_data(struct file_info *info)
  */
 static void re_init_rhash_context(struct file_info *info)
 {
-	if(rhash_data.rctx != 0) {
-		if(opt.mode & (MODE_CHECK | MODE_CHECK_EMBEDDED)) {
-			/* a set of hash sums can change from file to file */
-			rhash_free(rhash_data.rctx);
-			rhash_data.rctx = 0;
-		} else {
-			info->rctx = rhash_data.rctx;
-			if(!opt.bt_batch_file) {
-				rhash_reset(rhash_data.rctx);
+	if(info->rctx != 0) {
+		/* the context is owned by a hashing thread */
+		rhash_reset(info->rctx);
+	} else {
+		if(rhash_data.rctx != 0) {
+			if(opt.mode & (MODE_CHECK | MODE_CHECK_EMBEDDED)) {
+				/* a set of hash sums can change from file to file */
+				rhash_free(rhash_data.rctx);
+				rhash_data.rctx = 0;
 			} else {
-				/* add another file to the torrent batch */
-				rhash_transmit(RMSG_BT_ADD_FILE, rhash_data.rctx,
-					RHASH_STR2UPTR((char*)file_info_get_utf8_print_path(info)), (rhash_uptr_t)&info->size);
-				return;
+				info->rctx = rhash_data.rctx;
+				if(!opt.bt_batch_file) {
+					rhash_reset(rhash_data.rctx);
+				} else {
+					/* add another file to the torrent batch */
+					rhash_transmit(RMSG_BT_ADD_FILE, rhash_data.rctx,
+						RHASH_STR2UPTR((char*)file_info_get_utf8_print_path(info)), (rhash_uptr_t)&info->size);
+					return;
+				}
 			}
 		}
-	}
 
-	if(rhash_data.rctx == 0) {
-		info->rctx = rhash_data.rctx = rhash_init(info->sums_flags);
+		if(rhash_data.rctx == 0) {
+			info->rctx = rhash_data.rctx = rhash_init(info->sums_flags);
+			/* read regular files by a separate thread */
+			rhash_set_async_read(rhash_data.rctx, 1);
+		}
 	}
 
 	/* re-initialize BitTorrent data */
@@ -82,9 +93,50 @@ static void re_init_rhash_context(struct file_info *info)
 	}
 }
 
+#ifdef O_NOATIME
+# define RSH_O_NOATIME O_NOATIME
+#else
+# define RSH_O_NOATIME 0
+#endif
+
+/**
+ * Open a file for reading and retrieve its attributes from the opened
+ * descriptor, so the file path is looked up only once. Where supported,
+ * the file is opened without updating its access time.
+ *
+ * @param path the path of the file to open
+ * @param st the buffer to receive the file attributes
+ * @return the opened stream on success, NULL on fail with errno set
+ */
+static FILE* open_and_stat(const char* path, struct rsh_stat_struct* st)
+{
+	FILE* stream;
+	int err;
+#ifdef _WIN32
+	stream = rsh_fopen_bin(path, "rb");
+	if(!stream) return NULL;
+	if(rsh_fstat(_fileno(stream), st) == 0) return stream;
+	err = errno;
+	fclose(stream);
+#else
+	int fd = open(path, O_RDONLY | RSH_O_NOATIME);
+	/* O_NOATIME is permitted only to the owner of the file */
+	if(fd < 0 && errno == EPERM && RSH_O_NOATIME) fd = open(path, O_RDONLY);
+	if(fd < 0) return NULL;
+
+	if(rsh_fstat(fd, st) == 0 && (stream = fdopen(fd, "rb")) != NULL) return stream;
+	err = errno;
+	close(fd);
+#endif
+	errno = err;
+	return NULL;
+}
+
 /**
  * Calculate hash sums simultaneously, according to the info->sums_flags.
- * Calculated hashes are stored in info->rctx.
+ * Calculated hashes are stored in info->rctx. If info->rctx is not set,
+ * the shared rhash_data.rctx context is used. The file size and
+ * modification time are refreshed from the opened file.
  *
  * @param info file data. The info->full_path can be "-" to denote stdin
  * @return 0 on success, -1 on fail with error code stored in errno
@@ -106,25 +158,24 @@ static int calc_sums(struct file_info *info)
 #endif
 	} else {
 		struct rsh_stat_struct stat_buf;
-		/* skip non-existing files */
-		if(rsh_stat(info->full_path, &stat_buf) < 0) {
+		/* skip non-existing files and files opened with exclusive rights */
+		fd = open_and_stat(info->full_path, &stat_buf);
+		if(!fd) {
 			return -1;
 		}
 
 		if((opt.mode & (MODE_CHECK | MODE_CHECK_EMBEDDED)) && S_ISDIR(stat_buf.st_mode)) {
+			fclose(fd);
 			errno = EISDIR;
 			return -1;
 		}
 
 		info->size = stat_buf.st_size; /* total size, in bytes */
-		IF_WINDOWS(win32_set_filesize64(info->full_path, &info->size)); /* set correct filesize for large files under win32 */
-
-		if(!info->sums_flags) return 0;
+		info->mtime = stat_buf.st_mtime;
 
-		/* skip files opened with exclusive rights without reporting an error */
-		fd = rsh_fopen_bin(info->full_path, "rb");
-		if(!fd) {
-			return -1;
+		if(!info->sums_flags) {
+			fclose(fd);
+			return 0;
 		}
 	}
 
@@ -142,7 +193,6 @@ static int calc_sums(struct file_info *info)
 		}
 	}
 	info->size = info->rctx->msg_size - initial_size;
-	rhash_data.total_size += info->size;
 
 	if(fd != stdin) fclose(fd);
 	return res;
@@ -356,45 +406,64 @@ static void save_torrent(struct file_info* info)
 }
 
 /**
- * Calculate and print file hash sums using printf format.
+ * Initialize file information to calculate hash sums of a file.
  *
- * @param out a stream to print to
+ * @param info the structure to initialize
  * @param file the file to calculate sums for
  * @param print_path the path to print
- * @return 0 on success, -1 on fail
  */
-int calculate_and_print_sums(FILE* out, file_t* file, const char *print_path)
+void file_info_init_sums(struct file_info* info, file_t* file, const char* print_path)
 {
-	struct file_info info;
-	timedelta_t timer;
-	int res = 0;
-
-	memset(&info, 0, sizeof(info));
-	info.full_path = rsh_strdup(file->path);
-	file_info_set_print_path(&info, print_path);
-	info.size = 0;
-
-	info.sums_flags = opt.sum_flags;
+	memset(info, 0, sizeof(*info));
+	info->full_path = rsh_strdup(file->path);
+	file_info_set_print_path(info, print_path);
+	info->sums_flags = opt.sum_flags;
 
-	if(IS_DASH_STR(info.full_path)) {
-		print_path = "(stdin)";
-		memset(&info.stat_buf, 0, sizeof(info.stat_buf));
-	} else {
-		if(file->mode & FILE_IFDIR) return 0; /* don't handle directories */
-		info.size = file->size; /* total size, in bytes */
+	if(!IS_DASH_STR(info->full_path)) {
+		info->size = file->size; /* total size, in bytes */
+		info->mtime = file->mtime;
 	}
+}
+
+/**
+ * Calculate hash sums of a file, without printing anything.
+ * Several threads can calculate sums at once, if each
+ * of them sets its own rhash context to info->rctx.
+ *
+ * @param info the file information, initialized by file_info_init_sums()
+ * @return 0 on success, -1 on fail with error code stored in errno
+ */
+int calculate_sums(struct file_info* info)
+{
+	timedelta_t timer;
+	int res = 0;
 
-	/* initialize percents output */
-	init_percents(&info);
 	rhash_timer_start(&timer);
+	if(info->sums_flags) {
+		res = calc_sums(info);
+	}
+	info->time = rhash_timer_stop(&timer);
+	return res;
+}
 
-	if(info.sums_flags) {
-		/* calculate sums */
-		if(calc_sums(&info) < 0) {
+/**
+ * Print hash sums of a file, calculated by calculate_sums(),
+ * using printf format.
+ *
+ * @param out a stream to print to
+ * @param info the file information with calculated sums
+ * @param res the value returned by calculate_sums(), with errno set on fail
+ * @return 0 on success, -1 on fail
+ */
+int print_sums(FILE* out, struct file_info* info, int res)
+{
+	if(info->sums_flags) {
+		if(res < 0) {
 			/* print error unless sharing access error occurred */
 			if(errno == EACCES) return 0;
-			log_file_error(file->path);
-			res = -1;
+			log_file_error(info->full_path);
+		} else {
+			rhash_data.total_size += info->size;
 		}
 		if(rhash_data.interrupted) {
 			report_interrupted();
@@ -402,48 +471,75 @@ int calculate_and_print_sums(FILE* out, file_t* file, const char *print_path)
 		}
 	}
 
-	info.time = rhash_timer_stop(&timer);
-	finish_percents(&info, res);
+	finish_percents(info, res);
 
 	if((opt.mode & MODE_TORRENT) && !opt.bt_batch_file) {
-		save_torrent(&info);
+		save_torrent(info);
 	}
 
 	if(opt.flags & OPT_EMBED_CRC) {
 		/* rename the file */
-		rename_file_to_embed_crc32(&info);
+		rename_file_to_embed_crc32(info);
 	}
 
 	if((opt.mode & MODE_UPDATE) && opt.fmt == FMT_SFV) {
+		/* reuse the attributes retrieved while hashing the file */
 		file_t file;
-		file.path = info.full_path;
-		file.wpath = 0;
-		rsh_file_stat2(&file, 0);
+		memset(&file, 0, sizeof(file));
+		file.path = info->full_path;
+		file.size = info->size;
+		file.mtime = info->mtime;
 
-		print_sfv_header_line(rhash_data.upd_fd, &file, info.full_path);
+		print_sfv_header_line(rhash_data.upd_fd, &file, info->full_path);
 		if(opt.flags & OPT_VERBOSE) {
-			print_sfv_header_line(rhash_data.log, &file, info.full_path);
+			print_sfv_header_line(rhash_data.log, &file, info->full_path);
 			fflush(rhash_data.log);
 		}
-		rsh_file_cleanup(&file);
 	}
 
 	if(rhash_data.print_list && res >= 0) {
 		if (!opt.bt_batch_file) {
-			print_line(out, rhash_data.print_list, &info);
+			print_line(out, rhash_data.print_list, info);
 			fflush(out);
 
 			/* print calculated line to stderr or log-file if verbose */
 			if((opt.mode & MODE_UPDATE) && (opt.flags & OPT_VERBOSE)) {
-				print_line(rhash_data.log, rhash_data.print_list, &info);
+				print_line(rhash_data.log, rhash_data.print_list, info);
 				fflush(rhash_data.log);
 			}
 		}
 
-		if((opt.flags & OPT_SPEED) && info.sums_flags) {
-			print_file_time_stats(&info);
+		if((opt.flags & OPT_SPEED) && info->sums_flags) {
+			print_file_time_stats(info);
 		}
 	}
+	return res;
+}
+
+/**
+ * Calculate and print file hash sums using printf format.
+ *
+ * @param out a stream to print to
+ * @param file the file to calculate sums for
+ * @param print_path the path to print
+ * @return 0 on success, -1 on fail
+ */
+int calculate_and_print_sums(FILE* out, file_t* file, const char *print_path)
+{
+	struct file_info info;
+	int res;
+
+	if(!IS_DASH_STR(file->path) && (file->mode & FILE_IFDIR)) {
+		return 0; /* don't handle directories */
+	}
+	file_info_init_sums(&info, file, print_path);
+
+	/* initialize percents output */
+	init_percents(&info);
+
+	res = calculate_sums(&info);
+	res = print_sums(out, &info, res);
+
 	free(info.full_path);
 	file_info_destroy(&info);
 	return res;
@@ -470,6 +566,7 @@ static int verify_sums(struct file_info *info)
 		return -1;
 	}
 	info->time = rhash_timer_stop(&timer);
+	rhash_data.total_size += info->size;
 
 	if(rhash_data.interrupted) {
 		report_interrupted();
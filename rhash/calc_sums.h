@@ -26,9 +26,7 @@ struct file_info {
 	struct rhash_context* rctx;  /* state of hash algorithms */
 	int error;  /* -1 for i/o error, -2 for wrong sum, 0 on success */
 	char* allocated_ptr;
-
-	/* note: rsh_stat_struct size depends on _FILE_OFFSET_BITS */
-	struct rsh_stat_struct stat_buf; /* file attributes */
+	uint64_t mtime; /* the last modification time of the file */
 
 	unsigned sums_flags; /* mask of ids of calculated hash functions */
 	struct hash_check hc; /* hash values parsed from a hash file */
@@ -38,6 +36,9 @@ void file_info_destroy(struct file_info*); /* free allocated memory */
 const char* file_info_get_utf8_print_path(struct file_info*);
 
 void save_torrent_to(const char* path, struct rhash_context* rctx);
+void file_info_init_sums(struct file_info* info, file_t* file, const char* print_path);
+int calculate_sums(struct file_info* info);
+int print_sums(FILE* out, struct file_info* info, int res);
 int calculate_and_print_sums(FILE* out, file_t* file, const char *print_path);
 int check_hash_file(file_t* file, int chdir);
 int rename_file_to_embed_crc32(struct file_info *info);
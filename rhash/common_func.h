@@ -102,16 +102,19 @@ typedef  char rsh_tchar;
 # define rsh_stat_struct __stat64
 # define rsh_time_struct __time64_t
 # define rsh_stat(path, st) win_stat(path, st)
+# define rsh_fstat(fd, st) _fstat64(fd, st)
 # define clib_wstat(path, st) _wstat64(path, st)
 #elif defined(_WIN32) && (defined(__MSVCRT__) || defined(_MSC_VER))
 # define rsh_stat_struct _stati64
 # define rsh_time_struct __time64_t
 # define rsh_stat(path, st) win_stat(path, st)
+# define rsh_fstat(fd, st) _fstati64(fd, st)
 # define clib_wstat(path, st) _wstati64(path, st)
 #else
 # define rsh_stat_struct stat
 # define rsh_time_struct time_t
 # define rsh_stat(path, st) stat(path, st)
+# define rsh_fstat(fd, st) fstat(fd, st)
 /* # define clib_wstat(path, st) _wstat32(path, st) */
 #endif
 
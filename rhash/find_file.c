@@ -2,6 +2,18 @@
  *
  * find_file function for searching through directory trees doing work
  * on each file found similar to the Unix find command.
+ *
+ * Directories are read ahead of the walk by worker threads, which open
+ * a directory relative to the descriptor of its parent and stat the entries
+ * relative to the directory descriptor, so the long paths are not resolved
+ * again for every file. The calling thread walks the read directories in
+ * the depth-first order, so the call_back is called by the calling thread
+ * only and in the same order as by a single-threaded walk.
+ *
+ * The entries and the subdirectories of a directory are allocated from
+ * its arenas. A directory lives, until its subdirectories are walked,
+ * so a path is built from the names of the parent directories into
+ * a reused buffer. The depth of the walk is not limited.
  */
 
 #include "common_func.h" /* should be included before the C library files */
@@ -11,9 +23,15 @@
 #include <assert.h>
 #include <sys/types.h> /* ino_t */
 #include <errno.h>
+#include <limits.h> /* INT_MAX */
 #include <sys/stat.h>
+#ifndef _WIN32
+# include <dirent.h> /* opendir/readdir */
+# include <fcntl.h> /* openat() */
+# include <unistd.h> /* close() */
+#endif
 
-//#include "dirent.h"    /* opendir/readdir */
+#include "../librhash/rhash_thread.h"
 #include "output.h"
 #include "win_utils.h"
 #include "find_file.h"
@@ -25,6 +43,11 @@
 # define USE_LSTAT 0
 #endif
 
+/* open directories and stat files relative to directory descriptors */
+#if !defined(_WIN32) && defined(AT_FDCWD) && defined(O_DIRECTORY)
+# define USE_OPENAT
+#endif
+
 void process_files(const char* paths[], size_t count,
 	find_file_options* opt)
 {
@@ -53,74 +76,460 @@ void process_files(const char* paths[], size_t count,
 	rsh_file_cleanup(&file);
 }
 
-typedef struct dir_entry
+/* the number of directories, read in advance by every thread */
+#define READ_AHEAD_PER_THREAD 16
+
+/* the maximal number of directories, kept open to open their subdirectories */
+#define MAX_OPEN_DIRS 64
+
+/* the sizes of the first and of the biggest chunks of an arena */
+#define ARENA_MIN_CHUNK 512
+#define ARENA_MAX_CHUNK 65536
+
+/* the states of a directory */
+#define DIR_QUEUED  0
+#define DIR_READING 1
+#define DIR_READ    2
+
+/* the d_type field of struct dirent is supported */
+#if !defined(_WIN32) && defined(DT_DIR) && defined(DT_UNKNOWN) && defined(DT_LNK)
+# define USE_D_TYPE
+#endif
+
+/**
+ * A chunk of an arena.
+ */
+typedef struct arena_chunk
 {
-	struct dir_entry *next;
-	char* filename;
-	unsigned type; /* dir,link, etc. */
-} dir_entry;
+	struct arena_chunk* next;
+	size_t size;
+	size_t used;
+} arena_chunk;
 
 /**
- * Allocate and initialize a dir_entry.
+ * A bump allocator, freeing all allocated blocks at once.
+ */
+typedef struct walk_arena
+{
+	arena_chunk* chunks; /* the last allocated chunk first */
+} walk_arena;
+
+/**
+ * Allocate a memory block from an arena. The block is aligned to 8 bytes
+ * and is valid until the arena is freed.
  *
- * @param next next dir_entry in list
- * @param filename a filename to store in the dir_entry
- * @param type type of dir_entry
- * @return allocated dir_entry
+ * @param arena the arena to allocate from
+ * @param size the size of the block
+ * @return the allocated block
  */
-static dir_entry* dir_entry_new(dir_entry *next, char* filename, unsigned type)
+static void* arena_alloc(walk_arena* arena, size_t size)
 {
-	dir_entry* e = (dir_entry*)malloc(sizeof(dir_entry));
-	if(!e) return NULL;
-	if(filename) {
-		e->filename = rsh_strdup(filename);
-		if(!e->filename) {
-			free(e);
-			return NULL;
+	const size_t header = (sizeof(arena_chunk) + 7) & ~(size_t)7;
+	arena_chunk* chunk = arena->chunks;
+	size = (size + 7) & ~(size_t)7;
+	if(!chunk || chunk->used + size > chunk->size) {
+		size_t chunk_size = (chunk ? chunk->size * 2 : ARENA_MIN_CHUNK);
+		if(chunk_size > ARENA_MAX_CHUNK) chunk_size = ARENA_MAX_CHUNK;
+		if(chunk_size < size) chunk_size = size;
+		chunk = (arena_chunk*)rsh_malloc(header + chunk_size);
+		chunk->next = arena->chunks;
+		chunk->size = chunk_size;
+		chunk->used = 0;
+		arena->chunks = chunk;
+	}
+	chunk->used += size;
+	return (char*)chunk + header + chunk->used - size;
+}
+
+/**
+ * Free all blocks allocated from an arena.
+ *
+ * @param arena the arena to free
+ */
+static void arena_free(walk_arena* arena)
+{
+	while(arena->chunks) {
+		arena_chunk* next = arena->chunks->next;
+		free(arena->chunks);
+		arena->chunks = next;
+	}
+}
+
+/**
+ * An entry of a read directory.
+ */
+typedef struct walk_entry
+{
+	struct walk_entry* next;
+	uint64_t size;
+	uint64_t mtime;
+	uint64_t dev;   /* the device and the inode of a directory */
+	uint64_t ino;
+	unsigned mode;
+	int error;      /* errno if the entry can't be stat-ed */
+	int check_loop; /* non-zero for a directory, reached by a symbolic link */
+	size_t length;  /* the length of the name */
+	char name[1];
+} walk_entry;
+
+/**
+ * A directory to walk.
+ */
+typedef struct walk_dir
+{
+	struct walk_dir* next;   /* the next directory in the walk order */
+	struct walk_dir* parent; /* the parent directory, NULL for the root */
+	uint64_t dev;
+	uint64_t ino;
+	int level;      /* the depth of the directory entries */
+	int state;
+	int opened;     /* non-zero after the directory has been opened */
+	unsigned refs;  /* the walk and the allocated subdirectories */
+	unsigned dp_users; /* the walk and the subdirectories not opened yet */
+	DIR* dp;        /* the directory, kept open to open its subdirectories */
+	walk_entry* entries;
+	walk_entry** entries_end;
+	walk_arena entries_arena; /* freed, when the directory is walked */
+	walk_arena subdirs_arena; /* freed with the directory */
+	size_t length;  /* the length of the name */
+	char name[1];   /* the name in the parent directory, the path for the root */
+} walk_dir;
+
+/**
+ * The directories of a walk and the threads reading them.
+ */
+typedef struct dir_walker
+{
+	walk_dir* stack;     /* the directories to walk, in the walk order */
+	walk_dir* root;
+	unsigned read_ahead; /* the maximal number of directories read in advance */
+	unsigned open_dirs;  /* the number of directories kept open */
+	int stat_dirs;       /* non-zero if the call_back needs directories information */
+	int stop;
+	rhash_mutex_t lock;
+	rhash_cond_t has_work;   /* signaled when a directory can be read */
+	rhash_cond_t has_result; /* signaled when a directory has been read */
+	rhash_thread_t* threads;
+	unsigned threads_count;
+} dir_walker;
+
+/**
+ * Allocate a directory to walk from the arena of its parent,
+ * or by malloc() for the root.
+ *
+ * @param parent the parent directory, NULL for the root
+ * @param name the directory name, or the path for the root
+ * @param length the length of the name
+ * @return allocated directory
+ */
+static walk_dir* walk_dir_new(walk_dir* parent, const char* name, size_t length)
+{
+	size_t size = offsetof(walk_dir, name) + length + 1;
+	walk_dir* dir = (walk_dir*)(parent ? arena_alloc(&parent->subdirs_arena, size) : rsh_malloc(size));
+	memset(dir, 0, offsetof(walk_dir, name));
+	memcpy(dir->name, name, length + 1);
+	dir->length = length;
+	dir->parent = parent;
+	dir->level = (parent ? parent->level + 1 : 1);
+	dir->refs = dir->dp_users = 1;
+	dir->entries_end = &dir->entries;
+	return dir;
+}
+
+/**
+ * Release a user of the directory descriptor, closing it on the last one.
+ * The walker lock must be held.
+ *
+ * @param walker the walker
+ * @param dir the directory
+ */
+static void walk_dir_release_dp(dir_walker* walker, walk_dir* dir)
+{
+	if(--dir->dp_users == 0 && dir->dp) {
+		closedir(dir->dp);
+		dir->dp = NULL;
+		walker->open_dirs--;
+	}
+}
+
+/**
+ * Release a reference to a directory, freeing it with its parent directories
+ * on the last reference. The walker lock must be held.
+ *
+ * @param walker the walker
+ * @param dir the directory to release
+ */
+static void walk_dir_release(dir_walker* walker, walk_dir* dir)
+{
+	while(dir && --dir->refs == 0) {
+		walk_dir* parent = dir->parent;
+		if(parent && !dir->opened) walk_dir_release_dp(walker, parent);
+		if(dir->dp) {
+			closedir(dir->dp);
+			walker->open_dirs--;
 		}
-	} else {
-		e->filename = NULL;
+		arena_free(&dir->entries_arena);
+		arena_free(&dir->subdirs_arena);
+		if(!parent) free(dir);
+		dir = parent;
 	}
-	e->next = next;
-	e->type = type;
-	return e;
 }
 
 /**
- * Insert a dir_entry with given filename and type in list.
+ * Build the path of a directory from the names of its parent directories.
  *
- * @param at the position before which the entry will be inserted
- * @param filename file name
- * @param type file type
- * @return pointer to the inserted dir_entry
+ * @param dir the directory
+ * @param buffer the buffer to receive the path, reallocated if it is too small
+ * @param allocated the size of the buffer
+ * @return the length of the path
  */
-static dir_entry* dir_entry_insert(dir_entry **at, char* filename, unsigned type)
+static size_t walk_dir_path(const walk_dir* dir, char** buffer, size_t* allocated)
 {
-	dir_entry* e = dir_entry_new(*at, filename, type);
-	if(e) *at = e;
-	return e;
+	const walk_dir* d;
+	size_t length = 0;
+	size_t pos;
+	for(d = dir; d->parent; d = d->parent) {
+		length += d->length + 1;
+	}
+	/* the root path can end with a path separator */
+	if(length > 0 && d->length > 0 && IS_PATH_SEPARATOR(d->name[d->length - 1])) length--;
+	length += d->length;
+
+	if(length + 2 > *allocated) {
+		*allocated = (length + 2) * 2;
+		*buffer = (char*)rsh_realloc(*buffer, *allocated);
+	}
+	pos = length;
+	(*buffer)[pos] = '\0';
+	for(d = dir; d->parent; d = d->parent) {
+		pos -= d->length;
+		memcpy(*buffer + pos, d->name, d->length);
+		if(pos > d->parent->length || d->parent->parent) (*buffer)[--pos] = SYS_PATH_SEPARATOR;
+	}
+	memcpy(*buffer, d->name, d->length);
+	return length;
 }
 
 /**
- * Free memory allocated by a dir_entry object.
+ * Append a file name to the directory path in a buffer.
  *
- * @param e pointer to object to deallocate
+ * @param buffer the buffer containing the directory path, reallocated if it is too small
+ * @param allocated the size of the buffer
+ * @param dir_length the length of the directory path
+ * @param name the name to append
+ * @param length the length of the name
+ * @return the buffer
  */
-static void dir_entry_free(dir_entry* e)
+static char* walk_append_name(char** buffer, size_t* allocated, size_t dir_length, const char* name, size_t length)
 {
-	free(e->filename);
-	free(e);
+	if(dir_length + length + 2 > *allocated) {
+		*allocated = (dir_length + length + 2) * 2;
+		*buffer = (char*)rsh_realloc(*buffer, *allocated);
+	}
+	/* separate directory from filename */
+	if(dir_length > 0 && !IS_PATH_SEPARATOR((*buffer)[dir_length - 1]))
+		(*buffer)[dir_length++] = SYS_PATH_SEPARATOR;
+	memcpy(*buffer + dir_length, name, length + 1);
+	return *buffer;
 }
 
 /**
- * Directory iterator.
+ * Read the entries of a directory and stat them.
+ * The directory state is set to DIR_READ, when finished.
+ *
+ * @param walker the walker
+ * @param dir the directory to read
+ * @param path the buffer for file paths of the calling thread
+ * @param allocated the size of the path buffer
  */
-typedef struct dir_iterator
+static void walk_read_dir(dir_walker* walker, walk_dir* dir, char** path, size_t* allocated)
 {
-	int left;
-	char* prev_dir;
-} dir_iterator;
-#define MAX_DIRS_DEPTH 64
+	walk_dir* parent = dir->parent;
+	struct dirent* de;
+	DIR* dp;
+#ifdef USE_OPENAT
+	/* the parent is not closed, while this directory is not opened */
+	int fd = (parent && parent->dp ?
+		openat(dirfd(parent->dp), dir->name, O_RDONLY | O_DIRECTORY) :
+		(walk_dir_path(dir, path, allocated), open(*path, O_RDONLY | O_DIRECTORY)));
+	dp = (fd >= 0 ? fdopendir(fd) : NULL);
+	if(!dp && fd >= 0) close(fd);
+	if(dp) {
+		/* the directory is compared with the directories reached by symbolic links,
+		 * its d_ino and the device of its parent are wrong for a mount point */
+		struct stat st;
+		if(fstat(fd, &st) == 0) {
+			dir->dev = st.st_dev;
+			dir->ino = st.st_ino;
+		}
+	}
+#else
+	size_t path_length = walk_dir_path(dir, path, allocated);
+	dp = opendir(*path);
+#endif
+
+	if(parent) {
+		rhash_mutex_lock(&walker->lock);
+		dir->opened = 1;
+		walk_dir_release_dp(walker, parent);
+		rhash_mutex_unlock(&walker->lock);
+	}
+
+	while(dp && (de = readdir(dp)) != NULL) {
+		size_t length;
+		walk_entry* entry;
+		/* skip "." and ".." dirs */
+		if(de->d_name[0] == '.' && (de->d_name[1] == 0 ||
+			(de->d_name[1] == '.' && de->d_name[2] == 0 )))
+			continue;
+
+		length = strlen(de->d_name);
+		entry = (walk_entry*)arena_alloc(&dir->entries_arena, offsetof(walk_entry, name) + length + 1);
+		memset(entry, 0, offsetof(walk_entry, name));
+		memcpy(entry->name, de->d_name, length + 1);
+		entry->length = length;
+		*dir->entries_end = entry;
+		dir->entries_end = &entry->next;
+
+#ifdef USE_D_TYPE
+		/* a directory, which is not a symbolic link, needs no stat, if its information is not used,
+		 * its device and inode are taken by fstat, when it is opened */
+		if(de->d_type == DT_DIR && !walker->stat_dirs) {
+			entry->mode = FILE_IFDIR;
+			continue;
+		}
+#endif
+		{
+#ifdef USE_OPENAT
+			struct stat st;
+			if(fstatat(dirfd(dp), de->d_name, &st, (USE_LSTAT ? AT_SYMLINK_NOFOLLOW : 0)) < 0) {
+				entry->error = errno;
+				continue;
+			}
+			entry->size = st.st_size;
+			entry->mtime = st.st_mtime;
+			entry->mode = (S_ISDIR(st.st_mode) ? FILE_IFDIR : 0);
+			entry->dev = st.st_dev;
+			entry->ino = st.st_ino;
+# ifdef USE_D_TYPE
+			entry->check_loop = (de->d_type != DT_DIR);
+# else
+			entry->check_loop = 1;
+# endif
+#else
+			file_t file;
+			memset(&file, 0, sizeof(file));
+			file.path = walk_append_name(path, allocated, path_length, de->d_name, length);
+			if(rsh_file_stat2(&file, USE_LSTAT) < 0) {
+				entry->error = errno;
+			} else {
+				entry->size = file.size;
+				entry->mtime = file.mtime;
+				entry->mode = file.mode;
+			}
+			rsh_file_cleanup(&file);
+#endif
+		}
+	}
+
+	rhash_mutex_lock(&walker->lock);
+#ifdef USE_OPENAT
+	if(dp && walker->open_dirs < MAX_OPEN_DIRS) {
+		dir->dp = dp;
+		walker->open_dirs++;
+		dp = NULL;
+	}
+#endif
+	dir->state = DIR_READ;
+	rhash_cond_broadcast(&walker->has_result);
+	rhash_mutex_unlock(&walker->lock);
+	if(dp) closedir(dp);
+}
+
+/**
+ * The main function of a walker thread: read the queued directories
+ * in the walk order, keeping at most read_ahead of them unwalked.
+ *
+ * @param arg the walker
+ */
+static void walk_thread(void* arg)
+{
+	dir_walker* walker = (dir_walker*)arg;
+	char* path = NULL;
+	size_t allocated = 0;
+
+	rhash_mutex_lock(&walker->lock);
+	while(!walker->stop) {
+		walk_dir* dir;
+		unsigned ahead = 0;
+		for(dir = walker->stack; dir && dir->state != DIR_QUEUED; dir = dir->next) {
+			if(++ahead >= walker->read_ahead) {
+				dir = NULL;
+				break;
+			}
+		}
+		if(!dir) {
+			rhash_cond_wait(&walker->has_work, &walker->lock);
+			continue;
+		}
+		dir->state = DIR_READING;
+		rhash_mutex_unlock(&walker->lock);
+		walk_read_dir(walker, dir, &path, &allocated);
+		rhash_mutex_lock(&walker->lock);
+	}
+	rhash_mutex_unlock(&walker->lock);
+	free(path);
+}
+
+/**
+ * Take the next directory of the walk, waiting until it is read.
+ *
+ * @param walker the walker
+ * @param path the path buffer of the calling thread
+ * @param allocated the size of the path buffer
+ * @return the read directory, NULL if the walk is finished
+ */
+static walk_dir* walk_next_dir(dir_walker* walker, char** path, size_t* allocated)
+{
+	walk_dir* dir;
+	rhash_mutex_lock(&walker->lock);
+	dir = walker->stack;
+	if(dir) {
+		walker->stack = dir->next;
+		/* read the directory, if no thread has taken it yet */
+		if(dir->state == DIR_QUEUED) {
+			dir->state = DIR_READING;
+			rhash_mutex_unlock(&walker->lock);
+			walk_read_dir(walker, dir, path, allocated);
+			rhash_mutex_lock(&walker->lock);
+		}
+		while(dir->state != DIR_READ) {
+			rhash_cond_wait(&walker->has_result, &walker->lock);
+		}
+		rhash_cond_signal(&walker->has_work);
+	}
+	rhash_mutex_unlock(&walker->lock);
+	return dir;
+}
+
+/**
+ * Check if a directory is one of the given directory or its parents.
+ *
+ * @param dir the directory to start from
+ * @param entry the directory entry to look for
+ * @return non-zero if the entry is a directory of the path
+ */
+static int walk_is_loop(const walk_dir* dir, const walk_entry* entry)
+{
+#ifndef _WIN32
+	for(; dir; dir = dir->parent) {
+		if(dir->ino == entry->ino && dir->dev == entry->dev) return 1;
+	}
+#endif
+	(void)dir;
+	(void)entry;
+	return 0;
+}
 
 /**
  * Walk directory tree and call given callback function to process each file/directory.
@@ -130,16 +539,17 @@ typedef struct dir_iterator
  */
 int find_file(file_t* start_dir, find_file_options* options)
 {
-	dir_entry *dirs_stack = NULL; /* root of the dir_list */
-	dir_iterator* it;
-	int level = 1;
+	dir_walker walker;
+	walk_dir* dir;
 	int max_depth = options->max_depth;
 	int flags = options->options;
-	dir_entry* entry;
+	char* path = NULL;
+	size_t allocated = 0;
+	unsigned i;
 	file_t file;
 
-	if(max_depth < 0 || max_depth >= MAX_DIRS_DEPTH) {
-		max_depth = MAX_DIRS_DEPTH;
+	if(max_depth < 0) {
+		max_depth = INT_MAX;
 	}
 
 	/* skip the directory if max_depth == 0 */
@@ -160,107 +570,118 @@ int find_file(file_t* start_dir, find_file_options* options)
 			return 0;
 	}
 
-	it = (dir_iterator*)malloc(MAX_DIRS_DEPTH * sizeof(dir_iterator));
-	if(!it) return 0;
-
-	/* push root directory into dirs_stack */
-	it[0].left = 1;
-	it[0].prev_dir = rsh_strdup(start_dir->path);
-	it[1].prev_dir = NULL;
-	if(!it[0].prev_dir) {
-		errno = ENOMEM;
-		return -1;
-	}
-	entry = dir_entry_insert(&dirs_stack, NULL, 0);
-	if(!entry) {
-		free(it[0].prev_dir);
-		free(it);
-		errno = ENOMEM;
-		return -1;
+	memset(&walker, 0, sizeof(walker));
+	rhash_mutex_init(&walker.lock);
+	rhash_cond_init(&walker.has_work);
+	rhash_cond_init(&walker.has_result);
+	walker.stat_dirs = ((flags & (FIND_WALK_DEPTH_FIRST | FIND_SKIP_DIRS)) == 0);
+	walker.stack = walker.root = walk_dir_new(NULL, start_dir->path, strlen(start_dir->path));
+
+	/* start the threads reading directories in advance */
+	if(options->threads > 1) {
+		walker.read_ahead = options->threads * READ_AHEAD_PER_THREAD;
+		walker.threads = (rhash_thread_t*)rsh_calloc(options->threads, sizeof(rhash_thread_t));
+		for(; walker.threads_count < options->threads; walker.threads_count++) {
+			if(rhash_thread_create(&walker.threads[walker.threads_count], walk_thread, &walker) < 0) break;
+		}
 	}
 
-	while(!(options->options & FIND_CANCEL)) {
-		dir_entry *dir, **insert_at;
-		char* dir_path;
-		DIR *dp;
-		struct dirent *de;
-
-		/* walk back */
-		while((--level) >= 0 && it[level].left <= 0) free(it[level+1].prev_dir);
-		if(level < 0) break;
-		assert(dirs_stack != NULL);
-		/* on the first cycle: level == 0, stack[0] == 0; */
-
-		dir = dirs_stack; /* take last dir from the list */
-		dirs_stack = dirs_stack->next; /* remove last dir from the list */
-		it[level].left--;
-
-		dir_path = (!dir->filename ? rsh_strdup(it[level].prev_dir) :
-			make_path(it[level].prev_dir, dir->filename) );
-		dir_entry_free(dir);
-		if(!dir_path) continue;
-
-		level++;
-		it[level].left = 0;
-		it[level].prev_dir = dir_path;
+	while(!(options->options & FIND_CANCEL) && (dir = walk_next_dir(&walker, &path, &allocated)) != NULL) {
+		walk_dir** insert_at = &walker.stack;
+		size_t dir_length = walk_dir_path(dir, &path, &allocated);
+		walk_entry* entry = dir->entries;
 
 		if((flags & (FIND_WALK_DEPTH_FIRST | FIND_SKIP_DIRS))
 			== FIND_WALK_DEPTH_FIRST) {
-			rsh_file_cleanup(&file);
-			file.path = dir_path;
+			memset(&file, 0, sizeof(file));
+			file.path = path;
+			file.mode = FILE_IFDIR;
 			/* check if we should skip the directory */
-			if(!options->call_back(&file, options->call_back_data))
-				continue;
+			if(!options->call_back(&file, options->call_back_data)) {
+				entry = NULL;
+			}
 		}
 
-		/* read dir */
-		dp = opendir(dir_path);
-		if(dp == NULL) continue;
-
-		insert_at = &dirs_stack;
-
-		while((de = readdir(dp)) != NULL) {
+		for(; entry && !(options->options & FIND_CANCEL); entry = entry->next) {
 			int res;
-			/* skip "." and ".." dirs */
-			if(de->d_name[0] == '.' && (de->d_name[1] == 0 ||
-				(de->d_name[1] == '.' && de->d_name[2] == 0 )))
-				continue;
 
-			if( !(file.path = make_path(dir_path, de->d_name)) ) continue;
+			memset(&file, 0, sizeof(file));
+			file.path = walk_append_name(&path, &allocated, dir_length, entry->name, entry->length);
 
-			res  = rsh_file_stat2(&file, USE_LSTAT);
-			/* process */
-			if(res >= 0) {
-				if((file.mode & FILE_IFDIR) &&
-					(flags & (FIND_WALK_DEPTH_FIRST | FIND_SKIP_DIRS))) res = 1;
-				else {
-					/* handle file by callback function */
-					res = options->call_back(&file, options->call_back_data);
+			if(entry->error) {
+				if(options->options & FIND_LOG_ERRORS) {
+					errno = entry->error;
+					log_file_error(file.path);
 				}
+				continue;
+			}
+			file.size = entry->size;
+			file.mtime = entry->mtime;
+			file.mode = entry->mode;
+
+			if((file.mode & FILE_IFDIR) &&
+				(flags & (FIND_WALK_DEPTH_FIRST | FIND_SKIP_DIRS))) res = 1;
+			else {
+				/* handle file by callback function */
+				res = options->call_back(&file, options->call_back_data);
+			}
 
-				/* if file is a directory and we need to walk it */
-				if((file.mode & FILE_IFDIR) && res && level < max_depth) {
-					/* don't go deeper if max_depth reached */
-
-					/* add directory to dirs_stack */
-					if(dir_entry_insert(insert_at, de->d_name, file.mode)) {
-						/* if really added */
-						insert_at = &((*insert_at)->next);
-						it[level].left++;
+			/* if file is a directory and we need to walk it */
+			if((file.mode & FILE_IFDIR) && res && dir->level < max_depth) {
+				walk_dir* subdir;
+				/* don't walk a symbolic link to a parent directory again */
+				if(entry->check_loop && walk_is_loop(dir, entry)) {
+					if(options->options & FIND_LOG_ERRORS) {
+						errno = ELOOP;
+						log_file_error(file.path);
 					}
+					rsh_file_cleanup(&file);
+					continue;
 				}
-			} else if (options->options & FIND_LOG_ERRORS) {
-				log_file_error(file.path);
+				subdir = walk_dir_new(dir, entry->name, entry->length);
+				subdir->dev = entry->dev;
+				subdir->ino = entry->ino;
+
+				/* add the directory to the walk, after the previously added ones */
+				rhash_mutex_lock(&walker.lock);
+				dir->refs++;
+				dir->dp_users++;
+				subdir->next = *insert_at;
+				*insert_at = subdir;
+				insert_at = &subdir->next;
+				rhash_cond_signal(&walker.has_work);
+				rhash_mutex_unlock(&walker.lock);
 			}
 			rsh_file_cleanup(&file);
-			free(file.path);
 		}
-		closedir(dp);
 
-		if(it[level].left > 0) level++;
+		/* the entries are not needed, the directory lives while its subdirectories */
+		arena_free(&dir->entries_arena);
+		dir->entries = NULL;
+		rhash_mutex_lock(&walker.lock);
+		walk_dir_release_dp(&walker, dir);
+		walk_dir_release(&walker, dir);
+		rhash_mutex_unlock(&walker.lock);
 	}
-	assert(dirs_stack == NULL);
 
-	free(it);
+	/* stop the threads and free the directories left by a canceled walk */
+	rhash_mutex_lock(&walker.lock);
+	walker.stop = 1;
+	rhash_cond_broadcast(&walker.has_work);
+	rhash_mutex_unlock(&walker.lock);
+	for(i = 0; i < walker.threads_count; i++) {
+		rhash_thread_join(&walker.threads[i]);
+	}
+	while(walker.stack) {
+		dir = walker.stack;
+		walker.stack = dir->next;
+		walk_dir_release(&walker, dir);
+	}
+	assert(walker.open_dirs == 0);
+	free(walker.threads);
+	free(path);
+	rhash_cond_destroy(&walker.has_result);
+	rhash_cond_destroy(&walker.has_work);
+	rhash_mutex_destroy(&walker.lock);
 	return 0;
 }
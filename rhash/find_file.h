@@ -27,6 +27,7 @@ typedef struct find_file_options {
 	int (*call_back)(file_t* file, void* data);
 	void* call_back_data;
 	int errors_count;
+	unsigned threads; /* the number of threads reading directories in advance */
 } find_file_options;
 
 void process_files(const char** paths, size_t count,
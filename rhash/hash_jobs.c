@@ -0,0 +1,305 @@
+/* hash_jobs.c - calculating hash sums of several files in parallel
+ *
+ * The files found by the directory walker are queued into a ring of job
+ * slots. Worker threads take the queued jobs and calculate their hash sums,
+ * each slot having its own rhash context. The main thread prints the results
+ * in the order the files were queued, so the output is the same as without
+ * threads. The ring size bounds the number of files waiting to be printed.
+ *
+ * The workers take the largest queued file first, so a huge file is not left
+ * to the end of the scan. A huge file taken, when other workers have nothing
+ * to do, is hashed by chunks by the threads of its context, standing in for
+ * the idle workers, if the chosen algorithms allow it.
+ */
+
+#include "common_func.h" /* should be included before the C library files */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "rhash.h"
+#include "../librhash/rhash_thread.h"
+#include "../librhash/util.h"
+#include "calc_sums.h"
+#include "output.h"
+#include "parse_cmdline.h"
+#include "rhash_main.h"
+#include "hash_jobs.h"
+
+/* the number of job slots per hashing thread */
+#define SLOTS_PER_THREAD 4
+
+/* the minimal size of a file to be hashed by several threads */
+#define SPLIT_MIN_SIZE (64 * 1024 * 1024)
+
+/* the algorithms, which librhash can calculate by chunks of a file in parallel */
+#define SPLIT_HASH_IDS (RHASH_CRC32 | RHASH_TTH | RHASH_ED2K | RHASH_AICH | RHASH_BTIH)
+
+/* a file to calculate hash sums for */
+typedef struct hash_job
+{
+	struct file_info info;
+	char* path;  /* the copy of the file path, info.print_path can point into */
+	struct rhash_context* rctx; /* the context owned by the slot */
+	int res;     /* the result of calculate_sums() */
+	int error;   /* errno on fail */
+	int started; /* non-zero when a worker has taken the job */
+	int done;    /* non-zero when the hash sums are calculated */
+	unsigned threads; /* the number of threads hashing the file */
+} hash_job;
+
+typedef struct hash_jobs_t
+{
+	hash_job* slots;
+	unsigned size;  /* the number of slots */
+	unsigned head;  /* the next job to print */
+	unsigned tail;  /* the next slot to fill */
+	unsigned queued; /* the number of jobs not taken by workers */
+	unsigned busy;  /* the number of threads hashing files */
+	int finishing;  /* non-zero if no more jobs will be added */
+	rhash_atomic_t canceled; /* set by the SIGINT handler */
+	rhash_mutex_t lock;
+	rhash_cond_t has_work;
+	rhash_cond_t has_result;
+	rhash_thread_t* threads;
+	unsigned threads_count;
+} hash_jobs_t;
+
+static hash_jobs_t jobs;
+/* the slots, which contexts can be canceled by the SIGINT handler */
+static hash_job* volatile cancel_slots;
+
+/**
+ * Take the largest of the queued jobs. The jobs lock must be held.
+ *
+ * @return the taken job
+ */
+static hash_job* take_largest_job(void)
+{
+	hash_job* job = NULL;
+	unsigned i;
+	for(i = jobs.head; i != jobs.tail; i++) {
+		hash_job* slot = &jobs.slots[i % jobs.size];
+		if(slot->started) continue;
+		if(!job || slot->info.size > job->info.size) job = slot;
+	}
+	job->started = 1;
+	jobs.queued--;
+	return job;
+}
+
+/**
+ * Calculate hash sums of the queued jobs, until all jobs are done.
+ *
+ * @param arg unused
+ */
+static void hash_jobs_worker(void* arg)
+{
+	(void)arg;
+	rhash_mutex_lock(&jobs.lock);
+	for(;;) {
+		hash_job* job;
+		/* wait for a job and for a thread not lent to a huge file */
+		while(!(jobs.queued > 0 && jobs.busy < jobs.threads_count) && !(jobs.finishing && jobs.queued == 0)) {
+			rhash_cond_wait(&jobs.has_work, &jobs.lock);
+		}
+		if(jobs.queued == 0) break;
+		job = take_largest_job();
+
+		/* hash a huge file by the idle threads too, if nothing else is queued */
+		job->threads = 1;
+		if(jobs.queued == 0 && job->info.size >= SPLIT_MIN_SIZE && (opt.sum_flags & SPLIT_HASH_IDS)) {
+			job->threads = jobs.threads_count - jobs.busy;
+		}
+		jobs.busy += job->threads;
+		rhash_mutex_unlock(&jobs.lock);
+
+		/* skip the queued files, if the program was interrupted */
+		if(!rhash_atomic_load(&jobs.canceled)) {
+			if(job->threads > 1) rhash_set_threads(job->rctx, job->threads);
+			job->res = calculate_sums(&job->info);
+			job->error = errno;
+			if(job->threads > 1) rhash_set_threads(job->rctx, 1);
+		}
+
+		rhash_mutex_lock(&jobs.lock);
+		jobs.busy -= job->threads;
+		job->done = 1;
+		rhash_cond_broadcast(&jobs.has_result);
+		if(job->threads > 1) rhash_cond_broadcast(&jobs.has_work);
+	}
+	rhash_mutex_unlock(&jobs.lock);
+}
+
+/**
+ * Print the hash sums of a finished job and free the job data.
+ *
+ * @param job the job to print
+ */
+static void print_job(hash_job* job)
+{
+	if(!rhash_data.interrupted) {
+		int res;
+		init_percents(&job->info);
+		errno = job->error;
+		res = print_sums(rhash_data.out, &job->info, job->res);
+		if(!rhash_data.interrupted) rhash_data.processed++;
+		if(res < 0) rhash_data.error_flag = 1;
+	}
+	free(job->info.full_path);
+	file_info_destroy(&job->info);
+	free(job->path);
+}
+
+/**
+ * Print the finished jobs in the queue order. The jobs lock must be held,
+ * it is released while printing.
+ *
+ * @return non-zero if at least one job was printed
+ */
+static int print_finished_jobs(void)
+{
+	int printed = 0;
+	while(jobs.head != jobs.tail && jobs.slots[jobs.head % jobs.size].done) {
+		hash_job* job = &jobs.slots[jobs.head % jobs.size];
+		rhash_mutex_unlock(&jobs.lock);
+		print_job(job);
+		rhash_mutex_lock(&jobs.lock);
+		jobs.head++;
+		printed = 1;
+	}
+	return printed;
+}
+
+/**
+ * Start the threads to calculate hash sums of files in parallel.
+ * On fail the files are processed by the calling thread.
+ *
+ * @param threads the number of threads to start
+ * @return non-zero if the threads have been started
+ */
+int hash_jobs_start(unsigned threads)
+{
+	unsigned i;
+	memset(&jobs, 0, sizeof(jobs));
+	jobs.size = threads * SLOTS_PER_THREAD;
+	jobs.slots = (hash_job*)rsh_calloc(jobs.size, sizeof(hash_job));
+	jobs.threads = (rhash_thread_t*)rsh_calloc(threads, sizeof(rhash_thread_t));
+	for(i = 0; i < jobs.size; i++) {
+		jobs.slots[i].rctx = rhash_init(opt.sum_flags);
+	}
+	rhash_mutex_init(&jobs.lock);
+	rhash_cond_init(&jobs.has_work);
+	rhash_cond_init(&jobs.has_result);
+
+	for(i = 0; i < threads; i++) {
+		if(rhash_thread_create(&jobs.threads[i], hash_jobs_worker, NULL) < 0) break;
+	}
+	rhash_mutex_lock(&jobs.lock);
+	jobs.threads_count = i;
+	rhash_mutex_unlock(&jobs.lock);
+	if(jobs.threads_count == 0) {
+		log_warning(_("can't start threads: %s\n"), strerror(errno));
+		hash_jobs_finish();
+		return 0;
+	}
+	cancel_slots = jobs.slots;
+	return 1;
+}
+
+/**
+ * Check if files are processed by the hashing threads.
+ *
+ * @return non-zero if hash_jobs_start() has started the threads
+ */
+int hash_jobs_active(void)
+{
+	return jobs.threads_count > 0;
+}
+
+/**
+ * Queue a file to calculate and print its hash sums. Prints the results
+ * of the finished jobs, and waits if the queue is full.
+ *
+ * @param file the file to calculate sums for
+ * @param print_path the path to print, pointing into file->path or a static string
+ */
+void hash_jobs_add(file_t* file, const char* print_path)
+{
+	hash_job* job;
+	file_t job_file = *file;
+	size_t path_len = strlen(file->path);
+
+	rhash_mutex_lock(&jobs.lock);
+	print_finished_jobs();
+	while(jobs.tail - jobs.head == jobs.size) {
+		rhash_cond_wait(&jobs.has_result, &jobs.lock);
+		print_finished_jobs();
+	}
+	rhash_mutex_unlock(&jobs.lock);
+
+	/* only the calling thread uses the free slots */
+	job = &jobs.slots[jobs.tail % jobs.size];
+	job->path = job_file.path = rsh_strdup(file->path);
+	if(print_path >= file->path && print_path <= file->path + path_len) {
+		print_path = job->path + (print_path - file->path);
+	}
+	file_info_init_sums(&job->info, &job_file, print_path);
+	job->info.rctx = job->rctx;
+	job->res = job->error = job->started = job->done = 0;
+
+	rhash_mutex_lock(&jobs.lock);
+	jobs.tail++;
+	jobs.queued++;
+	rhash_cond_signal(&jobs.has_work);
+	rhash_mutex_unlock(&jobs.lock);
+}
+
+/**
+ * Wait for the queued jobs, print their results and stop the threads.
+ */
+void hash_jobs_finish(void)
+{
+	unsigned i;
+	if(!jobs.slots) return;
+
+	rhash_mutex_lock(&jobs.lock);
+	jobs.finishing = 1;
+	rhash_cond_broadcast(&jobs.has_work);
+	while(jobs.threads_count > 0 && jobs.head != jobs.tail) {
+		if(!print_finished_jobs()) {
+			rhash_cond_wait(&jobs.has_result, &jobs.lock);
+		}
+	}
+	rhash_mutex_unlock(&jobs.lock);
+
+	for(i = 0; i < jobs.threads_count; i++) {
+		rhash_thread_join(&jobs.threads[i]);
+	}
+	cancel_slots = NULL;
+	for(i = 0; i < jobs.size; i++) {
+		if(jobs.slots[i].rctx) rhash_free(jobs.slots[i].rctx);
+	}
+	rhash_cond_destroy(&jobs.has_result);
+	rhash_cond_destroy(&jobs.has_work);
+	rhash_mutex_destroy(&jobs.lock);
+	free(jobs.threads);
+	free(jobs.slots);
+	memset(&jobs, 0, sizeof(jobs));
+}
+
+/**
+ * Cancel hashing of all files being processed.
+ * Called by the SIGINT handler.
+ */
+void hash_jobs_cancel(void)
+{
+	hash_job* slots = cancel_slots;
+	unsigned i;
+	if(!slots) return;
+	rhash_atomic_store(&jobs.canceled, 1);
+	for(i = 0; i < jobs.size; i++) {
+		if(slots[i].rctx) rhash_cancel(slots[i].rctx);
+	}
+}
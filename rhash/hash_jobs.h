@@ -0,0 +1,19 @@
+/* hash_jobs.h - calculating hash sums of several files in parallel */
+#ifndef HASH_JOBS_H
+#define HASH_JOBS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  hash_jobs_start(unsigned threads);
+int  hash_jobs_active(void);
+void hash_jobs_add(file_t* file, const char* print_path);
+void hash_jobs_finish(void);
+void hash_jobs_cancel(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* HASH_JOBS_H */
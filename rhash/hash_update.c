@@ -166,8 +166,9 @@ static int add_sums_to_file(const char* hash_file_path, char* dir_path, file_set
 		file_t file;
 		char *allocated = 0;
 		char *print_path = file_set_get(files_to_add, i)->filepath;
+		/* the file attributes are retrieved once the file is opened for hashing */
+		memset(&file, 0, sizeof(file));
 		file.path = print_path;
-		file.wpath = 0;
 
 		if(dir_path[0] != '.' || dir_path[1] != 0) {
 			/* prepend the file path by directory path */
@@ -179,12 +180,9 @@ static int add_sums_to_file(const char* hash_file_path, char* dir_path, file_set
 				print_banner = 0;
 			}
 		}
-		rsh_file_stat2(&file, 0);
 
 		/* print hash sums to the crc file */
 		calculate_and_print_sums(fd, &file, print_path);
-
-		rsh_file_cleanup(&file);
 		free(allocated);
 
 		if(rhash_data.interrupted) {
@@ -77,6 +77,8 @@ static void print_help(void)
 	print_help_line("  -k, --check-embedded  ", _("Verify files by crc32 sum embedded in their names.\n"));
 	print_help_line("      --list-hashes  ", _("List the names of supported hashes, one per line.\n"));
 	print_help_line("  -B, --benchmark  ", _("Benchmark selected algorithm.\n"));
+	print_help_line("      --autotune ", _("Select the fastest implementations of hash algorithms.\n"));
+	print_help_line("      --autotune-cache=<file> ", _("Cache the auto-tuning results in the <file>.\n"));
 	print_help_line("  -v, --verbose ", _("Be verbose.\n"));
 	print_help_line("  -r, --recursive  ", _("Process directories recursively.\n"));
 	print_help_line("      --skip-ok ", _("Don't print OK messages for successfully verified files.\n"));
@@ -84,6 +86,7 @@ static void print_help(void)
 	print_help_line("      --percents   ", _("Show percents, while calculating or checking hashes.\n"));
 	print_help_line("      --speed   ", _("Output per-file and total processing speed.\n"));
 	print_help_line("      --maxdepth=<n> ", _("Descend at most <n> levels of directories.\n"));
+	print_help_line("  -j, --threads=<n> ", _("Calculate hash sums of <n> files in parallel.\n"));
 	print_help_line("  -o, --output=<file> ", _("File to output calculation or checking results.\n"));
 	print_help_line("  -l, --log=<file>    ", _("File to log errors and verbose information.\n"));
 	print_help_line("      --sfv     ", _("Print hash sums, using SFV format (default).\n"));
@@ -208,6 +211,23 @@ static void set_max_depth(options_t *o, char* number, unsigned param)
 	o->find_max_depth = atoi(number);
 }
 
+/**
+ * Process the --threads option.
+ *
+ * @param o pointer to the processed option
+ * @param number the string containing the number of threads
+ * @param param unused parameter
+ */
+static void set_threads(options_t *o, char* number, unsigned param)
+{
+	(void)param;
+	if(!*number || strspn(number, "0123456789") < strlen(number) || atoi(number) <= 0) {
+		log_error(_("threads parameter is not a positive number: %s\n"), number);
+		rsh_exit(2);
+	}
+	o->threads = (unsigned)atoi(number);
+}
+
 /**
  * Set the length of a BitTorrent file piece.
  *
@@ -344,12 +364,15 @@ cmdline_opt_t cmdline_opt[] =
 	{ F_VFNC,   0,   0, "video",  accept_video, 0 },
 	{ F_VFNC,   0,   0, "nya",  nya, 0 },
 	{ F_PFNC,   0,   0, "maxdepth", set_max_depth, 0 },
+	{ F_PFNC, 'j',   0, "threads", set_threads, 0 },
 	{ F_UFLG,   0,   0, "bt-private", &opt.flags, OPT_BT_PRIVATE },
 	{ F_PFNC,   0,   0, "bt-piece-length", set_bt_piece_length, 0 },
 	{ F_CSTR,   0,   0, "bt-announce", &opt.bt_announce, 0 },
 	{ F_CSTR,   0,   0, "bt-batch", &opt.bt_batch_file, 0 },
 	{ F_UFLG,   0,   0, "benchmark-raw", &opt.flags, OPT_BENCH_RAW },
 	{ F_PFNC,   0,   0, "openssl", openssl_flags, 0 },
+	{ F_UFLG,   0,   0, "autotune", &opt.flags, OPT_AUTOTUNE },
+	{ F_CSTR,   0,   0, "autotune-cache", &opt.autotune_cache, 0 },
 
 #ifdef _WIN32 /* code pages (windows only) */
 	{ F_UENC,   0,   0, "utf8", &opt.flags, OPT_UTF8 },
@@ -805,6 +828,8 @@ static void apply_cmdline_options(struct parsed_cmd_line_t *cmd_line)
 	if(opt.find_max_depth < 0) opt.find_max_depth = conf_opt.find_max_depth;
 	if(opt.flags & OPT_EMBED_CRC) opt.sum_flags |= RHASH_CRC32;
 	if(opt.openssl_mask == 0) opt.openssl_mask = conf_opt.openssl_mask;
+	if(opt.autotune_cache == 0) opt.autotune_cache = conf_opt.autotune_cache;
+	if(opt.autotune_cache) opt.flags |= OPT_AUTOTUNE;
 
 	/* set defaults */
 	if(opt.embed_crc_delimiter == 0) opt.embed_crc_delimiter = " ";
@@ -38,6 +38,7 @@ enum {
 	OPT_LOWERCASE = 0x4000,
 	OPT_GOST_REVERSE = 0x8000,
 	OPT_BENCH_RAW = 0x10000,
+	OPT_AUTOTUNE  = 0x20000,
 
 #ifdef _WIN32
 	OPT_UTF8 = 0x10000000,
@@ -71,12 +72,14 @@ struct options_t {
 	char* embed_crc_delimiter;
 	char  path_separator;
 	int   find_max_depth;
+	unsigned threads;    /* the number of files to hash in parallel */
 	struct vector_t *files_accept; /* suffixes of files for which sums will be calculated */
 	struct vector_t *crc_accept;   /* suffixes of crc files to verify or update */
 	unsigned openssl_mask;  /* mask which openssl hashes to use */
 	size_t bt_piece_length; /* BitTorrent piece length */
 	char*  bt_announce;     /* BitTorrent announce url */
 	char*  bt_batch_file;   /* path to save batch torrent to */
+	char*  autotune_cache;  /* path of the file to cache auto-tuning results */
 
 	char** argv;
 	char** files; /* the files to process */
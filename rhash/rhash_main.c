@@ -21,6 +21,7 @@
 #include "find_file.h"
 #include "calc_sums.h"
 #include "hash_update.h"
+#include "hash_jobs.h"
 #include "file_mask.h"
 #include "hash_print.h"
 #include "parse_cmdline.h"
@@ -72,6 +73,11 @@ static int find_file_callback(file_t* file, void* data)
 			} else {
 				/* default mode: calculate hash */
 				if(filepath[0] == '.' && IS_PATH_SEPARATOR(filepath[1])) filepath += 2;
+				if(hash_jobs_active()) {
+					/* the results are printed by hash_jobs in the same order */
+					hash_jobs_add(file, filepath);
+					return 1;
+				}
 				res = calculate_and_print_sums(rhash_data.out, file, filepath);
 				if(rhash_data.interrupted) return 0;
 				rhash_data.processed++;
@@ -98,6 +104,7 @@ static void ctrl_c_handler(int signum)
 	if(rhash_data.rctx) {
 		rhash_cancel(rhash_data.rctx);
 	}
+	hash_jobs_cancel();
 }
 
 #define MAX_TEMPLATE_SIZE 65536
@@ -190,6 +197,12 @@ int main(int argc, char *argv[])
 	prev_sigint_handler = signal(SIGINT, ctrl_c_handler); /* install SIGINT handler */
 	rhash_library_init();
 
+	/* select the fastest implementations of the hash algorithms to compute */
+	if(opt.flags & OPT_AUTOTUNE) {
+		if(rhash_autotune((opt.sum_flags ? opt.sum_flags : RHASH_ALL_HASHES), opt.autotune_cache) < 0)
+			log_warning(_("can't write auto-tuning cache %s\n"), opt.autotune_cache);
+	}
+
 	/* in benchmark mode just run benchmark and exit */
 	if(opt.mode & MODE_BENCHMARK) {
 		unsigned flags = (opt.flags & OPT_BENCH_RAW ? RHASH_BENCHMARK_CPB | RHASH_BENCHMARK_RAW : RHASH_BENCHMARK_CPB);
@@ -236,6 +249,7 @@ int main(int argc, char *argv[])
 	search_opt.max_depth = (opt.flags & OPT_RECURSIVE ? opt.find_max_depth : 0);
 	search_opt.options = FIND_SKIP_DIRS;
 	search_opt.call_back = find_file_callback;
+	search_opt.threads = opt.threads;
 
 	if ( opt.flags & OPT_VERBOSE ) {// v0.1 added: print the banner if verbose mode too
 		print_sfv_banner_to_stdout();
@@ -251,10 +265,17 @@ int main(int argc, char *argv[])
 	rhash_timer_start(&timer);
 	rhash_data.processed = 0;
 
+	/* calculate hash sums of several files at once, printing them in order */
+	if(opt.threads > 1 && !(opt.mode & (MODE_CHECK | MODE_CHECK_EMBEDDED | MODE_UPDATE)) &&
+		!opt.bt_batch_file && !(opt.flags & OPT_PERCENTS)) {
+		hash_jobs_start(opt.threads);
+	}
+
 	/* process files */
 	search_opt.options |= FIND_LOG_ERRORS;
 	search_opt.call_back_data = (void*)0;
 	process_files((const char**)opt.files, opt.n_files, &search_opt);
+	hash_jobs_finish();
 
 	if((opt.mode & MODE_CHECK_EMBEDDED) && rhash_data.processed > 1) {
 		print_check_stats();